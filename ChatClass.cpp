@@ -20,11 +20,41 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
 #include <arpa/inet.h>
 #include <sys/stat.h>
+#include <sys/resource.h>
 #include <sys/socket.h> 
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <netinet/ip.h>
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+#include <linux/filter.h>
 #include <time.h>
+#include <chrono>
 #include "ChatClass.h"          // Our own class and defined constants
+#include "ClockClass.h"         // The cached clocks
+#include "MetricsClass.h"       // Counting frames and transfers
+#include "TraceClass.h"         // Tracing the stages of transfers
+
+// ----------------------------------------------------------------------
+// The sender hashes the digest leaves of each read-ahead buffer as it
+// goes, which only works if every buffer starts on a leaf boundary.
+//
+// ----------------------------------------------------------------------
+
+#if READ_AHEAD_BUFFER_SIZE % DIGEST_LEAF_SIZE
+#error "READ_AHEAD_BUFFER_SIZE must be a multiple of DIGEST_LEAF_SIZE"
+#endif
+
+#if DIGEST_LEAF_SIZE % MAX_OUT_DATA_SIZE
+#error "DIGEST_LEAF_SIZE must be a multiple of MAX_OUT_DATA_SIZE"
+#endif
+
+#if TRANSFER_WHEEL_SLOTS & ( TRANSFER_WHEEL_SLOTS - 1 )
+#error "TRANSFER_WHEEL_SLOTS must be a power of two"
+#endif
 
 // ----------------------------------------------------------------------
 // ChatClass Constructor
@@ -39,34 +69,178 @@
 // The transmit socket is set to allow broadcast. Some Linux 
 // implimentations require the socket option to be enabled, some do not.
 //
+// A second transmit socket carries file blocks. It is non-blocking and
+// is marked for throughput while the first is marked for low delay, so
+// that chat text and control frames get ahead of file data in Linux's
+// queues as well as in ours.
+//
 // ----------------------------------------------------------------------
 
 ChatClass::ChatClass( const int this_port_number ) : base_port_number( this_port_number ), 
-    send_socket( HANDLE_NOT_VALID ), receive_socket( HANDLE_NOT_VALID )
+    send_socket( HANDLE_NOT_VALID ), bulk_socket( HANDLE_NOT_VALID ), receive_socket( HANDLE_NOT_VALID ),
+    service_round( 0 )
 {
     const int running_count    = how_many_are_running( );
-    int       transmit_port    = 0;
-    int       receive_port     = 0;
-    const int enable_broadcast = 1;
-    const int enable_reuse     = 1;
-
-    // Initialize class's private data
-    (void)memset( (char *)&send_address,    ASCII_NULL_ZERO, sizeof( send_address ) );
-    (void)memset( (char *)&receive_address, ASCII_NULL_ZERO, sizeof( receive_address ) );
-    (void)memset( udp_inbound_buffer,       ASCII_NULL_ZERO, sizeof( udp_inbound_buffer ) );
 
     // Do we already have a copy of this program running besides us? 
     if ( running_count > 1 )
     {
-        transmit_port = this_port_number;
-        receive_port  = this_port_number + 1;
+        open_sockets( this_port_number, this_port_number + 1, ALL_IP_ADDRESSES_BROADCAST, false );
     }
     else
     {
-        transmit_port = this_port_number + 1;
-        receive_port  = this_port_number;
+        open_sockets( this_port_number + 1, this_port_number, ALL_IP_ADDRESSES_BROADCAST, false );
+    }
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Constructor
+//
+// The transmit and receive port numbers and the address frames are
+// sent to are given rather than worked out, for programs such as the
+// benchmarks which run many copies of the class on one machine, and
+// which may send to the loopback broadcast address 127.255.255.255. If
+// the receive port is shared, every copy bound to it gets every frame
+// broadcasted to it.
+//
+// ----------------------------------------------------------------------
+
+ChatClass::ChatClass( const int transmit_port, const int receive_port, const uint32_t destination_address,
+    const bool share_receive_port ) : base_port_number( transmit_port ), 
+    send_socket( HANDLE_NOT_VALID ), bulk_socket( HANDLE_NOT_VALID ), receive_socket( HANDLE_NOT_VALID ),
+    service_round( 0 )
+{
+    open_sockets( transmit_port, receive_port, destination_address, share_receive_port );
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Constructor
+//
+// A receive shard: a copy of the class which keeps the files being
+// received from the devices of one shard. It takes frames in on the
+// receive socket passed by argument, which it closes when it is done,
+// and sends repair requests through a socket of its own addressed as
+// its owner's transmit socket is. It never sends files itself.
+//
+// ----------------------------------------------------------------------
+
+ChatClass::ChatClass( ChatClass & owner_class, const int shard_socket ) :
+    base_port_number( owner_class.base_port_number ), send_socket( HANDLE_NOT_VALID ),
+    bulk_socket( HANDLE_NOT_VALID ), receive_socket( shard_socket ), service_round( 0 )
+{
+    clear_state( );
+
+    send_address = owner_class.send_address;
+
+    // The shard's transfers time out as its owner's do, and are counted
+    // against its owner's limits
+    (void)memcpy( transfer_timeout_ms, owner_class.transfer_timeout_ms, sizeof( transfer_timeout_ms ) );
+
+    admission_p = owner_class.admission_p;
+
+    if ( owner_class.send_socket != HANDLE_NOT_VALID )
+    {
+        send_socket = dup( owner_class.send_socket );
+    }
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Clear State
+//
+// Initialize class's private data. Transfer IDs start somewhere that
+// a copy of the program which ran before us is unlikely to have used.
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::clear_state( void )
+{
+    int this_shard = 0;
+    int this_slot  = 0;
+
+    next_transfer_id = (uint32_t)time( NULL ) ^ ( (uint32_t)getpid( ) << 16 );
+    first_transfer_id = next_transfer_id;
+    receive_time_ns         = 0;
+    socket_drops_seen       = 0;
+    receive_buffer_bytes    = 0;
+    bulk_buffer_bytes       = 0;
+    receive_buffer_grown_ns = 0;
+    bulk_buffer_grown_ns    = 0;
+    outbound_active         = 0;
+
+    // The pipeline threads are not started until we are asked to
+    pipeline_running    = false;
+    stop_pipeline       = false;
+    pipeline_event      = HANDLE_NOT_VALID;
+    receive_queue_p     = (SpscQueueClass<pooled_frame *, RECEIVE_QUEUE_SLOTS> *)NULL;
+    disk_queue_p        = (SpscQueueClass<disk_write, DISK_QUEUE_SLOTS> *)NULL;
+    transmit_queue_p    = (SpscQueueClass<outbound_transfer, TRANSMIT_QUEUE_SLOTS> *)NULL;
+    sent_file_queue_p   = (SpscQueueClass<sent_file_record, SENT_FILE_QUEUE_SLOTS> *)NULL;
+    disk_writes_queued  = 0;
+    disk_writes_done    = 0;
+    disk_writer_waiting = false;
+    transmit_waiting    = false;
+
+    // The verifier thread is started when a file is first checked
+    stop_verifier = false;
+
+    // Nor are there any receive shards
+    shard_count     = 1;
+    next_shard_read = 0;
+
+    for ( this_shard = 0; this_shard < MAX_RECEIVE_SHARDS; this_shard++ )
+    {
+        shard_table_p[ this_shard ] = (ChatClass *)NULL;
+        shard_queue_p[ this_shard ] = (SpscQueueClass<pooled_frame *, SHARD_QUEUE_SLOTS> *)NULL;
+    }
+
+    // No transfer timers are running
+    for ( this_slot = 0; this_slot < TRANSFER_WHEEL_SLOTS; this_slot++ )
+    {
+        timer_wheel[ this_slot ] = TIMER_NOT_LINKED;
     }
 
+    timer_wheel_tick = wheel_tick_now( );
+
+    transfer_timeout_ms[ transfer_class_data ]   = TRANSFER_TIMEOUT_DATA_MS;
+    transfer_timeout_ms[ transfer_class_repair ] = TRANSFER_TIMEOUT_REPAIR_MS;
+
+    // Nothing has been taken in yet
+    admission_p = &admission;
+
+    admission.transfers      = 0;
+    admission.reserved_bytes = 0;
+    admission.open_files     = 0;
+
+    set_admission_limits( ADMIT_MAX_TRANSFERS, ADMIT_MAX_RESERVED_BYTES, ADMIT_MAX_OPEN_FILES );
+
+    // Nor any frame buffers; receive shards borrow their owner's
+    frame_pool_p = (FramePoolClass *)NULL;
+    held_frame_p = (pooled_frame *)NULL;
+
+    (void)memset( (char *)&send_address,    ASCII_NULL_ZERO, sizeof( send_address ) );
+    (void)memset( (char *)&receive_address, ASCII_NULL_ZERO, sizeof( receive_address ) );
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Open Sockets
+//
+// The work of the constructors: the sockets are created and bound to
+// the port numbers passed by argument.
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::open_sockets( const int transmit_port, const int receive_port, const uint32_t destination_address,
+    const bool share_receive_port )
+{
+    const int enable_broadcast = 1;
+    const int enable_reuse     = 1;
+    const int low_delay_tos    = IPTOS_LOWDELAY;
+    const int throughput_tos   = IPTOS_THROUGHPUT;
+    const int interactive_prio = TRANSMIT_PRIORITY_INTERACTIVE;
+    const int bulk_prio        = TRANSMIT_PRIORITY_BULK;
+
+    clear_state( );
+
     // Acquire a send socket
     if ( ( send_socket = socket( AF_INET, SOCK_DGRAM, 0 ) ) < 0 )
     {
@@ -77,13 +251,40 @@ ChatClass::ChatClass( const int this_port_number ) : base_port_number( this_port
 
     // Address the outbound frames as broadcasted to the selected UDP port number
     send_address.sin_family      = AF_INET;
-    send_address.sin_addr.s_addr = htonl( ALL_IP_ADDRESSES_BROADCAST );
+    send_address.sin_addr.s_addr = htonl( destination_address );
     send_address.sin_port        = htons( transmit_port );
 
     // Since all transmitted frames are broadcasted, enable that
     (void)setsockopt( send_socket, SOL_SOCKET, SO_BROADCAST, 
         &enable_broadcast, sizeof( enable_broadcast ) );
 
+    // Acquire a send socket for file data
+    if ( ( bulk_socket = socket( AF_INET, SOCK_DGRAM, 0 ) ) < 0 )
+    {
+        (void)printf("I was unable to acquire a socket\n");
+
+        exit( ERRORLEVEL_NO_SOCKET );
+    }
+
+    (void)setsockopt( bulk_socket, SOL_SOCKET, SO_BROADCAST, 
+        &enable_broadcast, sizeof( enable_broadcast ) );
+
+    // Mark the two transmit sockets. The type of service sets a priority
+    // of its own so the priority is set after it.
+    (void)setsockopt( send_socket, IPPROTO_IP, IP_TOS, &low_delay_tos, sizeof( low_delay_tos ) );
+    (void)setsockopt( send_socket, SOL_SOCKET, SO_PRIORITY, &interactive_prio, sizeof( interactive_prio ) );
+    (void)setsockopt( bulk_socket, IPPROTO_IP, IP_TOS, &throughput_tos, sizeof( throughput_tos ) );
+    (void)setsockopt( bulk_socket, SOL_SOCKET, SO_PRIORITY, &bulk_prio, sizeof( bulk_prio ) );
+
+    // File data is never waited on, a full socket waits until the next
+    // time around the main loop
+    (void)set_non_blocking( bulk_socket );
+
+    // Give the transmit sockets buffers which hold a burst
+    (void)size_socket_buffer( send_socket, false, SOCKET_SEND_BUFFER_START );
+
+    bulk_buffer_bytes = size_socket_buffer( bulk_socket, false, SOCKET_BULK_BUFFER_START );
+
     // Acquire an isolated receive socket
     if ( ( receive_socket = socket( AF_INET, SOCK_DGRAM, 0 ) ) < 0 )
     {
@@ -96,6 +297,12 @@ ChatClass::ChatClass( const int this_port_number ) : base_port_number( this_port
     (void)setsockopt( send_socket, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, 
         &enable_reuse, sizeof( enable_reuse ) );
 
+    // Copies of the class which share the receive port must all say so
+    if ( true == share_receive_port )
+    {
+        (void)setsockopt( receive_socket, SOL_SOCKET, SO_REUSEADDR, &enable_reuse, sizeof( enable_reuse ) );
+    }
+
     receive_address.sin_family      = AF_INET;
     receive_address.sin_port        = htons( receive_port );
     receive_address.sin_addr.s_addr = htonl( INADDR_ANY );
@@ -108,8 +315,45 @@ ChatClass::ChatClass( const int this_port_number ) : base_port_number( this_port
         exit( ERRORLEVEL_NO_BIND );
     }
 
+    // Give the receive socket a buffer which holds a burst of file
+    // blocks while the main loop is busy elsewhere
+    receive_buffer_bytes = size_socket_buffer( receive_socket, true, SOCKET_RECEIVE_BUFFER_START );
+
+    mark_receive_socket( receive_socket );
+
+    // Frames are received in to these a frame at a time until the
+    // pipeline is started
+    size_frame_pool( FRAME_POOL_IDLE_FRAMES );
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Mark Receive Socket
+//
+// Asks Linux to tell us, with every frame received on the socket passed
+// by argument, how many frames it has dropped so far because the socket
+// was full, and when it took each frame in. If either can not be had
+// the frames simply arrive without it and nothing is counted. The
+// socket is made non-blocking.
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::mark_receive_socket( const int this_socket )
+{
+    const int enable_overflow  = 1;
+    const int stamp_flags      = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+
+    if ( setsockopt( this_socket, SOL_SOCKET, SO_RXQ_OVFL, &enable_overflow, sizeof( enable_overflow ) ) < 0 )
+    {
+        (void)printf("I was unable to count receive socket drops: %s\n", strerror( errno ) );
+    }
+
+    if ( setsockopt( this_socket, SOL_SOCKET, SO_TIMESTAMPING, &stamp_flags, sizeof( stamp_flags ) ) < 0 )
+    {
+        (void)printf("I was unable to time stamp received frames: %s\n", strerror( errno ) );
+    }
+
     // Make the receive socket non-blocking
-    (void)set_non_blocking( receive_socket );
+    (void)set_non_blocking( this_socket );
 }
 
 // ----------------------------------------------------------------------
@@ -122,8 +366,13 @@ ChatClass::ChatClass( const int this_port_number ) : base_port_number( this_port
 
 ChatClass::~ChatClass( void )
 {
-    int  this_index     = 0;
-    bool restart_search = true;
+    int this_index = 0;
+
+    // The pipeline threads use the sockets so they are stopped first
+    pipeline_stop( );
+
+    // Let go of the frame buffers; receive shards have none of their own
+    size_frame_pool( 0 );
 
     // Make sure that the send socket is closed
     if ( send_socket != HANDLE_NOT_VALID )
@@ -134,6 +383,15 @@ ChatClass::~ChatClass( void )
         send_socket = HANDLE_NOT_VALID;
     }
 
+    // Make sure that the file data socket is closed
+    if ( bulk_socket != HANDLE_NOT_VALID )
+    {
+        (void)close( bulk_socket );
+
+        // Flag the socket as closed
+        bulk_socket = HANDLE_NOT_VALID;
+    }
+
     // Make sure that the receive socket is closed
     if ( receive_socket != HANDLE_NOT_VALID )
     {
@@ -143,31 +401,43 @@ ChatClass::~ChatClass( void )
         receive_socket = HANDLE_NOT_VALID;
     }
 
-    // Go through any existing file transfer control blocks. If we
-    // remove an entry from the vector, search from the beginning again.
-    while ( true == restart_search )
+    // Go through any existing file transfer control blocks and close
+    // the files of any that we some how ended up with open
+    for ( this_index = 0; this_index < send_control.size( ); this_index++ )
     {
-        restart_search = false;
-
-        for (this_index = 0; this_index < send_control.size(); this_index++ )
+        if ( (FILE *)NULL != send_control[ this_index ].out_file_p )
         {
-            // Did we some how end up with a file transfer file open?
-            if ( (FILE *)NULL != send_control[ this_index ].out_file_p )
-            {
-                (void)fclose( send_control[ this_index ].out_file_p );
+            close_inbound_file( send_control[ this_index ] );
+        }
 
-                // Flag the fact that the file is closed
-                send_control[ this_index ].out_file_p = (FILE *)NULL;
+        release_transfer( send_control[ this_index ].file_size, false );
+    }
 
-                // Remove this entry from the vector array
-                send_control.erase( send_control.begin() + this_index );
+    send_control.clear( );
+    send_control_index.clear( );
 
-                // Start searching for an entry from the beginning
-                restart_search = true;
-                break;
-            }
+    // Every file being checked was closed above, so the verifier has
+    // nothing left to do
+    if ( true == verifier.joinable( ) )
+    {
+        {
+            std::lock_guard<std::mutex> verify_guard( verify_lock );
+
+            stop_verifier = true;
         }
+
+        verify_wake.notify_one( );
+
+        verifier.join( );
+    }
+
+    // Stop reading any files that were still being sent
+    for ( this_index = 0; this_index < send_tasks.size( ); this_index++ )
+    {
+        delete send_tasks[ this_index ].in_file_p;
     }
+
+    send_tasks.clear( );
 }
 
 // ----------------------------------------------------------------------
@@ -214,19 +484,33 @@ void ChatClass::send_data( const void * this_data_p, int this_size )
     // and that there is data to send
     if ( send_socket != HANDLE_NOT_VALID && this_size > 0 )
     {
-        int    bytes_sent  = 0;
-        char * the_bytes_p = (char *)this_data_p;
+        int                bytes_sent  = 0;
+        char *             the_bytes_p = (char *)this_data_p;
+        uint64_t           send_start  = 0;
+        uint64_t           send_end    = 0;
+        const metric_frame this_type   = frame_type( this_data_p, this_size );
 
         // while there are bytes still left to transmit
         while( this_size > 0 )
         {
             // Attempt to send all of the data that is left to send
-            if ( ( bytes_sent = sendto( send_socket, the_bytes_p, this_size, 0, 
-                (struct sockaddr *)&send_address, sizeof( send_address ) ) ) < 0) 
+            send_start = ClockClass::clock_precise_ns( );
+
+            bytes_sent = sendto( send_socket, the_bytes_p, this_size, 0, 
+                (struct sockaddr *)&send_address, sizeof( send_address ) );
+
+            send_end = ClockClass::clock_precise_ns( );
+
+            MetricsClass::metrics_record( metric_send_ns, send_end - send_start );
+            TraceClass::trace_span( trace_send, send_start, send_end, this_size );
+
+            if ( bytes_sent < 0 ) 
             {
                 // There was a fatal error with sending the data
                 (void)printf("I was unable to send data\n");
 
+                MetricsClass::metrics_count( metric_send_errors );
+
                 // There can be no more bytes transmitted due to an error
                 this_size = 0;
             }
@@ -240,10 +524,14 @@ void ChatClass::send_data( const void * this_data_p, int this_size )
                 the_bytes_p += bytes_sent;
                 this_size   -= bytes_sent;
 
+                MetricsClass::metrics_frame_out( this_type, bytes_sent );
+
                 // Are there more bytes to send?
                 if ( this_size > 0 )
                 {
                     // Yes, so sleep some milliseconds to allow the data to flow
+                    MetricsClass::metrics_count( metric_send_retries );
+
                     usleep( INTER_WRITE_HOLDOFF_DELAY );
                 }
             }
@@ -251,6 +539,63 @@ void ChatClass::send_data( const void * this_data_p, int this_size )
     }
 }
 
+// ----------------------------------------------------------------------
+// ChatClass Send Bulk Data
+//
+// A frame of file data is sent out the file data socket. The socket is
+// non-blocking so if Linux has no room for the frame we do not wait
+// for it; the caller keeps the frame and tries again later.
+//
+// Returns: true if the frame was sent, or could never be sent, false
+// if the socket was full
+//
+// ----------------------------------------------------------------------
+
+bool ChatClass::send_bulk_data( const void * this_data_p, int this_size )
+{
+    uint64_t send_start = 0;
+    uint64_t send_end   = 0;
+    int      bytes_sent = 0;
+
+    if ( bulk_socket == HANDLE_NOT_VALID )
+    {
+        return true;
+    }
+
+    send_start = ClockClass::clock_precise_ns( );
+
+    bytes_sent = sendto( bulk_socket, this_data_p, this_size, 0,
+        (struct sockaddr *)&send_address, sizeof( send_address ) );
+
+    send_end = ClockClass::clock_precise_ns( );
+
+    MetricsClass::metrics_record( metric_send_ns, send_end - send_start );
+    TraceClass::trace_span( trace_bulk_send, send_start, send_end, this_size );
+
+    if ( bytes_sent < 0 )
+    {
+        if ( EAGAIN == errno || EWOULDBLOCK == errno || ENOBUFS == errno )
+        {
+            MetricsClass::metrics_count( metric_send_retries );
+
+            grow_socket_buffer( bulk_socket, false, SOCKET_BULK_BUFFER_MAX, bulk_buffer_bytes, bulk_buffer_grown_ns );
+
+            return false;
+        }
+
+        // There was a fatal error with sending the data
+        (void)printf("I was unable to send data\n");
+
+        MetricsClass::metrics_count( metric_send_errors );
+
+        return true;
+    }
+
+    MetricsClass::metrics_frame_out( frame_type( this_data_p, this_size ), bytes_sent );
+
+    return true;
+}
+
 // ----------------------------------------------------------------------
 // ChatClass Read Data
 //
@@ -272,52 +617,64 @@ void ChatClass::send_data( const void * this_data_p, int this_size )
 
 int ChatClass::read_data( void )
 {
-    int  struct_length                = sizeof( receive_address );
-    int  read_count                   = 0;
-    char from_ip[ SENT_CTRL_IP_SIZE ] = { 0 };
+    int           read_count                   = 0;
+    struct iovec  frame_vector;
+    struct msghdr this_message;
+    uint64_t      control_space[ SOCKET_CONTROL_SIZE / sizeof( uint64_t ) ];
 
-    // Make sure that the receive socket is open
-    if ( receive_socket != HANDLE_NOT_VALID )
+    // The caller is done with the frame it was given last time
+    frame_pool_p->frame_release( held_frame_p );
+
+    held_frame_p = (pooled_frame *)NULL;
+
+    // Once the pipeline is running the receive thread has taken the
+    // frames in already
+    if ( true == pipeline_running )
     {
-        // Get a frame up to the size of the receive buffer less 1 byte.
-        read_count = recvfrom( receive_socket, 
-            &udp_inbound_buffer, sizeof(udp_inbound_buffer), 0, 
-	        (struct sockaddr *)&receive_address, (socklen_t *)&struct_length );
+        read_count = take_received_frame( );
     }
-
-    // Did we receive an inbound frame?
-    if ( read_count > 0 )
+    else if ( receive_socket != HANDLE_NOT_VALID &&
+        (pooled_frame *)NULL != ( held_frame_p = frame_pool_p->frame_acquire( ) ) )
     {
-        const char *ip_address_p = inet_ntoa(receive_address.sin_addr);
+        // Get a frame up to the size of the frame buffer, leaving room
+        // for the caller to end text with a NULL, along with what Linux
+        // has to tell us about it
+        frame_vector.iov_base = held_frame_p->frame_data_p;
+        frame_vector.iov_len  = frame_pool_p->frame_data_size( ) - 1;
 
-        // We receive a frame, is it a file transfer start command?
-        if ( 0 == strncmp(udp_inbound_buffer, ":xfer:", 6 ) )
-        {
-            // Receive the first block of the inbound file and
-            // mark the fact that we are receiving in to a file
-            file_transfer( udp_inbound_buffer, read_count, ip_address_p );
+        (void)memset( &this_message, ASCII_NULL_ZERO, sizeof( this_message ) );
+
+        this_message.msg_name       = &held_frame_p->from_address;
+        this_message.msg_namelen    = sizeof( held_frame_p->from_address );
+        this_message.msg_iov        = &frame_vector;
+        this_message.msg_iovlen     = 1;
+        this_message.msg_control    = control_space;
+        this_message.msg_controllen = sizeof( control_space );
 
-            // The data was processed so report no more data
-            read_count = 0;
-        } 
-        else 
+        read_count = recvmsg( receive_socket, &this_message, 0 );
+
+        if ( read_count > 0 )
         {
-            // See if we are receiving in to a file from that device.
-            // If we are, store the data in to the growing receive file
-            // and if that was the last block of data, flag the
-            // fact that we are no longer receiving in to a file            
+            // Remember when it arrived so that the time until it is
+            // shown may be measured
+            held_frame_p->frame_size = read_count;
+            held_frame_p->receive_ns = ClockClass::clock_precise_ns( );
 
-            if ( true == receive_file_block( udp_inbound_buffer, read_count, ip_address_p ) )
-            {
-                // The data was processed so report no more data
-                read_count = 0;
-            }
+            take_socket_control( this_message );
         }
+    }
+
+    // Did we receive an inbound frame?
+    if ( read_count > 0 )
+    {
+        read_count = process_frame( held_frame_p->frame_data_p, read_count, held_frame_p->from_address,
+            held_frame_p->receive_ns );
+    }
+    else if ( (pooled_frame *)NULL != held_frame_p )
+    {
+        frame_pool_p->frame_release( held_frame_p );
 
-        // Store the IP address of the last-heard sender of the data
-        // (Currently the IP address is not used.)
-        (void)inet_ntop( AF_INET, &receive_address.sin_addr, 
-            from_ip, sizeof( from_ip ) );
+        held_frame_p = (pooled_frame *)NULL;
     }
 
     // Return the number of bytes read and not used, if any 
@@ -325,730 +682,3986 @@ int ChatClass::read_data( void )
 }
 
 // ----------------------------------------------------------------------
-// ChatClass Set Non Blocking
+// ChatClass Received Text
 //
-// The socket passed to the method by argument is set to non-blocking
+// Returns: The text read_data() last returned, which the caller may end
+// with a NULL at the byte count it was given, else NULL if read_data()
+// has returned none since it was last called
 //
 // ----------------------------------------------------------------------
 
-int ChatClass::set_non_blocking( const int this_socket )
+char * ChatClass::received_text( void )
 {
-    // Make sure that the handle is valid
-    if ( this_socket == HANDLE_NOT_VALID )
+    if ( (pooled_frame *)NULL == held_frame_p )
     {
-        return false;
+        return (char *)NULL;
     }
 
-    // Get the current settings, mask out blocking
-    int flags = fcntl( this_socket, F_GETFL, 0 );
-
-    flags |= O_NONBLOCK;
-
-    // Set the new values and return the status
-    return( fcntl( this_socket, F_SETFL, flags ) == 0 ) ? true : false;
+    return held_frame_p->frame_data_p;
 }
 
 // ----------------------------------------------------------------------
-// ChatClass Set Blocking
+// ChatClass Process Frame
 //
-// The socket passed to the method by argument is set to blocking
+// A frame which was received from the address passed by argument, at
+// the monotonic time passed by argument, is counted and handed to
+// receive_frame(). Receive shards call this from their own threads so
+// the sender's address is put in to a buffer of our own rather than
+// the one inet_ntoa() shares with every thread.
+//
+// Returns: The number of bytes of text in the frame, else 0 if the frame
+// was handled here
 //
 // ----------------------------------------------------------------------
 
-int ChatClass::set_blocking( const int this_socket )
+int ChatClass::process_frame( char * this_data_p, int this_byte_size, const struct sockaddr_in & from_address,
+    const uint64_t receive_ns )
 {
-    // Make sure that the handle is valid
-    if ( this_socket == HANDLE_NOT_VALID )
-    {
-        return false;
-    }
+    char               from_ip[ SENT_CTRL_IP_SIZE ] = { 0 };
+    const metric_frame this_type                    = frame_type( this_data_p, this_byte_size );
+    int                text_size                    = 0;
 
-    // Get the current settings, or in the blocking
-    int flags = fcntl( this_socket, F_GETFL, 0 );
+    receive_address = from_address;
+    receive_time_ns = receive_ns;
 
-    flags &= ~O_NONBLOCK;
+    (void)inet_ntop( AF_INET, &from_address.sin_addr, from_ip, sizeof( from_ip ) );
 
-    // Set the new values and return the status
-    return( fcntl( this_socket, F_SETFL, flags ) == 0 ) ? true : false;
+    MetricsClass::metrics_frame_in( this_type, this_byte_size );
+
+    // File transfer frames are handled here, text is left for the caller
+    text_size = receive_frame( this_data_p, this_byte_size, from_ip );
+
+    // Frames which were handled here are timed until they were
+    // handled; text is timed by the caller once it is shown
+    if ( 0 == text_size )
+    {
+        const uint64_t handled_time = ClockClass::clock_precise_ns( );
+
+        MetricsClass::metrics_record( metric_frame_ns, handled_time - receive_ns );
+        TraceClass::trace_span( trace_frame, receive_ns, handled_time, this_byte_size );
+    }
+
+    return text_size;
 }
 
 // ----------------------------------------------------------------------
-// ChatClass How Many Are Running
-//
-// A ps command gets shelled out which is piped to grep to extract a
-// list of all processes which contain the word "chat" after which the
-// result is examined line by line to count how many instances it 
-// appears that the chat program is running.
-//
-// The function assumes that the name of the executable remains "chat"
-// however argv[0] could conceivably be used to make the function more
-// useful for any executable file name passed to it.
+// ChatClass Take Socket Control
 //
-// Return: The number of instances of chat running on this system
+// Looks through what Linux handed us along with a received frame. The
+// count of frames it dropped because the receive socket was full only
+// ever grows, so whatever it grew by since the last frame is counted.
+// The software time stamp is the time of day at which Linux took the
+// frame in, so the time from there until now is how long the frame
+// waited for us, in the socket and in the main loop.
 //
 // ----------------------------------------------------------------------
 
-int ChatClass::how_many_are_running( void )
+void ChatClass::take_socket_control( struct msghdr & this_message )
 {
-    FILE * popen_handle                          = popen("ps x | grep chat", "r");
-    char   in_record[ MAX_POPEN_RECORD_IN_SIZE ] = { 0 };
-    int    entry_count                           = 0;
+    struct cmsghdr * this_control_p;
 
-    // Perform the ps command and pass the result to grep, opening
-    // the result text file
-    if ( (FILE *)NULL != popen_handle )
+    for ( this_control_p = CMSG_FIRSTHDR( &this_message );
+          this_control_p != (struct cmsghdr *)NULL;
+          this_control_p = CMSG_NXTHDR( &this_message, this_control_p ) )
     {
-        // While there are entries in the text file
-        while(! feof( popen_handle ))
+        if ( SOL_SOCKET != this_control_p->cmsg_level )
         {
-            // Read a line from the result file
-            (void)fgets(in_record, sizeof( in_record ) - 1, popen_handle );
+            continue;
+        }
 
-            // Was that read the end of file?
-            if (! feof( popen_handle ))
+        if ( SO_RXQ_OVFL == this_control_p->cmsg_type )
+        {
+            uint32_t socket_drops;
+
+            (void)memcpy( &socket_drops, CMSG_DATA( this_control_p ), sizeof( socket_drops ) );
+
+            if ( socket_drops != socket_drops_seen )
             {
-                // Is it our grep command in the task list?
-                if ( (char *)NULL == strstr( in_record, "grep" ) )
-                {
-                    // No so it's a copy of our program that is running so count it
-                    entry_count++;
-                }
+                MetricsClass::metrics_count( metric_socket_drops, socket_drops - socket_drops_seen );
+
+                socket_drops_seen = socket_drops;
+
+                grow_socket_buffer( receive_socket, true, SOCKET_RECEIVE_BUFFER_MAX,
+                    receive_buffer_bytes, receive_buffer_grown_ns );
             }
         }
+        else if ( SCM_TIMESTAMPING == this_control_p->cmsg_type )
+        {
+            struct scm_timestamping this_stamp;
+            uint64_t                stamp_ns;
+            uint64_t                now_ns;
 
-        // Finished with the result file
-        (void)pclose( popen_handle );
-    }
+            (void)memcpy( &this_stamp, CMSG_DATA( this_control_p ), sizeof( this_stamp ) );
 
-    // The number of chat instances gets returned
-    return entry_count;
-}
+            stamp_ns = (uint64_t)this_stamp.ts[ 0 ].tv_sec * 1000000000ULL + (uint64_t)this_stamp.ts[ 0 ].tv_nsec;
+            now_ns   = ClockClass::clock_precise_wall_ns( );
 
-// ----------------------------------------------------------------------
-// ChatClass Send File
+            // The time of day may be stepped; a stamp from the future
+            // is no measure of anything
+            if ( 0 != stamp_ns && now_ns >= stamp_ns )
+            {
+                MetricsClass::metrics_record( metric_kernel_to_user_ns, now_ns - stamp_ns );
+            }
+        }
+    }
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Size Socket Buffer
+//
+// Asks Linux for a receive or send buffer of the size passed by
+// argument for the socket passed by argument. The forcing option is
+// tried first since it goes past the limits Linux places on everyone
+// else; if we may not use it we take what the ordinary option gives.
+//
+// Returns: The size Linux granted, in the same terms as we asked for
+// it, else 0 if the socket is not open.
+//
+// ----------------------------------------------------------------------
+
+int ChatClass::size_socket_buffer( const int this_socket, const bool receive_side, const int wanted_bytes )
+{
+    const int force_option  = ( true == receive_side ? SO_RCVBUFFORCE : SO_SNDBUFFORCE );
+    const int normal_option = ( true == receive_side ? SO_RCVBUF : SO_SNDBUF );
+    int       granted_bytes = 0;
+    socklen_t option_length = sizeof( granted_bytes );
+
+    if ( this_socket == HANDLE_NOT_VALID )
+    {
+        return 0;
+    }
+
+    if ( setsockopt( this_socket, SOL_SOCKET, force_option, &wanted_bytes, sizeof( wanted_bytes ) ) < 0 )
+    {
+        (void)setsockopt( this_socket, SOL_SOCKET, normal_option, &wanted_bytes, sizeof( wanted_bytes ) );
+    }
+
+    // Linux reports twice the size it granted
+    if ( getsockopt( this_socket, SOL_SOCKET, normal_option, &granted_bytes, &option_length ) < 0 )
+    {
+        return 0;
+    }
+
+    return granted_bytes / 2;
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Grow Socket Buffer
+//
+// Doubles the buffer of the socket passed by argument, which was found
+// to be too small, unless it was grown within the last interval or has
+// reached the largest size. If Linux will not give us any more it is
+// left alone from then on.
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::grow_socket_buffer( const int this_socket, const bool receive_side, const int largest_bytes,
+    int & buffer_bytes, uint64_t & grown_ns )
+{
+    const uint64_t now_ns        = ClockClass::clock_monotonic_ns( );
+    int            wanted_bytes  = 0;
+    int            granted_bytes = 0;
+
+    if ( buffer_bytes >= largest_bytes ||
+         now_ns - grown_ns < (uint64_t)SOCKET_BUFFER_GROW_INTERVAL_MS * 1000000ULL )
+    {
+        return;
+    }
+
+    grown_ns     = now_ns;
+    wanted_bytes = ( buffer_bytes > largest_bytes / 2 ? largest_bytes : buffer_bytes * 2 );
+
+    granted_bytes = size_socket_buffer( this_socket, receive_side, wanted_bytes );
+
+    if ( granted_bytes <= buffer_bytes )
+    {
+        (void)printf("Linux will not let the %s socket buffer grow past %d KB\n",
+            receive_side ? "receive" : "bulk send", buffer_bytes / 1024 );
+
+        buffer_bytes = largest_bytes;
+
+        return;
+    }
+
+    (void)printf("The %s socket buffer was grown to %d KB\n",
+        receive_side ? "receive" : "bulk send", granted_bytes / 1024 );
+
+    buffer_bytes = granted_bytes;
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Socket Buffer Sizes
+//
+// Returns: The sizes of the receive, transmit and bulk send socket
+// buffers as Linux has them now, in the same terms as we ask for them.
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::socket_buffer_sizes( int & receive_bytes, int & send_bytes, int & bulk_bytes )
+{
+    int       this_size     = 0;
+    socklen_t option_length = sizeof( this_size );
+
+    receive_bytes = 0;
+    send_bytes    = 0;
+    bulk_bytes    = 0;
+
+    if ( 0 == getsockopt( receive_socket, SOL_SOCKET, SO_RCVBUF, &this_size, &option_length ) )
+    {
+        receive_bytes = this_size / 2;
+    }
+
+    option_length = sizeof( this_size );
+
+    if ( 0 == getsockopt( send_socket, SOL_SOCKET, SO_SNDBUF, &this_size, &option_length ) )
+    {
+        send_bytes = this_size / 2;
+    }
+
+    option_length = sizeof( this_size );
+
+    if ( 0 == getsockopt( bulk_socket, SOL_SOCKET, SO_SNDBUF, &this_size, &option_length ) )
+    {
+        bulk_bytes = this_size / 2;
+    }
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Receive Frame
+//
+// Handles a frame which arrived from the IP address passed by argument.
+// File transfer headers, blocks, digests, repair requests and busy
+// replies are taken care of here; anything else is text for the caller. read_data() calls
+// this for every frame it receives, and the benchmarks call it to feed
+// us frames from as many made-up devices as they like.
+//
+// Returns: The number of bytes of text in the frame, else 0 if the frame
+// was handled here
+//
+// ----------------------------------------------------------------------
+
+int ChatClass::receive_frame( char * this_data_p, int this_byte_size, const char * ip_address_p )
+{
+    // We receive a frame, is it a file transfer start command?
+    if ( 0 == strncmp(this_data_p, ":xfer:", 6 ) )
+    {
+        // Receive the first block of the inbound file and
+        // mark the fact that we are receiving in to a file
+        file_transfer( this_data_p, this_byte_size, ip_address_p );
+
+        // The data was processed so report no more data
+        this_byte_size = 0;
+    } 
+    else if ( 0 == strncmp(this_data_p, ":blok:", 6 ) )
+    {
+        // It is a block of file data. Check it and if it is intact
+        // store the data in to the growing receive file. Blocks
+        // that fail the check are dropped, never shown as text.
+        (void)receive_block_frame( this_data_p, this_byte_size, ip_address_p );
+
+        // The data was processed so report no more data
+        this_byte_size = 0;
+    }
+    else if ( 0 == strncmp(this_data_p, ":dgst:", 6 ) )
+    {
+        // It is the digest of a file that was sent to us
+        receive_digest_frame( this_data_p, this_byte_size, ip_address_p );
+
+        this_byte_size = 0;
+    }
+    else if ( 0 == strncmp(this_data_p, ":rpar:", 6 ) )
+    {
+        // Someone wants part of a file sent again, perhaps by us
+        receive_repair_request( this_data_p, this_byte_size );
+
+        this_byte_size = 0;
+    }
+    else if ( 0 == strncmp(this_data_p, ":busy:", 6 ) )
+    {
+        // Someone had no room for a file, perhaps one of ours
+        receive_busy_reply( this_data_p, this_byte_size, ip_address_p );
+
+        this_byte_size = 0;
+    }
+
+    return this_byte_size;
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Last Sender Address
+//
+// Returns: The IPv4 address, in network byte order, of whoever sent the
+// frame that read_data() last received
+//
+// ----------------------------------------------------------------------
+
+uint32_t ChatClass::last_sender_address( void )
+{
+    return (uint32_t)receive_address.sin_addr.s_addr;
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Last Receive Time
+//
+// Returns: The monotonic time in nanoseconds at which read_data() last
+// received a frame
+//
+// ----------------------------------------------------------------------
+
+uint64_t ChatClass::last_receive_time( void )
+{
+    return receive_time_ns;
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Inbound Transfer Count
+//
+// Returns: How many files are being received, not counting those the
+// receive shards are receiving, which look after themselves
+//
+// ----------------------------------------------------------------------
+
+size_t ChatClass::inbound_transfer_count( void )
+{
+    return send_control.size( );
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Wait For Input
+//
+// Waits until a frame arrives on the receive socket, or there is
+// something to read on the other handle passed by argument if it is
+// valid, or until the number of microseconds passed by argument have
+// passed, whichever comes first. Once the pipeline is running it is the
+// receive thread queueing frames that is waited on instead.
+//
+// Returns: true if there is something to read
+//
+// ----------------------------------------------------------------------
+
+bool ChatClass::wait_for_input( const int other_handle, const int timeout_us )
+{
+    struct pollfd   these_handles[ 2 ];
+    struct timespec this_timeout;
+    int             handle_count = 0;
+    int             poll_result  = 0;
+    uint64_t        event_count  = 0;
+
+    if ( true == pipeline_running )
+    {
+        these_handles[ handle_count ].fd     = pipeline_event;
+        these_handles[ handle_count ].events = POLLIN;
+        handle_count++;
+    }
+    else if ( receive_socket != HANDLE_NOT_VALID )
+    {
+        these_handles[ handle_count ].fd     = receive_socket;
+        these_handles[ handle_count ].events = POLLIN;
+        handle_count++;
+    }
+
+    if ( other_handle != HANDLE_NOT_VALID )
+    {
+        these_handles[ handle_count ].fd     = other_handle;
+        these_handles[ handle_count ].events = POLLIN;
+        handle_count++;
+    }
+
+    this_timeout.tv_sec  = timeout_us / 1000000;
+    this_timeout.tv_nsec = ( timeout_us % 1000000 ) * 1000L;
+
+    poll_result = ppoll( these_handles, handle_count, &this_timeout, (const sigset_t *)NULL );
+
+    // Frames queued from now on wake us again
+    if ( true == pipeline_running && poll_result > 0 )
+    {
+        (void)read( pipeline_event, &event_count, sizeof( event_count ) );
+    }
+
+    return poll_result > 0;
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Trace ID
+//
+// Returns: What tells a file being received apart from all others on
+// a trace, the sender's IPv4 address above its transfer ID
+//
+// ----------------------------------------------------------------------
+
+uint64_t ChatClass::trace_id( const file_sent_control & this_control )
+{
+    return ( (uint64_t)ntohl( inet_addr( this_control.ip_address ) ) << 32 ) | this_control.transfer_id;
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Frame Type
+//
+// Returns: What kind of frame the data passed by argument is, going by
+// the command it starts with, for counting it
+//
+// ----------------------------------------------------------------------
+
+metric_frame ChatClass::frame_type( const void * this_data_p, int this_size )
+{
+    const char * the_bytes_p = (const char *)this_data_p;
+
+    if ( this_size >= 6 && ':' == the_bytes_p[ 0 ] )
+    {
+        if ( 0 == strncmp( the_bytes_p, ":blok:", 6 ) )
+        {
+            return metric_frame_block;
+        }
+
+        if ( 0 == strncmp( the_bytes_p, ":xfer:", 6 ) || 0 == strncmp( the_bytes_p, ":busy:", 6 ) )
+        {
+            return metric_frame_transfer;
+        }
+
+        if ( 0 == strncmp( the_bytes_p, ":dgst:", 6 ) )
+        {
+            return metric_frame_digest;
+        }
+
+        if ( 0 == strncmp( the_bytes_p, ":rpar:", 6 ) )
+        {
+            return metric_frame_repair;
+        }
+    }
+
+    return metric_frame_text;
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Set Non Blocking
+//
+// The socket passed to the method by argument is set to non-blocking
+//
+// ----------------------------------------------------------------------
+
+int ChatClass::set_non_blocking( const int this_socket )
+{
+    // Make sure that the handle is valid
+    if ( this_socket == HANDLE_NOT_VALID )
+    {
+        return false;
+    }
+
+    // Get the current settings, mask out blocking
+    int flags = fcntl( this_socket, F_GETFL, 0 );
+
+    flags |= O_NONBLOCK;
+
+    // Set the new values and return the status
+    return( fcntl( this_socket, F_SETFL, flags ) == 0 ) ? true : false;
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Set Blocking
+//
+// The socket passed to the method by argument is set to blocking
+//
+// ----------------------------------------------------------------------
+
+int ChatClass::set_blocking( const int this_socket )
+{
+    // Make sure that the handle is valid
+    if ( this_socket == HANDLE_NOT_VALID )
+    {
+        return false;
+    }
+
+    // Get the current settings, or in the blocking
+    int flags = fcntl( this_socket, F_GETFL, 0 );
+
+    flags &= ~O_NONBLOCK;
+
+    // Set the new values and return the status
+    return( fcntl( this_socket, F_SETFL, flags ) == 0 ) ? true : false;
+}
+
+// ----------------------------------------------------------------------
+// ChatClass How Many Are Running
+//
+// A ps command gets shelled out which is piped to grep to extract a
+// list of all processes which contain the word "chat" after which the
+// result is examined line by line to count how many instances it 
+// appears that the chat program is running.
+//
+// The function assumes that the name of the executable remains "chat"
+// however argv[0] could conceivably be used to make the function more
+// useful for any executable file name passed to it.
+//
+// Return: The number of instances of chat running on this system
+//
+// ----------------------------------------------------------------------
+
+int ChatClass::how_many_are_running( void )
+{
+    FILE * popen_handle                          = popen("ps x | grep chat", "r");
+    char   in_record[ MAX_POPEN_RECORD_IN_SIZE ] = { 0 };
+    int    entry_count                           = 0;
+
+    // Perform the ps command and pass the result to grep, opening
+    // the result text file
+    if ( (FILE *)NULL != popen_handle )
+    {
+        // While there are entries in the text file
+        while(! feof( popen_handle ))
+        {
+            // Read a line from the result file
+            (void)fgets(in_record, sizeof( in_record ) - 1, popen_handle );
+
+            // Was that read the end of file?
+            if (! feof( popen_handle ))
+            {
+                // Is it our grep command in the task list?
+                if ( (char *)NULL == strstr( in_record, "grep" ) )
+                {
+                    // No so it's a copy of our program that is running so count it
+                    entry_count++;
+                }
+            }
+        }
+
+        // Finished with the result file
+        (void)pclose( popen_handle );
+    }
+
+    // The number of chat instances gets returned
+    return entry_count;
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Send File
+//
+// When the operator wants to send a file broadcast to all receivers,
+// this method is called. It extracts the path and file name from the
+// console input and builds a file transfer header after verifying that
+// the file to send exists, then it sends the file transfer header
+// block to all receivers.
+//
+// The data in the file is not sent here. The file is handed to a
+// read-ahead reader and the transfer is added to the list of files
+// being sent, and service_transfers() sends it a few blocks at a time
+// every time the main loop comes around, so that we keep reading
+// inbound frames and console input while a large file goes out, and
+// so that several files may be sent at the same time.
+//
+// Note that this method also gets invoked if we receive a get request
+// from a remote system. A flag indicats which it was, either an
+// unsolicited send request from an operator on this system, or a get
+// file request from a remote system.
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::send_file( char * path_and_name_p, const bool response_to_get_request )
+{
+    int                    stat_result                        = 0;
+    char                 * file_name_p                        = (char *)NULL;
+    file_transfer_header   file_header;
+    struct stat            our_status;
+    outbound_transfer      this_transfer;
+
+    // Discard leading white space, if any
+    skipspace( path_and_name_p );
+
+    // Remove trailing endline characters if any
+    while( path_and_name_p[ strlen( path_and_name_p ) - 1] == ASCII_CARRIAGE_RETURN ||
+           path_and_name_p[ strlen( path_and_name_p ) - 1] == ASCII_LINE_FEED )
+    {
+        path_and_name_p[ strlen( path_and_name_p ) - 1 ] = ASCII_NULL_ZERO;
+    }
+
+    // Are we already sending as many files as we may?
+    if ( outbound_active.load( ) >= MAX_OUTBOUND_TRANSFERS )
+    {
+        if ( false == response_to_get_request )
+        {
+            (void)printf( "\nToo many files are being sent, try [%s] again later\n", path_and_name_p );
+        }
+
+        return;
+    }
+
+    // See if the file offered exists
+    if (0 == ( stat_result = stat( path_and_name_p, &our_status ) ) )
+    {
+
+        this_transfer.in_file_p = new ReadAheadClass;
+
+        // The file may exist, we attempt to open it for reading. The
+        // read-ahead reader starts filling its buffers right away.
+        if ( true == this_transfer.in_file_p->read_ahead_open( path_and_name_p, 0 ) )
+        {
+            // Plug the file transfer header
+            (void)memset( (char *)&file_header, ASCII_NULL_ZERO, sizeof ( file_header ) );
+
+            // Note the fact that this is a file transfer frame
+            (void)strcpy(file_header.header_command, ":xfer:");
+
+            // Note the number of bytes expected in the file
+            file_header.file_size = (uint64_t)our_status.st_size;
+
+            // Flag the fact that this is a send
+            file_header.trans_type = trans_type_send;
+
+            // Every frame of this transfer carries this ID
+            file_header.transfer_id = next_transfer_id++;
+
+            // Do we have any path information?
+            file_name_p = strrchr( path_and_name_p, '/' );
+ 
+            if ( (char *)NULL != file_name_p )  
+            {
+                // There appears to be a delimiter so point past it
+                file_name_p++;
+            }
+            else
+            {
+                // There does not appear to be path information
+                file_name_p = path_and_name_p;
+            }
+
+            // Copy the file name in to the header
+            (void)memcpy( file_header.file_name, file_name_p, 
+                sizeof( file_header.file_name ) - 1 );
+
+            // Send the header data to alert receivers that inbound 
+            // data is coming and that it should be assembled in to a file
+            send_data( ( char *)&file_header, sizeof( file_header ) );
+
+            (void)printf("Sending %s of %llu bytes\n", 
+                file_name_p, (unsigned long long)file_header.file_size );
+
+            // Hand the file to service_transfers() to send
+            (void)memset( this_transfer.path_and_name, ASCII_NULL_ZERO, sizeof( this_transfer.path_and_name ) );
+            (void)strncpy( this_transfer.path_and_name, path_and_name_p, sizeof( this_transfer.path_and_name ) - 1 );
+
+            this_transfer.transfer_id  = file_header.transfer_id;
+            this_transfer.file_size    = file_header.file_size;
+            this_transfer.started_ns   = ClockClass::clock_precise_ns( );
+            this_transfer.out_offset   = 0;
+            this_transfer.end_offset   = file_header.file_size;
+            this_transfer.is_repair    = false;
+            this_transfer.is_done      = false;
+            this_transfer.weight       = SEND_WEIGHT_FILE;
+            this_transfer.deficit      = 0;
+            this_transfer.buffer_p     = (const char *)NULL;
+            this_transfer.buffer_count = 0;
+
+            this_transfer.digest_next_leaf = 0;
+            this_transfer.digest_sent      = false;
+
+            start_outbound_transfer( this_transfer );
+
+            // The file transfer was started
+            return;
+        }
+
+        delete this_transfer.in_file_p;
+    }
+
+    // Was this an unsolicited send file request?
+    if ( false == response_to_get_request ) 
+    {   
+        // It was not a get file request.
+        // We did not send a file so report the fact
+        (void)printf( "\nFile [%s] was not found\n", path_and_name_p );
+    }
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Start Outbound Transfer
+//
+// A file, or the leaves of one to be repaired, is handed on to be sent:
+// to the transmit thread if the pipeline is running, else to the list
+// service_transfers() works through.
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::start_outbound_transfer( const outbound_transfer & this_transfer )
+{
+    outbound_active++;
+
+    if ( false == pipeline_running )
+    {
+        send_tasks.push_back( this_transfer );
+
+        return;
+    }
+
+    // There are never more transfers than the queue has room for
+    (void)transmit_queue_p->spsc_push( this_transfer );
+
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+
+    if ( true == transmit_waiting.load( ) )
+    {
+        std::lock_guard<std::mutex> pipeline_guard( pipeline_lock );
+
+        transmit_wake.notify_one( );
+    }
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Service Transfers
+//
+// The main loop calls this method every time it comes around to send
+// the next few blocks of the files being sent. Once the pipeline is
+// running the transmit thread sends them, and all that is left to do
+// here is to remember the files it finished sending so that repair
+// requests for them may be answered.
+//
+// Returns: true if files are still being sent
+//
+// ----------------------------------------------------------------------
+
+bool ChatClass::service_transfers( void )
+{
+    sent_file_record this_record;
+
+    if ( false == pipeline_running )
+    {
+        return service_send_tasks( );
+    }
+
+    while ( true == sent_file_queue_p->spsc_pop( this_record ) )
+    {
+        remember_sent_file( this_record.path_and_name, this_record.file_size, this_record.root_digest );
+    }
+
+    return outbound_active.load( ) > 0;
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Service Send Tasks
+//
+// The bytes which may be sent per call are shared among the files being
+// sent by deficit round robin, starting each call with a different file,
+// until they are used up, the bulk socket is full, or every file is
+// waiting on the disk. Files which are finished are removed from the
+// list.
+//
+// Returns: true if files are still being sent
+//
+// ----------------------------------------------------------------------
+
+bool ChatClass::service_send_tasks( void )
+{
+    int      this_index  = 0;
+    int      byte_budget = SEND_BYTES_PER_SERVICE;
+    bool     link_full   = false;
+    bool     any_more    = true;
+    uint64_t trace_start = 0;
+
+    if ( true == send_tasks.empty( ) )
+    {
+        return false;
+    }
+
+    trace_start = TraceClass::trace_begin( );
+
+    service_round++;
+
+    while ( true == any_more && false == link_full && byte_budget >= MAX_OUT_DATA_SIZE )
+    {
+        any_more = false;
+
+        for ( this_index = 0; this_index < send_tasks.size( ) && false == link_full; this_index++ )
+        {
+            outbound_transfer & this_transfer = send_tasks[ ( service_round + this_index ) % send_tasks.size( ) ];
+
+            if ( true == this_transfer.is_done )
+            {
+                continue;
+            }
+
+            // Credit the file with its share of this round
+            this_transfer.deficit += this_transfer.weight * MAX_OUT_DATA_SIZE;
+
+            switch ( advance_transfer( this_transfer, byte_budget ) )
+            {
+                case advance_more:
+                    any_more = true;
+                    break;
+
+                case advance_link_full:
+                    link_full = true;
+                    break;
+
+                default:
+                    // A file with nothing to send keeps no credit
+                    this_transfer.deficit = 0;
+                    break;
+            }
+        }
+    }
+
+    // Go through the list backwards so that finished entries may be
+    // removed as we go
+    for ( this_index = send_tasks.size( ) - 1; this_index >= 0; this_index-- )
+    {
+        if ( true == send_tasks[ this_index ].is_done )
+        {
+            finish_outbound_transfer( send_tasks[ this_index ] );
+
+            send_tasks.erase( send_tasks.begin( ) + this_index );
+
+            outbound_active--;
+        }
+    }
+
+    TraceClass::trace_end( trace_service, trace_start, send_tasks.size( ) );
+
+    return false == send_tasks.empty( );
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Advance Transfer
+//
+// Sends blocks of a file being sent while the file has credit for them
+// and there are bytes left in the budget offered. When the read-ahead
+// buffer being sent runs out the next one is taken, but only if the
+// reader already has it so that we never wait on the disk. Every buffer
+// starts on a leaf boundary so the leaves of a new buffer are hashed
+// while the buffer is still in the cache. Once all of the data is sent
+// the digest follows it through the same socket so that it arrives
+// behind the data.
+//
+// Returns: What became of the transfer
+//
+// ----------------------------------------------------------------------
+
+advance_result ChatClass::advance_transfer( outbound_transfer & this_transfer, int & byte_budget )
+{
+    int block_size = 0;
+    int leaf_size  = 0;
+
+    while( true )
+    {
+        // Do we need another buffer?
+        if ( 0 == this_transfer.buffer_count )
+        {
+            // Let the reader fill the one we finished again
+            if ( (const char *)NULL != this_transfer.buffer_p )
+            {
+                this_transfer.in_file_p->read_ahead_release( );
+
+                this_transfer.buffer_p = (const char *)NULL;
+            }
+
+            // Did we send everything?
+            if ( this_transfer.out_offset >= this_transfer.end_offset )
+            {
+                // Follow the data of a whole file with its digest
+                while ( false == this_transfer.is_repair && false == this_transfer.digest_sent )
+                {
+                    if ( this_transfer.deficit < MAX_OUT_DATA_SIZE || byte_budget < MAX_OUT_DATA_SIZE )
+                    {
+                        return advance_more;
+                    }
+
+                    if ( false == send_file_digest( this_transfer ) )
+                    {
+                        return advance_link_full;
+                    }
+
+                    this_transfer.deficit -= MAX_OUT_DATA_SIZE;
+                    byte_budget           -= MAX_OUT_DATA_SIZE;
+                }
+
+                this_transfer.is_done = true;
+
+                return advance_done;
+            }
+
+            // Try again the next time around if the disk is behind us
+            if ( false == this_transfer.in_file_p->read_ahead_ready( ) )
+            {
+                return advance_idle;
+            }
+
+            this_transfer.buffer_count = this_transfer.in_file_p->read_ahead_next( &this_transfer.buffer_p );
+
+            // Could the file not be read? Sending it stops here and the
+            // receivers will time out.
+            if ( this_transfer.buffer_count < 0 )
+            {
+                (void)printf( "\nNOTE: Sending %s stopped, it could not be read: %s\n",
+                    this_transfer.path_and_name, strerror( this_transfer.in_file_p->read_ahead_error( ) ) );
+
+                MetricsClass::metrics_count( metric_send_errors );
+
+                this_transfer.buffer_count = 0;
+                this_transfer.buffer_p     = (const char *)NULL;
+                this_transfer.is_done      = true;
+
+                return advance_done;
+            }
+
+            // Did the file end early? The receivers will time out.
+            if ( 0 == this_transfer.buffer_count )
+            {
+                this_transfer.buffer_count = 0;
+                this_transfer.buffer_p     = (const char *)NULL;
+                this_transfer.is_done      = true;
+
+                return advance_done;
+            }
+
+            // Never send more than the receivers expect
+            if ( (uint64_t)this_transfer.buffer_count > this_transfer.end_offset - this_transfer.out_offset )
+            {
+                this_transfer.buffer_count = this_transfer.end_offset - this_transfer.out_offset;
+            }
+
+            // Repairs send leaves we already have the digest of
+            for ( block_size = 0; false == this_transfer.is_repair &&
+                block_size < this_transfer.buffer_count; block_size += leaf_size )
+            {
+                leaf_size = this_transfer.buffer_count - block_size;
+
+                if ( leaf_size > DIGEST_LEAF_SIZE )
+                {
+                    leaf_size = DIGEST_LEAF_SIZE;
+                }
+
+                this_transfer.leaf_digests.push_back( integrity.integrity_leaf_digest(
+                    this_transfer.buffer_p + block_size, leaf_size,
+                    (uint32_t)( ( this_transfer.out_offset + block_size ) / DIGEST_LEAF_SIZE ) ) );
+            }
+        }
+
+        // Compute the size of the block of data to send
+        block_size = this_transfer.buffer_count;
+
+        if ( block_size > MAX_OUT_DATA_SIZE )
+        {
+            block_size = MAX_OUT_DATA_SIZE;
+        }
+
+        // Has the file used up its credit, or the call its budget?
+        if ( this_transfer.deficit < block_size || byte_budget < block_size )
+        {
+            return advance_more;
+        }
+
+        // Send the next block of the buffer
+        if ( false == send_file_block( this_transfer.buffer_p, block_size, this_transfer.out_offset,
+            this_transfer.transfer_id ) )
+        {
+            return advance_link_full;
+        }
+
+        this_transfer.buffer_p     += block_size;
+        this_transfer.buffer_count -= block_size;
+        this_transfer.out_offset   += block_size;
+        this_transfer.deficit      -= block_size;
+        byte_budget                -= block_size;
+    }
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Finish Outbound Transfer
+//
+// A file we were sending is closed. If the whole file and its digest
+// were sent the file is remembered in case a receiver asks for repairs.
+// If the file shrank while we were reading it the receivers will time
+// out anyway.
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::finish_outbound_transfer( outbound_transfer & this_transfer )
+{
+    sent_file_record this_record;
+
+    TraceClass::trace_span( trace_transfer_out, this_transfer.started_ns, ClockClass::clock_precise_ns( ),
+        this_transfer.transfer_id );
+
+    this_transfer.in_file_p->read_ahead_close( );
+
+    delete this_transfer.in_file_p;
+
+    this_transfer.in_file_p = (ReadAheadClass *)NULL;
+
+    if ( false == this_transfer.digest_sent || this_transfer.out_offset != this_transfer.file_size )
+    {
+        return;
+    }
+
+    if ( false == pipeline_running )
+    {
+        remember_sent_file( this_transfer.path_and_name, this_transfer.file_size,
+            integrity.integrity_root_digest( this_transfer.leaf_digests, this_transfer.file_size ) );
+
+        return;
+    }
+
+    // The transmit thread hands the file back to be remembered by the
+    // thread which answers repair requests. If that thread is so far
+    // behind that the queue is full the file is not remembered, and a
+    // repair request for it goes unanswered.
+    (void)memcpy( this_record.path_and_name, this_transfer.path_and_name, sizeof( this_record.path_and_name ) );
+
+    this_record.file_size   = this_transfer.file_size;
+    this_record.root_digest = integrity.integrity_root_digest( this_transfer.leaf_digests, this_transfer.file_size );
+
+    (void)sent_file_queue_p->spsc_push( this_record );
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Send File Block
+//
+// A block of file data is sent with a file block header in front of it
+// which tells the receivers where in the file the data belongs. The
+// CRC covers the whole frame and is computed with the CRC field zero.
+//
+// Returns: false if the file data socket was full
+//
+// ----------------------------------------------------------------------
+
+bool ChatClass::send_file_block( const char * this_data_p, const int this_size, const uint64_t this_offset,
+    const uint32_t transfer_id )
+{
+    char                outbound_frame[ sizeof( file_block_header ) + MAX_OUT_DATA_SIZE ];
+    file_block_header * block_header_p = (file_block_header *)outbound_frame;
+
+    // Build the block header followed by the data itself
+    (void)memset( (char *)block_header_p, ASCII_NULL_ZERO, sizeof( file_block_header ) );
+    (void)strcpy( block_header_p->block_command, ":blok:" );
+
+    block_header_p->block_size   = this_size;
+    block_header_p->block_offset = this_offset;
+    block_header_p->transfer_id  = transfer_id;
+
+    (void)memcpy( &outbound_frame[ sizeof( file_block_header ) ], this_data_p, this_size );
+
+    block_header_p->block_crc = integrity.integrity_crc32c( outbound_frame,
+        sizeof( file_block_header ) + this_size );
+
+    return send_bulk_data( outbound_frame, sizeof( file_block_header ) + this_size );
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Send File Digest
+//
+// The next digest frame of a file which was just sent is transmitted.
+// It carries as many of the leaf digests not yet sent as fit, and the
+// root digest of the whole file. A file needs as many digest frames as
+// it takes, and always at least one.
+//
+// Returns: false if the file data socket was full
+//
+// ----------------------------------------------------------------------
+
+bool ChatClass::send_file_digest( outbound_transfer & this_transfer )
+{
+    char                 outbound_frame[ sizeof( file_digest_header ) + MAX_OUT_DATA_SIZE ];
+    file_digest_header * digest_header_p = (file_digest_header *)outbound_frame;
+    const uint32_t       first_leaf      = this_transfer.digest_next_leaf;
+    uint32_t             leaf_count      = this_transfer.leaf_digests.size( ) - first_leaf;
+
+    if ( leaf_count > DIGEST_LEAVES_PER_FRAME )
+    {
+        leaf_count = DIGEST_LEAVES_PER_FRAME;
+    }
+
+    (void)memset( (char *)digest_header_p, ASCII_NULL_ZERO, sizeof( file_digest_header ) );
+    (void)strcpy( digest_header_p->digest_command, ":dgst:" );
+
+    digest_header_p->first_leaf   = first_leaf;
+    digest_header_p->leaf_count   = leaf_count;
+    digest_header_p->total_leaves = this_transfer.leaf_digests.size( );
+    digest_header_p->file_size    = this_transfer.file_size;
+    digest_header_p->root_digest  = integrity.integrity_root_digest( this_transfer.leaf_digests,
+                                        this_transfer.file_size );
+    digest_header_p->transfer_id  = this_transfer.transfer_id;
+
+    if ( leaf_count > 0 )
+    {
+        (void)memcpy( &outbound_frame[ sizeof( file_digest_header ) ], &this_transfer.leaf_digests[ first_leaf ],
+            leaf_count * sizeof( uint64_t ) );
+    }
+
+    digest_header_p->digest_crc = integrity.integrity_crc32c( outbound_frame,
+        sizeof( file_digest_header ) + leaf_count * sizeof( uint64_t ) );
+
+    if ( false == send_bulk_data( outbound_frame, sizeof( file_digest_header ) + leaf_count * sizeof( uint64_t ) ) )
+    {
+        return false;
+    }
+
+    this_transfer.digest_next_leaf += leaf_count;
+
+    if ( this_transfer.digest_next_leaf >= this_transfer.leaf_digests.size( ) )
+    {
+        this_transfer.digest_sent = true;
+    }
+
+    return true;
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Remember Sent File
+//
+// Keeps track of the most recently sent files so that repair requests
+// for them can be answered. When the list is full the oldest entry is
+// forgotten.
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::remember_sent_file( const char * path_and_name_p, const uint64_t file_size, const uint64_t root_digest )
+{
+    sent_file_record this_record;
+
+    (void)memset( this_record.path_and_name, ASCII_NULL_ZERO, sizeof( this_record.path_and_name ) );
+    (void)strncpy( this_record.path_and_name, path_and_name_p, sizeof( this_record.path_and_name ) - 1 );
+
+    this_record.file_size   = file_size;
+    this_record.root_digest = root_digest;
+
+    if ( recent_sends.size( ) >= MAX_RECENT_SENDS )
+    {
+        recent_sends.erase( recent_sends.begin( ) );
+    }
+
+    recent_sends.push_back( this_record );
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Receive Repair Request
+//
+// A receiver found that some leaves of a file did not match the digest
+// or never arrived. If we sent the file with that root digest, and the
+// file still has the size we sent, the blocks of the requested leaves
+// are sent again by service_transfers() the same way as a new file is
+// sent. Other systems ignore it, as do we if we are already sending as
+// many files as we may; the receiver asks again when it times out.
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::receive_repair_request( char * this_data_p, int this_byte_size )
+{
+    file_repair_request repair_request;
+    uint32_t            received_crc = 0;
+    int                 this_index   = 0;
+    struct stat         our_status;
+
+    if ( this_byte_size != (int)sizeof( repair_request ) )
+    {
+        return;
+    }
+
+    (void)memcpy( (char *)&repair_request, this_data_p, sizeof( repair_request ) );
+
+    received_crc              = repair_request.repair_crc;
+    repair_request.repair_crc = 0;
+
+    if ( received_crc != integrity.integrity_crc32c( (char *)&repair_request, sizeof( repair_request ) ) )
+    {
+        return;
+    }
+
+    if ( outbound_active.load( ) >= MAX_OUTBOUND_TRANSFERS )
+    {
+        return;
+    }
+
+    for ( this_index = 0; this_index < recent_sends.size( ); this_index++ )
+    {
+        const sent_file_record & this_record = recent_sends[ this_index ];
+
+        if ( this_record.root_digest == repair_request.root_digest &&
+            0 == stat( this_record.path_and_name, &our_status ) &&
+            (uint64_t)our_status.st_size == this_record.file_size )
+        {
+            outbound_transfer this_transfer;
+
+            this_transfer.out_offset = (uint64_t)repair_request.first_leaf * DIGEST_LEAF_SIZE;
+            this_transfer.end_offset = this_transfer.out_offset +
+                (uint64_t)repair_request.leaf_count * DIGEST_LEAF_SIZE;
+
+            if ( this_transfer.out_offset >= this_record.file_size )
+            {
+                return;
+            }
+
+            if ( this_transfer.end_offset > this_record.file_size )
+            {
+                this_transfer.end_offset = this_record.file_size;
+            }
+
+            this_transfer.in_file_p = new ReadAheadClass;
+
+            if ( false == this_transfer.in_file_p->read_ahead_open( this_record.path_and_name,
+                (off_t)this_transfer.out_offset ) )
+            {
+                delete this_transfer.in_file_p;
+
+                return;
+            }
+
+            (void)printf( "Repairing %u leaves of %s\n", repair_request.leaf_count, this_record.path_and_name );
+
+            (void)strcpy( this_transfer.path_and_name, this_record.path_and_name );
+
+            this_transfer.transfer_id  = repair_request.transfer_id;
+            this_transfer.file_size    = this_record.file_size;
+            this_transfer.started_ns   = ClockClass::clock_precise_ns( );
+            this_transfer.is_repair    = true;
+            this_transfer.is_done      = false;
+            this_transfer.weight       = SEND_WEIGHT_REPAIR;
+            this_transfer.deficit      = 0;
+            this_transfer.buffer_p     = (const char *)NULL;
+            this_transfer.buffer_count = 0;
+
+            this_transfer.digest_next_leaf = 0;
+            this_transfer.digest_sent      = false;
+
+            start_outbound_transfer( this_transfer );
+
+            return;
+        }
+    }
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Receive File Start
+//
+// After receving the header block for a file transfer, this function
+// is called to handle it. A transfer of the same file already under way
+// is abandoned, as it is being sent again. The file is taken if there
+// is room for it; otherwise it waits for room or is refused, see
+// admit_transfer().
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::receive_file_start( char * this_data_p, int this_byte_size, const char * ip_address_p )
+{
+    int                  control_index = CONTROL_NOT_FOUND;
+    int                  offer_index   = CONTROL_NOT_FOUND;
+    admit_result         this_result   = admit_no_room;
+    file_transfer_header file_header;
+
+    // The header is always sent in a UDP frame of its own, so a frame
+    // too short to hold one is not a header
+    if ( this_byte_size < (int)sizeof( file_header ) )
+    {
+        return;
+    }
+
+    // Copy the starting data in to the header
+    (void)memcpy( (char *)&file_header, this_data_p, sizeof( file_header) );
+
+    // The name came from the network so make sure that it ends
+    file_header.file_name[ sizeof( file_header.file_name ) - 1 ] = ASCII_NULL_ZERO;
+
+    // See if this transfer from this device is already in progress 
+    control_index = find_send_control( ip_address_p, file_header.transfer_id );
+
+    // A value not minus 1 means it's in the vector array
+    if ( CONTROL_NOT_FOUND != control_index )
+    {
+        // Are we already receiving a file?
+        if ( true == send_control[ control_index ].in_file_transfer && 
+           (FILE *)NULL != send_control[ control_index ].out_file_p )
+        {
+            // This likely means that we were sent an incomplete file
+            // and the effort is being retried. Close the file abruptly
+            // and flag the fact that we are no longer receiving. We
+            // can fail to get a complete file because UDP is not assured
+            // delivery.
+            wait_for_disk_writes( );
+
+            close_inbound_file( send_control[ control_index ] );
+
+            // Flag the fact that we are no longer transfering a file
+            send_control[ control_index ].in_file_transfer = false;
+
+            // Note that there are no bytes left to receive
+            send_control[ control_index ].to_receive_count = 0;
+
+            (void)printf( "NOTE: Aborted previous file transfer from %s.\n", ip_address_p );
+        }
+
+        // Remove the existing entry from the vector array.
+        remove_send_control( control_index );
+    }
+
+    // An offer of it which is still waiting for room is offered again
+    offer_index = find_pending_offer( ip_address_p, file_header.transfer_id );
+
+    if ( CONTROL_NOT_FOUND != offer_index )
+    {
+        pending_offers.erase( pending_offers.begin( ) + offer_index );
+    }
+
+    // Does the file we're supposed to receive contain data?
+    if ( 0 == file_header.file_size )
+    {
+        // No, so just ignore the file transfer request
+        return;
+    }
+
+    // Offers which came first are given room first
+    if ( true == pending_offers.empty( ) )
+    {
+        this_result = admit_transfer( file_header.file_size );
+    }
+
+    if ( admit_taken == this_result )
+    {
+        (void)start_inbound_file( file_header, ip_address_p );
+    }
+    else if ( admit_no_room == this_result && pending_offers.size( ) < ADMIT_QUEUE_SLOTS )
+    {
+        queue_offer( file_header, ip_address_p );
+    }
+    else
+    {
+        refuse_offer( file_header, ip_address_p, this_result );
+    }
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Start Inbound File
+//
+// A file transfer which there is room for is started. The file name and
+// path are extracted from the header, and the number of bytes that are
+// expected gets extracted.
+//
+// The file name is checked to see if it exists in the directory where
+// the program was executed, and if the file name exists, a number gets
+// appended to the file name. We try a maximum of 20 file names before
+// we simply drop the transfer request in which case the data from the
+// file may flood in to our console output.
+//
+// NOTE: We could discard all of that data easily enough by setting the
+// send_control.in_file_transfer flag to true. Since the file handle
+// is not opened, all of the inbound data would be discarded. However
+// we want to see the otherwise discarded data.
+//
+// Returns: true if the file was created and is being received, else
+// the room which was set aside for it is given back
+//
+// ----------------------------------------------------------------------
+
+bool ChatClass::start_inbound_file( const file_transfer_header & file_header, const char * ip_address_p )
+{
+    char                 out_file_name[ MAX_OUT_FILE_NAME_SIZE ] = { 0 };
+    bool                 have_file_name                          = false;
+    int                  name_try_count                          = 0;
+    file_sent_control    this_control;
+
+    // We attempt to create a file name. If the file already exists
+    // we change the name by adding a number to the end of the file
+    // name, but we only try up to a maximum number of attempts.
+    while( false == have_file_name && name_try_count++ < MAX_FILE_OVERWRITE_CHECK ) 
+    {
+        // Get the name of the file to create from the header
+        (void)strcpy( out_file_name, file_header.file_name );
+
+        if ( name_try_count > 0 )
+        {
+            char to_append[ 10 ] = { 0 };
+
+            (void)sprintf( to_append, "%d", name_try_count );
+
+            (void)strcat( out_file_name, to_append );
+        }
+
+        // Does the file already exist?
+        this_control.out_file_p = fopen( out_file_name, "rb" );
+
+        if ( (FILE *)NULL == this_control.out_file_p )
+        {
+            // Flag the fact that this file name does not exist already
+            have_file_name = true;
+        }
+        else
+        {
+            // The file already exists
+            (void)fclose( this_control.out_file_p );
+
+            // Flag the fact that the file is closed
+            this_control.out_file_p = (FILE *)NULL;
+        }
+    }
+
+    // Did we get a good file name?
+    if ( true == have_file_name )
+    {
+        // Create the outbound file. It is opened for reading as well
+        // so that it can be checked against its digest once it is in.
+        if ( (FILE *)NULL != ( this_control.out_file_p = fopen( out_file_name, "w+b" ) ) )
+        {
+            // Give the file its full size up front so that blocks which
+            // never arrive leave holes which read back as zeros
+            (void)ftruncate( fileno( this_control.out_file_p ), (off_t)file_header.file_size );
+
+            // Flag the fact that we are receiving a file now
+            this_control.in_file_transfer = true;
+
+            // Set the size of data bytes that needs to be received 
+            this_control.to_receive_count = file_header.file_size;
+
+            // Store the IP address of the sending device. We
+            // use the IP address to track multiple inbound files
+            // from different devices. 
+            (void)strcpy( this_control.ip_address, ip_address_p );
+
+            this_control.transfer_id = file_header.transfer_id;
+
+            (void)printf( "\nInbound file: %s with %llu bytes from %s\n", 
+                out_file_name, (unsigned long long)this_control.to_receive_count, ip_address_p );
+
+            MetricsClass::metrics_count( metric_transfers_started );
+
+            // No blocks have failed their check yet
+            this_control.dropped_block_count = 0;
+
+            // Remember the name of the file we are creating
+            (void)strcpy( this_control.out_file_name, out_file_name );
+
+            // Nothing is known about the digest until it follows the data
+            this_control.file_size              = file_header.file_size;
+            this_control.root_digest            = 0;
+            this_control.digest_leaves_received = 0;
+            this_control.repair_attempts        = 0;
+            this_control.started_ns             = ClockClass::clock_precise_ns( );
+
+            this_control.leaf_digests.assign( integrity.integrity_leaf_count( this_control.file_size ), 0 );
+            this_control.leaf_digest_known.assign( this_control.leaf_digests.size( ), false );
+            this_control.leaf_bytes_received.assign( this_control.leaf_digests.size( ), 0 );
+            this_control.leaf_verified.assign( this_control.leaf_digests.size( ), false );
+            this_control.verify_p = (verify_job *)NULL;
+
+            // Append the control block to the vector array and start
+            // its timer. The data of the file follows in separate block
+            // frames.
+            arm_transfer_timer( add_send_control( this_control ), transfer_class_data );
+
+            return true;
+        }
+    }
+    else
+    {
+        // Could not create a file name that would not overwrite
+        // an existing file. We discard the inbound frame by doing 
+        // nothing. If there are further inbound UDP frames, they
+        // will be made available to the calling process every time 
+        // the read_data() method is invoked.
+        // 
+        // This behavior could be changed to discard the inbound file
+        // without being displayed to the console by uncommenting
+        // the following:
+        //
+        // this_control.in_file_transfer = true;
+        // this_control.to_receive_count = file_header.file_size;
+        // (void)strcpy( this_control.ip_address, ip_address_p );
+        // (void)printf("Can not save inbound file, file name collission\n");
+    }
+
+    // The file was not created so the room set aside for it is not used
+    release_transfer( file_header.file_size, true );
+
+    return false;
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Admit Transfer
+//
+// Sets aside room for a file of the size passed by argument: one more
+// file being received, its bytes, and the file it is received in to.
+// The room is counted by whichever class the receive shards belong to
+// so it may be set aside by any of them at once; it is taken first and
+// given back if any limit turns out to be passed.
+//
+// Returns: admit_taken if there was room, admit_no_room if there is not
+// now, or admit_too_large if the file is larger than all of the bytes
+// we may set aside
+//
+// ----------------------------------------------------------------------
+
+admit_result ChatClass::admit_transfer( const uint64_t file_size )
+{
+    admission_counts & this_admission = *admission_p;
+
+    if ( file_size > this_admission.max_reserved_bytes )
+    {
+        return admit_too_large;
+    }
+
+    if ( this_admission.transfers.fetch_add( 1 ) >= this_admission.max_transfers )
+    {
+        this_admission.transfers--;
+
+        return admit_no_room;
+    }
+
+    if ( this_admission.reserved_bytes.fetch_add( file_size ) + file_size > this_admission.max_reserved_bytes )
+    {
+        release_transfer( file_size, false );
+
+        return admit_no_room;
+    }
+
+    if ( this_admission.open_files.fetch_add( 1 ) >= this_admission.max_open_files )
+    {
+        release_transfer( file_size, true );
+
+        return admit_no_room;
+    }
+
+    return admit_taken;
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Release Transfer
+//
+// Gives back the room set aside for a file of the size passed by
+// argument, along with its file if that is still counted.
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::release_transfer( const uint64_t file_size, const bool file_open )
+{
+    admission_p->transfers--;
+    admission_p->reserved_bytes -= file_size;
+
+    if ( true == file_open )
+    {
+        admission_p->open_files--;
+    }
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Close Inbound File
+//
+// The file a transfer is being received in to is closed, and may be
+// counted toward another. The caller waits for the disk writes first.
+// A check of the file still under way is given up on.
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::close_inbound_file( file_sent_control & this_control )
+{
+    cancel_verification( this_control );
+
+    (void)fclose( this_control.out_file_p );
+
+    // Flag the fact that it is closed
+    this_control.out_file_p = (FILE *)NULL;
+
+    admission_p->open_files--;
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Queue Offer
+//
+// An offer of a file which there is no room for now waits for room at
+// the back of the queue.
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::queue_offer( const file_transfer_header & file_header, const char * ip_address_p )
+{
+    pending_offer this_offer;
+
+    this_offer.offer_header = file_header;
+    this_offer.queued_ns    = ClockClass::clock_monotonic_ns( );
+
+    (void)strcpy( this_offer.ip_address, ip_address_p );
+
+    pending_offers.push_back( this_offer );
+
+    (void)printf( "\nNOTE: No room for file %s from %s yet, it is waiting\n",
+        file_header.file_name, ip_address_p );
+
+    MetricsClass::metrics_count( metric_transfers_queued );
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Service Pending Offers
+//
+// The offers waiting for room are given it in the order they came for
+// as long as there is some. Those which have waited too long are
+// refused.
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::service_pending_offers( void )
+{
+    const uint64_t oldest_ns   = ClockClass::clock_monotonic_ns( ) - (uint64_t)ADMIT_QUEUE_WAIT_MS * 1000000ULL;
+    admit_result   this_result = admit_no_room;
+
+    while ( false == pending_offers.empty( ) )
+    {
+        const pending_offer & this_offer = pending_offers.front( );
+
+        if ( this_offer.queued_ns < oldest_ns )
+        {
+            refuse_offer( this_offer.offer_header, this_offer.ip_address, admit_no_room );
+        }
+        else
+        {
+            this_result = admit_transfer( this_offer.offer_header.file_size );
+
+            if ( admit_no_room == this_result )
+            {
+                return;
+            }
+
+            if ( admit_taken == this_result )
+            {
+                (void)start_inbound_file( this_offer.offer_header, this_offer.ip_address );
+            }
+            else
+            {
+                refuse_offer( this_offer.offer_header, this_offer.ip_address, this_result );
+            }
+        }
+
+        pending_offers.erase( pending_offers.begin( ) );
+    }
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Find Pending Offer
+//
+// Returns: The index in to the queue of offers of the one from the IP
+// address with the transfer ID passed by argument, else -1
+//
+// ----------------------------------------------------------------------
+
+int ChatClass::find_pending_offer( const char * ip_address_p, const uint32_t transfer_id )
+{
+    int this_index = 0;
+
+    for ( this_index = 0; this_index < (int)pending_offers.size( ); this_index++ )
+    {
+        if ( pending_offers[ this_index ].offer_header.transfer_id == transfer_id &&
+            0 == strcmp( pending_offers[ this_index ].ip_address, ip_address_p ) )
+        {
+            return this_index;
+        }
+    }
+
+    return CONTROL_NOT_FOUND;
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Refuse Offer
+//
+// An offer of a file is turned down, and the sender is told why with a
+// busy reply. Every device gets the reply; the transfer ID and the file
+// name tell the sender it is meant for.
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::refuse_offer( const file_transfer_header & file_header, const char * ip_address_p,
+    const admit_result this_reason )
+{
+    file_busy_reply busy_reply;
+
+    (void)memset( (char *)&busy_reply, ASCII_NULL_ZERO, sizeof( busy_reply ) );
+    (void)strcpy( busy_reply.busy_command, ":busy:" );
+
+    busy_reply.transfer_id = file_header.transfer_id;
+    busy_reply.busy_reason = (uint32_t)this_reason;
+    busy_reply.file_size   = file_header.file_size;
+
+    (void)memcpy( busy_reply.file_name, file_header.file_name, sizeof( busy_reply.file_name ) - 1 );
+
+    busy_reply.busy_crc = integrity.integrity_crc32c( (char *)&busy_reply, sizeof( busy_reply ) );
+
+    send_data( (char *)&busy_reply, sizeof( busy_reply ) );
+
+    (void)printf( "\nNOTE: Refused file %s of %llu bytes from %s, %s\n", busy_reply.file_name,
+        (unsigned long long)file_header.file_size, ip_address_p,
+        ( admit_too_large == this_reason ? "it is too large" : "there is no room for it" ) );
+
+    MetricsClass::metrics_count( metric_transfers_refused );
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Receive Busy Reply
+//
+// A receiver turned down a file. If it was one we offered, which we
+// tell by the transfer IDs we have handed out, we say so. The file is
+// still sent to everyone else.
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::receive_busy_reply( char * this_data_p, int this_byte_size, const char * ip_address_p )
+{
+    file_busy_reply busy_reply;
+    uint32_t        received_crc = 0;
+
+    if ( this_byte_size != (int)sizeof( busy_reply ) )
+    {
+        return;
+    }
+
+    (void)memcpy( (char *)&busy_reply, this_data_p, sizeof( busy_reply ) );
+
+    received_crc        = busy_reply.busy_crc;
+    busy_reply.busy_crc = 0;
+
+    if ( received_crc != integrity.integrity_crc32c( (char *)&busy_reply, sizeof( busy_reply ) ) )
+    {
+        return;
+    }
+
+    if ( busy_reply.transfer_id - first_transfer_id >= next_transfer_id - first_transfer_id )
+    {
+        return;
+    }
+
+    busy_reply.file_name[ sizeof( busy_reply.file_name ) - 1 ] = ASCII_NULL_ZERO;
+
+    (void)printf( "\nNOTE: %s did not take %s, %s\n", ip_address_p, busy_reply.file_name,
+        ( admit_too_large == busy_reply.busy_reason ? "it is too large" : "it has no room for it" ) );
+}
+
+// ----------------------------------------------------------------------
+// ChatClass File Transfer
+//
+// An inbound UDP frame indicates that a file transfer is requested.
+// This may be an unsolicited send or a get request. This method copies
+// the UDP frame's data in to the header structure to determine which
+// type of transfer request it is, dispatching the functionality to the
+// correct method to handle it.
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::file_transfer( char * this_data_p, const int this_byte_size, const char * ip_address_p )
+{
+    file_transfer_header file_header;
+
+    // A frame too short to hold the header is dropped
+    if ( this_byte_size < (int)sizeof( file_header ) )
+    {
+        return;
+    }
+
+    // Copy the starting data in to the header. 
+    (void)memcpy( (char *)&file_header, this_data_p, sizeof( file_header) );
+
+    // See if the file transfer is an unsolicited send or a get
+    if ( file_header.trans_type == trans_type_send )
+    {
+        // It is an unsolicited send
+        receive_file_start( this_data_p, this_byte_size, ip_address_p );
+    }
+    else if ( file_header.trans_type == trans_type_get_request )
+    {
+        // It is a get file request
+        get_file_request( this_data_p );
+    }
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Receive Block Frame
+//
+// A UDP frame starting with a file block header was received. The
+// frame must be at least as large as the header, the size in the
+// header must agree with the size of the frame, and the CRC32C of the
+// frame must match the CRC in the header. Frames which fail any of
+// these checks are dropped before anything is written to the file.
+//
+// Returns: true if the block was intact and was stored in to a file
+//
+// ----------------------------------------------------------------------
+
+bool ChatClass::receive_block_frame( char * this_data_p, int this_byte_size, const char * ip_address_p )
+{
+    file_block_header block_header;
+    uint32_t          received_crc  = 0;
+    int               control_index = CONTROL_NOT_FOUND;
+
+    // Make sure that there is a whole header and that the data which
+    // follows it is exactly as large as the header claims
+    if ( this_byte_size >= (int)sizeof( block_header ) )
+    {
+        (void)memcpy( (char *)&block_header, this_data_p, sizeof( block_header ) );
+
+        if ( block_header.block_size == this_byte_size - sizeof( block_header ) )
+        {
+            // The CRC was computed with the CRC field set to zero
+            received_crc           = block_header.block_crc;
+            block_header.block_crc = 0;
+
+            (void)memcpy( this_data_p, (char *)&block_header, sizeof( block_header ) );
+
+            if ( received_crc == integrity.integrity_crc32c( this_data_p, this_byte_size ) )
+            {
+                // The block is intact so store it in to the file
+                return receive_file_block( this_data_p + sizeof( block_header ),
+                    block_header.block_size, block_header.block_offset, block_header.transfer_id,
+                    ip_address_p );
+            }
+        }
+
+        // The block is damaged. If we are receiving the file it claims
+        // to be a part of, keep track of how many were dropped.
+        control_index = find_send_control( ip_address_p, block_header.transfer_id );
+
+        if ( CONTROL_NOT_FOUND != control_index )
+        {
+            send_control[ control_index ].dropped_block_count++;
+        }
+
+        MetricsClass::metrics_count( metric_blocks_dropped );
+    }
+
+    return false;
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Receive File Block
+//
+// When the send_control.in_file_transfer flag indicates that a file transfer is 
+// taking place, and when the file handle shows that the destination 
+// file is open, the data passed to this function by argument gets
+// written to that file.
+//
+// The data is written at the offset in the file that the block header
+// offered so that a block which was dropped leaves a hole rather than
+// shifting every block which follows it.
+//
+// NOTE: We could move the check for the open output file to avoid
+// the write() call and allow the data streaming in to us to be
+// discarded solely if the send_control.in_file_transfer flag is true.
+//
+// ----------------------------------------------------------------------
+
+bool ChatClass::receive_file_block( char * this_data_p, int this_byte_size, const uint64_t this_offset,
+    const uint32_t transfer_id, const char * ip_address_p )
+{
+    const int orig_block_size = this_byte_size;
+    int       control_index   = CONTROL_NOT_FOUND;
+    bool      are_receiving   = false;
+
+    // See if this transfer from this device is in progress 
+    control_index = find_send_control( ip_address_p, transfer_id );
+
+    // A value of CONTROL_NOT_FOUND means it's not in the vector array
+    if ( CONTROL_NOT_FOUND == control_index )
+    {
+        // Report that we are not getting a file from this device
+        return false;
+    }
+
+    // Make sure that the block belongs inside of the file. The offset
+    // comes from the frame so it is checked without adding to it, which
+    // could wrap around.
+    if ( orig_block_size <= 0 || this_offset >= send_control[ control_index ].file_size ||
+        (uint64_t)orig_block_size > send_control[ control_index ].file_size - this_offset )
+    {
+        return false;
+    }
+
+    // Senders never split a block across two leaves, so one which
+    // claims to be split is not from a sender
+    if ( this_offset / DIGEST_LEAF_SIZE != ( this_offset + orig_block_size - 1 ) / DIGEST_LEAF_SIZE ||
+        this_offset / DIGEST_LEAF_SIZE >= send_control[ control_index ].leaf_bytes_received.size( ) )
+    {
+        return false;
+    }
+
+    // Make sure that we are receiving
+    if ( true == send_control[ control_index ].in_file_transfer && 
+        (FILE *)NULL != send_control[ control_index ].out_file_p )
+    {
+        file_sent_control & this_control = send_control[ control_index ];
+        const uint32_t      leaf_index   = (uint32_t)( this_offset / DIGEST_LEAF_SIZE );
+
+        // The disk writer thread writes the block if the pipeline is
+        // running, else it is written right here
+        if ( true == pipeline_running )
+        {
+            queue_disk_write( this_control.out_file_p, this_data_p, this_byte_size, this_offset );
+        }
+        else
+        {
+            write_file_block( this_control.out_file_p, this_data_p, this_byte_size, this_offset );
+        }
+
+        // Restart the timeout timer
+        arm_transfer_timer( control_index, this_control.timer_class );
+
+        // Flag the fact that we received the data in to a file
+        are_receiving = true;
+
+        // Deduct what we expected to have written from the size of
+        // the file that needs to be sent
+        if ( this_control.to_receive_count >= (uint64_t)orig_block_size )
+        {
+            this_control.to_receive_count -= orig_block_size;
+        }
+
+        // Keep track of how much of the block's leaf has arrived. A
+        // block never straddles two leaves, as was checked above.
+        this_control.leaf_bytes_received[ leaf_index ] += orig_block_size;
+
+        if ( this_control.leaf_bytes_received[ leaf_index ] > leaf_size( this_control, leaf_index ) )
+        {
+            this_control.leaf_bytes_received[ leaf_index ] = leaf_size( this_control, leaf_index );
+        }
+
+        // Did we get the whole file? It is only done once it has been
+        // checked against its digest, which follows the data.
+        if ( 0 == this_control.to_receive_count &&
+            this_control.digest_leaves_received == this_control.leaf_digests.size( ) )
+        {
+            verify_file_transfer( control_index );
+        }
+    }
+
+    // Report whether we received this data in to a file or not
+    return are_receiving;
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Write File Block
+//
+// The block of a file being received passed by argument is written to
+// the file at the offset passed by argument. Writes which fail are
+// tried again a second later, up to MAX_FILE_WRITE_RETRY_COUNT times,
+// after which the rest of the block is given up on; the leaf it is in
+// fails its digest and is asked for again.
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::write_file_block( FILE * out_file_p, const char * this_data_p, int this_byte_size,
+    const uint64_t this_offset )
+{
+    int            write_result    = 0;
+    int            write_try_count = 0;
+    const int      orig_block_size = this_byte_size;
+    const uint64_t write_start     = ClockClass::clock_precise_ns( );
+    uint64_t       write_end       = 0;
+
+    // Position the file to where this block belongs
+    (void)fseeko( out_file_p, (off_t)this_offset, SEEK_SET );
+
+    // Write the data to the file until it's all written
+    // attempting to send the block a maximum of X times
+    while( this_byte_size > 0 && write_try_count < MAX_FILE_WRITE_RETRY_COUNT )
+    {
+        // Attempt to write the whole block
+        write_result = fwrite( this_data_p, 1, this_byte_size, out_file_p );
+
+        // Did we send any data? If we run out of space on
+        // the file system, we want to abandon the effort.
+        if ( write_result > 0 )
+        {
+            // Deduct the bytes sent
+            this_byte_size -= write_result;
+            this_data_p    += write_result;
+
+            // Write was successful so restart the try counter
+            write_try_count = 0;
+        }
+        else
+        {
+            // Possibly a slow file system or out of space so
+            // we delay a second and then incriment our attempt
+            // counter to avoid stalling forever.
+            const uint64_t retry_start = TraceClass::trace_begin( );
+
+            sleep(1);
+
+            TraceClass::trace_end( trace_write_retry, retry_start, this_byte_size );
+
+            write_try_count++;
+
+            MetricsClass::metrics_count( metric_write_retries );
+        }
+    }
+
+    write_end = ClockClass::clock_precise_ns( );
+
+    MetricsClass::metrics_record( metric_block_write_ns, write_end - write_start );
+    TraceClass::trace_span( trace_block_write, write_start, write_end, orig_block_size );
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Receive Digest Frame
+//
+// The sender of a file follows the data with the digests of the file's
+// leaves. The frame must be intact, must come from the device we are
+// receiving a file from, and must describe a file of the size we are
+// receiving. Once every leaf digest is in, and they agree with the
+// root digest, the file gets checked against them.
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::receive_digest_frame( char * this_data_p, int this_byte_size, const char * ip_address_p )
+{
+    file_digest_header digest_header;
+    uint32_t           received_crc  = 0;
+    uint32_t           this_leaf     = 0;
+    int                control_index = CONTROL_NOT_FOUND;
+
+    if ( this_byte_size < (int)sizeof( digest_header ) )
+    {
+        return;
+    }
+
+    (void)memcpy( (char *)&digest_header, this_data_p, sizeof( digest_header ) );
+
+    if ( digest_header.leaf_count > DIGEST_LEAVES_PER_FRAME ||
+        this_byte_size != (int)( sizeof( digest_header ) + digest_header.leaf_count * sizeof( uint64_t ) ) )
+    {
+        return;
+    }
+
+    // The CRC was computed with the CRC field set to zero
+    received_crc               = digest_header.digest_crc;
+    digest_header.digest_crc   = 0;
+
+    (void)memcpy( this_data_p, (char *)&digest_header, sizeof( digest_header ) );
+
+    if ( received_crc != integrity.integrity_crc32c( this_data_p, this_byte_size ) )
+    {
+        return;
+    }
+
+    // See if this transfer from this device is in progress 
+    control_index = find_send_control( ip_address_p, digest_header.transfer_id );
+
+    if ( CONTROL_NOT_FOUND == control_index )
+    {
+        // The whole of a file went by while its offer waited for room,
+        // which would have to be asked for again, so it is refused
+        control_index = find_pending_offer( ip_address_p, digest_header.transfer_id );
+
+        if ( CONTROL_NOT_FOUND != control_index )
+        {
+            refuse_offer( pending_offers[ control_index ].offer_header, ip_address_p, admit_no_room );
+
+            pending_offers.erase( pending_offers.begin( ) + control_index );
+        }
+
+        return;
+    }
+
+    file_sent_control & this_control = send_control[ control_index ];
+
+    // Make sure that the digest is for the file we are receiving
+    if ( false == this_control.in_file_transfer ||
+        digest_header.file_size != this_control.file_size ||
+        digest_header.total_leaves != this_control.leaf_digests.size( ) ||
+        digest_header.first_leaf > digest_header.total_leaves ||
+        digest_header.leaf_count > digest_header.total_leaves - digest_header.first_leaf )
+    {
+        return;
+    }
+
+    this_control.root_digest = digest_header.root_digest;
+
+    // Store the leaf digests we did not already have
+    for ( this_leaf = 0; this_leaf < digest_header.leaf_count; this_leaf++ )
+    {
+        const uint32_t leaf_index = digest_header.first_leaf + this_leaf;
+
+        if ( false == this_control.leaf_digest_known[ leaf_index ] )
+        {
+            (void)memcpy( (char *)&this_control.leaf_digests[ leaf_index ],
+                this_data_p + sizeof( digest_header ) + this_leaf * sizeof( uint64_t ),
+                sizeof( uint64_t ) );
+
+            this_control.leaf_digest_known[ leaf_index ] = true;
+            this_control.digest_leaves_received++;
+        }
+    }
+
+    // Do we have the whole digest?
+    if ( this_control.digest_leaves_received != this_control.leaf_digests.size( ) )
+    {
+        return;
+    }
+
+    // The leaf digests must agree with the root digest
+    if ( integrity.integrity_root_digest( this_control.leaf_digests, this_control.file_size ) !=
+        this_control.root_digest )
+    {
+        (void)printf( "NOTE: The digest of %s from %s is damaged, the file is unverified.\n",
+            this_control.out_file_name, ip_address_p );
+
+        finish_file_transfer( control_index );
+
+        return;
+    }
+
+    // The digest is sent after all of the data so anything that is
+    // still missing now was lost on the way. Check what we have and
+    // ask for what is missing right away.
+    verify_file_transfer( control_index );
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Verify File Transfer
+//
+// The file being received from a device is checked against the digest
+// its sender offered. Only the leaves which have arrived in full and
+// have not matched before are read back, and they are hashed on the
+// verifier thread, on as many cores as the computer has, so that the
+// frames of other transfers keep being handled meanwhile. The check is
+// finished by complete_verification() once transfer_timed_out() finds
+// the verifier is done with it.
+//
+// If a check is already under way nothing more is done; any leaves
+// which arrive meanwhile are checked when it finishes.
+//
+// NOTE: The control entry may be removed from the vector array by this
+// method so the caller must not use the index afterwards.
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::verify_file_transfer( const int control_index )
+{
+    file_sent_control & this_control = send_control[ control_index ];
+    verify_job *        this_job_p   = (verify_job *)NULL;
+    uint32_t            leaf_index   = 0;
+
+    if ( (verify_job *)NULL != this_control.verify_p )
+    {
+        return;
+    }
+
+    // Make sure that everything we wrote may be read back
+    wait_for_disk_writes( );
+
+    (void)fflush( this_control.out_file_p );
+
+    this_job_p = new verify_job;
+
+    this_job_p->file_handle = fileno( this_control.out_file_p );
+    this_job_p->file_size   = this_control.file_size;
+    this_job_p->read_ok     = true;
+    this_job_p->trace_start = TraceClass::trace_begin( );
+    this_job_p->job_done.store( false, std::memory_order_relaxed );
+
+    // A leaf which is still missing bytes is bad without reading it
+    for ( leaf_index = 0; leaf_index < this_control.leaf_digests.size( ); leaf_index++ )
+    {
+        if ( false == this_control.leaf_verified[ leaf_index ] &&
+            this_control.leaf_bytes_received[ leaf_index ] == leaf_size( this_control, leaf_index ) )
+        {
+            this_job_p->hash_leaves.push_back( leaf_index );
+        }
+    }
+
+    // With nothing to read back the check is finished right here
+    if ( true == this_job_p->hash_leaves.empty( ) )
+    {
+        this_job_p->job_done.store( true, std::memory_order_relaxed );
+
+        complete_verification( control_index, *this_job_p );
+
+        delete this_job_p;
+
+        return;
+    }
+
+    if ( false == verifier.joinable( ) )
+    {
+        verifier = std::thread( &ChatClass::verifier_thread, this );
+    }
+
+    {
+        std::lock_guard<std::mutex> verify_guard( verify_lock );
+
+        verify_queue.push_back( this_job_p );
+    }
+
+    verify_wake.notify_one( );
+
+    this_control.verify_p = this_job_p;
+
+    verifying_keys.push_back( this_control.control_key );
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Complete Verification
+//
+// The leaves the verifier hashed for the file being received passed by
+// argument are compared with its digest, and those which match are
+// never read again. If every leaf has matched the file is complete and
+// gets closed. If leaves arrived in full while the check was under way
+// they are checked in turn before anything is asked for.
+//
+// If leaves are bad, contiguous runs of them are asked for again with
+// repair requests, up to MAX_REPAIR_ATTEMPTS times, after which we give
+// up on the file.
+//
+// NOTE: The control entry may be removed from the vector array by this
+// method so the caller must not use the index afterwards.
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::complete_verification( const int control_index, verify_job & this_job )
+{
+    file_sent_control & this_control = send_control[ control_index ];
+    std::vector<bool>   leaf_bad( this_control.leaf_digests.size( ), false );
+    std::vector<bool>   leaf_hashed( this_control.leaf_digests.size( ), false );
+    uint32_t            bad_count    = 0;
+    uint32_t            range_count  = 0;
+    uint32_t            leaf_index   = 0;
+    bool                check_again  = false;
+
+    TraceClass::trace_end( trace_verify, this_job.trace_start, this_job.hash_leaves.size( ) );
+
+    for ( leaf_index = 0; leaf_index < this_job.hash_leaves.size( ); leaf_index++ )
+    {
+        const uint32_t this_leaf = this_job.hash_leaves[ leaf_index ];
+
+        leaf_hashed[ this_leaf ] = true;
+
+        // If we could not read the file back none of it has matched
+        if ( true == this_job.read_ok &&
+            this_job.leaf_digests[ this_leaf ] == this_control.leaf_digests[ this_leaf ] )
+        {
+            this_control.leaf_verified[ this_leaf ] = true;
+        }
+    }
+
+    for ( leaf_index = 0; leaf_index < leaf_bad.size( ); leaf_index++ )
+    {
+        if ( true == this_control.leaf_verified[ leaf_index ] )
+        {
+            continue;
+        }
+
+        if ( false == leaf_hashed[ leaf_index ] &&
+            this_control.leaf_bytes_received[ leaf_index ] == leaf_size( this_control, leaf_index ) )
+        {
+            check_again = true;
+        }
+
+        leaf_bad[ leaf_index ] = true;
+        bad_count++;
+    }
+
+    // Leaves came in while we were checking so they are checked too
+    if ( true == check_again )
+    {
+        verify_file_transfer( control_index );
+
+        return;
+    }
+
+    // Did the whole file arrive intact?
+    if ( 0 == bad_count )
+    {
+        (void)printf( "File %s verified, %llu bytes\n", this_control.out_file_name,
+            (unsigned long long)this_control.file_size );
+
+        MetricsClass::metrics_count( metric_transfers_completed );
+        MetricsClass::metrics_record( metric_transfer_ms,
+            ( ClockClass::clock_precise_ns( ) - this_control.started_ns ) / 1000000ULL );
+
+        finish_file_transfer( control_index );
+
+        return;
+    }
+
+    // Have we asked for the file to be repaired too many times?
+    if ( this_control.repair_attempts >= MAX_REPAIR_ATTEMPTS )
+    {
+        (void)printf( "NOTE: Inbound file %s failed verification, %u leaves are bad.\n",
+            this_control.out_file_name, bad_count );
+
+        MetricsClass::metrics_count( metric_transfers_failed );
+
+        finish_file_transfer( control_index );
+
+        return;
+    }
+
+    this_control.repair_attempts++;
+
+    (void)printf( "NOTE: Requesting %u damaged leaves of %s again\n", bad_count, this_control.out_file_name );
+
+    // Ask for every run of bad leaves, as many runs as we may ask for
+    // at once. Runs beyond that are found again by the next check.
+    leaf_index = 0;
+
+    while ( leaf_index < leaf_bad.size( ) && range_count < MAX_REPAIR_RANGES )
+    {
+        file_repair_request repair_request;
+        uint32_t            first_leaf = 0;
+
+        if ( false == leaf_bad[ leaf_index ] )
+        {
+            leaf_index++;
+
+            continue;
+        }
+
+        first_leaf = leaf_index;
+
+        // The leaves we ask for are received again from the start
+        while ( leaf_index < leaf_bad.size( ) && true == leaf_bad[ leaf_index ] )
+        {
+            this_control.leaf_bytes_received[ leaf_index ] = 0;
+
+            leaf_index++;
+        }
+
+        (void)memset( (char *)&repair_request, ASCII_NULL_ZERO, sizeof( repair_request ) );
+        (void)strcpy( repair_request.repair_command, ":rpar:" );
+
+        repair_request.first_leaf  = first_leaf;
+        repair_request.leaf_count  = leaf_index - first_leaf;
+        repair_request.root_digest = this_control.root_digest;
+        repair_request.transfer_id = this_control.transfer_id;
+        repair_request.repair_crc  = integrity.integrity_crc32c( (char *)&repair_request, sizeof( repair_request ) );
+
+        send_data( (char *)&repair_request, sizeof( repair_request ) );
+
+        range_count++;
+    }
+
+    // Work out how much is still to come
+    this_control.to_receive_count = 0;
+
+    for ( leaf_index = 0; leaf_index < leaf_bad.size( ); leaf_index++ )
+    {
+        this_control.to_receive_count += leaf_size( this_control, leaf_index ) -
+            this_control.leaf_bytes_received[ leaf_index ];
+    }
+
+    // Restart the timeout timer, for as long as repairs are given
+    arm_transfer_timer( control_index, transfer_class_repair );
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Service Verifications
+//
+// The checks the verifier has finished are completed. The files being
+// checked are found again by their keys since completing one may move
+// others about in the vector array.
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::service_verifications( void )
+{
+    size_t key_index = 0;
+
+    while ( key_index < verifying_keys.size( ) )
+    {
+        std::unordered_map<uint64_t, int>::const_iterator this_entry =
+            send_control_index.find( verifying_keys[ key_index ] );
+        verify_job * this_job_p    = (verify_job *)NULL;
+        int          control_index = CONTROL_NOT_FOUND;
+
+        if ( send_control_index.end( ) == this_entry )
+        {
+            verifying_keys.erase( verifying_keys.begin( ) + key_index );
+
+            continue;
+        }
+
+        control_index = this_entry->second;
+        this_job_p    = send_control[ control_index ].verify_p;
+
+        if ( (verify_job *)NULL == this_job_p || false == this_job_p->job_done.load( std::memory_order_acquire ) )
+        {
+            key_index++;
+
+            continue;
+        }
+
+        send_control[ control_index ].verify_p = (verify_job *)NULL;
+
+        verifying_keys.erase( verifying_keys.begin( ) + key_index );
+
+        complete_verification( control_index, *this_job_p );
+
+        delete this_job_p;
+    }
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Cancel Verification
+//
+// The check of the file being received passed by argument is given up
+// on so that the file may be closed. A check the verifier has not
+// started is taken off its queue, else we wait for the verifier to
+// finish it.
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::cancel_verification( file_sent_control & this_control )
+{
+    size_t job_index = 0;
+    size_t key_index = 0;
+
+    if ( (verify_job *)NULL == this_control.verify_p )
+    {
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> verify_guard( verify_lock );
+
+        for ( job_index = 0; job_index < verify_queue.size( ); job_index++ )
+        {
+            if ( verify_queue[ job_index ] == this_control.verify_p )
+            {
+                verify_queue.erase( verify_queue.begin( ) + job_index );
+
+                this_control.verify_p->job_done.store( true, std::memory_order_relaxed );
+
+                break;
+            }
+        }
+
+        while ( false == this_control.verify_p->job_done.load( std::memory_order_acquire ) )
+        {
+            verify_finished.wait( verify_guard );
+        }
+    }
+
+    for ( key_index = 0; key_index < verifying_keys.size( ); key_index++ )
+    {
+        if ( verifying_keys[ key_index ] == this_control.control_key )
+        {
+            verifying_keys.erase( verifying_keys.begin( ) + key_index );
+
+            break;
+        }
+    }
+
+    delete this_control.verify_p;
+
+    this_control.verify_p = (verify_job *)NULL;
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Verifier Thread
+//
+// Hashes the leaves of the files queued for it in the order they were
+// queued, flagging each job done when it is finished, and waits for
+// more when it runs out. Nothing else of the class is touched here.
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::verifier_thread( void )
+{
+    std::unique_lock<std::mutex> verify_guard( verify_lock );
+    verify_job *                 this_job_p = (verify_job *)NULL;
+
+    while ( true )
+    {
+        while ( true == verify_queue.empty( ) && false == stop_verifier )
+        {
+            verify_wake.wait( verify_guard );
+        }
+
+        if ( true == verify_queue.empty( ) )
+        {
+            break;
+        }
+
+        this_job_p = verify_queue.front( );
+
+        verify_queue.pop_front( );
+
+        verify_guard.unlock( );
+
+        this_job_p->read_ok = integrity.integrity_digest_leaves( this_job_p->file_handle,
+            this_job_p->file_size, this_job_p->hash_leaves, this_job_p->leaf_digests );
+
+        verify_guard.lock( );
+
+        this_job_p->job_done.store( true, std::memory_order_release );
+
+        verify_finished.notify_all( );
+    }
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Finish File Transfer
+//
+// The file being received from a device is closed and its entry gets
+// removed from the vector array.
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::finish_file_transfer( const int control_index )
+{
+    TraceClass::trace_span( trace_transfer_in, send_control[ control_index ].started_ns,
+        ClockClass::clock_precise_ns( ), trace_id( send_control[ control_index ] ) );
+
+    if ( (FILE *)NULL != send_control[ control_index ].out_file_p )
+    {
+        wait_for_disk_writes( );
+
+        close_inbound_file( send_control[ control_index ] );
+    }
+
+    remove_send_control( control_index );
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Leaf Size
+//
+// Returns: The number of bytes in a leaf of the file being received,
+// which is the leaf size for every leaf but the last.
+//
+// ----------------------------------------------------------------------
+
+uint32_t ChatClass::leaf_size( const file_sent_control & this_control, const uint32_t leaf_index )
+{
+    const uint64_t leaf_start = (uint64_t)leaf_index * DIGEST_LEAF_SIZE;
+
+    if ( this_control.file_size - leaf_start < DIGEST_LEAF_SIZE )
+    {
+        return (uint32_t)( this_control.file_size - leaf_start );
+    }
+
+    return DIGEST_LEAF_SIZE;
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Transfer Timed Out
+//
+// Checks to see if a file transfer "send" request has timed out. The
+// timer of a transfer is started again every time a UDP block comes
+// in for it, so once it runs out nothing has arrived for as long as
+// its class allows, 10 seconds unless set otherwise, and the transfer
+// can be assumed to have failed. Only the slots of the timer wheel
+// which came due since we were last called are looked at.
+//
+// Offers which are waiting for room are given it here, if there is
+// any, or refused if they have waited too long.
+//
+// The calling of this method is optional. Since UDP is not promised
+// delivery, it is a good idea to call this method every now and then
+// to see if a file transfer has timed out. If the process using this
+// class does not perform file transfers, there is no reason to call
+// this method.
+//
+// ----------------------------------------------------------------------
+
+bool ChatClass::transfer_timed_out( void )
+{
+    const uint64_t current_tick  = wheel_tick_now( );
+    const size_t   table_size    = send_control.size( );
+    const uint64_t trace_start   = 0 == table_size ? 0 : TraceClass::trace_begin( );
+    uint64_t       this_tick     = timer_wheel_tick + 1;
+    int            this_index    = TIMER_NOT_LINKED;
+    size_t         expired_index = 0;
+    bool           any_timeouts  = false;
+
+    // Finish the checks of any files the verifier is done with
+    if ( false == verifying_keys.empty( ) )
+    {
+        service_verifications( );
+    }
+
+    // After a long wait every slot is looked at once
+    if ( current_tick - timer_wheel_tick > TRANSFER_WHEEL_SLOTS )
+    {
+        this_tick = current_tick - TRANSFER_WHEEL_SLOTS + 1;
+    }
+
+    for ( ; this_tick <= current_tick; this_tick++ )
+    {
+        // Find the transfers in the slot whose timers have run out;
+        // those further away than the wheel goes round are left alone.
+        // They are found again by their keys since handling one may
+        // move others about in the vector array.
+        expired_keys.clear( );
+
+        for ( this_index = timer_wheel[ this_tick & ( TRANSFER_WHEEL_SLOTS - 1 ) ];
+              TIMER_NOT_LINKED != this_index;
+              this_index = send_control[ this_index ].timer_next )
+        {
+            if ( send_control[ this_index ].timer_deadline <= current_tick )
+            {
+                expired_keys.push_back( send_control[ this_index ].control_key );
+            }
+        }
+
+        for ( expired_index = 0; expired_index < expired_keys.size( ); expired_index++ )
+        {
+            std::unordered_map<uint64_t, int>::const_iterator this_entry =
+                send_control_index.find( expired_keys[ expired_index ] );
+
+            if ( send_control_index.end( ) != this_entry && true == expire_transfer( this_entry->second ) )
+            {
+                any_timeouts = true;
+            }
+        }
+    }
+
+    timer_wheel_tick = current_tick;
+
+    TraceClass::trace_end( trace_timeouts, trace_start, table_size );
+
+    if ( false == pending_offers.empty( ) )
+    {
+        service_pending_offers( );
+    }
+
+    // Report on whether any file transfers timed out
+    return any_timeouts;
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Expire Transfer
+//
+// The timer of the file being received passed by argument has run out.
+// If the digest arrived then the sender is finished and whatever is
+// still missing was lost, so the file is checked and the missing
+// leaves asked for again, or given up on if we already asked too many
+// times. Otherwise the transfer has failed and is removed.
+//
+// NOTE: The control entry may be removed from the vector array by this
+// method so the caller must not use the index afterwards.
+//
+// Returns: true if the transfer timed out and was removed
+//
+// ----------------------------------------------------------------------
+
+bool ChatClass::expire_transfer( const int control_index )
+{
+    file_sent_control & this_control = send_control[ control_index ];
+
+    stop_transfer_timer( control_index );
+
+    if ( this_control.digest_leaves_received == this_control.leaf_digests.size( ) )
+    {
+        verify_file_transfer( control_index );
+
+        return false;
+    }
+
+    if ( (FILE *)NULL != this_control.out_file_p )
+    {
+        // Close the output file once nothing is left to be written to it
+        wait_for_disk_writes( );
+
+        close_inbound_file( this_control );
+
+        if ( 0 == this_control.to_receive_count )
+        {
+            (void)printf( "NOTE: Inbound file %s arrived but its digest did not, it is unverified.\n",
+                this_control.out_file_name );
+        }
+        else
+        {
+            (void)printf("NOTE: Inbound file transfer timed out, %d damaged blocks dropped.\n",
+                this_control.dropped_block_count );
+        }
+    }
+
+    // Flag the fact that we are no longer receiving a file
+    this_control.in_file_transfer = false;
+
+    MetricsClass::metrics_count( metric_transfers_timed_out );
+    TraceClass::trace_span( trace_transfer_in, this_control.started_ns,
+        ClockClass::clock_precise_ns( ), trace_id( this_control ) );
+
+    // Remove this entry from the vector array
+    remove_send_control( control_index );
+
+    return true;
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Set Transfer Timeout
+//
+// Sets how many milliseconds a file being received in the class passed
+// by argument may go without anything arriving for it before it is
+// given up on. Timers already running keep the time they were given.
+// Receive shards take the timeouts their owner has when the pipeline
+// is started, so they must be set before then.
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::set_transfer_timeout( const transfer_class this_class, const uint32_t timeout_ms )
+{
+    if ( this_class >= transfer_class_data && this_class < TRANSFER_CLASSES )
+    {
+        transfer_timeout_ms[ this_class ] = timeout_ms;
+    }
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Set Admission Limits
+//
+// Sets how many files may be received at once, how many bytes may be
+// set aside for them, and how many files may be held open for them.
+// The last is held to what Linux lets us open less a few spare. Files
+// already being received are not affected. Receive shards are counted
+// against their owner's limits, which should be set before the
+// pipeline is started.
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::set_admission_limits( const uint32_t max_transfers, const uint64_t max_reserved_bytes,
+    const uint32_t max_open_files )
+{
+    struct rlimit file_limit;
+
+    admission_p->max_transfers      = max_transfers;
+    admission_p->max_reserved_bytes = max_reserved_bytes;
+    admission_p->max_open_files     = max_open_files;
+
+    if ( 0 == getrlimit( RLIMIT_NOFILE, &file_limit ) && RLIM_INFINITY != file_limit.rlim_cur &&
+        file_limit.rlim_cur < (rlim_t)max_open_files + ADMIT_SPARE_DESCRIPTORS )
+    {
+        admission_p->max_open_files = file_limit.rlim_cur > ADMIT_SPARE_DESCRIPTORS ?
+            (uint32_t)( file_limit.rlim_cur - ADMIT_SPARE_DESCRIPTORS ) : 0;
+    }
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Admission Usage
 //
-// When the operator wants to send a file broadcast to all receivers,
-// this method is called. It extracts the path and file name from the
-// console input and builds a file transfer header after verifying that
-// the file to send exists, then it sends the file transfer header
-// block to all receivers.
+// Returns: How many files are being received, how many bytes are set
+// aside for them and how many of their files are open, counting every
+// receive shard, and how many offers are waiting for room here
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::admission_usage( uint32_t & transfers, uint64_t & reserved_bytes, uint32_t & open_files,
+    size_t & queued_offers )
+{
+    transfers      = admission_p->transfers.load( );
+    reserved_bytes = admission_p->reserved_bytes.load( );
+    open_files     = admission_p->open_files.load( );
+    queued_offers  = pending_offers.size( );
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Arm Transfer Timer
 //
-// The data in the file gets extracted and gets transmitted via UDP
-// in blocks until all data gets sent. Because the sending method
-// checks the Layer 2 and 3 queue, though we may flood the Ethernet
-// interface, we should not lose data (keeping in mind that UDP is not
-// assured delivery.)
+// Starts the timer of the file being received passed by argument again,
+// with the timeout of the class passed by argument. A timer which runs
+// out in the same slot as before simply has its tick changed.
 //
-// Note that this method also gets invoked if we receive a get request
-// from a remote system. A flag indicats which it was, either an
-// unsolicited send request from an operator on this system, or a get
-// file request from a remote system.
+// ----------------------------------------------------------------------
+
+void ChatClass::arm_transfer_timer( const int control_index, const transfer_class this_class )
+{
+    file_sent_control & this_control  = send_control[ control_index ];
+    uint64_t            this_deadline = 0;
+
+    this_deadline = wheel_tick_now( ) +
+        ( transfer_timeout_ms[ this_class ] + TRANSFER_WHEEL_TICK_MS - 1 ) / TRANSFER_WHEEL_TICK_MS;
+
+    this_control.timer_class = this_class;
+
+    if ( 0 != this_control.timer_deadline &&
+        0 == ( ( this_control.timer_deadline ^ this_deadline ) & ( TRANSFER_WHEEL_SLOTS - 1 ) ) )
+    {
+        this_control.timer_deadline = this_deadline;
+
+        return;
+    }
+
+    stop_transfer_timer( control_index );
+
+    link_transfer_timer( control_index, this_deadline );
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Link Transfer Timer
+//
+// The stopped timer of the file being received passed by argument is
+// set to run out at the tick passed by argument and is put at the head
+// of that tick's slot.
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::link_transfer_timer( const int control_index, const uint64_t this_deadline )
+{
+    file_sent_control & this_control = send_control[ control_index ];
+    int &               slot_head    = timer_wheel[ this_deadline & ( TRANSFER_WHEEL_SLOTS - 1 ) ];
+
+    this_control.timer_deadline = this_deadline;
+    this_control.timer_prev     = TIMER_NOT_LINKED;
+    this_control.timer_next     = slot_head;
+
+    if ( TIMER_NOT_LINKED != slot_head )
+    {
+        send_control[ slot_head ].timer_prev = control_index;
+    }
+
+    slot_head = control_index;
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Stop Transfer Timer
+//
+// The timer of the file being received passed by argument is taken off
+// of the wheel, if it was running.
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::stop_transfer_timer( const int control_index )
+{
+    file_sent_control & this_control = send_control[ control_index ];
+
+    if ( 0 == this_control.timer_deadline )
+    {
+        return;
+    }
+
+    if ( TIMER_NOT_LINKED != this_control.timer_prev )
+    {
+        send_control[ this_control.timer_prev ].timer_next = this_control.timer_next;
+    }
+    else
+    {
+        timer_wheel[ this_control.timer_deadline & ( TRANSFER_WHEEL_SLOTS - 1 ) ] = this_control.timer_next;
+    }
+
+    if ( TIMER_NOT_LINKED != this_control.timer_next )
+    {
+        send_control[ this_control.timer_next ].timer_prev = this_control.timer_prev;
+    }
+
+    this_control.timer_deadline = 0;
+    this_control.timer_next     = TIMER_NOT_LINKED;
+    this_control.timer_prev     = TIMER_NOT_LINKED;
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Wheel Tick Now
+//
+// Returns: The current tick of the timer wheels, from the cached
+// monotonic clock
+//
+// ----------------------------------------------------------------------
+
+uint64_t ChatClass::wheel_tick_now( void )
+{
+    return ClockClass::clock_monotonic_ns( ) / ( TRANSFER_WHEEL_TICK_MS * 1000000ULL );
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Get File
+//
+// The operator is reqesting that all listeners who have the file 
+// located in the requested directory with the requested file name send
+// it the contents of that file.
+//
+// This method builds a file transfer header requesting the file and
+// sends it as a UDP frame.
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::get_file( char * path_and_name_p )
+{
+    file_transfer_header file_header;
+
+    // Discard leading white space, if any
+    skipspace( path_and_name_p );
+
+    // Remove trailing endline characters if any
+    while( path_and_name_p[ strlen( path_and_name_p ) - 1] == ASCII_CARRIAGE_RETURN ||
+           path_and_name_p[ strlen( path_and_name_p ) - 1] == ASCII_LINE_FEED )
+    {
+        path_and_name_p[ strlen( path_and_name_p ) - 1 ] = ASCII_NULL_ZERO;
+    }
+
+    // Plug the file transfer header starting with all zeros
+    (void)memset( (char *)&file_header, ASCII_NULL_ZERO, sizeof ( file_header ) );
+
+    // Note the fact that this is a file transfer frame
+    (void)strcpy(file_header.header_command, ":xfer:");
+
+    // Note the number of bytes expected in the file is zero so far
+    file_header.file_size = 0;
+
+    // Flag the fact that this is a get
+    file_header.trans_type = trans_type_get_request;
+ 
+    // Copy the path and file name in to the header
+    (void)memcpy( file_header.file_name, path_and_name_p, 
+        sizeof( file_header.file_name ) - 1 );
+
+    // Send the header data to request the file
+    send_data( ( char *)&file_header, sizeof( file_header ) );
+
+    // Indicate the fact that we requested the file
+    (void)printf( "\nFile [%s] was requested\n", path_and_name_p );
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Get File Request
+//
+// The path and file name provided in a get file request is examined to 
+// see if the file exists on this system, and if it does a response is
+// created and the file is sent using the "send" file transfer 
+// functionality. 
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::get_file_request( const char * this_data_p )
+{
+    file_transfer_header file_header;
+
+    // Plug the file transfer header starting with all zeros
+    (void)memset( (char *)&file_header, ASCII_NULL_ZERO, sizeof ( file_header ) );
+
+    // Extract the data in to the data structure
+    (void)memcpy( (char *)&file_header, this_data_p, sizeof( file_header ) );
+
+    // The name came from the network so make sure that it ends
+    file_header.file_name[ sizeof( file_header.file_name ) - 1 ] = ASCII_NULL_ZERO;
+
+    // We received a get file request. In order to handle it we
+    // treat the request as if an operator performed a send file
+    // request though we pass the method a flag indicating that 
+    // it was a get rather than an unsolicited send.
+    send_file( file_header.file_name, true );
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Find Send Control
+//
+// Looks up the entry in the vector array of send controls with an IP
+// address and a transfer ID that match those passed to the method by
+// argument, and if it is found, returns the index in to the vector
+// array, otherwise if the entry is not found returns -1 to indicate
+// that the entry does not exist.
+//
+// ----------------------------------------------------------------------
+
+int ChatClass::find_send_control( const char * ip_address_p, const uint32_t transfer_id )
+{
+    std::unordered_map<uint64_t, int>::const_iterator this_entry =
+        send_control_index.find( send_control_key( ip_address_p, transfer_id ) );
+
+    if ( send_control_index.end( ) == this_entry )
+    {
+        // Indicate that an entry for the IP address device does not exist
+        return CONTROL_NOT_FOUND;
+    }
+
+    // Report the index of the existing device
+    return this_entry->second;
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Add Send Control
+//
+// The control entry passed by argument is appended to the vector array
+// with its timer stopped, and may be found from then on.
+//
+// Returns: The index of the entry in the vector array
+//
+// ----------------------------------------------------------------------
+
+int ChatClass::add_send_control( const file_sent_control & this_control )
+{
+    const int control_index = (int)send_control.size( );
+
+    send_control.push_back( this_control );
+
+    file_sent_control & new_control = send_control[ control_index ];
+
+    new_control.control_key    = send_control_key( new_control.ip_address, new_control.transfer_id );
+    new_control.timer_deadline = 0;
+    new_control.timer_next     = TIMER_NOT_LINKED;
+    new_control.timer_prev     = TIMER_NOT_LINKED;
+    new_control.timer_class    = transfer_class_data;
+
+    send_control_index[ new_control.control_key ] = control_index;
+
+    return control_index;
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Remove Send Control
+//
+// The control entry passed by argument is removed from the vector array
+// along with its timer. The last entry is moved in to its place so that
+// nothing else moves.
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::remove_send_control( const int control_index )
+{
+    const int last_index    = (int)send_control.size( ) - 1;
+    uint64_t  last_deadline = 0;
+
+    stop_transfer_timer( control_index );
+
+    release_transfer( send_control[ control_index ].file_size, false );
+
+    (void)send_control_index.erase( send_control[ control_index ].control_key );
+
+    if ( control_index != last_index )
+    {
+        last_deadline = send_control[ last_index ].timer_deadline;
+
+        stop_transfer_timer( last_index );
+
+        send_control[ control_index ] = std::move( send_control[ last_index ] );
+
+        send_control_index[ send_control[ control_index ].control_key ] = control_index;
+
+        if ( 0 != last_deadline )
+        {
+            link_transfer_timer( control_index, last_deadline );
+        }
+    }
+
+    send_control.pop_back( );
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Send Control Key
+//
+// Returns: What a file being received is found by, the sender's IPv4
+// address above the sender's ID for the transfer
+//
+// ----------------------------------------------------------------------
+
+uint64_t ChatClass::send_control_key( const char * ip_address_p, const uint32_t transfer_id )
+{
+    return ( (uint64_t)ntohl( inet_addr( ip_address_p ) ) << 32 ) | transfer_id;
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Pipeline Start
+//
+// Starts the receive, disk writer and transmit threads. From now on
+// read_data() takes frames from the receive thread, the blocks of
+// files being received are written by the disk writer thread, and the
+// files being sent are sent by the transmit thread, which takes over
+// any that service_transfers() was sending.
+//
+// If more than one receive shard is asked for, the shards beyond the
+// first are opened as well, up to MAX_RECEIVE_SHARDS. If they can not
+// all be opened the pipeline runs without them.
+//
+// Returns: true if the pipeline is running
+//
+// ----------------------------------------------------------------------
+
+bool ChatClass::pipeline_start( const int receive_shards )
+{
+    int this_shard = 0;
+
+    if ( true == pipeline_running || receive_socket == HANDLE_NOT_VALID )
+    {
+        return pipeline_running;
+    }
+
+    // The receive thread tells wait_for_input() that frames are queued
+    if ( ( pipeline_event = eventfd( 0, EFD_NONBLOCK ) ) < 0 )
+    {
+        (void)printf("I was unable to start the pipeline threads: %s\n", strerror( errno ) );
+
+        pipeline_event = HANDLE_NOT_VALID;
+
+        return false;
+    }
+
+    receive_queue_p   = new SpscQueueClass<pooled_frame *, RECEIVE_QUEUE_SLOTS>;
+    disk_queue_p      = new SpscQueueClass<disk_write, DISK_QUEUE_SLOTS>;
+    transmit_queue_p  = new SpscQueueClass<outbound_transfer, TRANSMIT_QUEUE_SLOTS>;
+    sent_file_queue_p = new SpscQueueClass<sent_file_record, SENT_FILE_QUEUE_SLOTS>;
+
+    stop_pipeline    = false;
+    pipeline_running = true;
+
+    if ( receive_shards > 1 )
+    {
+        (void)start_receive_shards( receive_shards );
+    }
+
+    // Enough frames for every queue and batch a frame may wait in
+    size_frame_pool( RECEIVE_QUEUE_SLOTS + RECEIVE_BATCH_FRAMES + DISK_QUEUE_SLOTS + FRAME_POOL_SPARE_FRAMES +
+        ( shard_count - 1 ) * ( SHARD_QUEUE_SLOTS + RECEIVE_BATCH_FRAMES ) );
+
+    receiver    = std::thread( &ChatClass::receive_thread, this );
+    disk_writer = std::thread( &ChatClass::disk_writer_thread, this );
+    transmitter = std::thread( &ChatClass::transmit_thread, this );
+
+    for ( this_shard = 1; this_shard < shard_count; this_shard++ )
+    {
+        shard_worker[ this_shard ] = std::thread( &ChatClass::shard_thread, this, this_shard );
+    }
+
+    return true;
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Pipeline Stop
+//
+// Stops the pipeline threads once the disk writer has written every
+// block queued for it. Frames the receive thread took in which were not
+// read are dropped. Files the transmit thread was sending are left for
+// service_transfers() to finish. Receive shards are closed, along with
+// any files they were part way through receiving.
 //
 // ----------------------------------------------------------------------
 
-void ChatClass::send_file( char * path_and_name_p, const bool response_to_get_request )
-{
-    char                   outbound_data[ MAX_OUT_DATA_SIZE ] = { 0 };
-    int                    out_count                          = 0;
-    int                    stat_result                        = 0;
-    int                    block_size                         = 0;
-    int                    read_size                          = 0;
-    char                 * file_name_p                        = (char *)NULL;
-    file_transfer_header   file_header;
-    struct stat            our_status;
+void ChatClass::pipeline_stop( void )
+{
+    outbound_transfer this_transfer;
+    sent_file_record  this_record;
+    pooled_frame    * this_frame_p = (pooled_frame *)NULL;
+    int               this_shard   = 0;
+
+    if ( false == pipeline_running )
+    {
+        return;
+    }
+
+    stop_pipeline = true;
+
+    {
+        std::lock_guard<std::mutex> pipeline_guard( pipeline_lock );
 
-    // Discard leading white space, if any
-    skipspace( path_and_name_p );
+        disk_wake.notify_one( );
+        transmit_wake.notify_one( );
+    }
 
-    // Remove trailing endline characters if any
-    while( path_and_name_p[ strlen( path_and_name_p ) - 1] == ASCII_CARRIAGE_RETURN ||
-           path_and_name_p[ strlen( path_and_name_p ) - 1] == ASCII_LINE_FEED )
+    receiver.join( );
+    disk_writer.join( );
+    transmitter.join( );
+
+    for ( this_shard = 1; this_shard < shard_count; this_shard++ )
     {
-        path_and_name_p[ strlen( path_and_name_p ) - 1 ] = ASCII_NULL_ZERO;
+        shard_worker[ this_shard ].join( );
     }
 
-    // See if the file offered exists
-    if (0 == ( stat_result = stat( path_and_name_p, &our_status ) ) )
+    // Frames which were taken in and not read go back to the pool
+    while ( true == receive_queue_p->spsc_pop( this_frame_p ) )
     {
-        // The file may exist, we attempt to open for reading in
-        // binary mode
-        FILE * in_file_p = fopen( path_and_name_p, "rb" );
+        frame_pool_p->frame_release( this_frame_p );
+    }
 
-        if ( (FILE *)NULL != in_file_p )
+    for ( this_shard = 1; this_shard < shard_count; this_shard++ )
+    {
+        while ( true == shard_queue_p[ this_shard ]->spsc_pop( this_frame_p ) )
         {
-            // Store the size of the file
-            out_count = our_status.st_size;
-
-            // Plug the file transfer header
-            (void)memset( (char *)&file_header, ASCII_NULL_ZERO, sizeof ( file_header ) );
+            frame_pool_p->frame_release( this_frame_p );
+        }
+    }
 
-            // Note the fact that this is a file transfer frame
-            (void)strcpy(file_header.header_command, ":xfer:");
+    stop_receive_shards( );
 
-            // Note the number of bytes expected in the file
-            file_header.file_size = out_count;
+    pipeline_running = false;
 
-            // Flag the fact that this is a send
-            file_header.trans_type = trans_type_send;
+    // Transfers the transmit thread never took on are sent from here now
+    while ( true == transmit_queue_p->spsc_pop( this_transfer ) )
+    {
+        send_tasks.push_back( this_transfer );
+    }
 
-            // Do we have any path information?
-            file_name_p = strrchr( path_and_name_p, '/' );
- 
-            if ( (char *)NULL != file_name_p )  
-            {
-                // There appears to be a delimiter so point past it
-                file_name_p++;
-            }
-            else
-            {
-                // There does not appear to be path information
-                file_name_p = path_and_name_p;
-            }
+    while ( true == sent_file_queue_p->spsc_pop( this_record ) )
+    {
+        remember_sent_file( this_record.path_and_name, this_record.file_size, this_record.root_digest );
+    }
 
-            // Copy the file name in to the header
-            (void)memcpy( file_header.file_name, file_name_p, 
-                sizeof( file_header.file_name ) - 1 );
+    delete receive_queue_p;
+    delete disk_queue_p;
+    delete transmit_queue_p;
+    delete sent_file_queue_p;
 
-            // Send the header data to alert receivers that inbound 
-            // data is coming and that it should be assembled in to a file
-            send_data( ( char *)&file_header, sizeof( file_header ) );
+    receive_queue_p   = (SpscQueueClass<pooled_frame *, RECEIVE_QUEUE_SLOTS> *)NULL;
+    disk_queue_p      = (SpscQueueClass<disk_write, DISK_QUEUE_SLOTS> *)NULL;
+    transmit_queue_p  = (SpscQueueClass<outbound_transfer, TRANSMIT_QUEUE_SLOTS> *)NULL;
+    sent_file_queue_p = (SpscQueueClass<sent_file_record, SENT_FILE_QUEUE_SLOTS> *)NULL;
 
-            (void)printf("Sending %s of %d bytes\n", 
-                file_name_p, file_header.file_size );
+    (void)close( pipeline_event );
 
-            // Go through the inbound file and break it up in to smaller
-            // pieces, reading blocks and sending them one by one until
-            // the entire file has been sent.
-            while( out_count > 0 )
-            {
-                // Compute the size of the block of data to send
-                if ( out_count > sizeof( outbound_data ) )
-                {
-                    block_size = sizeof( outbound_data );
-                }
-                else
-                {
-                    block_size = out_count;
-                }
+    pipeline_event = HANDLE_NOT_VALID;
 
-                // Read the next block of data to send    
-                read_size = fread( outbound_data, 1, block_size, in_file_p );
+    // Back to a frame at a time
+    size_frame_pool( FRAME_POOL_IDLE_FRAMES );
+}
 
-                // Send the data that was read
-                send_data( outbound_data, read_size );
- 
-                // Deduct the size we asked to be sent from the
-                // overall size of the file to be sent
-                out_count -= block_size;
-            }
+// ----------------------------------------------------------------------
+// ChatClass Size Frame Pool
+//
+// Replaces the frame buffers with a pool of as many frames as passed by
+// argument, or with none at all if that is 0. The frame read_data()
+// last returned is let go of; nothing else may be holding a frame.
+//
+// ----------------------------------------------------------------------
 
-            // We are finished with the transfer and the inbound file
-            (void)fclose( in_file_p );
+void ChatClass::size_frame_pool( const uint32_t frame_count )
+{
+    if ( (FramePoolClass *)NULL != frame_pool_p )
+    {
+        frame_pool_p->frame_release( held_frame_p );
 
-            // The file transfer was completed
-            return;
-        }
+        delete frame_pool_p;
     }
 
-    // Was this an unsolicited send file request?
-    if ( false == response_to_get_request ) 
-    {   
-        // It was not a get file request.
-        // We did not send a file so report the fact
-        (void)printf( "\nFile [%s] was not found\n", path_and_name_p );
+    held_frame_p = (pooled_frame *)NULL;
+    frame_pool_p = (FramePoolClass *)NULL;
+
+    if ( frame_count > 0 )
+    {
+        frame_pool_p = new FramePoolClass( frame_count, UDP_IN_BUFFER_SIZE, 0 != FRAME_POOL_HUGE_PAGES );
     }
 }
 
 // ----------------------------------------------------------------------
-// ChatClass Receive File Start
+// ChatClass Frame Pool Sizes
 //
-// After receving the header block for a file transfer, this function
-// is called to handle it. The file name and path are extracted from the
-// header, and the number of bytes that are expected gets extracted.
+// Returns: By argument, how many frames the pool holds, how many bytes
+// each of them holds, and whether they are on huge pages
 //
-// The file name is checked to see if it exists in the directory where
-// the program was executed, and if the file name exists, a number gets
-// appended to the file name. We try a maximum of 20 file names before
-// we simply drop the transfer request in which case the data from the
-// file may flood in to our console output.
+// ----------------------------------------------------------------------
+
+void ChatClass::frame_pool_sizes( uint32_t & frame_count, uint32_t & frame_bytes, bool & huge_pages )
+{
+    frame_count = 0;
+    frame_bytes = 0;
+    huge_pages  = false;
+
+    if ( (FramePoolClass *)NULL != frame_pool_p )
+    {
+        frame_count = frame_pool_p->frame_count( );
+        frame_bytes = frame_pool_p->frame_data_size( );
+        huge_pages  = frame_pool_p->frame_huge_pages( );
+    }
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Take Received Frame
 //
-// NOTE: We could discard all of that data easily enough by setting the
-// send_control.in_file_transfer flag to true. Since the file handle
-// is not opened, all of the inbound data would be discarded. However
-// we want to see the otherwise discarded data.
+// The oldest frame the receive thread queued is held for read_data().
+// Once the receive thread's queue is empty the frames the receive
+// shards queued are taken, a shard at a time in turn.
+//
+// Returns: The number of bytes in the frame, else -1 if none are queued
 //
 // ----------------------------------------------------------------------
 
-void ChatClass::receive_file_start( char * this_data_p, int this_byte_size, const char * ip_address_p )
+int ChatClass::take_received_frame( void )
 {
-    char                 out_file_name[ MAX_OUT_FILE_NAME_SIZE ] = { 0 };
-    bool                 have_file_name                          = false;
-    int                  name_try_count                          = 0;
-    int                  control_index                           = CONTROL_NOT_FOUND;
-    file_transfer_header file_header;
-    file_sent_control    this_control;
-
-    // See if there is a transfer from this device in progress 
-    control_index = find_send_control( ip_address_p );
+    pooled_frame * this_frame_p = (pooled_frame *)NULL;
+    int            shard_tries  = 0;
 
-    // A value not minus 1 means it's in the vector array
-    if ( CONTROL_NOT_FOUND != control_index )
+    if ( false == receive_queue_p->spsc_pop( this_frame_p ) )
     {
-        // Are we already receiving a file?
-        if ( true == send_control[ control_index ].in_file_transfer && 
-           (FILE *)NULL != send_control[ control_index ].out_file_p )
+        for ( shard_tries = 1; shard_tries < shard_count; shard_tries++ )
         {
-            // This likely means that we were sent an incomplete file
-            // and the effort is being retried. Close the file abruptly
-            // and flag the fact that we are no longer receiving. We
-            // can fail to get a complete file because UDP is not assured
-            // delivery.
-            (void)fclose( send_control[ control_index ].out_file_p );
+            SpscQueueClass<pooled_frame *, SHARD_QUEUE_SLOTS> * this_queue_p = 
+                shard_queue_p[ 1 + next_shard_read % ( shard_count - 1 ) ];
 
-            // Flag the fact that the file is no longer open
-            send_control[ control_index ].out_file_p = (FILE *)NULL;
+            next_shard_read++;
 
-            // Flag the fact that we are no longer transfering a file
-            send_control[ control_index ].in_file_transfer = false;
+            if ( true == this_queue_p->spsc_pop( this_frame_p ) )
+            {
+                break;
+            }
+        }
+    }
 
-            // Note that there are no bytes left to receive
-            send_control[ control_index ].to_receive_count = 0;
+    if ( (pooled_frame *)NULL == this_frame_p )
+    {
+        return -1;
+    }
 
-            (void)printf( "NOTE: Aborted previous file transfer from %s.\n", ip_address_p );
+    held_frame_p = this_frame_p;
+
+    return this_frame_p->frame_size;
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Fill Receive Batch
+//
+// Every empty place in the batch of frames passed by argument is given
+// a frame from the pool, for as long as the pool has any to give.
+//
+// Returns: How many frames, from the start of the batch, are ready for
+// frames to be received in to
+//
+// ----------------------------------------------------------------------
+
+int ChatClass::fill_receive_batch( pooled_frame ** these_frames_p )
+{
+    int this_frame = 0;
+
+    for ( this_frame = 0; this_frame < RECEIVE_BATCH_FRAMES; this_frame++ )
+    {
+        if ( (pooled_frame *)NULL == these_frames_p[ this_frame ] &&
+            (pooled_frame *)NULL == ( these_frames_p[ this_frame ] = frame_pool_p->frame_acquire( ) ) )
+        {
+            break;
         }
+    }
 
-        // Remove the existing entry from the vector array.
-        // We only allow one file transfer at a time from a remote device.
-        send_control.erase(send_control.begin() + control_index);
+    return this_frame;
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Receive Batch
+//
+// Takes in as many frames as Linux has on the socket passed by argument,
+// up to the number passed by argument, with one call, straight in to
+// the frames of the batch passed by argument. What Linux has to tell us
+// about each frame is taken care of by the class passed by argument.
+//
+// Returns: How many frames were received
+//
+// ----------------------------------------------------------------------
+
+int ChatClass::receive_batch( ChatClass & table_class, pooled_frame ** these_frames_p, const int slot_count )
+{
+    struct mmsghdr these_messages[ RECEIVE_BATCH_FRAMES ];
+    struct iovec   these_vectors[ RECEIVE_BATCH_FRAMES ];
+    uint64_t       control_space[ RECEIVE_BATCH_FRAMES ][ SOCKET_CONTROL_SIZE / sizeof( uint64_t ) ];
+    int            frame_count = 0;
+    int            this_frame  = 0;
+    uint64_t       batch_time  = 0;
+
+    (void)memset( these_messages, ASCII_NULL_ZERO, sizeof( these_messages[ 0 ] ) * slot_count );
+
+    for ( this_frame = 0; this_frame < slot_count; this_frame++ )
+    {
+        struct msghdr & this_message = these_messages[ this_frame ].msg_hdr;
+
+        // Leave room for the caller to end text with a NULL
+        these_vectors[ this_frame ].iov_base = these_frames_p[ this_frame ]->frame_data_p;
+        these_vectors[ this_frame ].iov_len  = frame_pool_p->frame_data_size( ) - 1;
+
+        this_message.msg_name       = &these_frames_p[ this_frame ]->from_address;
+        this_message.msg_namelen    = sizeof( these_frames_p[ this_frame ]->from_address );
+        this_message.msg_iov        = &these_vectors[ this_frame ];
+        this_message.msg_iovlen     = 1;
+        this_message.msg_control    = control_space[ this_frame ];
+        this_message.msg_controllen = sizeof( control_space[ this_frame ] );
     }
 
-    // Copy the starting data in to the header. Since the header is sent
-    // as a UDP frame, and because inbound data may come back-to-back,
-    // we handle the case where the header has been followed by a block
-    // of inbound data (which may or may not happen depending upon the
-    // implementation of Linux.)
-    (void)memset( (char *)&file_header, ASCII_NULL_ZERO, sizeof( file_header) );
+    frame_count = recvmmsg( table_class.receive_socket, these_messages, slot_count, MSG_DONTWAIT,
+        (struct timespec *)NULL );
 
-    (void)memcpy( (char *)&file_header, this_data_p, sizeof( file_header) );
+    batch_time = ClockClass::clock_precise_ns( );
 
-    // Does the file we're supposed to receive contain data?
-    if ( file_header.file_size == 0 )
+    for ( this_frame = 0; this_frame < frame_count; this_frame++ )
     {
-        // No, so just ignore the file transfer request
-        return;
+        these_frames_p[ this_frame ]->frame_size = these_messages[ this_frame ].msg_len;
+        these_frames_p[ this_frame ]->receive_ns = batch_time;
+
+        table_class.take_socket_control( these_messages[ this_frame ].msg_hdr );
     }
 
-    // We attempt to create a file name. If the file already exists
-    // we change the name by adding a number to the end of the file
-    // name, but we only try up to a maximum number of attempts.
-    while( false == have_file_name && name_try_count++ < MAX_FILE_OVERWRITE_CHECK ) 
+    return ( frame_count > 0 ? frame_count : 0 );
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Receive Thread
+//
+// Waits for frames to arrive and takes in as many as Linux has, up to
+// the batch size, with one call, straight in to frames from the pool,
+// which are then queued for read_data(). If read_data() is so far
+// behind that the queue is full the frames wait in the receive socket,
+// whose buffer grows if Linux has to drop any of them. When there are
+// receive shards, broadcasted frames from the devices of the other
+// shards are passed over; the other shards take those in themselves,
+// and the frames they were received in to are used again.
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::receive_thread( void )
+{
+    pooled_frame * these_frames[ RECEIVE_BATCH_FRAMES ] = { (pooled_frame *)NULL };
+    struct pollfd  this_handle;
+    const uint64_t event_count = 1;
+    int            slot_count  = 0;
+    int            frame_count = 0;
+    int            this_frame  = 0;
+    int            kept_count  = 0;
+    uint64_t       batch_start = 0;
+
+    this_handle.fd     = receive_socket;
+    this_handle.events = POLLIN;
+
+    while ( false == stop_pipeline.load( ) )
     {
-        // Get the name of the file to create from the header
-        (void)strcpy( out_file_name, file_header.file_name );
+        // As many frames as a batch may fill and the queue has room for
+        slot_count = fill_receive_batch( these_frames );
 
-        if ( name_try_count > 0 )
+        while ( slot_count > 0 && (pooled_frame **)NULL == receive_queue_p->spsc_claim( slot_count - 1 ) )
         {
-            char to_append[ 10 ] = { 0 };
+            slot_count--;
+        }
 
-            (void)sprintf( to_append, "%d", name_try_count );
+        if ( 0 == slot_count )
+        {
+            std::this_thread::sleep_for( std::chrono::microseconds( PIPELINE_FULL_DELAY_US ) );
 
-            (void)strcat( out_file_name, to_append );
+            continue;
         }
 
-        // Does the file already exist?
-        this_control.out_file_p = fopen( out_file_name, "rb" );
+        if ( poll( &this_handle, 1, PIPELINE_IDLE_DELAY_MS ) <= 0 )
+        {
+            continue;
+        }
 
-        if ( (FILE *)NULL == this_control.out_file_p )
+        batch_start = TraceClass::trace_begin( );
+
+        frame_count = receive_batch( *this, these_frames, slot_count );
+
+        if ( 0 == frame_count )
         {
-            // Flag the fact that this file name does not exist already
-            have_file_name = true;
+            continue;
         }
-        else
+
+        for ( kept_count = 0, this_frame = 0; this_frame < frame_count; this_frame++ )
         {
-            // The file already exists
-            (void)fclose( this_control.out_file_p );
+            if ( shard_count > 1 && 0 != shard_of_address( these_frames[ this_frame ]->from_address, shard_count ) )
+            {
+                continue;
+            }
 
-            // Flag the fact that the file is closed
-            this_control.out_file_p = (FILE *)NULL;
+            *receive_queue_p->spsc_claim( kept_count++ ) = these_frames[ this_frame ];
+
+            these_frames[ this_frame ] = (pooled_frame *)NULL;
+        }
+
+        receive_queue_p->spsc_publish( kept_count );
+
+        TraceClass::trace_end( trace_receive, batch_start, frame_count );
+
+        // Wake the caller if it is waiting for input
+        if ( kept_count > 0 )
+        {
+            (void)write( pipeline_event, &event_count, sizeof( event_count ) );
         }
     }
 
-    // Did we get a good file name?
-    if ( true == have_file_name )
+    for ( this_frame = 0; this_frame < RECEIVE_BATCH_FRAMES; this_frame++ )
+    {
+        frame_pool_p->frame_release( these_frames[ this_frame ] );
+    }
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Queue Disk Write
+//
+// The block of a file being received passed by argument is queued for
+// the disk writer thread, which holds on to the frame the block arrived
+// in until it is written. A block which did not arrive in the frame
+// read_data() is handling is copied in to a frame of its own. If the
+// disk is so far behind that the queue is full we wait for it to catch
+// up a little, which holds up the frames behind this one rather than
+// dropping the block.
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::queue_disk_write( FILE * out_file_p, const char * this_data_p, const int this_byte_size,
+    const uint64_t this_offset )
+{
+    disk_write   * this_write_p = (disk_write *)NULL;
+    pooled_frame * this_frame_p = held_frame_p;
+
+    while ( (disk_write *)NULL == ( this_write_p = disk_queue_p->spsc_claim( 0 ) ) ||
+        ( false == frame_pool_p->frame_owned( held_frame_p, this_data_p ) &&
+          (pooled_frame *)NULL == ( this_frame_p = frame_pool_p->frame_acquire( ) ) ) )
+    {
+        std::unique_lock<std::mutex> pipeline_guard( pipeline_lock );
+
+        disk_wake.notify_one( );
+
+        (void)disk_drained.wait_for( pipeline_guard, std::chrono::microseconds( PIPELINE_FULL_DELAY_US ) );
+    }
+
+    if ( this_frame_p == held_frame_p )
+    {
+        frame_pool_p->frame_hold( this_frame_p );
+    }
+    else
+    {
+        (void)memcpy( this_frame_p->frame_data_p, this_data_p, this_byte_size );
+
+        this_data_p = this_frame_p->frame_data_p;
+    }
+
+    this_write_p->out_file_p   = out_file_p;
+    this_write_p->file_offset  = this_offset;
+    this_write_p->write_size   = this_byte_size;
+    this_write_p->frame_p      = this_frame_p;
+    this_write_p->write_data_p = this_data_p;
+
+    disk_queue_p->spsc_publish( 1 );
+
+    disk_writes_queued++;
+
+    // The writer looks at the queue after saying that it is waiting,
+    // and we look at whether it is waiting after filling the queue, so
+    // one of us always sees the other
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+
+    if ( true == disk_writer_waiting.load( ) )
+    {
+        std::lock_guard<std::mutex> pipeline_guard( pipeline_lock );
+
+        disk_wake.notify_one( );
+    }
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Wait For Disk Writes
+//
+// Waits until the disk writer thread has written every block queued for
+// it, so that a file may be read back or closed. Without the pipeline
+// nothing is ever queued and this returns at once.
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::wait_for_disk_writes( void )
+{
+    if ( disk_writes_done.load( std::memory_order_acquire ) == disk_writes_queued )
+    {
+        return;
+    }
+
+    std::unique_lock<std::mutex> pipeline_guard( pipeline_lock );
+
+    while ( disk_writes_done.load( std::memory_order_acquire ) != disk_writes_queued )
+    {
+        disk_wake.notify_one( );
+
+        (void)disk_drained.wait_for( pipeline_guard, std::chrono::milliseconds( 1 ) );
+    }
+}
+
+// ----------------------------------------------------------------------
+// ChatClass Disk Writer Thread
+//
+// Writes the blocks queued for it in the order they were queued, and
+// when it runs out says so to anyone waiting for the writes, then waits
+// for more. Every block queued is written before the thread stops.
+//
+// ----------------------------------------------------------------------
+
+void ChatClass::disk_writer_thread( void )
+{
+    disk_write * this_write_p = (disk_write *)NULL;
+
+    while ( true )
     {
-        // Flag the time when we started to receive data
-        this_control.transfer_start_time = time( NULL );
-
-        // Create the outbound file
-        if ( (FILE *)NULL != ( this_control.out_file_p = fopen( out_file_name, "wb" ) ) )
+        while ( (disk_write *)NULL != ( this_write_p = disk_queue_p->spsc_front( ) ) )
         {
-            // Flag the fact that we are receiving a file now
-            this_control.in_file_transfer = true;
+            write_file_block( this_write_p->out_file_p, this_write_p->write_data_p, this_write_p->write_size,
+                this_write_p->file_offset );
 
-            // Set the size of data bytes that needs to be received 
-            this_control.to_receive_count = file_header.file_size;
+            frame_pool_p->frame_release( this_write_p->frame_p );
 
-            // Store the IP address of the sending device. We
-            // use the IP address to track multiple inbound files
-            // from different devices. 
-            (void)strcpy( this_control.ip_address, ip_address_p );
+            disk_queue_p->spsc_release( );
 
-            (void)printf( "\nInbound file: %s with %d bytes from %s\n", 
-                out_file_name, this_control.to_receive_count, ip_address_p );
+            disk_writes_done.fetch_add( 1, std::memory_order_release );
+        }
 
-            // Append the control block to the vector array
-            send_control.push_back( this_control );
+        std::unique_lock<std::mutex> pipeline_guard( pipeline_lock );
 
-            // Deduct the size of the header from the inbound data
-            this_byte_size -= sizeof( file_header );
+        disk_drained.notify_all( );
 
-            // Do we have any following data to save?
-            if ( this_byte_size > 0 )
-            {
-                // Point to where the follow-up data is, past the header
-                this_data_p += sizeof( file_header );
+        // Nothing is queued once we are asked to stop
+        if ( true == stop_pipeline.load( ) )
+        {
+            break;
+        }
 
-                // Store the follow-up data to the file
-                (void)receive_file_block( this_data_p, this_byte_size, ip_address_p );
-            }
+        disk_writer_waiting = true;
+
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+
+        if ( true == disk_queue_p->spsc_empty( ) )
+        {
+            (void)disk_wake.wait_for( pipeline_guard, std::chrono::milliseconds( PIPELINE_IDLE_DELAY_MS ) );
         }
-    }
-    else
-    {
-        // Could not create a file name that would not overwrite
-        // an existing file. We discard the inbound frame by doing 
-        // nothing. If there are further inbound UDP frames, they
-        // will be made available to the calling process every time 
-        // the read_data() method is invoked.
-        // 
-        // This behavior could be changed to discard the inbound file
-        // without being displayed to the console by uncommenting
-        // the following:
-        //
-        // this_control.in_file_transfer = true;
-        // this_control.to_receive_count = file_header.file_size;
-        // (void)strcpy( this_control.ip_address, ip_address_p );
-        // (void)printf("Can not save inbound file, file name collission\n");
+
+        disk_writer_waiting = false;
     }
 }
 
 // ----------------------------------------------------------------------
-// ChatClass File Transfer
+// ChatClass Transmit Thread
 //
-// An inbound UDP frame indicates that a file transfer is requested.
-// This may be an unsolicited send or a get request. This method copies
-// the UDP frame's data in to the header structure to determine which
-// type of transfer request it is, dispatching the functionality to the
-// correct method to handle it.
+// Takes on the files handed to it and sends them, a service's worth of
+// bytes shared among them every service interval. A service which
+// finds the bulk socket full simply ends early. When nothing is being
+// sent the thread waits for a file to be handed to it.
 //
 // ----------------------------------------------------------------------
 
-void ChatClass::file_transfer( char * this_data_p, const int this_byte_size, const char * ip_address_p )
+void ChatClass::transmit_thread( void )
 {
-    file_transfer_header file_header;
+    outbound_transfer this_transfer;
+    uint64_t          next_service = ClockClass::clock_precise_ns( );
+    uint64_t          this_time    = 0;
 
-    // Copy the starting data in to the header. 
-    (void)memset( (char *)&file_header, ASCII_NULL_ZERO, sizeof( file_header) );
+    while ( false == stop_pipeline.load( ) )
+    {
+        while ( true == transmit_queue_p->spsc_pop( this_transfer ) )
+        {
+            send_tasks.push_back( this_transfer );
+        }
 
-    (void)memcpy( (char *)&file_header, this_data_p, sizeof( file_header) );
+        if ( true == send_tasks.empty( ) )
+        {
+            std::unique_lock<std::mutex> pipeline_guard( pipeline_lock );
 
-    // See if the file transfer is an unsolicited send or a get
-    if ( file_header.trans_type == trans_type_send )
-    {
-        // It is an unsolicited send
-        receive_file_start( this_data_p, this_byte_size, ip_address_p );
-    }
-    else if ( file_header.trans_type == trans_type_get_request )
-    {
-        // It is a get file request
-        get_file_request( this_data_p );
+            transmit_waiting = true;
+
+            std::atomic_thread_fence( std::memory_order_seq_cst );
+
+            if ( true == transmit_queue_p->spsc_empty( ) && false == stop_pipeline.load( ) )
+            {
+                (void)transmit_wake.wait_for( pipeline_guard, std::chrono::milliseconds( PIPELINE_IDLE_DELAY_MS ) );
+            }
+
+            transmit_waiting = false;
+
+            next_service = ClockClass::clock_precise_ns( );
+
+            continue;
+        }
+
+        // Pace the services; one which is late is not made up for
+        this_time = ClockClass::clock_precise_ns( );
+
+        if ( this_time < next_service )
+        {
+            std::this_thread::sleep_for( std::chrono::nanoseconds( next_service - this_time ) );
+
+            this_time = next_service;
+        }
+
+        next_service = this_time + TRANSMIT_SERVICE_INTERVAL_US * 1000ULL;
+
+        (void)service_send_tasks( );
     }
 }
 
 // ----------------------------------------------------------------------
-// ChatClass Receive File Block
+// ChatClass Start Receive Shards
 //
-// When the send_control.in_file_transfer flag indicates that a file transfer is 
-// taking place, and when the file handle shows that the destination 
-// file is open, the data passed to this function by argument gets
-// written to that file.
+// The receive socket we were created with joins a SO_REUSEPORT group
+// and as many more receive sockets as shards were asked for beyond the
+// first are bound to the same port, each with a copy of the class of
+// its own to keep the files it receives in and a queue to hand us
+// everything else through. Frames sent to us alone are then steered
+// to their shard by Linux.
 //
-// NOTE: We could move the check for the open output file to avoid 
-// the write() call and allow the data streaming in to us to be 
-// discarded solely if the send_control.in_file_transfer flag is true.
+// Returns: true if every shard was opened, else false with none open
 //
 // ----------------------------------------------------------------------
 
-bool ChatClass::receive_file_block( char * this_data_p, int this_byte_size, const char * ip_address_p )
+bool ChatClass::start_receive_shards( const int receive_shards )
 {
-    int       write_result    = 0;
-    const int orig_block_size = this_byte_size;
-    int       write_try_count = 0;
-    int       control_index   = CONTROL_NOT_FOUND;
-    bool      are_receiving   = false;
-
-    // See if there is a transfer from this device in progress 
-    control_index = find_send_control( ip_address_p );
-
-    // A value of CONTROL_NOT_FOUND means it's not in the vector array
-    if ( CONTROL_NOT_FOUND == control_index )
+    const int          enable_reuse   = 1;
+    const int          wanted_shards  = ( receive_shards > MAX_RECEIVE_SHARDS ? MAX_RECEIVE_SHARDS : receive_shards );
+    int                share_port     = 0;
+    socklen_t          option_length  = sizeof( share_port );
+    struct sockaddr_in bound_address;
+    socklen_t          address_length = sizeof( bound_address );
+    int                shard_socket   = HANDLE_NOT_VALID;
+    ChatClass        * this_table_p   = (ChatClass *)NULL;
+
+    (void)memset( (char *)&bound_address, ASCII_NULL_ZERO, sizeof( bound_address ) );
+
+    // Find out which port we are bound to and whether it is shared with
+    // other copies of the class; the shards must say the same
+    if ( getsockname( receive_socket, (struct sockaddr *)&bound_address, &address_length ) < 0 ||
+         getsockopt( receive_socket, SOL_SOCKET, SO_REUSEADDR, &share_port, &option_length ) < 0 ||
+         setsockopt( receive_socket, SOL_SOCKET, SO_REUSEPORT, &enable_reuse, sizeof( enable_reuse ) ) < 0 )
     {
-        // Report that we are not getting a file from this device
+        (void)printf("I was unable to share the receive port among shards: %s\n", strerror( errno ) );
+
         return false;
     }
 
-    // Make sure that we are receiving
-    if ( true == send_control[ control_index ].in_file_transfer && 
-        (FILE *)NULL != send_control[ control_index ].out_file_p )
+    while ( shard_count < wanted_shards )
     {
-        // Write the data to the file until it's all written
-        // attempting to send the block a maximum of X times
-        while( this_byte_size > 0 && write_try_count < MAX_FILE_WRITE_RETRY_COUNT )
+        if ( ( shard_socket = socket( AF_INET, SOCK_DGRAM, 0 ) ) < 0 )
         {
-            // Attempt to write the whole block
-            write_result = fwrite( this_data_p, 1, this_byte_size, 
-                send_control[ control_index ].out_file_p );
+            break;
+        }
 
-            // Did we send any data? If we run out of space on
-            // the file system, we want to abandon the effort.
-            if ( write_result > 0 )
-            {
-                // Deduct the bytes sent
-                this_byte_size -= write_result;
-                this_data_p    += write_result;
+        (void)setsockopt( shard_socket, SOL_SOCKET, SO_REUSEPORT, &enable_reuse, sizeof( enable_reuse ) );
 
-                // Write was successful so restart the try counter
-                write_try_count = 0;
-            }
-            else
-            {
-                // Possibly a slow file system or out of space so
-                // we delay a second and then incriment our attempt
-                // counter to avoid stalling forever.
-                sleep(1);
+        if ( 0 != share_port )
+        {
+            (void)setsockopt( shard_socket, SOL_SOCKET, SO_REUSEADDR, &enable_reuse, sizeof( enable_reuse ) );
+        }
 
-                write_try_count++;
-            }
+        if ( bind( shard_socket, (struct sockaddr *)&bound_address, sizeof( bound_address ) ) == -1 )
+        {
+            (void)close( shard_socket );
+
+            break;
         }
 
-        // Restart the timeout timer
-        send_control[ control_index ].transfer_start_time = time( NULL );
+        // The shard owns the socket from here on
+        this_table_p = new ChatClass( *this, shard_socket );
 
-        // Flag the fact that we received the data in to a file
-        are_receiving = true;
+        this_table_p->receive_buffer_bytes = size_socket_buffer( shard_socket, true, SOCKET_RECEIVE_BUFFER_START );
 
-        // Deduct what we expected to have written from the size of
-        // the file that needs to be sent
-        if ( send_control[ control_index ].to_receive_count >= orig_block_size )
-        {
-            send_control[ control_index ].to_receive_count -= orig_block_size;
-        }
+        this_table_p->mark_receive_socket( shard_socket );
 
-        // Did we get the whole file?
-        if ( 0 == send_control[ control_index ].to_receive_count ) 
-        {
-            // Close the output file
-            (void)fclose( send_control[ control_index ].out_file_p );
+        shard_table_p[ shard_count ] = this_table_p;
+        shard_queue_p[ shard_count ] = new SpscQueueClass<pooled_frame *, SHARD_QUEUE_SLOTS>;
 
-            // Flag the fact that it is closed
-            send_control[ control_index ].out_file_p = (FILE *)NULL;
+        shard_count++;
+    }
 
-            // Flag the fact that we are no longer receiving a file
-            send_control[ control_index ].in_file_transfer = false;
+    // Without steering the frames sent to us alone could land on a shard
+    // which drops them, so it is all of the shards or none of them
+    if ( shard_count < wanted_shards )
+    {
+        (void)printf("I was unable to open receive shard %d: %s\n", shard_count, strerror( errno ) );
 
-            // Stop the timer
-            send_control[ control_index ].transfer_start_time = 0L;
+        stop_receive_shards( );
 
-            // Remove the entry from the vector array
-            send_control.erase( send_control.begin() + control_index );
-        }
+        return false;
     }
 
-    // Report whether we received this data in to a file or not
-    return are_receiving;
+    if ( false == attach_shard_steering( ) )
+    {
+        stop_receive_shards( );
+
+        return false;
+    }
+
+    return true;
 }
 
 // ----------------------------------------------------------------------
-// ChatClass Transfer Timed Out
-//
-// Checks to see if a file transfer "send" request has timed out. If the
-// transfr timer is running it checks to see if the starting transfer 
-// date/time shows that the current time is 10 seconds beyond the last 
-// date/time that the timer was updated. Since the timer gets updated 
-// every time a UDP block comes in, after 10 seconds of no activity the
-// transfer can be assumed to have failed.
+// ChatClass Stop Receive Shards
 //
-// The calling of this method is optional. Since UDP is not promised
-// delivery, it is a good idea to call this method every now and then
-// to see if a file transfer has timed out. If the process using this
-// class does not perform file transfers, there is no reason to call
-// this method.
+// Closes the receive shards, whose workers must have stopped already.
+// Frames they queued for us which were not read are dropped.
 //
 // ----------------------------------------------------------------------
 
-bool ChatClass::transfer_timed_out( void )
+void ChatClass::stop_receive_shards( void )
 {
-    int  this_index     = 0;
-    bool any_timeouts   = false;
-    bool restart_search = true;
+    int this_shard = 0;
 
-    // Every time we remove a timed-out entry from the vector array
-    // we restart the search for another entry that had timed out
-    while ( true == restart_search )
+    for ( this_shard = 1; this_shard < shard_count; this_shard++ )
     {
-        restart_search = false;
-
-        for (this_index = 0; this_index < send_control.size(); this_index++)
-        {
-            // Is the transfer timer running?
-            if ( send_control[ this_index ].transfer_start_time > 0 )
-            {
-                time_t current_time = time( NULL );
-
-                // The timer is running so see if 10 seconds have passed.
-                // Note that this will not work well if the system's date
-                // or time gets updated while the transfer is taking place.
-                if ( current_time >= send_control[ this_index ].transfer_start_time + 10 )
-                {
-                    if ( (FILE *)NULL != send_control[ this_index ].out_file_p )
-                    {
-                        // Close the output file
-                        (void)fclose( send_control[ this_index ].out_file_p );
+        delete shard_table_p[ this_shard ];
+        delete shard_queue_p[ this_shard ];
 
-                        // Flag the fact that it is closed
-                        send_control[ this_index ].out_file_p = (FILE *)NULL;
-
-                        (void)printf("NOTE: Inbound file transfer timed out.\n");
-                    }
+        shard_table_p[ this_shard ] = (ChatClass *)NULL;
+        shard_queue_p[ this_shard ] = (SpscQueueClass<pooled_frame *, SHARD_QUEUE_SLOTS> *)NULL;
+    }
 
-                    // Flag the fact that we are no longer receiving a file
-                    send_control[ this_index ].in_file_transfer = false;
+#ifdef SO_DETACH_REUSEPORT_BPF
+    if ( shard_count > 1 )
+    {
+        (void)setsockopt( receive_socket, SOL_SOCKET, SO_DETACH_REUSEPORT_BPF, &this_shard, sizeof( this_shard ) );
+    }
+#endif
 
-                    // Stop the timer
-                    send_control[ this_index ].transfer_start_time = 0L;
+    shard_count     = 1;
+    next_shard_read = 0;
+}
 
-                    // Report that the file transfer timed out
-                    any_timeouts = true;
+// ----------------------------------------------------------------------
+// ChatClass Attach Shard Steering
+//
+// Gives the SO_REUSEPORT group a classic socket filter which chooses
+// the socket a frame sent to us alone goes to. It works out the same
+// hash of the sender's address that shard_of_address() does, from the
+// source address in the frame's IP header, and the sockets of the
+// group are numbered in the order they were bound, which is the order
+// of the shards.
+//
+// Returns: true if the filter was attached
+//
+// ----------------------------------------------------------------------
 
-                    // Remove this entry from the vector array
-                    send_control.erase( send_control.begin() + this_index );
+bool ChatClass::attach_shard_steering( void )
+{
+    struct sock_filter steering_code[] =
+    {
+        { BPF_LD  | BPF_W   | BPF_ABS, 0, 0, (uint32_t)( SKF_NET_OFF + 12 ) },  // A = source address
+        { BPF_MISC | BPF_TAX,          0, 0, 0 },                             // X = A
+        { BPF_ALU | BPF_RSH | BPF_K,   0, 0, 16 },                            // A >>= 16
+        { BPF_ALU | BPF_XOR | BPF_X,   0, 0, 0 },                             // A ^= X
+        { BPF_ALU | BPF_MUL | BPF_K,   0, 0, SHARD_HASH_MULTIPLIER },         // A *= multiplier
+        { BPF_MISC | BPF_TAX,          0, 0, 0 },                             // X = A
+        { BPF_ALU | BPF_RSH | BPF_K,   0, 0, 16 },                            // A >>= 16
+        { BPF_ALU | BPF_XOR | BPF_X,   0, 0, 0 },                             // A ^= X
+        { BPF_ALU | BPF_MOD | BPF_K,   0, 0, (uint32_t)shard_count },         // A %= shards
+        { BPF_RET | BPF_A,             0, 0, 0 }                              // Socket A
+    } ;
+    struct sock_fprog steering_program;
+
+    steering_program.len    = sizeof( steering_code ) / sizeof( steering_code[ 0 ] );
+    steering_program.filter = steering_code;
+
+    if ( setsockopt( receive_socket, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+        &steering_program, sizeof( steering_program ) ) < 0 )
+    {
+        (void)printf("I was unable to steer frames to receive shards: %s\n", strerror( errno ) );
 
-                    // We removed an entry so start searching for a timeout
-                    // from the beginning of the vector array again.
-                    restart_search = true;
-                    break;
-                }
-            }
-        }
-     }
+        return false;
+    }
 
-    // Report on whether any file transfers timed out
-    return any_timeouts;
+    return true;
 }
 
 // ----------------------------------------------------------------------
-// ChatClass Get File
-//
-// The operator is reqesting that all listeners who have the file 
-// located in the requested directory with the requested file name send
-// it the contents of that file.
+// ChatClass Shard Thread
 //
-// This method builds a file transfer header requesting the file and
-// sends it as a UDP frame.
+// The worker of the receive shard passed by argument. It takes in as
+// many frames as Linux has on the shard's socket, up to the batch size,
+// with one call, in to frames from our pool. Frames from the devices
+// of other shards are passed over. Headers, blocks and digests of files
+// being sent to us are handled here, in to the shard's own table, and
+// their blocks are written here too. Anything else is queued for
+// read_data(), waiting for room if it is so far behind that the queue
+// is full. The frames which were not queued are used again. The
+// shard's transfers are checked for time outs every time around.
 //
 // ----------------------------------------------------------------------
 
-void ChatClass::get_file( char * path_and_name_p )
+void ChatClass::shard_thread( const int shard_index )
 {
-    file_transfer_header file_header;
+    ChatClass    * table_p     = shard_table_p[ shard_index ];
+    SpscQueueClass<pooled_frame *, SHARD_QUEUE_SLOTS> * queue_p = shard_queue_p[ shard_index ];
+    pooled_frame * these_frames[ RECEIVE_BATCH_FRAMES ] = { (pooled_frame *)NULL };
+    pooled_frame * this_frame_p = (pooled_frame *)NULL;
+    struct pollfd  this_handle;
+    const uint64_t event_count  = 1;
+    int            slot_count   = 0;
+    int            frame_count  = 0;
+    int            this_frame   = 0;
+    uint64_t       batch_start  = 0;
+
+    this_handle.fd     = table_p->receive_socket;
+    this_handle.events = POLLIN;
+
+    while ( false == stop_pipeline.load( ) )
+    {
+        if ( 0 == ( slot_count = fill_receive_batch( these_frames ) ) )
+        {
+            std::this_thread::sleep_for( std::chrono::microseconds( PIPELINE_FULL_DELAY_US ) );
 
-    // Discard leading white space, if any
-    skipspace( path_and_name_p );
+            continue;
+        }
 
-    // Remove trailing endline characters if any
-    while( path_and_name_p[ strlen( path_and_name_p ) - 1] == ASCII_CARRIAGE_RETURN ||
-           path_and_name_p[ strlen( path_and_name_p ) - 1] == ASCII_LINE_FEED )
-    {
-        path_and_name_p[ strlen( path_and_name_p ) - 1 ] = ASCII_NULL_ZERO;
-    }
+        if ( poll( &this_handle, 1, PIPELINE_IDLE_DELAY_MS ) > 0 )
+        {
+            batch_start = TraceClass::trace_begin( );
 
-    // Plug the file transfer header starting with all zeros
-    (void)memset( (char *)&file_header, ASCII_NULL_ZERO, sizeof ( file_header ) );
+            frame_count = receive_batch( *table_p, these_frames, slot_count );
 
-    // Note the fact that this is a file transfer frame
-    (void)strcpy(file_header.header_command, ":xfer:");
+            for ( this_frame = 0; this_frame < frame_count; this_frame++ )
+            {
+                this_frame_p = these_frames[ this_frame ];
 
-    // Note the number of bytes expected in the file is zero so far
-    file_header.file_size = 0;
+                if ( (uint32_t)shard_index != shard_of_address( this_frame_p->from_address, shard_count ) )
+                {
+                    continue;
+                }
 
-    // Flag the fact that this is a get
-    file_header.trans_type = trans_type_get_request;
- 
-    // Copy the path and file name in to the header
-    (void)memcpy( file_header.file_name, path_and_name_p, 
-        sizeof( file_header.file_name ) - 1 );
+                // The frame is used again once the shard is done with it
+                if ( true == is_inbound_transfer_frame( this_frame_p->frame_data_p, this_frame_p->frame_size ) )
+                {
+                    (void)table_p->process_frame( this_frame_p->frame_data_p, this_frame_p->frame_size,
+                        this_frame_p->from_address, this_frame_p->receive_ns );
 
-    // Send the header data to request the file
-    send_data( ( char *)&file_header, sizeof( file_header ) );
+                    continue;
+                }
 
-    // Indicate the fact that we requested the file
-    (void)printf( "\nFile [%s] was requested\n", path_and_name_p );
+                while ( false == queue_p->spsc_push( this_frame_p ) && false == stop_pipeline.load( ) )
+                {
+                    std::this_thread::sleep_for( std::chrono::microseconds( PIPELINE_FULL_DELAY_US ) );
+                }
+
+                if ( true == stop_pipeline.load( ) )
+                {
+                    break;
+                }
+
+                these_frames[ this_frame ] = (pooled_frame *)NULL;
+
+                // Wake the caller if it is waiting for input
+                (void)write( pipeline_event, &event_count, sizeof( event_count ) );
+            }
+
+            if ( frame_count > 0 )
+            {
+                TraceClass::trace_end( trace_receive, batch_start, frame_count );
+            }
+        }
+
+        (void)table_p->transfer_timed_out( );
+    }
+
+    for ( this_frame = 0; this_frame < RECEIVE_BATCH_FRAMES; this_frame++ )
+    {
+        frame_pool_p->frame_release( these_frames[ this_frame ] );
+    }
 }
 
 // ----------------------------------------------------------------------
-// ChatClass Get File Request
+// ChatClass Shard Of Address
 //
-// The path and file name provided in a get file request is examined to 
-// see if the file exists on this system, and if it does a response is
-// created and the file is sent using the "send" file transfer 
-// functionality. 
+// Returns: The receive shard which the frames from the device at the
+// address passed by argument belong to, out of the number of shards
+// passed by argument. attach_shard_steering() must work out the same.
 //
 // ----------------------------------------------------------------------
 
-void ChatClass::get_file_request( const char * this_data_p )
+uint32_t ChatClass::shard_of_address( const struct sockaddr_in & from_address, const int shard_total )
 {
-    file_transfer_header file_header;
-
-    // Plug the file transfer header starting with all zeros
-    (void)memset( (char *)&file_header, ASCII_NULL_ZERO, sizeof ( file_header ) );
+    uint32_t this_hash = ntohl( from_address.sin_addr.s_addr );
 
-    // Extract the data in to the data structure
-    (void)memcpy( (char *)&file_header, this_data_p, sizeof( file_header ) );
+    this_hash ^= this_hash >> 16;
+    this_hash *= SHARD_HASH_MULTIPLIER;
+    this_hash ^= this_hash >> 16;
 
-    // We received a get file request. In order to handle it we
-    // treat the request as if an operator performed a send file
-    // request though we pass the method a flag indicating that 
-    // it was a get rather than an unsolicited send.
-    send_file( file_header.file_name, true );
+    return this_hash % (uint32_t)shard_total;
 }
 
 // ----------------------------------------------------------------------
-// ChatClass Find Send Control
+// ChatClass Is Inbound Transfer Frame
 //
-// Goes through the vector array of send controls looking for an entry
-// with an IP address that matches the IP address passed to the method
-// by argument, and if it is found, returns the index in to the vector
-// array, otherwise if the entry is not found returns -1 to indicate 
-// that the entry does not exist.
+// Returns: true if the frame passed by argument is part of a file being
+// sent to us: its header, one of its blocks or its digest. Get requests
+// and repair requests are about files we send, so they are not.
 //
 // ----------------------------------------------------------------------
 
-int ChatClass::find_send_control( const char * ip_address_p )
+bool ChatClass::is_inbound_transfer_frame( const char * this_data_p, const int this_byte_size )
 {
-    int this_index = 0;
+    file_transfer_header file_header;
 
-    // Go through all entries in the vector array
-    for (this_index = 0; this_index < send_control.size(); this_index++)
+    if ( this_byte_size < 6 )
     {
-        // Is this entry the same as the device's IP address?
-        if (0 == strcmp( send_control[ this_index ].ip_address, ip_address_p ) )
-        {
-            // Report the index of the existing device
-            return this_index;
-        }
+        return false;
     }
 
-    // Indicate that an entry for the IP address device does not exist
-    return CONTROL_NOT_FOUND;
-}
+    if ( 0 == strncmp( this_data_p, ":blok:", 6 ) || 0 == strncmp( this_data_p, ":dgst:", 6 ) )
+    {
+        return true;
+    }
+
+    if ( 0 != strncmp( this_data_p, ":xfer:", 6 ) || this_byte_size < (int)sizeof( file_header ) )
+    {
+        return false;
+    }
+
+    (void)memcpy( (char *)&file_header, this_data_p, sizeof( file_header ) );
 
+    return file_header.trans_type == trans_type_send;
+}
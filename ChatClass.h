@@ -19,7 +19,20 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <vector>
+#include <unordered_map>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <deque>
+#include <condition_variable>
+#include "IntegrityClass.h"     // For file block integrity checks
+#include "ReadAheadClass.h"     // For reading files being sent
+#include "MetricsClass.h"       // For counting frames and transfers
+#include "SpscQueueClass.h"     // For handing work between the pipeline threads
+#include "FramePoolClass.h"     // For the buffers frames are received in to
 
 // ----------------------------------------------------------------------
 // General defined constants that we will be using. We attempt to avoid
@@ -67,6 +80,15 @@
 
 #define UDP_IN_BUFFER_SIZE          (1024 * 2)
 
+// ----------------------------------------------------------------------
+// Along with each frame Linux hands us a count of the frames it dropped
+// and the time at which it took the frame in. This is room enough for
+// both of them.
+//
+// ----------------------------------------------------------------------
+
+#define SOCKET_CONTROL_SIZE         256
+
 // ----------------------------------------------------------------------
 // MACRO for removing leading white space of spaces and tabs
 //
@@ -107,10 +129,147 @@
     {
         char          header_command[ XFER_HDR_CMD_SIZE ];  // Currently always :xfer:
         char          file_name[ XFER_HDR_NAME_SZIE ];      // The path and file name
-        int           file_size;                            // The number of bytes to expect
+        uint64_t      file_size;                            // The number of bytes to expect
         transfer_type trans_type;                           // The type of transfer
+        uint32_t      transfer_id;                          // Tells sends from one device apart
     } file_transfer_header;
 
+// ----------------------------------------------------------------------
+// Every block of file data that follows the file transfer header is
+// sent in a UDP frame which starts with this block header. The header
+// tells the receivers where in the file the data belongs and carries
+// a CRC32C of the entire frame, computed with the block_crc set to
+// zero, so that corrupted frames and stray frames which are not file
+// data at all are never written in to a file.
+//
+// A device may be sending several files at once so every frame of a
+// transfer carries the transfer ID from the file transfer header.
+//
+// ----------------------------------------------------------------------
+
+#define XFER_BLOCK_CMD_SIZE     8
+
+    typedef struct FILE_BLOCK_HEADER_T
+    {
+        char          block_command[ XFER_BLOCK_CMD_SIZE ]; // Currently always :blok:
+        uint32_t      block_crc;                            // CRC32C of the whole frame
+        uint32_t      block_size;                           // The number of data bytes following
+        uint64_t      block_offset;                         // Where the data goes in the file
+        uint32_t      transfer_id;                          // Which transfer the block is for
+        uint32_t      reserved;                             // Always zero
+    } file_block_header;
+
+// ----------------------------------------------------------------------
+// After the last block of a file has been sent, the whole-file digest
+// follows in one or more frames starting with this header. Each frame
+// carries the root digest of the file and a run of the leaf digests,
+// starting with the leaf numbered first_leaf. The CRC is computed the
+// same way as it is for file blocks.
+//
+// ----------------------------------------------------------------------
+
+#define DIGEST_LEAVES_PER_FRAME ( MAX_OUT_DATA_SIZE / sizeof( uint64_t ) )
+
+    typedef struct FILE_DIGEST_HEADER_T
+    {
+        char          digest_command[ XFER_BLOCK_CMD_SIZE ]; // Currently always :dgst:
+        uint32_t      digest_crc;                            // CRC32C of the whole frame
+        uint32_t      first_leaf;                            // Number of the first leaf digest
+        uint32_t      leaf_count;                            // Leaf digests in this frame
+        uint32_t      total_leaves;                          // Leaf digests in the file
+        uint64_t      file_size;                             // The size of the file
+        uint64_t      root_digest;                           // The digest of the whole file
+        uint32_t      transfer_id;                           // Which transfer the digest is for
+        uint32_t      reserved;                              // Always zero
+    } file_digest_header;
+
+// ----------------------------------------------------------------------
+// When a received file does not match its digest, the receiver asks
+// for the leaves that did not match, or that never arrived, with a
+// repair request. The root digest identifies which file is meant; only
+// the system which sent a file with that digest answers.
+//
+// ----------------------------------------------------------------------
+
+    typedef struct FILE_REPAIR_REQUEST_T
+    {
+        char          repair_command[ XFER_BLOCK_CMD_SIZE ]; // Currently always :rpar:
+        uint32_t      repair_crc;                            // CRC32C of the whole frame
+        uint32_t      first_leaf;                            // First leaf to send again
+        uint32_t      leaf_count;                            // How many leaves to send again
+        uint32_t      transfer_id;                           // The transfer the file came in
+        uint64_t      root_digest;                           // The digest of the whole file
+    } file_repair_request;
+
+// ----------------------------------------------------------------------
+// A receiver asks for repairs a limited number of times before giving
+// up on a file, and it asks for a limited number of ranges of leaves
+// each time. A sender remembers a limited number of the files it has
+// sent so that it can answer repair requests for them.
+//
+// ----------------------------------------------------------------------
+
+#define MAX_REPAIR_ATTEMPTS         5
+#define MAX_REPAIR_RANGES           32
+#define MAX_RECENT_SENDS            16
+
+    typedef struct SENT_FILE_RECORD_T
+    {
+        char     path_and_name[ MAX_OUT_FILE_NAME_SIZE ];   // Where the sent file is
+        uint64_t file_size;                                 // The size that was sent
+        uint64_t root_digest;                               // The digest that was sent
+    } sent_file_record;
+
+// ----------------------------------------------------------------------
+// Every file being received has an inactivity timer which is started
+// again whenever anything arrives for it. The timers are kept on a
+// hashed timer wheel: a ring of slots a tick apart, each a list of the
+// transfers whose timers run out in it. Starting a timer again links
+// it in to another slot, and each tick looks only at the transfers in
+// the slots which came due, so that neither costs more with more files
+// being received. A timer further away than the wheel goes round is
+// looked at and left alone once every time round.
+//
+// How long a transfer may go without anything arriving depends on its
+// class, and may be changed with set_transfer_timeout().
+//
+// ----------------------------------------------------------------------
+
+#define TRANSFER_WHEEL_SLOTS        512
+#define TRANSFER_WHEEL_TICK_MS      100
+#define TRANSFER_TIMEOUT_DATA_MS    10000
+#define TRANSFER_TIMEOUT_REPAIR_MS  10000
+#define TIMER_NOT_LINKED            (int)-1
+
+    typedef enum TRANSFER_CLASS_T
+    {
+        transfer_class_data,                          // The blocks of the file are coming
+        transfer_class_repair,                        // Leaves of it were asked for again
+        TRANSFER_CLASSES
+    } transfer_class;
+
+// ----------------------------------------------------------------------
+// A file being received is checked against its digest by a verifier
+// thread of its own class, so that reading a large file back never
+// holds up the thread which handles frames. Only the leaves which have
+// arrived in full and have not already matched are read back; a leaf
+// which matched is never read again, so a repair checks only the leaves
+// which were asked for again. The job is handed back by its done flag,
+// which transfer_timed_out() looks for.
+//
+// ----------------------------------------------------------------------
+
+    typedef struct VERIFY_JOB_T
+    {
+        int                   file_handle;            // The file to read back
+        uint64_t              file_size;              // Its size
+        std::vector<uint32_t> hash_leaves;            // The leaves to hash
+        std::vector<uint64_t> leaf_digests;           // Their digests, by leaf
+        bool                  read_ok;                // false if the file could not be read
+        uint64_t              trace_start;            // When the job was queued
+        std::atomic<bool>     job_done;               // Set by the verifier when finished
+    } verify_job;
+
 // ----------------------------------------------------------------------
 // When a file is sent, the file on the receiving side maintains data
 // variables to control and monitor the reception of the unsolicited 
@@ -121,12 +280,178 @@
     typedef struct FILE_SENT_CONTROL_T
     {
         bool     in_file_transfer;                    // true if a file transfer is happening
-        int      to_receive_count;                    // The number of bytes left to receive
+        uint64_t to_receive_count;                    // The number of bytes left to receive
         FILE   * out_file_p;                          // The output file being created
-        time_t   transfer_start_time;                 // The time stamp of the latest inbound data
+        uint64_t timer_deadline;                      // Wheel tick the transfer times out at, else 0
+        int      timer_next;                          // The next transfer in the same wheel slot
+        int      timer_prev;                          // The one before it in the wheel slot
+        transfer_class timer_class;                   // Which timeout the transfer is given
+        uint64_t control_key;                         // The sender's address and the transfer ID
+        int      dropped_block_count;                 // Blocks which failed their CRC check
         char     ip_address[ SENT_CTRL_IP_SIZE ];     // IP address of remote device
+        uint32_t transfer_id;                         // The remote device's ID for the transfer
+        char     out_file_name[ MAX_OUT_FILE_NAME_SIZE ]; // The name of the file being created
+        uint64_t file_size;                           // The size of the whole file
+        uint64_t root_digest;                         // The sender's digest of the file
+        uint32_t digest_leaves_received;              // How many leaf digests have arrived
+        int      repair_attempts;                     // How many times repairs were requested
+        uint64_t started_ns;                          // Monotonic time the transfer started
+        std::vector<uint64_t> leaf_digests;           // The sender's digest of every leaf
+        std::vector<bool>     leaf_digest_known;      // Which leaf digests have arrived
+        std::vector<uint32_t> leaf_bytes_received;    // Bytes written in to every leaf
+        std::vector<bool>     leaf_verified;          // Leaves which matched their digests
+        verify_job          * verify_p;               // The check under way, else NULL
     } file_sent_control;
 
+// ----------------------------------------------------------------------
+// A file offered to us is only taken while there is room for it. The
+// files being received at once, the bytes of disk set aside for them
+// and the files held open for them are each limited, the last to no
+// more than Linux lets us open less a few spare. The receive shards
+// are counted against their owner's limits, so the limits hold however
+// the files are split among them.
+//
+// An offer there is no room for waits in a short queue for a file to
+// finish, in the order it came. The blocks which go by meanwhile are
+// asked for again once the digest is in, as lost blocks are. An offer
+// which finds the queue full, waits too long, or could never fit is
+// refused, and the sender is told so with a busy reply naming the
+// transfer and the file.
+//
+// The bytes set aside allow for a file of 10 GB, the largest we expect
+// to be sent, with room to spare for smaller ones.
+//
+// ----------------------------------------------------------------------
+
+#define ADMIT_MAX_TRANSFERS         64
+#define ADMIT_MAX_RESERVED_BYTES    ( 16384ULL * 1024 * 1024 )
+#define ADMIT_MAX_OPEN_FILES        64
+#define ADMIT_SPARE_DESCRIPTORS     32
+#define ADMIT_QUEUE_SLOTS           16
+#define ADMIT_QUEUE_WAIT_MS         2000
+
+    enum admit_result
+    {
+        admit_taken     = 1,                // There was room, it is counted
+        admit_no_room   = 2,                // Not now, perhaps later
+        admit_too_large = 3                 // It could never fit
+    } ;
+
+    typedef struct ADMISSION_COUNTS_T
+    {
+        std::atomic<uint32_t> transfers;              // Files being received
+        std::atomic<uint64_t> reserved_bytes;         // Their sizes added together
+        std::atomic<uint32_t> open_files;             // Their files which are open
+        uint32_t              max_transfers;          // The limits on each
+        uint64_t              max_reserved_bytes;
+        uint32_t              max_open_files;
+    } admission_counts;
+
+    typedef struct PENDING_OFFER_T
+    {
+        file_transfer_header offer_header;            // What was offered
+        char     ip_address[ SENT_CTRL_IP_SIZE ];     // Who offered it
+        uint64_t queued_ns;                           // Monotonic time it was queued
+    } pending_offer;
+
+#define XFER_BUSY_CMD_SIZE      8
+
+    typedef struct FILE_BUSY_REPLY_T
+    {
+        char          busy_command[ XFER_BUSY_CMD_SIZE ];   // Currently always :busy:
+        uint32_t      busy_crc;                             // CRC32C of the whole frame
+        uint32_t      transfer_id;                          // The offer being refused
+        uint32_t      busy_reason;                          // An admit_result
+        uint64_t      file_size;                            // The size that was offered
+        char          file_name[ XFER_HDR_NAME_SZIE ];      // The name that was offered
+    } file_busy_reply;
+
+// ----------------------------------------------------------------------
+// Outbound frames fall in to three classes. Chat text and control
+// frames (file transfer headers, get requests and repair requests) are
+// sent right away through the transmit socket, which is marked as low
+// delay so that Linux queues it ahead of bulk traffic. File blocks and
+// the digests which follow them are bulk data, sent through a second,
+// non-blocking socket marked for throughput, so that a typed line never
+// waits behind the blocks of a large file.
+//
+// ----------------------------------------------------------------------
+
+#define TRANSMIT_PRIORITY_INTERACTIVE   6     // TC_PRIO_INTERACTIVE
+#define TRANSMIT_PRIORITY_BULK          2     // TC_PRIO_BULK
+
+// ----------------------------------------------------------------------
+// The buffers Linux gives a socket by default hold only a couple of
+// hundred frames, which a burst of file blocks fills while the main
+// loop sleeps. The sockets are given the starting sizes here instead.
+// Whenever Linux tells us it dropped frames because the receive socket
+// was full, or the bulk socket is found full, that socket's buffer is
+// doubled, no more often than the interval here, up to the largest
+// size. Sizes are what we ask for; Linux keeps twice that for its own
+// bookkeeping.
+//
+// Sizes beyond net.core.rmem_max and net.core.wmem_max are only had
+// when we may use SO_RCVBUFFORCE and SO_SNDBUFFORCE, which wants
+// CAP_NET_ADMIN; otherwise Linux gives us what those allow.
+//
+// ----------------------------------------------------------------------
+
+#define SOCKET_RECEIVE_BUFFER_START     (4 * 1024 * 1024)
+#define SOCKET_RECEIVE_BUFFER_MAX       (64 * 1024 * 1024)
+#define SOCKET_SEND_BUFFER_START        (256 * 1024)
+#define SOCKET_BULK_BUFFER_START        (1024 * 1024)
+#define SOCKET_BULK_BUFFER_MAX          (16 * 1024 * 1024)
+#define SOCKET_BUFFER_GROW_INTERVAL_MS  1000
+
+// ----------------------------------------------------------------------
+// Files being sent by us are advanced a few blocks at a time every time
+// the main loop calls service_transfers() so that a large file does not
+// stop us from reading inbound frames and console input. Only so many
+// files may be sent at once. Leaves sent again because of a repair
+// request are sent the same way.
+//
+// The bytes allowed per call are shared among the files being sent by
+// deficit round robin: every round each file is credited its weight
+// times a full block and sends blocks while its credit lasts. Repairs
+// get a larger weight so that a receiver waiting on a few leaves is
+// not held up behind whole files. If the bulk socket is full we stop
+// until the next call.
+//
+// ----------------------------------------------------------------------
+
+#define SEND_BYTES_PER_SERVICE      (64 * 1024)
+#define SEND_WEIGHT_FILE            1
+#define SEND_WEIGHT_REPAIR          4
+#define MAX_OUTBOUND_TRANSFERS      8
+
+    enum advance_result
+    {
+        advance_more      = 1,              // Has more to send but no credit
+        advance_idle      = 2,              // Waiting on the disk
+        advance_done      = 3,              // Finished, whole or not
+        advance_link_full = 4               // The bulk socket is full
+    } ;
+
+    typedef struct OUTBOUND_TRANSFER_T
+    {
+        char             path_and_name[ MAX_OUT_FILE_NAME_SIZE ]; // The file being sent
+        ReadAheadClass * in_file_p;                   // Reads the file ahead of us
+        uint32_t         transfer_id;                 // Our ID for the transfer
+        uint64_t         file_size;                   // The size the header offered
+        uint64_t         out_offset;                  // How much has been sent
+        uint64_t         end_offset;                  // Where the sending stops
+        bool             is_repair;                   // true if resending leaves
+        bool             is_done;                     // true once it may be removed
+        int              weight;                      // Share of the bytes per call
+        int              deficit;                     // Bytes it may still send this round
+        uint32_t         digest_next_leaf;            // First leaf digest not yet sent
+        bool             digest_sent;                 // true once the digest went out
+        const char     * buffer_p;                    // The read-ahead buffer being sent
+        int              buffer_count;                // Bytes of the buffer not yet sent
+        uint64_t         started_ns;                  // Monotonic time the sending started
+        std::vector<uint64_t> leaf_digests;           // Digest of every leaf sent so far
+    } outbound_transfer;
+
 // ----------------------------------------------------------------------
 // If a control frame is not found, this is the index value that gets
 // returned by the control search method. Typically the 
@@ -138,6 +463,93 @@
 
 #define CONTROL_NOT_FOUND       (int)-1
 
+// ----------------------------------------------------------------------
+// Unless the pipeline is started everything happens on the thread which
+// calls us. Once it is started three threads of our own do the work
+// which waits on Linux, each handed its work through a queue of its own
+// so that no stage waits on another:
+//
+// The receive thread takes in frames, as many at once as Linux has up
+// to the batch size, and queues them for read_data().
+//
+// The disk writer thread writes the blocks of files being received, in
+// the order they were queued. Anything which reads a file back or
+// closes it first waits for the writes queued before it.
+//
+// The transmit thread sends the files being sent, the bytes allowed
+// per service shared among them as service_transfers() would share
+// them, once every service interval, which paces them.
+//
+// The thread which calls us is left with the console, the text and
+// the file transfer protocol, none of which waits on the disk or on
+// the network.
+//
+// ----------------------------------------------------------------------
+
+#define RECEIVE_QUEUE_SLOTS         1024
+#define RECEIVE_BATCH_FRAMES        32
+#define DISK_QUEUE_SLOTS            1024
+#define TRANSMIT_QUEUE_SLOTS        ( MAX_OUTBOUND_TRANSFERS * 2 )
+#define SENT_FILE_QUEUE_SLOTS       MAX_RECENT_SENDS
+#define PIPELINE_IDLE_DELAY_MS      100
+#define PIPELINE_FULL_DELAY_US      200
+#define TRANSMIT_SERVICE_INTERVAL_US 1000
+
+// ----------------------------------------------------------------------
+// Frames are received in to buffers from a pool and are handed along by
+// pointer from there on: through the queues, to the code which handles
+// them, to the disk writer for the blocks of files, and to the caller
+// for text. Without the pipeline a frame at a time is enough. With it
+// the pool holds enough frames to fill every queue a frame may wait in
+// and every batch being received, so it never runs dry before a queue
+// fills. A block which did not arrive in a pooled frame, such as one a
+// benchmark feeds to receive_frame(), is copied in to one to be queued.
+//
+// ----------------------------------------------------------------------
+
+#define FRAME_POOL_IDLE_FRAMES      2
+#define FRAME_POOL_SPARE_FRAMES     8
+#define FRAME_POOL_HUGE_PAGES       1
+
+#if MAX_OUT_DATA_SIZE > UDP_IN_BUFFER_SIZE
+#error "A pooled frame must be able to hold a block of a file"
+#endif
+
+// ----------------------------------------------------------------------
+// The pipeline may also split the files being received among receive
+// shards, for computers which take in files from many devices at once.
+// Every shard has a receive socket of its own, all of them bound to the
+// one port with SO_REUSEPORT, a worker thread of its own, and a table
+// of the files it is receiving of its own, so that no shard waits on
+// another. The receive socket we were created with is the first shard
+// and is worked by the pipeline as it would be without shards.
+//
+// All of the frames from one device go to one shard, chosen by a hash
+// of the device's address. Linux hands a frame sent to us alone to the
+// shard the hash chooses. A broadcasted frame is handed to every shard
+// and the shards which it is not for drop it; a socket filter could
+// drop them sooner, but Linux would count what it filtered as frames
+// it had to drop, which is what the receive buffers are sized by.
+//
+// The worker of a shard takes care of the files being received from
+// its devices itself. Everything else, text, get requests and repair
+// requests, it queues for read_data(), as the receive thread does.
+//
+// ----------------------------------------------------------------------
+
+#define MAX_RECEIVE_SHARDS          16
+#define SHARD_QUEUE_SLOTS           256
+#define SHARD_HASH_MULTIPLIER       0x45d9f3bU
+
+    typedef struct DISK_WRITE_T
+    {
+        FILE         * out_file_p;                    // The file being received
+        uint64_t       file_offset;                   // Where the block goes
+        int            write_size;                    // Bytes in the block
+        pooled_frame * frame_p;                       // The frame the block is held in
+        const char   * write_data_p;                  // The block, inside of the frame
+    } disk_write;
+
 // ----------------------------------------------------------------------
 // The Chat Class is described here
 //
@@ -148,40 +560,188 @@ class ChatClass
     // Public methods and data which anybody may invoke
     public:
         ChatClass( const int this_port_number );
+        ChatClass( const int transmit_port, const int receive_port, const uint32_t destination_address,
+            const bool share_receive_port );
         ~ChatClass( void );
 
         void send_text( char * this_text_p );
         void send_data( const void * this_data_p, int this_size );
         int  read_data( void );
+        int  receive_frame( char * this_data_p, int this_byte_size, const char * ip_address_p );
         int  set_non_blocking( const int this_socket );
         int  set_blocking( const int this_socket );
         void send_file ( char * path_and_name_p, const bool response_to_get_request );
         void get_file ( char * path_and_name_p );
         bool transfer_timed_out( void );
+        bool service_transfers( void );
+        uint32_t last_sender_address( void );
+        uint64_t last_receive_time( void );
+        size_t inbound_transfer_count( void );
+        bool wait_for_input( const int other_handle, const int timeout_us );
+        void socket_buffer_sizes( int & receive_bytes, int & send_bytes, int & bulk_bytes );
+        void set_transfer_timeout( const transfer_class this_class, const uint32_t timeout_ms );
+        void set_admission_limits( const uint32_t max_transfers, const uint64_t max_reserved_bytes,
+                 const uint32_t max_open_files );
+        void admission_usage( uint32_t & transfers, uint64_t & reserved_bytes, uint32_t & open_files,
+                 size_t & queued_offers );
+        bool pipeline_start( const int receive_shards = 1 );
+        void pipeline_stop( void );
+        void frame_pool_sizes( uint32_t & frame_count, uint32_t & frame_bytes, bool & huge_pages );
 
         // Make inbound UDP frames reachable by everyone. Typical
         // MTUs for UDP on the Internet are some 512 bytes however
         // fragmentation and re-assembly and such means that we
         // can get somewhere around 1500 byte frames in one gulp
-        // on Ethernet and WiFi networks, so we allocate a buffer
-        // larger than the maximum we expect.
-        char udp_inbound_buffer[ UDP_IN_BUFFER_SIZE ];
+        // on Ethernet and WiFi networks, so the frame buffers are
+        // larger than the maximum we expect. The text read_data()
+        // last returned stays where this points, with room after
+        // it for a NULL, until read_data() is called again.
+        char * received_text( void );
 
     // Private methods and data
     private:
+        ChatClass( ChatClass & owner_class, const int shard_socket );
+        void clear_state( void );
         int  how_many_are_running( void );
+        void open_sockets( const int transmit_port, const int receive_port, const uint32_t destination_address,
+                 const bool share_receive_port );
         void receive_file_start( char * this_data_p, int this_byte_size, const char * ip_address_p );
-        bool receive_file_block( char * this_data_p, int this_byte_size, const char * ip_address_p );
+        bool start_inbound_file( const file_transfer_header & file_header, const char * ip_address_p );
+        admit_result admit_transfer( const uint64_t file_size );
+        void release_transfer( const uint64_t file_size, const bool file_open );
+        void close_inbound_file( file_sent_control & this_control );
+        void queue_offer( const file_transfer_header & file_header, const char * ip_address_p );
+        void service_pending_offers( void );
+        int  find_pending_offer( const char * ip_address_p, const uint32_t transfer_id );
+        void refuse_offer( const file_transfer_header & file_header, const char * ip_address_p,
+                 const admit_result this_reason );
+        void receive_busy_reply( char * this_data_p, int this_byte_size, const char * ip_address_p );
+        bool receive_file_block( char * this_data_p, int this_byte_size, const uint64_t this_offset,
+                 const uint32_t transfer_id, const char * ip_address_p );
+        bool receive_block_frame( char * this_data_p, int this_byte_size, const char * ip_address_p );
+        void receive_digest_frame( char * this_data_p, int this_byte_size, const char * ip_address_p );
+        void receive_repair_request( char * this_data_p, int this_byte_size );
+        void verify_file_transfer( const int control_index );
+        void complete_verification( const int control_index, verify_job & this_job );
+        void service_verifications( void );
+        void cancel_verification( file_sent_control & this_control );
+        void verifier_thread( void );
+        void finish_file_transfer( const int control_index );
+        uint32_t leaf_size( const file_sent_control & this_control, const uint32_t leaf_index );
+        bool send_file_block( const char * this_data_p, const int this_size, const uint64_t this_offset,
+                 const uint32_t transfer_id );
+        bool send_file_digest( outbound_transfer & this_transfer );
+        void remember_sent_file( const char * path_and_name_p, const uint64_t file_size, const uint64_t root_digest );
         void file_transfer( char * this_data_p, const int this_byte_size, const char * ip_address_p );
         void get_file_request( const char * this_data_p );
-        int  find_send_control( const char * ip_address_p );
+        int  find_send_control( const char * ip_address_p, const uint32_t transfer_id );
+        int  add_send_control( const file_sent_control & this_control );
+        void remove_send_control( const int control_index );
+        void arm_transfer_timer( const int control_index, const transfer_class this_class );
+        void link_transfer_timer( const int control_index, const uint64_t this_deadline );
+        void stop_transfer_timer( const int control_index );
+        bool expire_transfer( const int control_index );
+        static uint64_t wheel_tick_now( void );
+        static uint64_t send_control_key( const char * ip_address_p, const uint32_t transfer_id );
+        advance_result advance_transfer( outbound_transfer & this_transfer, int & byte_budget );
+        bool send_bulk_data( const void * this_data_p, int this_size );
+        void finish_outbound_transfer( outbound_transfer & this_transfer );
+        static metric_frame frame_type( const void * this_data_p, int this_size );
+        static uint64_t trace_id( const file_sent_control & this_control );
+        void take_socket_control( struct msghdr & this_message );
+        static int size_socket_buffer( const int this_socket, const bool receive_side, const int wanted_bytes );
+        static void grow_socket_buffer( const int this_socket, const bool receive_side, const int largest_bytes,
+                 int & buffer_bytes, uint64_t & grown_ns );
+        bool service_send_tasks( void );
+        void start_outbound_transfer( const outbound_transfer & this_transfer );
+        void write_file_block( FILE * out_file_p, const char * this_data_p, int this_byte_size,
+                 const uint64_t this_offset );
+        void queue_disk_write( FILE * out_file_p, const char * this_data_p, const int this_byte_size,
+                 const uint64_t this_offset );
+        void wait_for_disk_writes( void );
+        int  take_received_frame( void );
+        void receive_thread( void );
+        void disk_writer_thread( void );
+        void transmit_thread( void );
+        void size_frame_pool( const uint32_t frame_count );
+        int  fill_receive_batch( pooled_frame ** these_frames_p );
+        int  receive_batch( ChatClass & table_class, pooled_frame ** these_frames_p, const int slot_count );
+        int  process_frame( char * this_data_p, int this_byte_size, const struct sockaddr_in & from_address,
+                 const uint64_t receive_ns );
+        void mark_receive_socket( const int this_socket );
+        bool start_receive_shards( const int receive_shards );
+        void stop_receive_shards( void );
+        bool attach_shard_steering( void );
+        void shard_thread( const int shard_index );
+        static uint32_t shard_of_address( const struct sockaddr_in & from_address, const int shard_total );
+        static bool is_inbound_transfer_frame( const char * this_data_p, const int this_byte_size );
 
         int                           base_port_number;
         int                           send_socket;
+        int                           bulk_socket;
         int                           receive_socket;
         struct sockaddr_in            send_address;
         struct sockaddr_in            receive_address;
+        uint64_t                      receive_time_ns;
+        uint32_t                      socket_drops_seen;
+        int                           receive_buffer_bytes;
+        int                           bulk_buffer_bytes;
+        uint64_t                      receive_buffer_grown_ns;
+        uint64_t                      bulk_buffer_grown_ns;
         std::vector<file_sent_control>send_control;
+        std::unordered_map<uint64_t, int> send_control_index;
+        int                           timer_wheel[ TRANSFER_WHEEL_SLOTS ];
+        uint64_t                      timer_wheel_tick;
+        uint32_t                      transfer_timeout_ms[ TRANSFER_CLASSES ];
+        std::vector<uint64_t>         expired_keys;
+        std::vector<uint64_t>         verifying_keys;
+        std::deque<verify_job *>      verify_queue;
+        std::thread                   verifier;
+        std::mutex                    verify_lock;
+        std::condition_variable       verify_wake;
+        std::condition_variable       verify_finished;
+        bool                          stop_verifier;
+        admission_counts              admission;
+        admission_counts            * admission_p;
+        std::vector<pending_offer>    pending_offers;
+        std::vector<sent_file_record> recent_sends;
+        std::vector<outbound_transfer>send_tasks;
+        uint32_t                      next_transfer_id;
+        uint32_t                      first_transfer_id;
+        unsigned int                  service_round;
+        IntegrityClass                integrity;
+        std::atomic<int>              outbound_active;
+
+        // The pipeline, when it is started
+        bool                          pipeline_running;
+        std::atomic<bool>             stop_pipeline;
+        int                           pipeline_event;
+        SpscQueueClass<pooled_frame *, RECEIVE_QUEUE_SLOTS>     * receive_queue_p;
+        SpscQueueClass<disk_write, DISK_QUEUE_SLOTS>            * disk_queue_p;
+        SpscQueueClass<outbound_transfer, TRANSMIT_QUEUE_SLOTS> * transmit_queue_p;
+        SpscQueueClass<sent_file_record, SENT_FILE_QUEUE_SLOTS> * sent_file_queue_p;
+        uint64_t                      disk_writes_queued;
+        std::atomic<uint64_t>         disk_writes_done;
+        std::atomic<bool>             disk_writer_waiting;
+        std::atomic<bool>             transmit_waiting;
+        std::thread                   receiver;
+        std::thread                   disk_writer;
+        std::thread                   transmitter;
+        std::mutex                    pipeline_lock;
+        std::condition_variable       disk_wake;
+        std::condition_variable       disk_drained;
+        std::condition_variable       transmit_wake;
+
+        // The receive shards beyond the first, when there are any
+        int                           shard_count;
+        unsigned int                  next_shard_read;
+        ChatClass                   * shard_table_p[ MAX_RECEIVE_SHARDS ];
+        SpscQueueClass<pooled_frame *, SHARD_QUEUE_SLOTS> * shard_queue_p[ MAX_RECEIVE_SHARDS ];
+        std::thread                   shard_worker[ MAX_RECEIVE_SHARDS ];
+
+        // The frame buffers, and the frame read_data() last returned
+        FramePoolClass              * frame_pool_p;
+        pooled_frame                * held_frame_p;
 } ;
 
 #endif
@@ -1,81 +1,193 @@
-
-// ----------------------------------------------------------------------
-// Various MACROs and anything else that does not fit well anywhere else
-//
-// See main.c for disclaimers and other information.
-//
-// Fredric L. Rice, June 2018
-// http://www.crystallake.name
-// fred @ crystal lake . name
-// 
-// ----------------------------------------------------------------------
-
-#ifndef _CHAT_DEFINES_H_
-#define _CHAT_DEFINES_H_    1
-
-// ----------------------------------------------------------------------
-// We always allow the "exit" command to be entered from the console
-// to terminate the program. The other commands are wapped in
-// conditional compiles to enable or disable those commands. Set the
-// value to 0 to not allow various commands.
-//
-// If you want a simple many-to-many chat program, set them all to 0.
-//
-// ----------------------------------------------------------------------
-
-#define ALLOW_COMMAND_SEND  1
-#define ALLOW_COMMAND_GET   1
-#define ALLOW_COMMAND_LOG   1
-
-// ----------------------------------------------------------------------
-// You can turn logging off entirely by setting this value to 0 zero
-//
-// ----------------------------------------------------------------------
-
-#define WANT_LOGGING        1
-
-// ----------------------------------------------------------------------
-// The console commands to control things can be redefined here.
-//
-// ----------------------------------------------------------------------
-
-    const char *command_exit = "exit";
-    const char *command_send = ":send";
-    const char *command_get  = ":get";
-    const char *command_log  = ":log";
-
-// ----------------------------------------------------------------------
-// The UDP port numbers used to transmit and receive are defined here
-// by providing the base UDP port number. All UDP port numbers used
-// in this program start from this base number.
-//
-// ----------------------------------------------------------------------
-
-#define DEFAULT_UDP_PORT_BASE       5777
-
-// ----------------------------------------------------------------------
-// Maximum console input buffer size is defined here.
-//
-// ----------------------------------------------------------------------
-
-#define MAX_CONSOLE_IN_SIZE         1024
-
-// ----------------------------------------------------------------------
-// Other defined constants that we will be using. We attempt to avoid
-// hard-coded numbers in the source code.
-//
-// ----------------------------------------------------------------------
-
-#define ASCII_NULL_ZERO             0x00
-#define ASCII_LINE_FEED             0x0a
-#define ASCII_CARRIAGE_RETURN       0x0d
-
-// ----------------------------------------------------------------------
-// The main function avoids hard looping by delying this number of
-// microseconds. Typically we go for around 5 milliseconds.
-//
-// ----------------------------------------------------------------------
-
-#define MAIN_LOOP_SLEEP_DELAY       5000
-
-#endif
+
+// ----------------------------------------------------------------------
+// Various MACROs and anything else that does not fit well anywhere else
+//
+// See main.c for disclaimers and other information.
+//
+// Fredric L. Rice, June 2018
+// http://www.crystallake.name
+// fred @ crystal lake . name
+// 
+// ----------------------------------------------------------------------
+
+#ifndef _CHAT_DEFINES_H_
+#define _CHAT_DEFINES_H_    1
+
+// ----------------------------------------------------------------------
+// We always allow the "exit" command to be entered from the console
+// to terminate the program. The other commands are wapped in
+// conditional compiles to enable or disable those commands. Set the
+// value to 0 to not allow various commands.
+//
+// If you want a simple many-to-many chat program, set them all to 0.
+//
+// ----------------------------------------------------------------------
+
+#define ALLOW_COMMAND_SEND  1
+#define ALLOW_COMMAND_GET   1
+#define ALLOW_COMMAND_LOG   1
+
+// ----------------------------------------------------------------------
+// You can turn logging off entirely by setting this value to 0 zero
+//
+// ----------------------------------------------------------------------
+
+#define WANT_LOGGING        1
+
+// ----------------------------------------------------------------------
+// How hard the log writer works to get lines on to the disk. See
+// LoggingClass.h for the modes. A commit happens once the oldest line
+// waiting is the number of milliseconds old or the number of bytes are
+// waiting; if both are 0 every batch of lines is committed.
+//
+// ----------------------------------------------------------------------
+
+#define CHAT_LOG_DURABILITY     log_durability_flush
+#define CHAT_LOG_COMMIT_MS      0
+#define CHAT_LOG_COMMIT_BYTES   0
+
+// ----------------------------------------------------------------------
+// Set to 1 to have the words of the log indexed, in the background, so
+// that tools/logsearch can find them without reading every segment.
+//
+// ----------------------------------------------------------------------
+
+#define CHAT_LOG_TERM_INDEX     1
+
+// ----------------------------------------------------------------------
+// The metrics are served for collectors to scrape in the Prometheus
+// text format on a Unix domain socket, named here and created in the
+// directory the program was launched within, and on a TCP port of the
+// loopback address if one is given here. Set the name to "" or the
+// port to 0 to not serve them that way.
+//
+// ----------------------------------------------------------------------
+
+#define CHAT_METRICS_SOCKET     "chat-metrics.sock"
+#define CHAT_METRICS_TCP_PORT   0
+
+// ----------------------------------------------------------------------
+// Set to 1 to have the main loop wait for a frame or for console input
+// rather than sleeping, so that it answers at once and still comes
+// around at least every MAIN_LOOP_SLEEP_DELAY microseconds. Set to 0 to
+// always sleep for that long, as the program used to.
+//
+// ----------------------------------------------------------------------
+
+#define CHAT_LOOP_WAITS_FOR_INPUT   1
+
+// ----------------------------------------------------------------------
+// Set to 1 to have frames received, the blocks of files received
+// written, and files sent by threads of their own, so that none of them
+// waits on another or on the console. Set to 0 to do everything on the
+// main loop's thread, as the program used to.
+//
+// ----------------------------------------------------------------------
+
+#define CHAT_PIPELINE_THREADS       1
+
+// ----------------------------------------------------------------------
+// How many receive shards the pipeline splits the files being received
+// among. Each shard has a receive socket and a thread of its own, which
+// helps a computer taking in files from many devices at once. The files
+// from any one device are always received by the same shard, so 1 is
+// best unless there are many devices.
+//
+// ----------------------------------------------------------------------
+
+#define CHAT_RECEIVE_SHARDS         1
+
+// ----------------------------------------------------------------------
+// How many files may be received at once, how many megabytes may be
+// set aside for them, and how many files may be held open for them.
+// Files offered beyond these wait a little for room, then are refused
+// and their senders told so.
+//
+// ----------------------------------------------------------------------
+
+#define CHAT_ADMIT_TRANSFERS        64
+#define CHAT_ADMIT_RESERVED_MB      4096
+#define CHAT_ADMIT_OPEN_FILES       64
+
+// ----------------------------------------------------------------------
+// The echo command has the program answer latency probes, text which
+// starts with the probe prefix, with a reply which starts with the
+// reply prefix and carries the time at which the probe was shown, for
+// bench/latency_bench to measure with.
+//
+// ----------------------------------------------------------------------
+
+#define ECHO_PROBE_PREFIX       ":ping "
+#define ECHO_REPLY_PREFIX       ":pong "
+
+// ----------------------------------------------------------------------
+// Tracing records how long every stage of the main loop and of the
+// file transfers takes, for :tracedump to write out for chrome://tracing
+// or the Perfetto UI. Set CHAT_TRACE_AT_START to 1 to trace from the
+// start rather than from when :trace turns it on. The trace is written
+// to the file named here, in the directory the program was launched
+// within, unless :tracedump is given another.
+//
+// ----------------------------------------------------------------------
+
+#define CHAT_TRACE_AT_START     0
+#define CHAT_TRACE_FILE         "chat-trace.json"
+
+// ----------------------------------------------------------------------
+// The console commands to control things can be redefined here.
+//
+// ----------------------------------------------------------------------
+
+    const char *command_exit = "exit";
+    const char *command_send = ":send";
+    const char *command_get  = ":get";
+    const char *command_log  = ":log";
+    const char *command_logstat = ":logstat";
+    const char *command_stats   = ":stats";
+    const char *command_echo    = ":echo";
+    const char *command_trace   = ":trace";
+    const char *command_tracedump = ":tracedump";
+
+// ----------------------------------------------------------------------
+// The UDP port numbers used to transmit and receive are defined here
+// by providing the base UDP port number. All UDP port numbers used
+// in this program start from this base number.
+//
+// ----------------------------------------------------------------------
+
+#define DEFAULT_UDP_PORT_BASE       5777
+
+// ----------------------------------------------------------------------
+// Maximum console input buffer size is defined here.
+//
+// ----------------------------------------------------------------------
+
+#define MAX_CONSOLE_IN_SIZE         1024
+
+// ----------------------------------------------------------------------
+// Other defined constants that we will be using. We attempt to avoid
+// hard-coded numbers in the source code.
+//
+// ----------------------------------------------------------------------
+
+#define ASCII_NULL_ZERO             0x00
+#define ASCII_LINE_FEED             0x0a
+#define ASCII_CARRIAGE_RETURN       0x0d
+
+// ----------------------------------------------------------------------
+// The main function avoids hard looping by delying this number of
+// microseconds. Typically we go for around 5 milliseconds.
+//
+// ----------------------------------------------------------------------
+
+#define MAIN_LOOP_SLEEP_DELAY       5000
+
+// ----------------------------------------------------------------------
+// Every time around the main loop we take in at most this many inbound
+// UDP frames before looking at the console again.
+//
+// ----------------------------------------------------------------------
+
+#define MAX_FRAMES_PER_LOOP         256
+
+#endif
@@ -0,0 +1,130 @@
+
+// ----------------------------------------------------------------------
+// ClockClass -- Small class which keeps the time of day and the
+// monotonic time cached so that everything which needs to know what
+// time it is can find out without asking Linux.
+//
+// The main loop calls clock_tick() once every time around, which reads
+// both clocks and caches them. Everything else reads the cached times,
+// which are never more than one pass of the main loop old; that is far
+// finer than the timeouts and the log need. Any thread may read them.
+//
+// A program which never calls clock_tick(), such as a tool which only
+// writes a log, gets the coarse clocks instead, which Linux keeps up to
+// date every scheduler tick and which cost little more than a load.
+//
+// Something which measures how long a single call takes should use
+// clock_precise_ns() instead.
+//
+// See main.c for disclaimers and other information.
+//
+// Fredric L. Rice, June 2018
+// http://www.crystallake.name
+// fred @ crystal lake . name
+//
+// ----------------------------------------------------------------------
+
+#include <atomic>
+#include "ClockClass.h"         // Our own class and defined constants
+
+// ----------------------------------------------------------------------
+// Local data storage
+//
+// ----------------------------------------------------------------------
+
+    static std::atomic<uint64_t> cached_monotonic_ns( 0 );
+    static std::atomic<uint64_t> cached_wall_ns( 0 );
+
+// ----------------------------------------------------------------------
+// Returns the time of the clock passed by argument in nanoseconds
+//
+// ----------------------------------------------------------------------
+
+static uint64_t read_clock( const clockid_t this_clock )
+{
+    struct timespec this_time;
+
+    (void)clock_gettime( this_clock, &this_time );
+
+    return (uint64_t)this_time.tv_sec * 1000000000ULL + (uint64_t)this_time.tv_nsec;
+}
+
+// ----------------------------------------------------------------------
+// ClockClass Clock Tick
+//
+// Reads both clocks and caches what they say.
+//
+// ----------------------------------------------------------------------
+
+void ClockClass::clock_tick( void )
+{
+    cached_monotonic_ns.store( read_clock( CLOCK_MONOTONIC ), std::memory_order_relaxed );
+    cached_wall_ns.store( read_clock( CLOCK_REALTIME ), std::memory_order_relaxed );
+}
+
+// ----------------------------------------------------------------------
+// ClockClass Clock Monotonic
+//
+// Returns: The monotonic time in nanoseconds as of the last tick
+//
+// ----------------------------------------------------------------------
+
+uint64_t ClockClass::clock_monotonic_ns( void )
+{
+    const uint64_t this_ns = cached_monotonic_ns.load( std::memory_order_relaxed );
+
+    return 0 != this_ns ? this_ns : read_clock( CLOCK_MONOTONIC_COARSE );
+}
+
+// ----------------------------------------------------------------------
+// ClockClass Clock Wall
+//
+// Returns: The time of day in nanoseconds since the Linux epoch as of
+// the last tick
+//
+// ----------------------------------------------------------------------
+
+uint64_t ClockClass::clock_wall_ns( void )
+{
+    const uint64_t this_ns = cached_wall_ns.load( std::memory_order_relaxed );
+
+    return 0 != this_ns ? this_ns : read_clock( CLOCK_REALTIME_COARSE );
+}
+
+// ----------------------------------------------------------------------
+// ClockClass Clock Seconds
+//
+// Returns: The monotonic time in whole seconds as of the last tick, for
+// timeouts which must not jump when the time of day is set
+//
+// ----------------------------------------------------------------------
+
+time_t ClockClass::clock_seconds( void )
+{
+    return (time_t)( clock_monotonic_ns( ) / 1000000000ULL );
+}
+
+// ----------------------------------------------------------------------
+// ClockClass Clock Precise
+//
+// Returns: The monotonic time in nanoseconds right now
+//
+// ----------------------------------------------------------------------
+
+uint64_t ClockClass::clock_precise_ns( void )
+{
+    return read_clock( CLOCK_MONOTONIC );
+}
+
+// ----------------------------------------------------------------------
+// ClockClass Clock Precise Wall
+//
+// Returns: The time of day in nanoseconds since the epoch right now, to
+// compare with times Linux stamps on things, such as received frames
+//
+// ----------------------------------------------------------------------
+
+uint64_t ClockClass::clock_precise_wall_ns( void )
+{
+    return read_clock( CLOCK_REALTIME );
+}
@@ -0,0 +1,41 @@
+
+// ----------------------------------------------------------------------
+// ClockClass -- Small class which keeps the time of day and the
+// monotonic time cached so that everything which needs to know what
+// time it is can find out without asking Linux.
+//
+// See main.c for disclaimers and other information.
+//
+// Fredric L. Rice, June 2018
+// http://www.crystallake.name
+// fred @ crystal lake . name
+//
+// ----------------------------------------------------------------------
+
+#ifndef _CLOCKCLASS_H_
+#define _CLOCKCLASS_H_   1
+
+#include <stdint.h>
+#include <time.h>
+
+// ----------------------------------------------------------------------
+// Our class is defined here. There is only one clock so everything in
+// it is static and it is never instantiated.
+//
+// ----------------------------------------------------------------------
+
+class ClockClass
+{
+    public:
+        static void     clock_tick( void );
+        static uint64_t clock_monotonic_ns( void );
+        static uint64_t clock_wall_ns( void );
+        static time_t   clock_seconds( void );
+        static uint64_t clock_precise_ns( void );
+        static uint64_t clock_precise_wall_ns( void );
+
+    private:
+        ClockClass( void );
+} ;
+
+#endif
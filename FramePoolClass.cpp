@@ -0,0 +1,237 @@
+
+// ----------------------------------------------------------------------
+// FramePoolClass -- Small class which keeps a fixed number of received
+// frame buffers for reuse.
+//
+// The receive path acquires a frame, has Linux put a frame straight in
+// to it, and hands it on by pointer: to a queue, to the code which
+// handles the frame, to the disk writer. Each holder releases it when
+// it is done with it and the last release puts it back in the pool. No
+// frame is ever copied or allocated once the pool is made.
+//
+// See main.c for disclaimers and other information.
+//
+// Fredric L. Rice, June 2018
+// http://www.crystallake.name
+// fred @ crystal lake . name
+//
+// ----------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "FramePoolClass.h"     // Our own class and defined constants
+
+// ----------------------------------------------------------------------
+// FramePoolClass Constructor
+//
+// The frame data is allocated in one piece, on huge pages if that is
+// asked for and Linux has enough of them, else on ordinary pages which
+// Linux is asked to make huge if it can. A pool smaller than a huge
+// page is never put on one. Every frame starts out free.
+//
+// ----------------------------------------------------------------------
+
+FramePoolClass::FramePoolClass( const uint32_t frame_count, const uint32_t data_size, const bool try_huge_pages ) :
+    frames_p( (pooled_frame *)NULL ), frame_data_p( (char *)NULL ), data_bytes( 0 ), pool_frames( frame_count ),
+    data_size_each( data_size ), huge_pages( false ), free_top( 0 )
+{
+    void   * mapped_p   = MAP_FAILED;
+    uint32_t this_frame = 0;
+
+    data_stride = ( data_size + FRAME_POOL_CACHE_LINE - 1 ) & ~( FRAME_POOL_CACHE_LINE - 1 );
+    data_bytes  = (size_t)data_stride * frame_count;
+
+    if ( true == try_huge_pages && data_bytes >= FRAME_POOL_HUGE_PAGE_SIZE )
+    {
+        const size_t huge_bytes = ( data_bytes + FRAME_POOL_HUGE_PAGE_SIZE - 1 ) & ~(size_t)( FRAME_POOL_HUGE_PAGE_SIZE - 1 );
+
+        mapped_p = mmap( NULL, huge_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+
+        if ( MAP_FAILED != mapped_p )
+        {
+            data_bytes = huge_bytes;
+            huge_pages = true;
+        }
+    }
+
+    if ( MAP_FAILED == mapped_p )
+    {
+        mapped_p = mmap( NULL, data_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+
+        if ( MAP_FAILED == mapped_p )
+        {
+            (void)printf("I was unable to allocate %lu bytes of frame buffers\n", (unsigned long)data_bytes );
+
+            exit( EXIT_FAILURE );
+        }
+
+        if ( true == try_huge_pages && data_bytes >= FRAME_POOL_HUGE_PAGE_SIZE )
+        {
+            (void)madvise( mapped_p, data_bytes, MADV_HUGEPAGE );
+        }
+    }
+
+    frame_data_p = (char *)mapped_p;
+    frames_p     = new pooled_frame[ frame_count ];
+
+    for ( this_frame = 0; this_frame < frame_count; this_frame++ )
+    {
+        pooled_frame & this_pooled = frames_p[ this_frame ];
+
+        this_pooled.frame_refs   = 0;
+        this_pooled.frame_size   = 0;
+        this_pooled.receive_ns   = 0;
+        this_pooled.frame_data_p = frame_data_p + (size_t)data_stride * this_frame;
+
+        (void)memset( (char *)&this_pooled.from_address, 0, sizeof( this_pooled.from_address ) );
+
+        frame_push( &this_pooled );
+    }
+}
+
+// ----------------------------------------------------------------------
+// FramePoolClass Destructor
+//
+// Every frame must have been released by now.
+//
+// ----------------------------------------------------------------------
+
+FramePoolClass::~FramePoolClass( void )
+{
+    delete [] frames_p;
+
+    (void)munmap( frame_data_p, data_bytes );
+}
+
+// ----------------------------------------------------------------------
+// FramePoolClass Frame Acquire
+//
+// Takes a free frame from the pool, holding one reference to it.
+//
+// Returns: The frame, else NULL if every frame is in use
+//
+// ----------------------------------------------------------------------
+
+pooled_frame * FramePoolClass::frame_acquire( void )
+{
+    uint64_t       this_top     = free_top.load( std::memory_order_acquire );
+    uint64_t       next_top     = 0;
+    pooled_frame * this_frame_p = (pooled_frame *)NULL;
+
+    do
+    {
+        if ( 0 == ( this_top & 0xFFFFFFFFULL ) )
+        {
+            return (pooled_frame *)NULL;
+        }
+
+        this_frame_p = &frames_p[ ( this_top & 0xFFFFFFFFULL ) - 1 ];
+
+        next_top = ( ( ( this_top >> 32 ) + 1 ) << 32 ) | this_frame_p->next_free.load( std::memory_order_relaxed );
+    }
+    while ( false == free_top.compare_exchange_weak( this_top, next_top,
+        std::memory_order_acquire, std::memory_order_acquire ) );
+
+    this_frame_p->frame_refs.store( 1, std::memory_order_relaxed );
+
+    return this_frame_p;
+}
+
+// ----------------------------------------------------------------------
+// FramePoolClass Frame Hold
+//
+// Takes one more reference to a frame which is already held.
+//
+// ----------------------------------------------------------------------
+
+void FramePoolClass::frame_hold( pooled_frame * this_frame_p )
+{
+    this_frame_p->frame_refs.fetch_add( 1, std::memory_order_relaxed );
+}
+
+// ----------------------------------------------------------------------
+// FramePoolClass Frame Release
+//
+// Lets go of one reference to a frame, which goes back to the pool if
+// it was the last. Releasing a NULL frame does nothing.
+//
+// ----------------------------------------------------------------------
+
+void FramePoolClass::frame_release( pooled_frame * this_frame_p )
+{
+    if ( (pooled_frame *)NULL == this_frame_p )
+    {
+        return;
+    }
+
+    if ( 1 == this_frame_p->frame_refs.fetch_sub( 1, std::memory_order_acq_rel ) )
+    {
+        frame_push( this_frame_p );
+    }
+}
+
+// ----------------------------------------------------------------------
+// FramePoolClass Frame Owned
+//
+// Returns: true if the data passed by argument lies inside of the data
+// of the frame passed by argument
+//
+// ----------------------------------------------------------------------
+
+bool FramePoolClass::frame_owned( const pooled_frame * this_frame_p, const char * this_data_p )
+{
+    if ( (const pooled_frame *)NULL == this_frame_p )
+    {
+        return false;
+    }
+
+    return this_data_p >= this_frame_p->frame_data_p && this_data_p < this_frame_p->frame_data_p + data_size_each;
+}
+
+// ----------------------------------------------------------------------
+// FramePoolClass Frame Data Size, Frame Count and Frame Huge Pages
+//
+// Returns: How many bytes each frame holds, how many frames there are,
+// and whether the frame data is on huge pages
+//
+// ----------------------------------------------------------------------
+
+uint32_t FramePoolClass::frame_data_size( void )
+{
+    return data_size_each;
+}
+
+uint32_t FramePoolClass::frame_count( void )
+{
+    return pool_frames;
+}
+
+bool FramePoolClass::frame_huge_pages( void )
+{
+    return huge_pages;
+}
+
+// ----------------------------------------------------------------------
+// FramePoolClass Frame Push
+//
+// Puts a frame which nobody holds on top of the free stack.
+//
+// ----------------------------------------------------------------------
+
+void FramePoolClass::frame_push( pooled_frame * this_frame_p )
+{
+    const uint64_t this_index = (uint64_t)( this_frame_p - frames_p ) + 1;
+    uint64_t       this_top   = free_top.load( std::memory_order_relaxed );
+    uint64_t       next_top   = 0;
+
+    do
+    {
+        this_frame_p->next_free.store( (uint32_t)( this_top & 0xFFFFFFFFULL ), std::memory_order_relaxed );
+
+        next_top = ( ( ( this_top >> 32 ) + 1 ) << 32 ) | this_index;
+    }
+    while ( false == free_top.compare_exchange_weak( this_top, next_top,
+        std::memory_order_release, std::memory_order_relaxed ) );
+}
@@ -0,0 +1,92 @@
+
+// ----------------------------------------------------------------------
+// FramePoolClass -- Small class which keeps a fixed number of received
+// frame buffers for reuse, so that a frame may be taken in, handed from
+// thread to thread and written or shown without being copied or having
+// memory allocated for it.
+//
+// See main.c for disclaimers and other information.
+//
+// Fredric L. Rice, June 2018
+// http://www.crystallake.name
+// fred @ crystal lake . name
+//
+// ----------------------------------------------------------------------
+
+#ifndef _FRAMEPOOLCLASS_H_
+#define _FRAMEPOOLCLASS_H_   1
+
+#include <stdint.h>
+#include <stddef.h>
+#include <netinet/in.h>
+#include <atomic>
+
+// ----------------------------------------------------------------------
+// Each frame's data starts on a cache line of its own, and so does the
+// description of each frame, so that threads working on neighbouring
+// frames do not take lines away from each other. The data of all of
+// the frames is one allocation which is put on huge pages if Linux has
+// any to give, which saves the receive path a page table walk for
+// nearly every frame.
+//
+// ----------------------------------------------------------------------
+
+#define FRAME_POOL_CACHE_LINE       64
+#define FRAME_POOL_HUGE_PAGE_SIZE   (2 * 1024 * 1024)
+
+// ----------------------------------------------------------------------
+// A frame in the pool. Whoever acquires it holds one reference to it,
+// and anyone it is handed to who keeps it past the hand off takes one
+// more. It goes back to the pool when the last one is released.
+//
+// ----------------------------------------------------------------------
+
+    typedef struct alignas( FRAME_POOL_CACHE_LINE ) POOLED_FRAME_T
+    {
+        std::atomic<uint32_t> frame_refs;             // References held to the frame
+        std::atomic<uint32_t> next_free;              // The pool's free list, 1 based
+        int                   frame_size;             // Bytes in the frame
+        struct sockaddr_in    from_address;           // Who sent it
+        uint64_t              receive_ns;             // Monotonic time it was taken in
+        char                * frame_data_p;           // The frame's bytes
+    } pooled_frame;
+
+// ----------------------------------------------------------------------
+// Our class is defined here. Any thread may acquire, hold and release
+// frames; the free frames are kept on a stack which is changed with
+// compare and swap, tagged so that a frame taken off and put back in
+// the meantime is noticed.
+//
+// ----------------------------------------------------------------------
+
+class FramePoolClass
+{
+    public:
+        FramePoolClass( const uint32_t frame_count, const uint32_t data_size, const bool try_huge_pages );
+        ~FramePoolClass( void );
+
+        pooled_frame * frame_acquire( void );
+        void           frame_hold( pooled_frame * this_frame_p );
+        void           frame_release( pooled_frame * this_frame_p );
+        bool           frame_owned( const pooled_frame * this_frame_p, const char * this_data_p );
+        uint32_t       frame_data_size( void );
+        uint32_t       frame_count( void );
+        bool           frame_huge_pages( void );
+
+    private:
+        FramePoolClass( const FramePoolClass & );
+        FramePoolClass & operator=( const FramePoolClass & );
+
+        void frame_push( pooled_frame * this_frame_p );
+
+        pooled_frame          * frames_p;
+        char                  * frame_data_p;
+        size_t                  data_bytes;
+        uint32_t                pool_frames;
+        uint32_t                data_size_each;
+        uint32_t                data_stride;
+        bool                    huge_pages;
+        std::atomic<uint64_t>   free_top;             // Tag above the 1 based index of the top
+} ;
+
+#endif
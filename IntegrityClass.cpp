@@ -0,0 +1,645 @@
+
+// ----------------------------------------------------------------------
+// IntegrityClass -- Small class which computes the check values used
+// to make sure that the data in a file transfer arrived intact.
+//
+// Every file block that gets transmitted carries a CRC32C of the block.
+// On processors which offer SSE4.2 the crc32 instruction computes the
+// CRC eight bytes at a time; elsewhere a table-driven "slicing by 8"
+// implementation computes the same value in software.
+//
+// Every file also gets a whole-file digest made from a tree of leaf
+// digests, so that the receiver can prove the file on its disk is the
+// file that was sent, and can ask for just the damaged leaves again.
+//
+// See main.c for disclaimers and other information.
+//
+// Fredric L. Rice, June 2018
+// http://www.crystallake.name
+// fred @ crystal lake . name
+//
+// ----------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <thread>
+#include <atomic>
+#include "IntegrityClass.h"    // Our own class and defined constants
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <nmmintrin.h>
+#define HAVE_X86_CRC32C     1
+#else
+#define HAVE_X86_CRC32C     0
+#endif
+
+// ----------------------------------------------------------------------
+// Local data storage. The slicing tables are built once before main()
+// gets called so that there is no question of two threads building
+// them at the same time.
+//
+// ----------------------------------------------------------------------
+
+    static uint32_t crc32c_table[ CRC32C_TABLE_COUNT ][ CRC32C_TABLE_SIZE ];
+    static uint32_t crc32c_stride_shift[ CRC32C_SHIFT_TABLE_COUNT ][ CRC32C_TABLE_SIZE ];
+
+// ----------------------------------------------------------------------
+// Multiplies a 32 by 32 matrix over GF(2), stored as 32 column words,
+// by the vector passed by argument.
+//
+// ----------------------------------------------------------------------
+
+static uint32_t gf2_matrix_times( const uint32_t * matrix_p, uint32_t this_vector )
+{
+    uint32_t this_sum = 0;
+
+    while ( 0 != this_vector )
+    {
+        if ( this_vector & 1 )
+        {
+            this_sum ^= *matrix_p;
+        }
+
+        this_vector >>= 1;
+        matrix_p++;
+    }
+
+    return this_sum;
+}
+
+// ----------------------------------------------------------------------
+// Squares the matrix offered by argument in to the square matrix.
+//
+// ----------------------------------------------------------------------
+
+static void gf2_matrix_square( uint32_t * square_p, const uint32_t * matrix_p )
+{
+    int this_index = 0;
+
+    for ( this_index = 0; this_index < 32; this_index++ )
+    {
+        square_p[ this_index ] = gf2_matrix_times( matrix_p, matrix_p[ this_index ] );
+    }
+}
+
+// ----------------------------------------------------------------------
+// Builds the operator which advances a CRC register across the number
+// of zero bytes offered by argument. The operator for a single zero
+// bit is squared three times to get the operator for a zero byte, and
+// then the operators for each power of two zero bytes which make up
+// the count are multiplied together.
+//
+// ----------------------------------------------------------------------
+
+static void crc32c_zeros_operator( uint32_t * result_p, size_t zero_bytes )
+{
+    uint32_t power_matrix[ 32 ];
+    uint32_t work_matrix[ 32 ];
+    uint32_t this_row   = 1;
+    int      this_index = 0;
+
+    // The operator for one zero bit, and the identity for the result
+    power_matrix[ 0 ] = CRC32C_POLYNOMIAL;
+
+    for ( this_index = 1; this_index < 32; this_index++ )
+    {
+        power_matrix[ this_index ] = this_row;
+        this_row <<= 1;
+    }
+
+    for ( this_index = 0; this_index < 32; this_index++ )
+    {
+        result_p[ this_index ] = (uint32_t)1 << this_index;
+    }
+
+    // Two, four, then eight zero bits
+    gf2_matrix_square( work_matrix, power_matrix );
+    gf2_matrix_square( power_matrix, work_matrix );
+    gf2_matrix_square( work_matrix, power_matrix );
+    (void)memcpy( power_matrix, work_matrix, sizeof( power_matrix ) );
+
+    while ( 0 != zero_bytes )
+    {
+        if ( zero_bytes & 1 )
+        {
+            for ( this_index = 0; this_index < 32; this_index++ )
+            {
+                work_matrix[ this_index ] = gf2_matrix_times( power_matrix, result_p[ this_index ] );
+            }
+
+            (void)memcpy( result_p, work_matrix, sizeof( work_matrix ) );
+        }
+
+        gf2_matrix_square( work_matrix, power_matrix );
+        (void)memcpy( power_matrix, work_matrix, sizeof( power_matrix ) );
+
+        zero_bytes >>= 1;
+    }
+}
+
+// ----------------------------------------------------------------------
+// Advances the CRC register across one stride of zero bytes using the
+// stride shift tables.
+//
+// ----------------------------------------------------------------------
+
+static inline uint32_t crc32c_shift_stride( const uint32_t this_crc )
+{
+    return crc32c_stride_shift[ 0 ][ this_crc & 0xff ]
+         ^ crc32c_stride_shift[ 1 ][ ( this_crc >> 8 ) & 0xff ]
+         ^ crc32c_stride_shift[ 2 ][ ( this_crc >> 16 ) & 0xff ]
+         ^ crc32c_stride_shift[ 3 ][ this_crc >> 24 ];
+}
+
+    static struct CRC32C_TABLE_BUILDER_T
+    {
+        CRC32C_TABLE_BUILDER_T( void )
+        {
+            uint32_t this_crc   = 0;
+            uint32_t stride_operator[ 32 ];
+            int      this_index = 0;
+            int      this_bit   = 0;
+            int      this_table = 0;
+
+            // The first table is the classic byte at a time table
+            for ( this_index = 0; this_index < CRC32C_TABLE_SIZE; this_index++ )
+            {
+                this_crc = (uint32_t)this_index;
+
+                for ( this_bit = 0; this_bit < 8; this_bit++ )
+                {
+                    this_crc = ( this_crc & 1 ) ? ( this_crc >> 1 ) ^ CRC32C_POLYNOMIAL : ( this_crc >> 1 );
+                }
+
+                crc32c_table[ 0 ][ this_index ] = this_crc;
+            }
+
+            // Each following table advances the previous one by a byte
+            for ( this_index = 0; this_index < CRC32C_TABLE_SIZE; this_index++ )
+            {
+                this_crc = crc32c_table[ 0 ][ this_index ];
+
+                for ( this_table = 1; this_table < CRC32C_TABLE_COUNT; this_table++ )
+                {
+                    this_crc = crc32c_table[ 0 ][ this_crc & 0xff ] ^ ( this_crc >> 8 );
+
+                    crc32c_table[ this_table ][ this_index ] = this_crc;
+                }
+            }
+
+            // The shift tables apply the stride operator a byte at a time
+            crc32c_zeros_operator( stride_operator, CRC32C_STRIDE_SIZE );
+
+            for ( this_index = 0; this_index < CRC32C_TABLE_SIZE; this_index++ )
+            {
+                for ( this_table = 0; this_table < CRC32C_SHIFT_TABLE_COUNT; this_table++ )
+                {
+                    crc32c_stride_shift[ this_table ][ this_index ] =
+                        gf2_matrix_times( stride_operator, (uint32_t)this_index << ( 8 * this_table ) );
+                }
+            }
+        }
+    } crc32c_table_builder;
+
+// ----------------------------------------------------------------------
+// IntegrityClass Constructor
+//
+// We find out whether the processor we are running on has the SSE4.2
+// crc32 instruction so that we know which implementation to use.
+//
+// ----------------------------------------------------------------------
+
+IntegrityClass::IntegrityClass( void ) : hardware_crc( false )
+{
+#if HAVE_X86_CRC32C
+    hardware_crc = __builtin_cpu_supports( "sse4.2" ) ? true : false;
+#endif
+}
+
+// ----------------------------------------------------------------------
+// IntegrityClass Integrity CRC32C
+//
+// The CRC32C of the data passed to the method by argument is computed
+// using the fastest implementation this processor offers.
+//
+// Returns: The CRC32C of the data
+//
+// ----------------------------------------------------------------------
+
+uint32_t IntegrityClass::integrity_crc32c( const void * this_data_p, size_t this_size )
+{
+    uint32_t this_crc = CRC32C_INITIAL_VALUE;
+
+    if ( true == hardware_crc )
+    {
+        this_crc = crc32c_hardware( this_crc, (const unsigned char *)this_data_p, this_size );
+    }
+    else
+    {
+        this_crc = crc32c_software( this_crc, (const unsigned char *)this_data_p, this_size );
+    }
+
+    return ~this_crc;
+}
+
+// ----------------------------------------------------------------------
+// IntegrityClass Integrity Has Hardware CRC
+//
+// Returns: true if the SSE4.2 crc32 instruction is being used
+//
+// ----------------------------------------------------------------------
+
+bool IntegrityClass::integrity_has_hardware_crc( void )
+{
+    return hardware_crc;
+}
+
+// ----------------------------------------------------------------------
+// IntegrityClass CRC32C Hardware
+//
+// Computes the CRC using the SSE4.2 crc32 instruction. While at least
+// three strides remain, three CRCs run side by side over three
+// adjacent strides, the second and third starting from zero, after
+// which the first is shifted across a stride and combined with the
+// second, and that again with the third. Whatever is left is done
+// eight bytes at a time and then one byte at a time. The function is
+// compiled for SSE4.2 regardless of the compiler's default target; it
+// only gets called after the constructor found the instruction exists.
+//
+// ----------------------------------------------------------------------
+
+#if HAVE_X86_CRC32C
+__attribute__(( target( "sse4.2" ) ))
+#endif
+uint32_t IntegrityClass::crc32c_hardware( uint32_t this_crc, const unsigned char * this_data_p, size_t this_size )
+{
+#if HAVE_X86_CRC32C && defined( __x86_64__ )
+    uint64_t wide_crc = this_crc;
+
+    while ( this_size >= CRC32C_STRIDE_SIZE * 3 )
+    {
+        const unsigned char * end_p     = this_data_p + CRC32C_STRIDE_SIZE;
+        uint64_t              crc_two   = 0;
+        uint64_t              crc_three = 0;
+
+        do
+        {
+            uint64_t word_one   = 0;
+            uint64_t word_two   = 0;
+            uint64_t word_three = 0;
+
+            (void)memcpy( &word_one,   this_data_p,                          sizeof( word_one ) );
+            (void)memcpy( &word_two,   this_data_p + CRC32C_STRIDE_SIZE,     sizeof( word_two ) );
+            (void)memcpy( &word_three, this_data_p + CRC32C_STRIDE_SIZE * 2, sizeof( word_three ) );
+
+            wide_crc  = _mm_crc32_u64( wide_crc,  word_one );
+            crc_two   = _mm_crc32_u64( crc_two,   word_two );
+            crc_three = _mm_crc32_u64( crc_three, word_three );
+
+            this_data_p += sizeof( uint64_t );
+        }
+        while ( this_data_p < end_p );
+
+        wide_crc = crc32c_shift_stride( (uint32_t)wide_crc ) ^ (uint32_t)crc_two;
+        wide_crc = crc32c_shift_stride( (uint32_t)wide_crc ) ^ (uint32_t)crc_three;
+
+        this_data_p += CRC32C_STRIDE_SIZE * 2;
+        this_size   -= CRC32C_STRIDE_SIZE * 3;
+    }
+
+    while ( this_size >= sizeof( uint64_t ) )
+    {
+        uint64_t this_word = 0;
+
+        // Copy the word to avoid unaligned access concerns
+        (void)memcpy( &this_word, this_data_p, sizeof( this_word ) );
+
+        wide_crc = _mm_crc32_u64( wide_crc, this_word );
+
+        this_data_p += sizeof( uint64_t );
+        this_size   -= sizeof( uint64_t );
+    }
+
+    this_crc = (uint32_t)wide_crc;
+#endif
+
+#if HAVE_X86_CRC32C
+    while ( this_size > 0 )
+    {
+        this_crc = _mm_crc32_u8( this_crc, *this_data_p++ );
+
+        this_size--;
+    }
+
+    return this_crc;
+#else
+    return crc32c_software( this_crc, this_data_p, this_size );
+#endif
+}
+
+// ----------------------------------------------------------------------
+// IntegrityClass CRC32C Software
+//
+// Computes the CRC using the "slicing by 8" tables, which handles
+// eight bytes for every eight table look-ups rather than one byte at
+// a time through a dependent chain of look-ups.
+//
+// ----------------------------------------------------------------------
+
+uint32_t IntegrityClass::crc32c_software( uint32_t this_crc, const unsigned char * this_data_p, size_t this_size )
+{
+    while ( this_size >= 8 )
+    {
+        const uint32_t low_word = this_crc ^ ( (uint32_t)this_data_p[ 0 ]
+            | ( (uint32_t)this_data_p[ 1 ] << 8 )
+            | ( (uint32_t)this_data_p[ 2 ] << 16 )
+            | ( (uint32_t)this_data_p[ 3 ] << 24 ) );
+
+        this_crc = crc32c_table[ 7 ][ low_word & 0xff ]
+                 ^ crc32c_table[ 6 ][ ( low_word >> 8 ) & 0xff ]
+                 ^ crc32c_table[ 5 ][ ( low_word >> 16 ) & 0xff ]
+                 ^ crc32c_table[ 4 ][ low_word >> 24 ]
+                 ^ crc32c_table[ 3 ][ this_data_p[ 4 ] ]
+                 ^ crc32c_table[ 2 ][ this_data_p[ 5 ] ]
+                 ^ crc32c_table[ 1 ][ this_data_p[ 6 ] ]
+                 ^ crc32c_table[ 0 ][ this_data_p[ 7 ] ];
+
+        this_data_p += 8;
+        this_size   -= 8;
+    }
+
+    while ( this_size > 0 )
+    {
+        this_crc = crc32c_table[ 0 ][ ( this_crc ^ *this_data_p++ ) & 0xff ] ^ ( this_crc >> 8 );
+
+        this_size--;
+    }
+
+    return this_crc;
+}
+
+// ----------------------------------------------------------------------
+// The leaf hash is the 64 bit xxHash (XXH64). It keeps four independent
+// accumulators going across each 32 bytes of input, which keeps the
+// processor's multipliers busy, and it is fast enough that one core
+// hashes a leaf faster than the disk can deliver it.
+//
+// ----------------------------------------------------------------------
+
+#define XXH_PRIME64_1       11400714785074694791ULL
+#define XXH_PRIME64_2       14029467366897019727ULL
+#define XXH_PRIME64_3       1609587929392839161ULL
+#define XXH_PRIME64_4       9650029242287828579ULL
+#define XXH_PRIME64_5       2870177450012600261ULL
+
+static inline uint64_t xxh_rotate_left( const uint64_t this_value, const int this_count )
+{
+    return ( this_value << this_count ) | ( this_value >> ( 64 - this_count ) );
+}
+
+static inline uint64_t xxh_read64( const unsigned char * this_data_p )
+{
+    uint64_t this_word = 0;
+
+    (void)memcpy( &this_word, this_data_p, sizeof( this_word ) );
+
+    return this_word;
+}
+
+static inline uint64_t xxh_round( uint64_t this_acc, const uint64_t this_input )
+{
+    this_acc += this_input * XXH_PRIME64_2;
+    this_acc  = xxh_rotate_left( this_acc, 31 );
+
+    return this_acc * XXH_PRIME64_1;
+}
+
+static inline uint64_t xxh_merge_round( uint64_t this_acc, const uint64_t this_value )
+{
+    this_acc ^= xxh_round( 0, this_value );
+
+    return this_acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+static uint64_t xxh64( const unsigned char * this_data_p, size_t this_size, const uint64_t this_seed )
+{
+    const unsigned char * end_p     = this_data_p + this_size;
+    uint64_t              this_hash = 0;
+
+    if ( this_size >= 32 )
+    {
+        const unsigned char * limit_p = end_p - 32;
+        uint64_t              acc_one   = this_seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+        uint64_t              acc_two   = this_seed + XXH_PRIME64_2;
+        uint64_t              acc_three = this_seed;
+        uint64_t              acc_four  = this_seed - XXH_PRIME64_1;
+
+        do
+        {
+            acc_one   = xxh_round( acc_one,   xxh_read64( this_data_p ) );
+            acc_two   = xxh_round( acc_two,   xxh_read64( this_data_p + 8 ) );
+            acc_three = xxh_round( acc_three, xxh_read64( this_data_p + 16 ) );
+            acc_four  = xxh_round( acc_four,  xxh_read64( this_data_p + 24 ) );
+
+            this_data_p += 32;
+        }
+        while ( this_data_p <= limit_p );
+
+        this_hash = xxh_rotate_left( acc_one, 1 )    + xxh_rotate_left( acc_two, 7 )
+                  + xxh_rotate_left( acc_three, 12 ) + xxh_rotate_left( acc_four, 18 );
+
+        this_hash = xxh_merge_round( this_hash, acc_one );
+        this_hash = xxh_merge_round( this_hash, acc_two );
+        this_hash = xxh_merge_round( this_hash, acc_three );
+        this_hash = xxh_merge_round( this_hash, acc_four );
+    }
+    else
+    {
+        this_hash = this_seed + XXH_PRIME64_5;
+    }
+
+    this_hash += (uint64_t)this_size;
+
+    while ( this_data_p + 8 <= end_p )
+    {
+        this_hash ^= xxh_round( 0, xxh_read64( this_data_p ) );
+        this_hash  = xxh_rotate_left( this_hash, 27 ) * XXH_PRIME64_1 + XXH_PRIME64_4;
+
+        this_data_p += 8;
+    }
+
+    if ( this_data_p + 4 <= end_p )
+    {
+        uint32_t this_word = 0;
+
+        (void)memcpy( &this_word, this_data_p, sizeof( this_word ) );
+
+        this_hash ^= (uint64_t)this_word * XXH_PRIME64_1;
+        this_hash  = xxh_rotate_left( this_hash, 23 ) * XXH_PRIME64_2 + XXH_PRIME64_3;
+
+        this_data_p += 4;
+    }
+
+    while ( this_data_p < end_p )
+    {
+        this_hash ^= (uint64_t)( *this_data_p++ ) * XXH_PRIME64_5;
+        this_hash  = xxh_rotate_left( this_hash, 11 ) * XXH_PRIME64_1;
+    }
+
+    // Final avalanche
+    this_hash ^= this_hash >> 33;
+    this_hash *= XXH_PRIME64_2;
+    this_hash ^= this_hash >> 29;
+    this_hash *= XXH_PRIME64_3;
+    this_hash ^= this_hash >> 32;
+
+    return this_hash;
+}
+
+// ----------------------------------------------------------------------
+// IntegrityClass Integrity Leaf Count
+//
+// Returns: The number of digest leaves a file of the given size has
+//
+// ----------------------------------------------------------------------
+
+uint32_t IntegrityClass::integrity_leaf_count( const uint64_t file_size )
+{
+    return (uint32_t)( ( file_size + DIGEST_LEAF_SIZE - 1 ) / DIGEST_LEAF_SIZE );
+}
+
+// ----------------------------------------------------------------------
+// IntegrityClass Integrity Leaf Digest
+//
+// Hashes the data of one leaf. The leaf number is used as the seed so
+// that two leaves holding the same data do not have the same digest.
+//
+// Returns: The 64 bit digest of the leaf
+//
+// ----------------------------------------------------------------------
+
+uint64_t IntegrityClass::integrity_leaf_digest( const void * this_data_p, size_t this_size, const uint32_t leaf_index )
+{
+    return xxh64( (const unsigned char *)this_data_p, this_size, (uint64_t)leaf_index );
+}
+
+// ----------------------------------------------------------------------
+// IntegrityClass Integrity Root Digest
+//
+// Hashes the array of leaf digests, seeded by the size of the file.
+//
+// Returns: The 64 bit digest of the whole file
+//
+// ----------------------------------------------------------------------
+
+uint64_t IntegrityClass::integrity_root_digest( const std::vector<uint64_t> & leaf_digests, const uint64_t file_size )
+{
+    if ( leaf_digests.empty( ) )
+    {
+        return xxh64( (const unsigned char *)NULL, 0, file_size );
+    }
+
+    return xxh64( (const unsigned char *)&leaf_digests[ 0 ],
+        leaf_digests.size( ) * sizeof( uint64_t ), file_size );
+}
+
+// ----------------------------------------------------------------------
+// IntegrityClass Integrity Digest Leaves
+//
+// Reads and hashes the leaves of an open file which are listed by
+// argument, storing each digest in to the leaf_digests array at the
+// leaf's index. The list is split across as many threads as there are
+// processor cores, up to DIGEST_MAX_THREADS, and each thread reads its
+// leaves with pread() so that no thread disturbs another's position.
+//
+// Returns: true if every listed leaf could be read and hashed
+//
+// ----------------------------------------------------------------------
+
+bool IntegrityClass::integrity_digest_leaves( const int file_handle, const uint64_t file_size,
+    const std::vector<uint32_t> & leaf_indexes, std::vector<uint64_t> & leaf_digests )
+{
+    std::vector<std::thread> hash_threads;
+    unsigned int             thread_count = std::thread::hardware_concurrency( );
+    unsigned int             this_thread  = 0;
+    std::atomic<bool>        read_failed( false );
+
+    leaf_digests.resize( integrity_leaf_count( file_size ), 0 );
+
+    if ( thread_count < 1 )
+    {
+        thread_count = 1;
+    }
+
+    if ( thread_count > DIGEST_MAX_THREADS )
+    {
+        thread_count = DIGEST_MAX_THREADS;
+    }
+
+    if ( thread_count > leaf_indexes.size( ) )
+    {
+        thread_count = leaf_indexes.size( );
+    }
+
+    // Each thread takes every thread_count'th leaf in the list
+    for ( this_thread = 0; this_thread < thread_count; this_thread++ )
+    {
+        hash_threads.push_back( std::thread( [ &, this_thread ]( void )
+        {
+            unsigned char * leaf_data_p = (unsigned char *)malloc( DIGEST_LEAF_SIZE );
+            size_t          this_entry  = this_thread;
+
+            if ( (unsigned char *)NULL == leaf_data_p )
+            {
+                read_failed.store( true, std::memory_order_relaxed );
+
+                return;
+            }
+
+            for ( ; this_entry < leaf_indexes.size( ); this_entry += thread_count )
+            {
+                const uint32_t leaf_index  = leaf_indexes[ this_entry ];
+                const uint64_t leaf_offset = (uint64_t)leaf_index * DIGEST_LEAF_SIZE;
+                size_t         leaf_size   = DIGEST_LEAF_SIZE;
+                size_t         have_size   = 0;
+
+                if ( leaf_offset + leaf_size > file_size )
+                {
+                    leaf_size = file_size - leaf_offset;
+                }
+
+                while ( have_size < leaf_size )
+                {
+                    const ssize_t read_count = pread( file_handle, leaf_data_p + have_size,
+                        leaf_size - have_size, (off_t)( leaf_offset + have_size ) );
+
+                    if ( read_count <= 0 )
+                    {
+                        break;
+                    }
+
+                    have_size += read_count;
+                }
+
+                if ( have_size != leaf_size )
+                {
+                    read_failed.store( true, std::memory_order_relaxed );
+                }
+
+                leaf_digests[ leaf_index ] = integrity_leaf_digest( leaf_data_p, have_size, leaf_index );
+            }
+
+            free( leaf_data_p );
+        } ) );
+    }
+
+    for ( this_thread = 0; this_thread < hash_threads.size( ); this_thread++ )
+    {
+        hash_threads[ this_thread ].join( );
+    }
+
+    // The joins make every store visible here
+    return false == read_failed.load( std::memory_order_relaxed );
+}
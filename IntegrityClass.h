@@ -0,0 +1,89 @@
+
+// ----------------------------------------------------------------------
+// IntegrityClass -- Small class which computes the check values used
+// to make sure that the data in a file transfer arrived intact.
+//
+// See main.c for disclaimers and other information.
+//
+// Fredric L. Rice, June 2018
+// http://www.crystallake.name
+// fred @ crystal lake . name
+//
+// ----------------------------------------------------------------------
+
+#ifndef _INTEGRITYCLASS_H_
+#define _INTEGRITYCLASS_H_   1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// ----------------------------------------------------------------------
+// The CRC32C (Castagnoli) polynomial in its reflected form, which is
+// the same polynomial the SSE4.2 crc32 instruction implements. The
+// software fallback uses "slicing by 8" which needs 8 tables of 256
+// entries each.
+//
+// ----------------------------------------------------------------------
+
+#define CRC32C_POLYNOMIAL           0x82F63B78U
+#define CRC32C_INITIAL_VALUE        0xFFFFFFFFU
+#define CRC32C_TABLE_COUNT          8
+#define CRC32C_TABLE_SIZE           256
+
+// ----------------------------------------------------------------------
+// The crc32 instruction takes three cycles to produce its result but
+// can start a new one every cycle, so the hardware implementation runs
+// three independent CRCs over three adjacent strides of the data and
+// then shifts and combines them. The stride is sized so that three of
+// them cover nearly all of a full 1 KB file block frame.
+//
+// ----------------------------------------------------------------------
+
+#define CRC32C_STRIDE_SIZE          336
+#define CRC32C_SHIFT_TABLE_COUNT    4
+
+// ----------------------------------------------------------------------
+// Whole-file digests are a two level tree. The file is cut in to leaves
+// of a fixed size and every leaf is hashed on its own with a 64 bit
+// hash seeded by the leaf's number; the root is the hash of all of the
+// leaf hashes seeded by the size of the file. Because the leaves are
+// independent they may be hashed on as many cores as the computer has,
+// and a leaf which does not match tells us exactly which part of the
+// file needs to be sent again.
+//
+// The leaf size is a multiple of the largest block of file data that
+// gets sent so that a block never straddles two leaves.
+//
+// ----------------------------------------------------------------------
+
+#define DIGEST_LEAF_SIZE            (256 * 1024)
+#define DIGEST_MAX_THREADS          16
+
+// ----------------------------------------------------------------------
+// Our class is defined here.
+//
+// ----------------------------------------------------------------------
+
+class IntegrityClass
+{
+    public:
+        IntegrityClass( void );
+
+        uint32_t integrity_crc32c( const void * this_data_p, size_t this_size );
+        bool     integrity_has_hardware_crc( void );
+
+        uint32_t integrity_leaf_count( const uint64_t file_size );
+        uint64_t integrity_leaf_digest( const void * this_data_p, size_t this_size, const uint32_t leaf_index );
+        uint64_t integrity_root_digest( const std::vector<uint64_t> & leaf_digests, const uint64_t file_size );
+        bool     integrity_digest_leaves( const int file_handle, const uint64_t file_size,
+                     const std::vector<uint32_t> & leaf_indexes, std::vector<uint64_t> & leaf_digests );
+
+    private:
+        uint32_t crc32c_hardware( uint32_t this_crc, const unsigned char * this_data_p, size_t this_size );
+        uint32_t crc32c_software( uint32_t this_crc, const unsigned char * this_data_p, size_t this_size );
+
+        bool     hardware_crc;
+} ;
+
+#endif
@@ -0,0 +1,505 @@
+
+// ----------------------------------------------------------------------
+// LogReaderClass -- Small class which reads back the binary log that
+// the LoggingClass writes, one record at a time.
+//
+// The segment is mapped read only and the kernel is told that it will
+// be read sequentially. Every record is checked against the end of the
+// segment before it is offered, so a segment cut short by a crash ends
+// at the last whole record rather than running off the end.
+//
+// Side index entries are in the order the records were written, which
+// is the order of their wall clock times unless the clock was stepped
+// back, so a time found through the index is where to start reading
+// and not a promise that nothing earlier follows.
+//
+// See main.c for disclaimers and other information.
+//
+// Fredric L. Rice, June 2018
+// http://www.crystallake.name
+// fred @ crystal lake . name
+//
+// ----------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "LogReaderClass.h"     // Our own class and defined constants
+
+// ----------------------------------------------------------------------
+// Local data storage
+//
+// ----------------------------------------------------------------------
+
+    static const char * direction_names[ ] =
+    {
+        "--", "in", "out"
+    } ;
+
+    static const char * frame_names[ ] =
+    {
+        "?", "text", "command", "note"
+    } ;
+
+// ----------------------------------------------------------------------
+// LogReaderClass Constructor
+//
+// ----------------------------------------------------------------------
+
+LogReaderClass::LogReaderClass( void ) : map_p( NULL ), map_size( 0 ), map_owned( false ),
+    read_offset( 0 )
+{
+}
+
+// ----------------------------------------------------------------------
+// LogReaderClass Destructor
+//
+// ----------------------------------------------------------------------
+
+LogReaderClass::~LogReaderClass( void )
+{
+    log_reader_close( );
+}
+
+// ----------------------------------------------------------------------
+// LogReaderClass Log Reader Open
+//
+// The segment file passed to the method by argument is mapped in to
+// memory, or read through gzip if its name ends with .gz, and its
+// segment header is checked.
+//
+// Returns: true if the file is a segment of the log we can read
+//
+// ----------------------------------------------------------------------
+
+bool LogReaderClass::log_reader_open( const char * path_and_name_p )
+{
+    struct stat file_status;
+    int         in_file  = -1;
+    void *      mapped_p = MAP_FAILED;
+
+    log_reader_close( );
+
+    if ( strlen( path_and_name_p ) > 3 &&
+        0 == strcmp( &path_and_name_p[ strlen( path_and_name_p ) - 3 ], ".gz" ) )
+    {
+        return read_compressed( path_and_name_p ) && check_segment( );
+    }
+
+    if ( -1 == ( in_file = open( path_and_name_p, O_RDONLY ) ) )
+    {
+        return false;
+    }
+
+    if ( 0 == fstat( in_file, &file_status ) && file_status.st_size > 0 )
+    {
+        mapped_p = mmap( NULL, (size_t)file_status.st_size, PROT_READ, MAP_PRIVATE, in_file, 0 );
+    }
+
+    // The mapping keeps the file open for us
+    (void)close( in_file );
+
+    if ( MAP_FAILED == mapped_p )
+    {
+        return false;
+    }
+
+    (void)madvise( mapped_p, (size_t)file_status.st_size, MADV_SEQUENTIAL );
+
+    map_p     = (const char *)mapped_p;
+    map_size  = (size_t)file_status.st_size;
+    map_owned = true;
+
+    return check_segment( );
+}
+
+// ----------------------------------------------------------------------
+// LogReaderClass Read Compressed
+//
+// Reads the whole of a compressed segment in to memory through gzip.
+//
+// Returns: true if anything was read
+//
+// ----------------------------------------------------------------------
+
+bool LogReaderClass::read_compressed( const char * path_and_name_p )
+{
+    char   this_command[ MAX_LOG_FILE_PATH_NAME * 2 ];
+    FILE * command_p  = (FILE *)NULL;
+    size_t held       = 0;
+    size_t read_count = 0;
+
+    (void)snprintf( this_command, sizeof( this_command ), "%s '%s' 2>/dev/null",
+        LOG_DECOMPRESS_COMMAND, path_and_name_p );
+
+    if ( (FILE *)NULL == ( command_p = popen( this_command, "r" ) ) )
+    {
+        return false;
+    }
+
+    do
+    {
+        held_data.resize( held + LOG_READER_PIPE_SIZE );
+
+        read_count = fread( &held_data[ held ], 1, LOG_READER_PIPE_SIZE, command_p );
+
+        held += read_count;
+    } while ( read_count > 0 );
+
+    (void)pclose( command_p );
+
+    held_data.resize( held );
+
+    map_p    = held_data.data( );
+    map_size = held;
+
+    return held > 0;
+}
+
+// ----------------------------------------------------------------------
+// LogReaderClass Log Reader Open Memory
+//
+// Reads a segment that the caller already has in memory, such as one
+// that was decompressed or read from a pipe. The memory must outlive
+// the reading of it.
+//
+// Returns: true if the data is a segment of the log we can read
+//
+// ----------------------------------------------------------------------
+
+bool LogReaderClass::log_reader_open_memory( const char * this_data_p, size_t this_size )
+{
+    log_reader_close( );
+
+    map_p     = this_data_p;
+    map_size  = this_size;
+    map_owned = false;
+
+    return check_segment( );
+}
+
+// ----------------------------------------------------------------------
+// LogReaderClass Log Reader Close
+//
+// ----------------------------------------------------------------------
+
+void LogReaderClass::log_reader_close( void )
+{
+    if ( true == map_owned )
+    {
+        (void)munmap( (void *)map_p, map_size );
+    }
+
+    map_p       = (const char *)NULL;
+    map_size    = 0;
+    map_owned   = false;
+    read_offset = 0;
+
+    std::vector<char>( ).swap( held_data );
+}
+
+// ----------------------------------------------------------------------
+// LogReaderClass Check Segment
+//
+// Makes sure that the segment starts with a segment header of a version
+// we understand and positions the reader at the first record.
+//
+// Returns: true if the segment may be read
+//
+// ----------------------------------------------------------------------
+
+bool LogReaderClass::check_segment( void )
+{
+    const log_segment_header * header_p = (const log_segment_header *)map_p;
+
+    if ( (const char *)NULL == map_p || map_size < sizeof( log_segment_header ) ||
+        0 != memcmp( header_p->segment_magic, LOG_SEGMENT_MAGIC, sizeof( LOG_SEGMENT_MAGIC ) ) ||
+        LOG_FORMAT_VERSION != header_p->format_version )
+    {
+        log_reader_close( );
+
+        return false;
+    }
+
+    read_offset = sizeof( log_segment_header );
+
+    return true;
+}
+
+// ----------------------------------------------------------------------
+// LogReaderClass Log Reader Next
+//
+// Offers the next record's header, its data and the size of its data
+// through the arguments. Both point in to the segment and remain valid
+// until the reader is closed. The header may not be aligned in memory.
+//
+// Returns: true if a record was offered, else false at the end of the
+// segment or at a record which does not fit in it
+//
+// ----------------------------------------------------------------------
+
+bool LogReaderClass::log_reader_next( const log_record_header ** record_pp, const char ** data_pp,
+    uint32_t * data_size_p )
+{
+    uint32_t record_length = 0;
+
+    if ( read_offset + sizeof( log_record_header ) > map_size )
+    {
+        return false;
+    }
+
+    (void)memcpy( (char *)&record_length, &map_p[ read_offset ], sizeof( record_length ) );
+
+    if ( record_length < sizeof( log_record_header ) || read_offset + record_length > map_size )
+    {
+        return false;
+    }
+
+    *record_pp   = (const log_record_header *)&map_p[ read_offset ];
+    *data_pp     = &map_p[ read_offset + sizeof( log_record_header ) ];
+    *data_size_p = record_length - (uint32_t)sizeof( log_record_header );
+
+    read_offset += record_length;
+
+    return true;
+}
+
+// ----------------------------------------------------------------------
+// LogReaderClass Log Reader Seek
+//
+// Moves the reader to a record which is known to start at the offset
+// in the segment passed by argument.
+//
+// ----------------------------------------------------------------------
+
+void LogReaderClass::log_reader_seek( const uint64_t this_offset )
+{
+    if ( this_offset >= sizeof( log_segment_header ) && this_offset <= map_size )
+    {
+        read_offset = this_offset;
+    }
+}
+
+// ----------------------------------------------------------------------
+// LogReaderClass Log Reader Offset
+//
+// Returns: The offset in the segment of the next record to be read
+//
+// ----------------------------------------------------------------------
+
+uint64_t LogReaderClass::log_reader_offset( void )
+{
+    return read_offset;
+}
+
+// ----------------------------------------------------------------------
+// LogReaderClass Log Reader Segment
+//
+// Returns: The header of the open segment, else NULL
+//
+// ----------------------------------------------------------------------
+
+const log_segment_header * LogReaderClass::log_reader_segment( void )
+{
+    return (const log_segment_header *)map_p;
+}
+
+// ----------------------------------------------------------------------
+// LogReaderClass Log Reader Direction Name and Frame Name
+//
+// Returns: A short name for a record's direction or frame type
+//
+// ----------------------------------------------------------------------
+
+const char * LogReaderClass::log_reader_direction_name( const uint8_t this_direction )
+{
+    if ( this_direction < sizeof( direction_names ) / sizeof( direction_names[ 0 ] ) )
+    {
+        return direction_names[ this_direction ];
+    }
+
+    return "?";
+}
+
+const char * LogReaderClass::log_reader_frame_name( const uint8_t this_type )
+{
+    if ( this_type < sizeof( frame_names ) / sizeof( frame_names[ 0 ] ) )
+    {
+        return frame_names[ this_type ];
+    }
+
+    return "?";
+}
+
+// ----------------------------------------------------------------------
+// LogReaderClass Log Reader Format
+//
+// Formats a record as a line of text in to the buffer offered, which
+// must hold LOG_READER_LINE_SIZE bytes: the local wall clock time to
+// the microsecond, the direction, the peer, the frame type, and then
+// the data with anything which is not printable shown as an escape.
+// The new line that ends most chat text is left off and one is added.
+//
+// Returns: The length of the line, which is not NULL terminated
+//
+// ----------------------------------------------------------------------
+
+int LogReaderClass::log_reader_format( const log_record_header * record_p, const char * data_p,
+    uint32_t data_size, char * line_p )
+{
+    log_record_header this_record;
+    struct tm         our_time;
+    time_t            this_second = 0;
+    char              peer[ INET_ADDRSTRLEN ];
+    int               line_count  = 0;
+    uint32_t          this_byte   = 0;
+
+    // The record may not be aligned in the segment
+    (void)memcpy( (char *)&this_record, (const char *)record_p, sizeof( this_record ) );
+
+    this_second = (time_t)( this_record.wall_ns / 1000000000ULL );
+
+    (void)localtime_r( &this_second, &our_time );
+
+    if ( 0 == this_record.peer_address )
+    {
+        (void)strcpy( peer, "-" );
+    }
+    else
+    {
+        (void)inet_ntop( AF_INET, &this_record.peer_address, peer, sizeof( peer ) );
+    }
+
+    line_count = snprintf( line_p, LOG_READER_LINE_SIZE,
+        "%04d-%02d-%02d %02d:%02d:%02d.%06u %-3s %-15s %s: ",
+        our_time.tm_year + 1900, our_time.tm_mon + 1, our_time.tm_mday,
+        our_time.tm_hour, our_time.tm_min, our_time.tm_sec,
+        (unsigned int)( ( this_record.wall_ns % 1000000000ULL ) / 1000 ),
+        log_reader_direction_name( this_record.direction ), peer,
+        log_reader_frame_name( this_record.frame_type ) );
+
+    if ( data_size > LOG_RING_TEXT_SIZE )
+    {
+        data_size = LOG_RING_TEXT_SIZE;
+    }
+
+    while ( data_size > 0 && ( '\n' == data_p[ data_size - 1 ] || '\r' == data_p[ data_size - 1 ] ) )
+    {
+        data_size--;
+    }
+
+    for ( this_byte = 0; this_byte < data_size; this_byte++ )
+    {
+        const unsigned char this_char = (unsigned char)data_p[ this_byte ];
+
+        if ( this_char >= ' ' && this_char < 0x7f && '\\' != this_char )
+        {
+            line_p[ line_count++ ] = (char)this_char;
+        }
+        else
+        {
+            line_count += sprintf( &line_p[ line_count ], "\\x%02x", this_char );
+        }
+    }
+
+    line_p[ line_count++ ] = '\n';
+
+    return line_count;
+}
+
+// ----------------------------------------------------------------------
+// LogReaderClass Log Reader Load Index
+//
+// Loads the side index of the segment named by argument, which may be
+// compressed, through the arguments.
+//
+// Returns: true if the segment has an index we can use
+//
+// ----------------------------------------------------------------------
+
+bool LogReaderClass::log_reader_load_index( const char * path_and_name_p, log_index_header & this_header,
+    std::vector<log_index_entry> & these_entries )
+{
+    char   index_name[ MAX_LOG_FILE_PATH_NAME * 2 ];
+    size_t name_length = 0;
+    FILE * index_p     = (FILE *)NULL;
+    bool   loaded      = false;
+
+    // The index is named after the uncompressed segment
+    (void)snprintf( index_name, sizeof( index_name ) - sizeof( LOG_INDEX_SUFFIX ), "%s", path_and_name_p );
+
+    name_length = strlen( index_name );
+
+    if ( name_length > 3 && 0 == strcmp( &index_name[ name_length - 3 ], ".gz" ) )
+    {
+        index_name[ name_length - 3 ] = ASCII_NULL_ZERO;
+    }
+
+    (void)strcat( index_name, LOG_INDEX_SUFFIX );
+
+    if ( (FILE *)NULL == ( index_p = fopen( index_name, "rb" ) ) )
+    {
+        return false;
+    }
+
+    if ( 1 == fread( (char *)&this_header, sizeof( this_header ), 1, index_p ) &&
+        0 == memcmp( this_header.index_magic, LOG_INDEX_MAGIC, sizeof( LOG_INDEX_MAGIC ) ) &&
+        LOG_FORMAT_VERSION == this_header.format_version )
+    {
+        these_entries.resize( this_header.entry_count );
+
+        loaded = 0 == this_header.entry_count ||
+            this_header.entry_count == fread( (char *)these_entries.data( ), sizeof( log_index_entry ),
+                this_header.entry_count, index_p );
+    }
+
+    (void)fclose( index_p );
+
+    return loaded;
+}
+
+// ----------------------------------------------------------------------
+// LogReaderClass Log Reader Find Time
+//
+// Searches the index entries for the last one logged at or before the
+// wall clock time passed by argument.
+//
+// Returns: The segment offset to start reading from to find records
+// logged at or after that time
+//
+// ----------------------------------------------------------------------
+
+uint64_t LogReaderClass::log_reader_find_time( const std::vector<log_index_entry> & these_entries,
+    const uint64_t this_wall_ns )
+{
+    size_t low  = 0;
+    size_t high = these_entries.size( );
+
+    // Find the first entry later than the time
+    while ( low < high )
+    {
+        const size_t middle = low + ( high - low ) / 2;
+
+        if ( these_entries[ middle ].wall_ns <= this_wall_ns )
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    if ( 0 == low )
+    {
+        return sizeof( log_segment_header );
+    }
+
+    return these_entries[ low - 1 ].record_offset;
+}
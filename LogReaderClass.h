@@ -0,0 +1,79 @@
+
+// ----------------------------------------------------------------------
+// LogReaderClass -- Small class which reads back the binary log that
+// the LoggingClass writes, one record at a time.
+//
+// A segment is mapped in to memory and the records are offered in
+// place, without copying, so that a scan of the log costs little more
+// than walking the record lengths. A compressed segment is read in to
+// memory through gzip instead. The side index written next to a
+// segment may be loaded to find where in the segment to start reading.
+//
+// See main.c for disclaimers and other information.
+//
+// Fredric L. Rice, June 2018
+// http://www.crystallake.name
+// fred @ crystal lake . name
+//
+// ----------------------------------------------------------------------
+
+#ifndef _LOGREADERCLASS_H_
+#define _LOGREADERCLASS_H_   1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "LoggingClass.h"       // The segment and record layouts
+
+// ----------------------------------------------------------------------
+// The longest line a record may be formatted in to: the time, the
+// direction, the peer and the frame type, and then every byte of the
+// data shown as a four character escape at worst.
+//
+// ----------------------------------------------------------------------
+
+#define LOG_READER_LINE_SIZE        (LOG_RING_TEXT_SIZE * 4 + 128)
+#define LOG_READER_PIPE_SIZE        (1024 * 1024)
+
+// ----------------------------------------------------------------------
+// Our class is defined here.
+//
+// ----------------------------------------------------------------------
+
+class LogReaderClass
+{
+    public:
+        LogReaderClass( void );
+        ~LogReaderClass( void );
+
+        bool log_reader_open( const char * path_and_name_p );
+        bool log_reader_open_memory( const char * this_data_p, size_t this_size );
+        void log_reader_close( void );
+        bool log_reader_next( const log_record_header ** record_pp, const char ** data_pp,
+                 uint32_t * data_size_p );
+        void log_reader_seek( const uint64_t this_offset );
+
+        uint64_t log_reader_offset( void );
+        const log_segment_header * log_reader_segment( void );
+
+        static const char * log_reader_direction_name( const uint8_t this_direction );
+        static const char * log_reader_frame_name( const uint8_t this_type );
+        static int  log_reader_format( const log_record_header * record_p, const char * data_p,
+                        uint32_t data_size, char * line_p );
+        static bool log_reader_load_index( const char * path_and_name_p, log_index_header & this_header,
+                        std::vector<log_index_entry> & these_entries );
+        static uint64_t log_reader_find_time( const std::vector<log_index_entry> & these_entries,
+                        const uint64_t this_wall_ns );
+
+    private:
+        bool check_segment( void );
+        bool read_compressed( const char * path_and_name_p );
+
+        const char * map_p;                 // The whole segment
+        size_t       map_size;              // Bytes in the segment
+        bool         map_owned;             // True if we mapped it
+        uint64_t     read_offset;           // Where the next record starts
+        std::vector<char> held_data;        // A decompressed segment
+} ;
+
+#endif
@@ -1,142 +1,1134 @@
-
-// ----------------------------------------------------------------------
-// LoggingClass -- Small log file class which creates a log file using
-// a name based upon the current date and time, and allows 
-// NULL-terminated ASCII text to be appended to the growing log.
-//
-// Logging may be enabled or disabled through a method, however 
-// logging is default enabled.
-//
-// See main.c for disclaimers and other information.
-//
-// Fredric L. Rice, June 2018
-// http://www.crystallake.name
-// fred @ crystal lake . name
-// 
-// ----------------------------------------------------------------------
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <time.h>
-#include "LoggingClass.h"       // Our own class and defined constants
-
-// ----------------------------------------------------------------------
-// Local data storage
-//
-// ----------------------------------------------------------------------
-
-    static const char * months[ ] = 
-    { 
-        "Jan", "Feb", "Mar", "Apr", "May", "Jun",
-        "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" 
-    } ;
-
-// ----------------------------------------------------------------------
-// LoggingClass Constructor
-//
-// The file name stored locally in the class gets set to all zeros,
-// and the pointer to the log file hangle gets initialized to NULL.
-//
-// ----------------------------------------------------------------------
-
-LoggingClass::LoggingClass( void ) : write_log_p( NULL ), logging_enabled( true )
-{
-    // Make sure that the log file name starts out filled with zeros
-    (void)memset( log_file_name, ASCII_NULL_ZERO, sizeof( log_file_name ) );
-}
-
-// ----------------------------------------------------------------------
-// LoggingClass Destructor
-//
-// If the log file handle is open, the file gets flushed, the file is
-// closed, and the handle is set to indicate that the file is closed.
-//
-// ----------------------------------------------------------------------
-
-LoggingClass::~LoggingClass( void )
-{
-    if ( ( FILE *)NULL != write_log_p )
-    {
-        (void)fflush( write_log_p );
-
-        (void)fclose( write_log_p );
-
-        write_log_p = (FILE *)NULL;
-    }
-}
-
-// ----------------------------------------------------------------------
-// LoggingClass Logging Create Log
-//
-// The log file name is created using the current local date and time,
-// then the file is opened for write text.
-//
-// ----------------------------------------------------------------------
-
-void LoggingClass::logging_create_log( void )
-{
-    struct tm our_time;
-    time_t    current_time = 0L;
-
-    // Make sure that the file is not already opened
-    if ( (FILE *)NULL == write_log_p )
-    {
-        // Find out what the current time is
-        current_time = time( NULL );
-
-        // Convert that Linux epoc in to local time structure
-        (void)localtime_r( &current_time, &our_time );
-
-        // Build a log file name
-        (void)sprintf( log_file_name, 
-            "%02d%s%02d%02d-%02d-%02d-chatlog.txt",
-            our_time.tm_mday, months[ our_time.tm_mon ], ( our_time.tm_year + 1900 ),
-            our_time.tm_hour, our_time.tm_min, our_time.tm_sec );
-
-        // Attempt to create a log file using that file name
-        if ( ( FILE *)NULL == (write_log_p = fopen( log_file_name, "w+t") ) )
-        {
-            (void)printf( "I am unable to create log file [%s]\n", log_file_name );
-        }
-    }
-}
-
-// ----------------------------------------------------------------------
-// LoggingClass Logging Write Log
-//
-// The text passed to this method by NULL-terminated string is written
-// to the end of the log file. The function assumes that there is room
-// on the file system and that the file system is fast enough to store
-// all data in the write request.
-//
-// ----------------------------------------------------------------------
-
-void LoggingClass::logging_write_log( const char * this_text_p )
-{
-    // Make sure that the file is open and
-    // Make sure that logging is enabled
-    if ( (FILE *)NULL != write_log_p && true == logging_enabled )
-    {
-        // Write the string and assume that it was successful
-        (void)fputs( this_text_p, write_log_p );
-
-        // Avoid Linux's flushing process and request it now
-        (void)fflush( write_log_p );
-    }
-}
-
-// ----------------------------------------------------------------------
-// LoggingClass Logging Enable Disable
-//
-// The logging can be turned on or off depending upon the argument
-// passed to the function.
-//
-// ----------------------------------------------------------------------
-
-void LoggingClass::logging_enable_disable( const bool logging_on_off )
-{
-    logging_enabled = logging_on_off;
-}
-
-
+
+// ----------------------------------------------------------------------
+// LoggingClass -- Small log file class which creates a log file using
+// a name based upon the current date and time, and allows records of
+// what was sent and received to be appended to the growing log. The
+// log is binary; tools/logdump turns it back in to text.
+//
+// Logging may be enabled or disabled through a method, however 
+// logging is default enabled.
+//
+// The thread which logs copies each line in to a ring of slots and goes
+// on its way; it takes no lock and makes no system call unless it has
+// to wake the writer. A writer thread takes the lines out of the ring
+// and writes them to the file in large batches. Only one thread may
+// log through an instance of the class.
+//
+// The ring's head is moved by the writer as it takes lines, and by the
+// logger when it throws away the oldest line of a full ring, so both
+// move it with compare-and-swap. The writer copies a line out of its
+// slot before it moves the head past it, and if the logger moved the
+// head first the copy is discarded since the slot may have been
+// written over while it was being copied.
+//
+// How often the writer flushes, or flushes and syncs, the file is set
+// by the durability mode, and the cost of each is kept in statistics.
+//
+// The writer keeps a sparse side index of each segment as it writes it
+// and leaves it next to the segment when it is closed. If asked to, an
+// indexer thread builds an inverted index of the words in each segment
+// from copies of the batches, so that the writer never waits on it.
+//
+// The writer rolls the log over in to a new segment when the segment
+// gets too large or too old. A retention thread compresses and removes
+// old segments so that the writer never waits on gzip or the disk.
+//
+// See main.c for disclaimers and other information.
+//
+// Fredric L. Rice, June 2018
+// http://www.crystallake.name
+// fred @ crystal lake . name
+// 
+// ----------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <chrono>
+#include "LoggingClass.h"       // Our own class and defined constants
+#include "ClockClass.h"         // The cached clocks
+
+// ----------------------------------------------------------------------
+// Local data storage
+//
+// ----------------------------------------------------------------------
+
+    static const char * months[ ] = 
+    { 
+        "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+        "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" 
+    } ;
+
+// ----------------------------------------------------------------------
+// LoggingClass Constructor
+//
+// The file name stored locally in the class gets set to all zeros,
+// and the pointer to the log file hangle gets initialized to NULL.
+// The ring and the writer's batch buffer are allocated.
+//
+// ----------------------------------------------------------------------
+
+LoggingClass::LoggingClass( void ) : write_log_p( NULL ), logging_enabled( true ),
+    full_policy( LOG_DEFAULT_FULL_POLICY ), ring_head( 0 ), ring_tail( 0 ), dropped_lines( 0 ),
+    logging_thread( std::thread::id( ) ), wrong_thread_seen( false ), reported_drops( 0 ), writer_waiting( false ),
+    stop_writer( false ), writer_failed( false ), durability( LOG_DEFAULT_DURABILITY ), commit_ms( LOG_DEFAULT_COMMIT_MS ),
+    commit_bytes( LOG_DEFAULT_COMMIT_BYTES ), pending_bytes( 0 ), pending_since_ns( 0 ), created_ns( 0 ),
+    segment_max_bytes( LOG_SEGMENT_MAX_BYTES ), segment_max_seconds( LOG_SEGMENT_MAX_SECONDS ),
+    retain_segments( LOG_RETAIN_SEGMENTS ), retain_plain_segments( LOG_RETAIN_PLAIN_SEGMENTS ),
+    retain_compress( LOG_RETAIN_COMPRESS ), segment_number( 0 ), segment_bytes( 0 ), segment_started( 0 ),
+    closed_segments( 0 ), next_to_remove( 0 ), next_to_compress( 0 ), stop_retention( false ),
+    term_indexing( LOG_DEFAULT_TERM_INDEX ), terms_incomplete( false ), term_queue_bytes( 0 ),
+    stop_indexer( false )
+{
+    // Make sure that the log file names start out filled with zeros
+    (void)memset( log_file_name, ASCII_NULL_ZERO, sizeof( log_file_name ) );
+    (void)memset( log_base_name, ASCII_NULL_ZERO, sizeof( log_base_name ) );
+    (void)memset( (char *)&stats, ASCII_NULL_ZERO, sizeof( stats ) );
+    (void)memset( (char *)&segment_index, ASCII_NULL_ZERO, sizeof( segment_index ) );
+
+    ring_p  = (log_ring_slot *)malloc( sizeof( log_ring_slot ) * LOG_RING_SLOT_COUNT );
+    batch_p = (char *)malloc( LOG_WRITE_BATCH_SIZE );
+}
+
+// ----------------------------------------------------------------------
+// LoggingClass Destructor
+//
+// The writer thread is stopped after it writes whatever is left in the
+// ring. If the log file handle is open, the segment gets closed, and
+// then the indexer, once it has indexed what it was given, and the
+// retention thread are stopped.
+//
+// ----------------------------------------------------------------------
+
+LoggingClass::~LoggingClass( void )
+{
+    stop_writer = true;
+
+    wake_writer( );
+
+    if ( writer.joinable( ) )
+    {
+        writer.join( );
+    }
+
+    free( ring_p );
+    free( batch_p );
+
+    ring_p  = (log_ring_slot *)NULL;
+    batch_p = (char *)NULL;
+
+    if ( ( FILE *)NULL != write_log_p )
+    {
+        close_segment( );
+    }
+
+    {
+        std::lock_guard<std::mutex> indexer_guard( indexer_lock );
+
+        stop_indexer = true;
+
+        indexer_wake.notify_one( );
+    }
+
+    if ( indexer.joinable( ) )
+    {
+        indexer.join( );
+    }
+
+    {
+        std::lock_guard<std::mutex> retention_guard( retention_lock );
+
+        stop_retention = true;
+
+        retention_wake.notify_one( );
+    }
+
+    if ( retention.joinable( ) )
+    {
+        retention.join( );
+    }
+}
+
+// ----------------------------------------------------------------------
+// LoggingClass Logging Create Log
+//
+// The log file name is created using the current local date and time,
+// then the first segment is opened for write text and the writer and
+// retention threads start.
+//
+// ----------------------------------------------------------------------
+
+void LoggingClass::logging_create_log( void )
+{
+    struct tm our_time;
+    time_t    current_time = 0L;
+
+    // Make sure that the file is not already opened
+    if ( (FILE *)NULL == write_log_p )
+    {
+        // Find out what the current time is
+        current_time = time( NULL );
+
+        // Convert that Linux epoc in to local time structure
+        (void)localtime_r( &current_time, &our_time );
+
+        // Build a log file name which the segment numbers get added to
+        (void)sprintf( log_base_name, 
+            "%02d%s%02d%02d-%02d-%02d-chatlog",
+            our_time.tm_mday, months[ our_time.tm_mon ], ( our_time.tm_year + 1900 ),
+            our_time.tm_hour, our_time.tm_min, our_time.tm_sec );
+
+        // Attempt to create the first segment of the log
+        if ( true == open_segment( ) && (log_ring_slot *)NULL != ring_p && (char *)NULL != batch_p )
+        {
+            created_ns = ClockClass::clock_monotonic_ns( );
+
+            writer    = std::thread( &LoggingClass::writer_thread, this );
+            retention = std::thread( &LoggingClass::retention_thread, this );
+
+            if ( true == term_indexing )
+            {
+                indexer = std::thread( &LoggingClass::indexer_thread, this );
+            }
+        }
+    }
+}
+
+// ----------------------------------------------------------------------
+// LoggingClass Logging Write Log
+//
+// The text passed to this method by NULL-terminated string is logged as
+// chat text which came from neither direction.
+//
+// ----------------------------------------------------------------------
+
+void LoggingClass::logging_write_log( const char * this_text_p )
+{
+    logging_write_record( log_direction_none, log_frame_text, 0, this_text_p, strlen( this_text_p ) );
+}
+
+// ----------------------------------------------------------------------
+// LoggingClass Logging Write Record
+//
+// A record header describing the data is built in the next free slot
+// of the ring, and the data passed to this method is copied after it,
+// for the writer thread to append to the log file. If the ring is full
+// the full ring policy decides whether we wait for room, throw away the
+// oldest record, or throw away this one. Data too large for a slot is
+// cut short. Records from any thread but the first one to log are
+// thrown away, see the ring in LoggingClass.h.
+//
+// ----------------------------------------------------------------------
+
+void LoggingClass::logging_write_record( const log_direction this_direction, const log_frame_type this_type,
+    const uint32_t peer_address, const void * this_data_p, size_t this_size )
+{
+    const std::thread::id this_thread = std::this_thread::get_id( );
+    std::thread::id       no_thread;
+    uint32_t              this_tail   = 0;
+    uint32_t              this_head   = 0;
+    log_ring_slot       * slot_p      = (log_ring_slot *)NULL;
+
+    // Make sure that the writer is running, which it only does with a
+    // log file open, and make sure that logging is enabled
+    if ( false == writer.joinable( ) || true != logging_enabled )
+    {
+        return;
+    }
+
+    // A writer which lost its log file takes nothing more out of the ring
+    if ( true == writer_failed.load( std::memory_order_acquire ) )
+    {
+        dropped_lines.fetch_add( 1, std::memory_order_relaxed );
+
+        return;
+    }
+
+    // Only one thread may move the tail, whichever logged first
+    if ( this_thread != logging_thread.load( std::memory_order_relaxed ) &&
+        false == logging_thread.compare_exchange_strong( no_thread, this_thread ) )
+    {
+        if ( false == wrong_thread_seen.exchange( true ) )
+        {
+            (void)printf( "NOTE: Log records were written by a second thread, they are dropped\n" );
+        }
+
+        dropped_lines.fetch_add( 1, std::memory_order_relaxed );
+
+        return;
+    }
+
+    this_tail = ring_tail.load( std::memory_order_relaxed );
+
+    // Wait for, or make, room in the ring
+    while ( true )
+    {
+        this_head = ring_head.load( std::memory_order_acquire );
+
+        if ( this_tail - this_head < LOG_RING_SLOT_COUNT )
+        {
+            break;
+        }
+
+        if ( log_full_drop_newest == full_policy || true == writer_failed.load( std::memory_order_acquire ) )
+        {
+            dropped_lines.fetch_add( 1, std::memory_order_relaxed );
+
+            return;
+        }
+
+        if ( log_full_drop_oldest == full_policy )
+        {
+            // The writer may take the line first, in which case there
+            // is room now anyway
+            if ( true == ring_head.compare_exchange_weak( this_head, this_head + 1,
+                std::memory_order_acq_rel ) )
+            {
+                dropped_lines.fetch_add( 1, std::memory_order_relaxed );
+            }
+
+            continue;
+        }
+
+        // Let the writer make room
+        wake_writer( );
+
+        (void)usleep( LOG_FULL_BLOCK_DELAY );
+    }
+
+    slot_p = &ring_p[ this_tail & ( LOG_RING_SLOT_COUNT - 1 ) ];
+
+    if ( this_size > sizeof( slot_p->text ) )
+    {
+        this_size = sizeof( slot_p->text );
+    }
+
+    (void)memcpy( slot_p->text, this_data_p, this_size );
+
+    slot_p->record.record_length = (uint32_t)( sizeof( log_record_header ) + this_size );
+    slot_p->record.direction     = (uint8_t)this_direction;
+    slot_p->record.frame_type    = (uint8_t)this_type;
+    slot_p->record.reserved      = 0;
+    slot_p->record.monotonic_ns  = ClockClass::clock_monotonic_ns( );
+    slot_p->record.wall_ns       = ClockClass::clock_wall_ns( );
+    slot_p->record.peer_address  = peer_address;
+    slot_p->record.reserved_2    = 0;
+
+    // Hand the slot to the writer
+    ring_tail.store( this_tail + 1, std::memory_order_release );
+
+    if ( true == writer_waiting.load( std::memory_order_relaxed ) )
+    {
+        wake_writer( );
+    }
+}
+
+// ----------------------------------------------------------------------
+// LoggingClass Logging Enable Disable
+//
+// The logging can be turned on or off depending upon the argument
+// passed to the function.
+//
+// ----------------------------------------------------------------------
+
+void LoggingClass::logging_enable_disable( const bool logging_on_off )
+{
+    logging_enabled = logging_on_off;
+}
+
+// ----------------------------------------------------------------------
+// LoggingClass Logging Set Full Policy
+//
+// Selects what happens to a line logged while the ring is full.
+//
+// ----------------------------------------------------------------------
+
+void LoggingClass::logging_set_full_policy( const log_full_policy this_policy )
+{
+    full_policy = this_policy;
+}
+
+// ----------------------------------------------------------------------
+// LoggingClass Logging Dropped Count
+//
+// Returns: The number of lines thrown away because the ring was full
+//
+// ----------------------------------------------------------------------
+
+uint64_t LoggingClass::logging_dropped_count( void )
+{
+    return dropped_lines.load( std::memory_order_relaxed );
+}
+
+// ----------------------------------------------------------------------
+// LoggingClass Logging Set Durability
+//
+// Selects how hard the writer works to get lines on to the disk, how
+// old in milliseconds the oldest uncommitted line may get, and how many
+// bytes may wait, before the lines are committed. Zero for both commits
+// every batch.
+//
+// ----------------------------------------------------------------------
+
+void LoggingClass::logging_set_durability( const log_durability this_durability,
+    const int this_commit_ms, const int this_commit_bytes )
+{
+    durability   = this_durability;
+    commit_ms    = this_commit_ms;
+    commit_bytes = this_commit_bytes;
+
+    wake_writer( );
+}
+
+// ----------------------------------------------------------------------
+// LoggingClass Logging Get Stats
+//
+// Offers a copy of what the writer has done through the argument.
+//
+// ----------------------------------------------------------------------
+
+void LoggingClass::logging_get_stats( log_stats & these_stats )
+{
+    std::lock_guard<std::mutex> stats_guard( stats_lock );
+
+    these_stats               = stats;
+    these_stats.durability    = (log_durability)durability.load( );
+    these_stats.dropped_lines = dropped_lines.load( std::memory_order_relaxed );
+    these_stats.elapsed_ns    = 0 == created_ns ? 0 : ClockClass::clock_monotonic_ns( ) - created_ns;
+}
+
+// ----------------------------------------------------------------------
+// LoggingClass Commit Due
+//
+// Returns: true if lines are waiting to be committed and, under the
+// durability mode, the time has come to do so
+//
+// ----------------------------------------------------------------------
+
+bool LoggingClass::commit_due( const uint64_t now_ns )
+{
+    const int this_ms    = commit_ms.load( );
+    const int this_bytes = commit_bytes.load( );
+
+    if ( 0 == pending_bytes || log_durability_buffered == durability.load( ) )
+    {
+        return false;
+    }
+
+    if ( 0 == this_ms && 0 == this_bytes )
+    {
+        return true;
+    }
+
+    if ( this_bytes > 0 && pending_bytes >= (uint64_t)this_bytes )
+    {
+        return true;
+    }
+
+    return this_ms > 0 && now_ns - pending_since_ns >= (uint64_t)this_ms * 1000000ULL;
+}
+
+// ----------------------------------------------------------------------
+// LoggingClass Commit Log
+//
+// Flushes the lines written to the file, and syncs them to the disk if
+// the mode is group commit, keeping track of how long it took and how
+// long the oldest of the lines waited.
+//
+// ----------------------------------------------------------------------
+
+void LoggingClass::commit_log( void )
+{
+    const uint64_t start_ns = ClockClass::clock_precise_ns( );
+    uint64_t       done_ns  = 0;
+
+    (void)fflush( write_log_p );
+
+    if ( log_durability_group_commit == durability.load( ) )
+    {
+        (void)fdatasync( fileno( write_log_p ) );
+    }
+
+    done_ns = ClockClass::clock_precise_ns( );
+
+    {
+        std::lock_guard<std::mutex> stats_guard( stats_lock );
+
+        stats.commit_count++;
+        stats.commit_ns_total       += done_ns - start_ns;
+        stats.commit_delay_ns_total += done_ns - pending_since_ns;
+
+        if ( done_ns - start_ns > stats.commit_ns_max )
+        {
+            stats.commit_ns_max = done_ns - start_ns;
+        }
+
+        if ( done_ns - pending_since_ns > stats.commit_delay_ns_max )
+        {
+            stats.commit_delay_ns_max = done_ns - pending_since_ns;
+        }
+    }
+
+    pending_bytes    = 0;
+    pending_since_ns = 0;
+}
+
+// ----------------------------------------------------------------------
+// LoggingClass Logging Set Rotation
+//
+// Sets how large and how old in seconds a segment may get, how many
+// segments are kept, how many of the newest are left uncompressed, and
+// whether the older ones are compressed. Call it before the log is
+// created.
+//
+// ----------------------------------------------------------------------
+
+void LoggingClass::logging_set_rotation( const uint64_t max_bytes, const int max_seconds,
+    const int this_retain_segments, const int this_retain_plain, const bool compress_old )
+{
+    segment_max_bytes     = max_bytes;
+    segment_max_seconds   = max_seconds;
+    retain_segments       = this_retain_segments;
+    retain_plain_segments = this_retain_plain;
+    retain_compress       = compress_old;
+}
+
+// ----------------------------------------------------------------------
+// LoggingClass Logging Set Term Index
+//
+// Turns the indexing of the words of the log on or off. Call it before
+// the log is created.
+//
+// ----------------------------------------------------------------------
+
+void LoggingClass::logging_set_term_index( const bool index_terms )
+{
+    term_indexing = index_terms;
+}
+
+// ----------------------------------------------------------------------
+// LoggingClass Segment Name
+//
+// Builds the file name of a segment of the log in to the buffer offered.
+//
+// ----------------------------------------------------------------------
+
+void LoggingClass::segment_name( const uint32_t this_segment, char * name_p, const size_t name_size )
+{
+    (void)snprintf( name_p, name_size, LOG_SEGMENT_NAME_FORMAT, log_base_name, this_segment );
+}
+
+// ----------------------------------------------------------------------
+// LoggingClass Open Segment
+//
+// Creates the file for the current segment number, allocates the
+// segment's maximum size to it without changing the size of the file,
+// so that readers only ever see what was written, and writes the
+// segment header.
+//
+// Returns: true if the segment was created
+//
+// ----------------------------------------------------------------------
+
+bool LoggingClass::open_segment( void )
+{
+    log_segment_header this_header;
+
+    segment_name( segment_number, log_file_name, sizeof( log_file_name ) );
+
+    if ( ( FILE *)NULL == (write_log_p = fopen( log_file_name, "w+b") ) )
+    {
+        (void)printf( "I am unable to create log file [%s]\n", log_file_name );
+
+        return false;
+    }
+
+    // The C library buffers a whole batch when nothing else flushes
+    (void)setvbuf( write_log_p, (char *)NULL, _IOFBF, LOG_WRITE_BATCH_SIZE );
+
+    // Not every file system can allocate ahead; that is fine
+    (void)fallocate( fileno( write_log_p ), FALLOC_FL_KEEP_SIZE, 0, (off_t)segment_max_bytes );
+
+    (void)memset( (char *)&this_header, ASCII_NULL_ZERO, sizeof( this_header ) );
+    (void)memcpy( this_header.segment_magic, LOG_SEGMENT_MAGIC, sizeof( LOG_SEGMENT_MAGIC ) );
+
+    this_header.format_version       = LOG_FORMAT_VERSION;
+    this_header.segment_number       = segment_number;
+    this_header.created_wall_ns      = ClockClass::clock_wall_ns( );
+    this_header.created_monotonic_ns = ClockClass::clock_monotonic_ns( );
+
+    (void)fwrite( (char *)&this_header, 1, sizeof( this_header ), write_log_p );
+
+    segment_bytes   = sizeof( this_header );
+    segment_started = ClockClass::clock_seconds( );
+
+    // Start the segment's side index
+    (void)memset( (char *)&segment_index, ASCII_NULL_ZERO, sizeof( segment_index ) );
+    (void)memcpy( segment_index.index_magic, LOG_INDEX_MAGIC, sizeof( LOG_INDEX_MAGIC ) );
+
+    segment_index.format_version = LOG_FORMAT_VERSION;
+
+    index_entries.clear( );
+
+    std::lock_guard<std::mutex> stats_guard( stats_lock );
+
+    stats.segment_number = segment_number;
+
+    return true;
+}
+
+// ----------------------------------------------------------------------
+// LoggingClass Close Segment
+//
+// Commits whatever is waiting, gives back the space that was allocated
+// ahead and not used, closes the segment, and writes its side index.
+//
+// ----------------------------------------------------------------------
+
+void LoggingClass::close_segment( void )
+{
+    if ( pending_bytes > 0 )
+    {
+        commit_log( );
+    }
+
+    (void)fflush( write_log_p );
+
+    (void)ftruncate( fileno( write_log_p ), (off_t)segment_bytes );
+
+    (void)fclose( write_log_p );
+
+    write_log_p = (FILE *)NULL;
+
+    write_index( );
+
+    queue_term_work( 0, true );
+}
+
+// ----------------------------------------------------------------------
+// LoggingClass Queue Term Work
+//
+// Hands the indexer a copy of the batch about to be appended to the
+// segment, unless it has fallen too far behind, or tells it that the
+// segment has been closed. Word that a segment was closed is always
+// handed over so that every segment gets a term index.
+//
+// ----------------------------------------------------------------------
+
+void LoggingClass::queue_term_work( const int batch_count, const bool segment_closed )
+{
+    if ( false == term_indexing || false == indexer.joinable( ) )
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> indexer_guard( indexer_lock );
+
+    if ( false == segment_closed &&
+        ( true == terms_incomplete || term_queue_bytes + batch_count > LOG_TERM_QUEUE_BYTES ) )
+    {
+        terms_incomplete = true;
+
+        return;
+    }
+
+    term_queue.push_back( log_term_work( ) );
+
+    log_term_work & this_work = term_queue.back( );
+
+    this_work.segment_offset     = segment_bytes;
+    this_work.segment_number     = segment_number;
+    this_work.segment_closed     = segment_closed;
+    this_work.segment_incomplete = terms_incomplete;
+
+    if ( false == segment_closed )
+    {
+        this_work.batch.assign( batch_p, batch_p + batch_count );
+
+        term_queue_bytes += batch_count;
+    }
+    else
+    {
+        terms_incomplete = false;
+    }
+
+    indexer_wake.notify_one( );
+}
+
+// ----------------------------------------------------------------------
+// LoggingClass Index Batch
+//
+// Walks the records of the batch about to be appended to the segment,
+// adding every record's peer and time to the segment's side index and
+// noting where every so many of them start.
+//
+// ----------------------------------------------------------------------
+
+void LoggingClass::index_batch( const int batch_count )
+{
+    int batch_offset = 0;
+
+    while ( batch_offset < batch_count )
+    {
+        log_record_header this_record;
+        uint32_t          peer_bit = 0;
+
+        // Records are packed, so they are rarely aligned in the batch
+        (void)memcpy( (char *)&this_record, &batch_p[ batch_offset ], sizeof( this_record ) );
+
+        peer_bit = LOG_PEER_BIT( this_record.peer_address );
+
+        if ( 0 == segment_index.record_count % LOG_INDEX_INTERVAL )
+        {
+            log_index_entry this_entry;
+
+            this_entry.wall_ns       = this_record.wall_ns;
+            this_entry.record_offset = segment_bytes + batch_offset;
+
+            index_entries.push_back( this_entry );
+        }
+
+        if ( 0 == segment_index.record_count++ || this_record.wall_ns < segment_index.first_wall_ns )
+        {
+            segment_index.first_wall_ns = this_record.wall_ns;
+        }
+
+        if ( this_record.wall_ns > segment_index.last_wall_ns )
+        {
+            segment_index.last_wall_ns = this_record.wall_ns;
+        }
+
+        segment_index.peer_bitmap[ peer_bit / 8 ] |= (uint8_t)( 1 << ( peer_bit % 8 ) );
+
+        batch_offset += this_record.record_length;
+    }
+}
+
+// ----------------------------------------------------------------------
+// LoggingClass Write Index
+//
+// Writes the side index of the segment just closed next to it. A
+// segment without an index can still be read, only more slowly, so a
+// failure here is not reported.
+//
+// ----------------------------------------------------------------------
+
+void LoggingClass::write_index( void )
+{
+    char   index_name[ MAX_LOG_FILE_PATH_NAME + 8 ];
+    FILE * index_p = (FILE *)NULL;
+
+    (void)snprintf( index_name, sizeof( index_name ), "%s%s", log_file_name, LOG_INDEX_SUFFIX );
+
+    if ( (FILE *)NULL == ( index_p = fopen( index_name, "wb" ) ) )
+    {
+        return;
+    }
+
+    segment_index.entry_count   = (uint32_t)index_entries.size( );
+    segment_index.segment_bytes = segment_bytes;
+
+    (void)fwrite( (char *)&segment_index, 1, sizeof( segment_index ), index_p );
+
+    if ( false == index_entries.empty( ) )
+    {
+        (void)fwrite( (char *)index_entries.data( ), sizeof( log_index_entry ), index_entries.size( ), index_p );
+    }
+
+    (void)fclose( index_p );
+}
+
+// ----------------------------------------------------------------------
+// LoggingClass Retention Thread
+//
+// Every time a segment is closed, the oldest segments beyond the number
+// to be kept are removed, and the closed segments older than the newest
+// few are compressed. Segments are counted including the one being
+// written.
+//
+// ----------------------------------------------------------------------
+
+void LoggingClass::retention_thread( void )
+{
+    char     this_name[ MAX_LOG_FILE_PATH_NAME + 8 ];
+    char     this_command[ MAX_LOG_FILE_PATH_NAME * 2 ];
+    uint32_t segment_count = 0;
+    uint32_t closed_count  = 0;
+
+    while ( true )
+    {
+        {
+            std::unique_lock<std::mutex> retention_guard( retention_lock );
+
+            while ( closed_segments == closed_count && false == stop_retention )
+            {
+                retention_wake.wait( retention_guard );
+            }
+
+            if ( true == stop_retention )
+            {
+                return;
+            }
+
+            closed_count = closed_segments;
+        }
+
+        segment_count = closed_count + 1;
+
+        // Remove the oldest segments, compressed or not
+        while ( retain_segments > 0 && segment_count - next_to_remove > (uint32_t)retain_segments )
+        {
+            segment_name( next_to_remove, this_name, sizeof( this_name ) - 3 );
+
+            (void)unlink( this_name );
+
+            (void)strcat( this_name, ".gz" );
+
+            (void)unlink( this_name );
+
+            segment_name( next_to_remove, this_name, sizeof( this_name ) - 4 );
+
+            (void)strcat( this_name, LOG_INDEX_SUFFIX );
+
+            (void)unlink( this_name );
+
+            segment_name( next_to_remove, this_name, sizeof( this_name ) - 6 );
+
+            (void)strcat( this_name, TERM_INDEX_SUFFIX );
+
+            (void)unlink( this_name );
+
+            next_to_remove++;
+
+            std::lock_guard<std::mutex> stats_guard( stats_lock );
+
+            stats.segments_removed++;
+        }
+
+        if ( next_to_compress < next_to_remove )
+        {
+            next_to_compress = next_to_remove;
+        }
+
+        // Compress the closed segments that are not among the newest few
+        while ( true == retain_compress && next_to_compress < closed_count &&
+            segment_count - next_to_compress > (uint32_t)retain_plain_segments )
+        {
+            FILE * command_p = (FILE *)NULL;
+
+            segment_name( next_to_compress, this_name, sizeof( this_name ) );
+
+            (void)snprintf( this_command, sizeof( this_command ), "%s '%s' 2>/dev/null",
+                LOG_COMPRESS_COMMAND, this_name );
+
+            if ( (FILE *)NULL != ( command_p = popen( this_command, "r" ) ) &&
+                0 == pclose( command_p ) )
+            {
+                std::lock_guard<std::mutex> stats_guard( stats_lock );
+
+                stats.segments_compressed++;
+            }
+
+            next_to_compress++;
+        }
+    }
+}
+
+// ----------------------------------------------------------------------
+// LoggingClass Indexer Thread
+//
+// Adds the words of every record in the batches the writer hands over
+// to the term index of the segment, and writes the term index next to
+// the segment once the segment is closed. When asked to stop it first
+// indexes whatever it was given.
+//
+// ----------------------------------------------------------------------
+
+void LoggingClass::indexer_thread( void )
+{
+    char this_name[ MAX_LOG_FILE_PATH_NAME + 8 ];
+
+    while ( true )
+    {
+        log_term_work this_work;
+        int           batch_offset = 0;
+
+        {
+            std::unique_lock<std::mutex> indexer_guard( indexer_lock );
+
+            while ( true == term_queue.empty( ) && false == stop_indexer )
+            {
+                indexer_wake.wait( indexer_guard );
+            }
+
+            if ( true == term_queue.empty( ) )
+            {
+                return;
+            }
+
+            this_work = std::move( term_queue.front( ) );
+
+            term_queue_bytes -= this_work.batch.size( );
+
+            term_queue.pop_front( );
+        }
+
+        if ( true == this_work.segment_closed )
+        {
+            if ( true == this_work.segment_incomplete )
+            {
+                term_index.term_index_incomplete( );
+            }
+
+            segment_name( this_work.segment_number, this_name, sizeof( this_name ) - 6 );
+
+            (void)strcat( this_name, TERM_INDEX_SUFFIX );
+
+            if ( true == term_index.term_index_write( this_name ) )
+            {
+                std::lock_guard<std::mutex> stats_guard( stats_lock );
+
+                stats.segments_term_indexed++;
+
+                if ( true == this_work.segment_incomplete )
+                {
+                    stats.segments_term_incomplete++;
+                }
+            }
+
+            term_index.term_index_clear( );
+
+            continue;
+        }
+
+        while ( batch_offset < (int)this_work.batch.size( ) )
+        {
+            log_record_header this_record;
+
+            (void)memcpy( (char *)&this_record, &this_work.batch[ batch_offset ], sizeof( this_record ) );
+
+            term_index.term_index_add( &this_work.batch[ batch_offset + sizeof( this_record ) ],
+                this_record.record_length - sizeof( this_record ), this_work.segment_offset + batch_offset );
+
+            batch_offset += this_record.record_length;
+        }
+    }
+}
+
+// ----------------------------------------------------------------------
+// LoggingClass Wake Writer
+//
+// Wakes the writer thread if it is waiting for lines to arrive.
+//
+// ----------------------------------------------------------------------
+
+void LoggingClass::wake_writer( void )
+{
+    std::lock_guard<std::mutex> writer_guard( writer_lock );
+
+    writer_wake.notify_one( );
+}
+
+// ----------------------------------------------------------------------
+// LoggingClass Drain Ring
+//
+// Copies as many records out of the ring as fit in to the batch buffer.
+// If records were thrown away since the last batch, a note record
+// saying how many is put in to the batch first. When the oldest record
+// was logged and how many were copied are offered through the arguments.
+//
+// Returns: The number of bytes in the batch buffer
+//
+// ----------------------------------------------------------------------
+
+int LoggingClass::drain_ring( uint64_t & oldest_ns, uint32_t & line_count )
+{
+    uint32_t       this_head   = ring_head.load( std::memory_order_acquire );
+    const uint32_t this_tail   = ring_tail.load( std::memory_order_acquire );
+    const uint64_t drops_now   = dropped_lines.load( std::memory_order_relaxed );
+    int            batch_count = 0;
+
+    oldest_ns  = 0;
+    line_count = 0;
+
+    if ( drops_now != reported_drops )
+    {
+        log_record_header * note_p = (log_record_header *)batch_p;
+        const int           length = snprintf( &batch_p[ sizeof( log_record_header ) ],
+            LOG_WRITE_BATCH_SIZE - sizeof( log_record_header ), "[%llu log lines dropped]",
+            (unsigned long long)( drops_now - reported_drops ) );
+
+        (void)memset( (char *)note_p, ASCII_NULL_ZERO, sizeof( log_record_header ) );
+
+        note_p->record_length = (uint32_t)( sizeof( log_record_header ) + length );
+        note_p->direction     = log_direction_none;
+        note_p->frame_type    = log_frame_note;
+        note_p->monotonic_ns  = ClockClass::clock_monotonic_ns( );
+        note_p->wall_ns       = ClockClass::clock_wall_ns( );
+
+        batch_count    = (int)note_p->record_length;
+        reported_drops = drops_now;
+    }
+
+    while ( this_head != this_tail )
+    {
+        const log_ring_slot * slot_p        = &ring_p[ this_head & ( LOG_RING_SLOT_COUNT - 1 ) ];
+        const uint32_t        record_length = slot_p->record.record_length;
+        const uint64_t        enqueue_ns    = slot_p->record.monotonic_ns;
+
+        // Leave the record for the next batch if it does not fit
+        if ( record_length > sizeof( log_ring_slot ) ||
+            batch_count + (int)record_length > LOG_WRITE_BATCH_SIZE )
+        {
+            break;
+        }
+
+        // The record header and the data follow each other in the slot
+        (void)memcpy( &batch_p[ batch_count ], (const char *)slot_p, record_length );
+
+        // Keep the copy only if the logger did not throw the record away
+        // while we were copying it. A failed exchange loads the new head.
+        if ( true == ring_head.compare_exchange_strong( this_head, this_head + 1,
+            std::memory_order_acq_rel ) )
+        {
+            batch_count += record_length;
+
+            if ( 0 == line_count++ )
+            {
+                oldest_ns = enqueue_ns;
+            }
+
+            this_head++;
+        }
+    }
+
+    return batch_count;
+}
+
+// ----------------------------------------------------------------------
+// LoggingClass Writer Thread
+//
+// Takes batches of lines out of the ring and appends them to the log
+// file with one write each, committing them when the durability mode
+// says that it is time, and waiting for lines when the ring is empty
+// but never past the time the waiting lines must be committed. When
+// asked to stop it writes and commits whatever is left first.
+//
+// ----------------------------------------------------------------------
+
+void LoggingClass::writer_thread( void )
+{
+    while ( true )
+    {
+        const bool last_pass   = stop_writer.load( );
+        uint64_t   oldest_ns   = 0;
+        uint32_t   line_count  = 0;
+        const int  batch_count = drain_ring( oldest_ns, line_count );
+        uint64_t   now_ns      = 0;
+        uint64_t   wait_ms     = LOG_WRITER_IDLE_DELAY;
+
+        // Roll over to the next segment if this one is full or too old
+        if ( batch_count > 0 && segment_bytes > 0 &&
+            ( segment_bytes + batch_count > segment_max_bytes ||
+            ( segment_max_seconds > 0 && ClockClass::clock_seconds( ) - segment_started >= segment_max_seconds ) ) )
+        {
+            close_segment( );
+
+            segment_number++;
+
+            if ( false == open_segment( ) )
+            {
+                // Without a file there is nowhere for the lines to go,
+                // so the logger is told to throw them away rather than
+                // wait for room that will never be made
+                (void)printf( "NOTE: Logging stopped, log records are dropped from now on\n" );
+
+                dropped_lines.fetch_add( line_count, std::memory_order_relaxed );
+
+                writer_failed.store( true, std::memory_order_release );
+
+                return;
+            }
+
+            // Let the retention thread look after the closed segment
+            std::lock_guard<std::mutex> retention_guard( retention_lock );
+
+            closed_segments = segment_number;
+
+            retention_wake.notify_one( );
+        }
+
+        if ( batch_count > 0 )
+        {
+            index_batch( batch_count );
+
+            queue_term_work( batch_count, false );
+
+            (void)fwrite( batch_p, 1, batch_count, write_log_p );
+
+            segment_bytes += batch_count;
+
+            if ( 0 == pending_bytes )
+            {
+                pending_since_ns = 0 != oldest_ns ? oldest_ns : ClockClass::clock_monotonic_ns( );
+            }
+
+            pending_bytes += batch_count;
+
+            std::lock_guard<std::mutex> stats_guard( stats_lock );
+
+            stats.lines_written += line_count;
+            stats.bytes_written += batch_count;
+            stats.write_batches++;
+        }
+
+        now_ns = ClockClass::clock_monotonic_ns( );
+
+        if ( true == commit_due( now_ns ) ||
+            ( true == last_pass && 0 == batch_count && pending_bytes > 0 ) )
+        {
+            commit_log( );
+        }
+
+        if ( batch_count > 0 )
+        {
+            continue;
+        }
+
+        if ( true == last_pass )
+        {
+            return;
+        }
+
+        // Do not sleep past the time the waiting lines must be committed
+        if ( pending_bytes > 0 && commit_ms.load( ) > 0 &&
+            log_durability_buffered != durability.load( ) )
+        {
+            const uint64_t due_ns = pending_since_ns + (uint64_t)commit_ms.load( ) * 1000000ULL;
+
+            wait_ms = due_ns > now_ns ? ( due_ns - now_ns ) / 1000000ULL + 1 : 0;
+
+            if ( wait_ms > LOG_WRITER_IDLE_DELAY )
+            {
+                wait_ms = LOG_WRITER_IDLE_DELAY;
+            }
+        }
+
+        // Wait for more lines. The logger only wakes us if it sees that
+        // we are waiting, so look at the ring once more after saying so.
+        std::unique_lock<std::mutex> writer_guard( writer_lock );
+
+        writer_waiting = true;
+
+        if ( ring_head.load( ) == ring_tail.load( ) && false == stop_writer.load( ) && wait_ms > 0 )
+        {
+            (void)writer_wake.wait_for( writer_guard, std::chrono::milliseconds( wait_ms ) );
+        }
+
+        writer_waiting = false;
+    }
+}
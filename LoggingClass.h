@@ -1,60 +1,392 @@
-
-// ----------------------------------------------------------------------
-// LoggingClass -- Small log file class which creates a log file using
-// a name based upon the current date and time, and allows 
-// NULL-terminated ASCII text to be appended to the growing log.
-//
-// See main.c for disclaimers and other information.
-//
-// Fredric L. Rice, June 2018
-// http://www.crystallake.name
-// fred @ crystal lake . name
-// 
-// ----------------------------------------------------------------------
-
-#ifndef _LOGGINGCLASS_H_
-#define _LOGGINGCLASS_H_     1
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-
-// ----------------------------------------------------------------------
-// Other defined constants that we will be using. We attempt to avoid
-// hard-coded numbers in the source code.
-//
-// ----------------------------------------------------------------------
-
-#define ASCII_NULL_ZERO             0x00
-
-// ----------------------------------------------------------------------
-// Usually the log file is created in the current directory. This defined
-// constant describes the maximum size of the file name which does not
-// include the path.
-//
-// ----------------------------------------------------------------------
-
-#define MAX_LOG_FILE_PATH_NAME      256
-
-// ----------------------------------------------------------------------
-// Our class is defined here.
-//
-// ----------------------------------------------------------------------
-
-class LoggingClass
-{
-    public:
-        LoggingClass( void );
-        ~LoggingClass( void );
-
-        void logging_create_log( void );
-        void logging_write_log( const char * this_text_p );
-        void logging_enable_disable( const bool logging_on_off );
-
-    private:
-        FILE * write_log_p;
-        char   log_file_name[ MAX_LOG_FILE_PATH_NAME ];
-        int    logging_enabled;
-} ;
-
-#endif
+
+// ----------------------------------------------------------------------
+// LoggingClass -- Small log file class which creates a log file using
+// a name based upon the current date and time, and allows records of
+// what was sent and received to be appended to the growing log.
+//
+// Records are handed to a background writer thread through a ring so that
+// the caller never waits on the file system. The log is written in to
+// numbered segments which are rolled over by size or by age, and old
+// segments are compressed or removed in the background.
+//
+// See main.c for disclaimers and other information.
+//
+// Fredric L. Rice, June 2018
+// http://www.crystallake.name
+// fred @ crystal lake . name
+// 
+// ----------------------------------------------------------------------
+
+#ifndef _LOGGINGCLASS_H_
+#define _LOGGINGCLASS_H_     1
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <deque>
+#include "TermIndexClass.h"     // The inverted index of the words logged
+
+// ----------------------------------------------------------------------
+// Other defined constants that we will be using. We attempt to avoid
+// hard-coded numbers in the source code.
+//
+// ----------------------------------------------------------------------
+
+#define ASCII_NULL_ZERO             0x00
+
+// ----------------------------------------------------------------------
+// Usually the log file is created in the current directory. This defined
+// constant describes the maximum size of the file name which does not
+// include the path.
+//
+// ----------------------------------------------------------------------
+
+#define MAX_LOG_FILE_PATH_NAME      256
+
+// ----------------------------------------------------------------------
+// The log is a series of segments named after the time the log was
+// created followed by the segment number. A segment is closed and the
+// next one started once it would grow past the maximum size, or once
+// it has been open for the maximum number of seconds (0 for no limit).
+// Each segment has its maximum size allocated up front so that it is
+// laid out in one piece and writes never wait on the file system to
+// find room; a segment which is closed early gives back what it did
+// not use.
+//
+// Only so many segments are kept, the oldest being removed (0 keeps all
+// of them), and all but the newest few are compressed with gzip.
+//
+// ----------------------------------------------------------------------
+
+#define LOG_SEGMENT_MAX_BYTES       (64 * 1024 * 1024)
+#define LOG_SEGMENT_MAX_SECONDS     (24 * 60 * 60)
+#define LOG_RETAIN_SEGMENTS         60
+#define LOG_RETAIN_PLAIN_SEGMENTS   2
+#define LOG_RETAIN_COMPRESS         1
+#define LOG_SEGMENT_NAME_FORMAT     "%s-%04u.clog"
+#define LOG_COMPRESS_COMMAND        "gzip -f -q"
+#define LOG_DECOMPRESS_COMMAND      "gzip -d -c"
+
+// ----------------------------------------------------------------------
+// The log is binary. Every segment starts with a segment header and is
+// followed by records, each a record header and then the data that was
+// logged, with the record length covering both so that a reader can
+// step from one record to the next without looking at the data. Every
+// record carries both the monotonic time, which orders the records and
+// measures the time between them, and the wall clock time, which tells
+// when they happened; the peer address in network order (0 for this
+// system); whether the data came in or went out; and what sort of frame
+// it was. Values are in the byte order of the system which wrote them.
+//
+// ----------------------------------------------------------------------
+
+#define LOG_SEGMENT_MAGIC           "CHATLOG"
+#define LOG_FORMAT_VERSION          1
+
+    typedef struct LOG_SEGMENT_HEADER_T
+    {
+        char     segment_magic[ 8 ];                  // Always CHATLOG
+        uint32_t format_version;                      // LOG_FORMAT_VERSION
+        uint32_t segment_number;                      // Which segment of the log
+        uint64_t created_wall_ns;                     // Wall clock time it was started
+        uint64_t created_monotonic_ns;                // Monotonic time it was started
+    } log_segment_header;
+
+    typedef struct LOG_RECORD_HEADER_T
+    {
+        uint32_t record_length;                       // This header and the data
+        uint8_t  direction;                           // A log_direction
+        uint8_t  frame_type;                          // A log_frame_type
+        uint16_t reserved;                            // Always zero
+        uint64_t monotonic_ns;                        // CLOCK_MONOTONIC when logged
+        uint64_t wall_ns;                             // CLOCK_REALTIME when logged
+        uint32_t peer_address;                        // IPv4 address, 0 for us
+        uint32_t reserved_2;                          // Always zero
+    } log_record_header;
+
+// ----------------------------------------------------------------------
+// Every segment has a small side index, written next to it when it is
+// closed, so that a reader looking for a time or a peer need not read
+// every segment from the start. The index holds the earliest and latest
+// wall clock times in the segment, a bitmap with a bit set for every
+// peer heard from (hashed, so a set bit only means that the peer may be
+// in the segment), and the wall clock time and offset of every so many
+// records. The index is left uncompressed when the segment is.
+//
+// ----------------------------------------------------------------------
+
+#define LOG_INDEX_SUFFIX            ".idx"
+#define LOG_INDEX_MAGIC             "CHATIDX"
+#define LOG_INDEX_INTERVAL          256
+#define LOG_PEER_BITMAP_BITS        1024
+#define LOG_PEER_BIT( address )     ( ( (uint32_t)( address ) * 2654435761U ) >> 22 )
+
+    typedef struct LOG_INDEX_HEADER_T
+    {
+        char     index_magic[ 8 ];                    // Always CHATIDX
+        uint32_t format_version;                      // LOG_FORMAT_VERSION
+        uint32_t entry_count;                         // Entries following the header
+        uint64_t record_count;                        // Records in the segment
+        uint64_t segment_bytes;                       // Size of the segment
+        uint64_t first_wall_ns;                       // Earliest record
+        uint64_t last_wall_ns;                        // Latest record
+        uint8_t  peer_bitmap[ LOG_PEER_BITMAP_BITS / 8 ];
+    } log_index_header;
+
+// ----------------------------------------------------------------------
+// The words of the records may also be indexed, which is off unless it
+// is asked for. Batches the writer has written are copied to an indexer
+// thread which builds the inverted index of the segment and writes it
+// next to the segment when the segment is closed. Should the indexer
+// fall behind by too many bytes the writer stops handing it batches
+// for the rest of the segment, rather than wait, and the segment's term
+// index is marked as incomplete.
+//
+// ----------------------------------------------------------------------
+
+#define LOG_DEFAULT_TERM_INDEX      0
+#define LOG_TERM_QUEUE_BYTES        (16 * 1024 * 1024)
+
+    typedef struct LOG_INDEX_ENTRY_T
+    {
+        uint64_t wall_ns;                             // When the record was logged
+        uint64_t record_offset;                       // Where it is in the segment
+    } log_index_entry;
+
+    enum log_direction
+    {
+        log_direction_none     = 0,         // Neither, a note from the logger
+        log_direction_inbound  = 1,         // Received from the peer
+        log_direction_outbound = 2          // Sent by us
+    } ;
+
+    enum log_frame_type
+    {
+        log_frame_text         = 1,         // Chat text
+        log_frame_command      = 2,         // A console command
+        log_frame_note         = 3          // Something the logger noted
+    } ;
+
+// ----------------------------------------------------------------------
+// Lines to be logged are copied in to a ring of fixed size slots by
+// the one thread which logs, and a writer thread takes them out of the
+// ring and writes as many as it has in one go. The slot count must be
+// a power of two. Lines longer than a slot are cut short.
+//
+// Only one thread may log, as nothing stops two from filling the same
+// slot. The first thread to log a line is the one; lines any other
+// thread tries to log are thrown away and counted as dropped, and the
+// first of them is reported. The pipeline and receive shard threads of
+// the chat class must leave logging to the main loop.
+//
+// When the writer finds the ring empty it waits for a line to arrive,
+// but never longer than the idle delay in milliseconds.
+//
+// ----------------------------------------------------------------------
+
+#define LOG_RING_SLOT_COUNT         512
+#define LOG_RING_TEXT_SIZE          2048
+#define LOG_WRITE_BATCH_SIZE        (64 * 1024)
+#define LOG_WRITER_IDLE_DELAY       10
+#define LOG_FULL_BLOCK_DELAY        100
+
+#if LOG_RING_SLOT_COUNT & ( LOG_RING_SLOT_COUNT - 1 )
+#error "LOG_RING_SLOT_COUNT must be a power of two"
+#endif
+
+    typedef struct LOG_RING_SLOT_T
+    {
+        log_record_header record;                     // The record, ready to write
+        char              text[ LOG_RING_TEXT_SIZE ]; // The data, not NULL terminated
+    } log_ring_slot;
+
+// ----------------------------------------------------------------------
+// What happens to a line when the ring is full: the caller may wait
+// for the writer to make room, the oldest line in the ring may be
+// thrown away to make room, or the new line may be thrown away. Lines
+// thrown away are counted and the count is noted in the log. Should
+// the writer lose its log file every line is thrown away, whatever the
+// policy, since room would never be made.
+//
+// ----------------------------------------------------------------------
+
+    enum log_full_policy
+    {
+        log_full_block       = 1,           // Wait for room
+        log_full_drop_oldest = 2,           // Throw away the oldest line
+        log_full_drop_newest = 3            // Throw away the new line
+    } ;
+
+#define LOG_DEFAULT_FULL_POLICY     log_full_drop_oldest
+
+// ----------------------------------------------------------------------
+// How hard the writer works to get lines on to the disk. Buffered
+// leaves the lines in the C library's buffer until it fills. Flush
+// hands the lines to Linux once the oldest unflushed line is a number
+// of milliseconds old or a number of bytes are waiting, whichever is
+// first, and does so for every batch if both are zero. Group commit
+// does the same but also waits for the data to reach the disk with
+// fdatasync(), so all of the lines in the group pay for one sync.
+//
+// ----------------------------------------------------------------------
+
+    enum log_durability
+    {
+        log_durability_buffered     = 1,    // Left to the C library
+        log_durability_flush        = 2,    // fflush() when due
+        log_durability_group_commit = 3     // fflush() and fdatasync() when due
+    } ;
+
+#define LOG_DEFAULT_DURABILITY      log_durability_flush
+#define LOG_DEFAULT_COMMIT_MS       0
+#define LOG_DEFAULT_COMMIT_BYTES    0
+
+// ----------------------------------------------------------------------
+// What the writer has done since the log file was created, so that the
+// cost of a durability mode can be seen. A commit is a flush, or a
+// flush and a sync, and the commit delay is how long the oldest line
+// of a commit waited from being logged until the commit was done.
+//
+// ----------------------------------------------------------------------
+
+    typedef struct LOG_STATS_T
+    {
+        log_durability durability;                    // The mode in use
+        uint64_t       elapsed_ns;                    // Since the log was created
+        uint64_t       lines_written;                 // Lines handed to the file
+        uint64_t       bytes_written;                 // Bytes handed to the file
+        uint64_t       write_batches;                 // Batches written
+        uint64_t       dropped_lines;                 // Lines thrown away
+        uint64_t       commit_count;                  // Flushes or syncs done
+        uint64_t       commit_ns_total;               // Time spent committing
+        uint64_t       commit_ns_max;                 // Longest commit
+        uint64_t       commit_delay_ns_total;         // Oldest line's wait, summed
+        uint64_t       commit_delay_ns_max;           // Oldest line's longest wait
+        uint32_t       segment_number;                // The segment being written
+        uint32_t       segments_compressed;           // Old segments compressed
+        uint32_t       segments_removed;              // Old segments removed
+        uint32_t       segments_term_indexed;         // Term indexes written
+        uint32_t       segments_term_incomplete;      // Of them, missing records
+    } log_stats;
+
+// ----------------------------------------------------------------------
+// What the writer hands the indexer: a copy of a batch and where it was
+// written in the segment, or word that the segment has been closed.
+//
+// ----------------------------------------------------------------------
+
+    typedef struct LOG_TERM_WORK_T
+    {
+        std::vector<char> batch;                      // The records written
+        uint64_t          segment_offset;             // Where the batch starts
+        uint32_t          segment_number;             // The segment they are in
+        bool              segment_closed;             // True to write the index
+        bool              segment_incomplete;         // True if batches were skipped
+    } log_term_work;
+
+// ----------------------------------------------------------------------
+// Our class is defined here.
+//
+// ----------------------------------------------------------------------
+
+class LoggingClass
+{
+    public:
+        LoggingClass( void );
+        ~LoggingClass( void );
+
+        void logging_create_log( void );
+        void logging_write_log( const char * this_text_p );
+        void logging_write_record( const log_direction this_direction, const log_frame_type this_type,
+                 const uint32_t peer_address, const void * this_data_p, size_t this_size );
+        void logging_enable_disable( const bool logging_on_off );
+        void logging_set_full_policy( const log_full_policy this_policy );
+        uint64_t logging_dropped_count( void );
+        void logging_set_durability( const log_durability this_durability,
+                 const int commit_ms, const int commit_bytes );
+        void logging_get_stats( log_stats & these_stats );
+        void logging_set_rotation( const uint64_t max_bytes, const int max_seconds,
+                 const int retain_segments, const int retain_plain, const bool compress_old );
+        void logging_set_term_index( const bool index_terms );
+
+    private:
+        LoggingClass( const LoggingClass & );
+        LoggingClass & operator=( const LoggingClass & );
+
+        void   writer_thread( void );
+        int    drain_ring( uint64_t & oldest_ns, uint32_t & line_count );
+        void   wake_writer( void );
+        bool   commit_due( const uint64_t now_ns );
+        void   commit_log( void );
+        bool   open_segment( void );
+        void   close_segment( void );
+        void   segment_name( const uint32_t this_segment, char * name_p, const size_t name_size );
+        void   index_batch( const int batch_count );
+        void   write_index( void );
+        void   retention_thread( void );
+        void   queue_term_work( const int batch_count, const bool segment_closed );
+        void   indexer_thread( void );
+
+        FILE                  * write_log_p;
+        char                    log_file_name[ MAX_LOG_FILE_PATH_NAME ];
+        char                    log_base_name[ MAX_LOG_FILE_PATH_NAME ];
+        int                     logging_enabled;
+        log_full_policy         full_policy;
+        log_ring_slot         * ring_p;
+        char                  * batch_p;
+        std::atomic<uint32_t>   ring_head;            // Next slot the writer takes
+        std::atomic<uint32_t>   ring_tail;            // Next slot the logger fills
+        std::atomic<uint64_t>   dropped_lines;
+        std::atomic<std::thread::id> logging_thread;  // The one thread which logs
+        std::atomic<bool>       wrong_thread_seen;    // Another thread tried to log
+        uint64_t                reported_drops;
+        std::atomic<bool>       writer_waiting;
+        std::atomic<bool>       stop_writer;
+        std::atomic<bool>       writer_failed;        // The writer could not open a segment
+        std::thread             writer;
+        std::mutex              writer_lock;
+        std::condition_variable writer_wake;
+        std::atomic<int>        durability;
+        std::atomic<int>        commit_ms;
+        std::atomic<int>        commit_bytes;
+        uint64_t                pending_bytes;        // Written but not committed
+        uint64_t                pending_since_ns;     // When the oldest of them was logged
+        uint64_t                created_ns;
+        log_stats               stats;
+        std::mutex              stats_lock;
+        uint64_t                segment_max_bytes;
+        int                     segment_max_seconds;
+        int                     retain_segments;
+        int                     retain_plain_segments;
+        bool                    retain_compress;
+        uint32_t                segment_number;       // The segment being written
+        uint64_t                segment_bytes;        // Bytes written in to it
+        time_t                  segment_started;      // When it was started, monotonic
+        log_index_header        segment_index;        // Its side index so far
+        std::vector<log_index_entry> index_entries;
+        uint32_t                closed_segments;      // Segments before the one being written
+        uint32_t                next_to_remove;       // Oldest segment still kept
+        uint32_t                next_to_compress;     // Oldest segment not compressed
+        bool                    stop_retention;
+        std::thread             retention;
+        std::mutex              retention_lock;
+        std::condition_variable retention_wake;
+        bool                    term_indexing;        // Words are being indexed
+        bool                    terms_incomplete;     // Batches of this segment skipped
+        TermIndexClass          term_index;           // Used only by the indexer
+        std::deque<log_term_work> term_queue;
+        size_t                  term_queue_bytes;     // Bytes of batches in it
+        bool                    stop_indexer;
+        std::thread             indexer;
+        std::mutex              indexer_lock;
+        std::condition_variable indexer_wake;
+} ;
+
+#endif
@@ -0,0 +1,506 @@
+
+// ----------------------------------------------------------------------
+// MetricsClass -- Small class which counts what the chat program does
+// and keeps histograms of how long it takes to do it.
+//
+// Counting must cost next to nothing since it is done for every frame
+// sent and received, so there are no locks. Every thread is handed a
+// shard of the counters the first time it counts something, and after
+// that it only ever touches its own shard. The counters are atomic so
+// that a snapshot may be taken from any thread while they are being
+// counted, and so that the threads sharing the last shard, if there are
+// ever more threads than shards, do not lose counts; with no other
+// thread writing the same cache lines an atomic add costs little more
+// than a plain one.
+//
+// A snapshot adds every shard together. It is not taken at one instant,
+// so a counter may be a count or two ahead of another, which does not
+// matter for what the numbers are used for.
+//
+// See main.c for disclaimers and other information.
+//
+// Fredric L. Rice, June 2018
+// http://www.crystallake.name
+// fred @ crystal lake . name
+//
+// ----------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+#include "MetricsClass.h"       // Our own class and defined constants
+
+// ----------------------------------------------------------------------
+// A thread's shard of the counters. Shards are kept apart by a cache
+// line so that two threads never write to the same line.
+//
+// ----------------------------------------------------------------------
+
+    typedef struct alignas( 64 ) METRICS_SHARD_T
+    {
+        std::atomic<uint64_t> frames_in[ METRIC_FRAME_TYPES ];
+        std::atomic<uint64_t> bytes_in[ METRIC_FRAME_TYPES ];
+        std::atomic<uint64_t> frames_out[ METRIC_FRAME_TYPES ];
+        std::atomic<uint64_t> bytes_out[ METRIC_FRAME_TYPES ];
+        std::atomic<uint64_t> counters[ METRIC_COUNTERS ];
+        std::atomic<uint64_t> histogram_count[ METRIC_HISTOGRAMS ];
+        std::atomic<uint64_t> histogram_sum[ METRIC_HISTOGRAMS ];
+        std::atomic<uint64_t> histogram_max[ METRIC_HISTOGRAMS ];
+        std::atomic<uint64_t> histograms[ METRIC_HISTOGRAMS ][ METRICS_HISTOGRAM_BUCKETS ];
+    } metrics_shard;
+
+// ----------------------------------------------------------------------
+// Local data storage. The shards are in zeroed storage so the pages of
+// those which no thread ever uses are never touched.
+//
+// ----------------------------------------------------------------------
+
+    static metrics_shard                  all_shards[ METRICS_MAX_THREADS ];
+    static std::atomic<int>               shards_handed_out( 0 );
+    static thread_local metrics_shard *   this_thread_shard = (metrics_shard *)NULL;
+
+    static const char * frame_names[ METRIC_FRAME_TYPES ] =
+    {
+        "text", "transfer", "block", "digest", "repair"
+    } ;
+
+    static const char * counter_names[ METRIC_COUNTERS ] =
+    {
+        "transfers_started", "transfers_completed", "transfers_failed", "transfers_timed_out",
+        "transfers_queued", "transfers_refused", "blocks_dropped", "write_retries", "send_retries", "send_errors", "socket_drops"
+    } ;
+
+    static const char * counter_help[ METRIC_COUNTERS ] =
+    {
+        "Inbound files we began to receive", "Inbound files which were verified",
+        "Inbound files which could not be verified", "Inbound files which stopped arriving",
+        "Inbound files which waited for room", "Inbound files there was no room for",
+        "Blocks which failed their CRC check", "File writes which had to be tried again",
+        "Sends put off because the socket was full", "Sends which failed",
+        "Frames Linux dropped, the receive socket was full"
+    } ;
+
+    static const char * histogram_names[ METRIC_HISTOGRAMS ] =
+    {
+        "send_ns", "frame_ns", "block_write_ns", "text_delivery_ns", "transfer_ms", "kernel_to_user_ns"
+    } ;
+
+    // Prometheus wants times in seconds, so the histograms are exposed
+    // under names of their own with how many of their units are in one
+    static const char * histogram_exposed_names[ METRIC_HISTOGRAMS ] =
+    {
+        "chat_send_seconds", "chat_frame_seconds", "chat_block_write_seconds",
+        "chat_text_delivery_seconds", "chat_transfer_seconds", "chat_kernel_to_user_seconds"
+    } ;
+
+    static const char * histogram_help[ METRIC_HISTOGRAMS ] =
+    {
+        "Time to hand a frame to Linux", "Time to handle a received frame",
+        "Time to write a file block to the disk", "Time from text received until it was shown",
+        "Time from an inbound file starting until it was verified",
+        "Time from Linux stamping a frame until it was read"
+    } ;
+
+    static const double histogram_units_per_second[ METRIC_HISTOGRAMS ] =
+    {
+        1e9, 1e9, 1e9, 1e9, 1e3, 1e9
+    } ;
+
+// ----------------------------------------------------------------------
+// Returns: The calling thread's shard, handing it one if it has none
+//
+// ----------------------------------------------------------------------
+
+static inline metrics_shard & my_shard( void )
+{
+    if ( (metrics_shard *)NULL == this_thread_shard )
+    {
+        int this_shard = shards_handed_out.fetch_add( 1, std::memory_order_relaxed );
+
+        if ( this_shard >= METRICS_MAX_THREADS )
+        {
+            this_shard = METRICS_MAX_THREADS - 1;
+        }
+
+        this_thread_shard = &all_shards[ this_shard ];
+    }
+
+    return *this_thread_shard;
+}
+
+// ----------------------------------------------------------------------
+// Returns: The histogram bucket which a value is counted in
+//
+// ----------------------------------------------------------------------
+
+static inline int bucket_of( uint64_t this_value )
+{
+    int exponent = 0;
+
+    if ( this_value >= ( 1ULL << METRICS_MAX_EXPONENT ) )
+    {
+        this_value = ( 1ULL << METRICS_MAX_EXPONENT ) - 1;
+    }
+
+    // Small values are counted exactly
+    if ( this_value < METRICS_SUB_BUCKETS )
+    {
+        return (int)this_value;
+    }
+
+    // Which power of two, then which of its buckets
+    exponent = 63 - __builtin_clzll( this_value );
+
+    return ( exponent - METRICS_SUB_BUCKET_BITS + 1 ) * METRICS_SUB_BUCKETS +
+        (int)( ( this_value >> ( exponent - METRICS_SUB_BUCKET_BITS ) ) & ( METRICS_SUB_BUCKETS - 1 ) );
+}
+
+// ----------------------------------------------------------------------
+// MetricsClass Frame In
+//
+// Counts a frame which was received, and its bytes.
+//
+// ----------------------------------------------------------------------
+
+void MetricsClass::metrics_frame_in( const metric_frame this_type, const uint64_t this_bytes )
+{
+    metrics_shard & shard = my_shard( );
+
+    shard.frames_in[ this_type ].fetch_add( 1, std::memory_order_relaxed );
+    shard.bytes_in[ this_type ].fetch_add( this_bytes, std::memory_order_relaxed );
+}
+
+// ----------------------------------------------------------------------
+// MetricsClass Frame Out
+//
+// Counts a frame which was sent, and its bytes.
+//
+// ----------------------------------------------------------------------
+
+void MetricsClass::metrics_frame_out( const metric_frame this_type, const uint64_t this_bytes )
+{
+    metrics_shard & shard = my_shard( );
+
+    shard.frames_out[ this_type ].fetch_add( 1, std::memory_order_relaxed );
+    shard.bytes_out[ this_type ].fetch_add( this_bytes, std::memory_order_relaxed );
+}
+
+// ----------------------------------------------------------------------
+// MetricsClass Count
+//
+// Counts one more of something, or as many more as are passed by
+// argument.
+//
+// ----------------------------------------------------------------------
+
+void MetricsClass::metrics_count( const metric_counter this_counter, const uint64_t this_amount )
+{
+    my_shard( ).counters[ this_counter ].fetch_add( this_amount, std::memory_order_relaxed );
+}
+
+// ----------------------------------------------------------------------
+// MetricsClass Record
+//
+// Counts a value in to a histogram.
+//
+// ----------------------------------------------------------------------
+
+void MetricsClass::metrics_record( const metric_histogram this_histogram, const uint64_t this_value )
+{
+    metrics_shard & shard      = my_shard( );
+    uint64_t        this_max   = shard.histogram_max[ this_histogram ].load( std::memory_order_relaxed );
+
+    shard.histograms[ this_histogram ][ bucket_of( this_value ) ].fetch_add( 1, std::memory_order_relaxed );
+    shard.histogram_count[ this_histogram ].fetch_add( 1, std::memory_order_relaxed );
+    shard.histogram_sum[ this_histogram ].fetch_add( this_value, std::memory_order_relaxed );
+
+    // Only a new largest value needs to be stored
+    while ( this_value > this_max &&
+        false == shard.histogram_max[ this_histogram ].compare_exchange_weak( this_max, this_value,
+            std::memory_order_relaxed ) )
+    {
+    }
+}
+
+// ----------------------------------------------------------------------
+// MetricsClass Get Snapshot
+//
+// Adds up every shard which has been handed out.
+//
+// ----------------------------------------------------------------------
+
+void MetricsClass::metrics_get_snapshot( metrics_snapshot & this_snapshot )
+{
+    int shard_count = shards_handed_out.load( std::memory_order_relaxed );
+    int this_shard  = 0;
+    int this_item   = 0;
+    int this_bucket = 0;
+
+    (void)memset( (char *)&this_snapshot, 0, sizeof( this_snapshot ) );
+
+    if ( shard_count > METRICS_MAX_THREADS )
+    {
+        shard_count = METRICS_MAX_THREADS;
+    }
+
+    for ( this_shard = 0; this_shard < shard_count; this_shard++ )
+    {
+        const metrics_shard & shard = all_shards[ this_shard ];
+
+        for ( this_item = 0; this_item < METRIC_FRAME_TYPES; this_item++ )
+        {
+            this_snapshot.frames_in[ this_item ]  += shard.frames_in[ this_item ].load( std::memory_order_relaxed );
+            this_snapshot.bytes_in[ this_item ]   += shard.bytes_in[ this_item ].load( std::memory_order_relaxed );
+            this_snapshot.frames_out[ this_item ] += shard.frames_out[ this_item ].load( std::memory_order_relaxed );
+            this_snapshot.bytes_out[ this_item ]  += shard.bytes_out[ this_item ].load( std::memory_order_relaxed );
+        }
+
+        for ( this_item = 0; this_item < METRIC_COUNTERS; this_item++ )
+        {
+            this_snapshot.counters[ this_item ] += shard.counters[ this_item ].load( std::memory_order_relaxed );
+        }
+
+        for ( this_item = 0; this_item < METRIC_HISTOGRAMS; this_item++ )
+        {
+            const uint64_t this_max = shard.histogram_max[ this_item ].load( std::memory_order_relaxed );
+
+            this_snapshot.histogram_count[ this_item ] += shard.histogram_count[ this_item ].load( std::memory_order_relaxed );
+            this_snapshot.histogram_sum[ this_item ]   += shard.histogram_sum[ this_item ].load( std::memory_order_relaxed );
+
+            if ( this_max > this_snapshot.histogram_max[ this_item ] )
+            {
+                this_snapshot.histogram_max[ this_item ] = this_max;
+            }
+
+            for ( this_bucket = 0; this_bucket < METRICS_HISTOGRAM_BUCKETS; this_bucket++ )
+            {
+                this_snapshot.histograms[ this_item ][ this_bucket ] +=
+                    shard.histograms[ this_item ][ this_bucket ].load( std::memory_order_relaxed );
+            }
+        }
+    }
+}
+
+// ----------------------------------------------------------------------
+// MetricsClass Bucket Value
+//
+// Returns: The largest value which is counted in a histogram bucket
+//
+// ----------------------------------------------------------------------
+
+uint64_t MetricsClass::metrics_bucket_value( const int this_bucket )
+{
+    int exponent = 0;
+    int sub      = 0;
+
+    if ( this_bucket < METRICS_SUB_BUCKETS )
+    {
+        return (uint64_t)this_bucket;
+    }
+
+    exponent = this_bucket / METRICS_SUB_BUCKETS + METRICS_SUB_BUCKET_BITS - 1;
+    sub      = this_bucket % METRICS_SUB_BUCKETS;
+
+    return ( (uint64_t)( METRICS_SUB_BUCKETS + sub ) << ( exponent - METRICS_SUB_BUCKET_BITS ) ) +
+        ( 1ULL << ( exponent - METRICS_SUB_BUCKET_BITS ) ) - 1;
+}
+
+// ----------------------------------------------------------------------
+// MetricsClass Percentile
+//
+// Returns: The value which the percent passed by argument of a
+// histogram's values are at or below, to within the bucket it is in
+//
+// ----------------------------------------------------------------------
+
+uint64_t MetricsClass::metrics_percentile( const metrics_snapshot & this_snapshot,
+    const metric_histogram this_histogram, const double this_percent )
+{
+    const uint64_t this_count  = this_snapshot.histogram_count[ this_histogram ];
+    uint64_t       wanted      = 0;
+    uint64_t       seen        = 0;
+    uint64_t       this_value  = 0;
+    int            this_bucket = 0;
+
+    if ( 0 == this_count )
+    {
+        return 0;
+    }
+
+    wanted = (uint64_t)( this_count * this_percent / 100.0 + 0.999999 );
+
+    if ( wanted < 1 )
+    {
+        wanted = 1;
+    }
+
+    for ( this_bucket = 0; this_bucket < METRICS_HISTOGRAM_BUCKETS; this_bucket++ )
+    {
+        seen += this_snapshot.histograms[ this_histogram ][ this_bucket ];
+
+        if ( seen >= wanted )
+        {
+            break;
+        }
+    }
+
+    this_value = metrics_bucket_value( this_bucket < METRICS_HISTOGRAM_BUCKETS ?
+        this_bucket : METRICS_HISTOGRAM_BUCKETS - 1 );
+
+    // No value was larger than the largest one seen
+    if ( this_value > this_snapshot.histogram_max[ this_histogram ] )
+    {
+        this_value = this_snapshot.histogram_max[ this_histogram ];
+    }
+
+    return this_value;
+}
+
+// ----------------------------------------------------------------------
+// The names of what is counted, for showing them
+//
+// ----------------------------------------------------------------------
+
+const char * MetricsClass::metrics_frame_name( const metric_frame this_type )
+{
+    return frame_names[ this_type ];
+}
+
+const char * MetricsClass::metrics_counter_name( const metric_counter this_counter )
+{
+    return counter_names[ this_counter ];
+}
+
+const char * MetricsClass::metrics_histogram_name( const metric_histogram this_histogram )
+{
+    return histogram_names[ this_histogram ];
+}
+
+// ----------------------------------------------------------------------
+// MetricsClass Format Prometheus
+//
+// The snapshot passed by argument is written out in the Prometheus text
+// exposition format. The frames are counted under one name with their
+// kind as a label. Every histogram is given the same bucket bounds, one
+// less than each power of two, the largest value counted below it, so
+// that the histograms of many nodes may be added together; that is
+// coarser than the histogram itself, whose median and tail are given as
+// well, along with the longest time seen.
+//
+// ----------------------------------------------------------------------
+
+void MetricsClass::metrics_format_prometheus( const metrics_snapshot & this_snapshot, std::string & this_text )
+{
+    char       this_line[ 256 ];
+    int        this_item   = 0;
+    int        this_bucket = 0;
+    int        exponent    = 0;
+    const char *this_name  = (const char *)NULL;
+
+    static const struct
+    {
+        const char * name_p;
+        const char * help_p;
+        size_t       offset;
+    } frame_series[ ] =
+    {
+        { "chat_frames_received_total", "Frames received",         offsetof( metrics_snapshot, frames_in ) },
+        { "chat_bytes_received_total",  "Bytes of frames received", offsetof( metrics_snapshot, bytes_in ) },
+        { "chat_frames_sent_total",     "Frames sent",             offsetof( metrics_snapshot, frames_out ) },
+        { "chat_bytes_sent_total",      "Bytes of frames sent",    offsetof( metrics_snapshot, bytes_out ) }
+    } ;
+
+    this_text.clear( );
+
+    for ( this_item = 0; this_item < (int)( sizeof( frame_series ) / sizeof( frame_series[ 0 ] ) ); this_item++ )
+    {
+        const uint64_t * these_counts = (const uint64_t *)( (const char *)&this_snapshot + frame_series[ this_item ].offset );
+
+        (void)snprintf( this_line, sizeof( this_line ), "# HELP %s %s\n# TYPE %s counter\n",
+            frame_series[ this_item ].name_p, frame_series[ this_item ].help_p, frame_series[ this_item ].name_p );
+
+        this_text += this_line;
+
+        for ( this_bucket = 0; this_bucket < METRIC_FRAME_TYPES; this_bucket++ )
+        {
+            (void)snprintf( this_line, sizeof( this_line ), "%s{type=\"%s\"} %llu\n",
+                frame_series[ this_item ].name_p, frame_names[ this_bucket ],
+                (unsigned long long)these_counts[ this_bucket ] );
+
+            this_text += this_line;
+        }
+    }
+
+    for ( this_item = 0; this_item < METRIC_COUNTERS; this_item++ )
+    {
+        this_name = counter_names[ this_item ];
+
+        (void)snprintf( this_line, sizeof( this_line ),
+            "# HELP chat_%s_total %s\n# TYPE chat_%s_total counter\nchat_%s_total %llu\n",
+            this_name, counter_help[ this_item ], this_name, this_name,
+            (unsigned long long)this_snapshot.counters[ this_item ] );
+
+        this_text += this_line;
+    }
+
+    for ( this_item = 0; this_item < METRIC_HISTOGRAMS; this_item++ )
+    {
+        const double   units  = histogram_units_per_second[ this_item ];
+        const uint64_t *these = this_snapshot.histograms[ this_item ];
+        uint64_t       below  = 0;
+
+        this_name   = histogram_exposed_names[ this_item ];
+        this_bucket = 0;
+
+        (void)snprintf( this_line, sizeof( this_line ), "# HELP %s %s\n# TYPE %s histogram\n",
+            this_name, histogram_help[ this_item ], this_name );
+
+        this_text += this_line;
+
+        // The values below every power of two. A bucket never straddles
+        // a power of two so the count below one is exact, and is given
+        // as the count at or below the largest value of the last bucket
+        // counted, as Prometheus bounds include their value.
+        for ( exponent = 0; exponent <= METRICS_MAX_EXPONENT; exponent++ )
+        {
+            while ( this_bucket < METRICS_HISTOGRAM_BUCKETS &&
+                metrics_bucket_value( this_bucket ) < ( 1ULL << exponent ) )
+            {
+                below += these[ this_bucket ];
+
+                this_bucket++;
+            }
+
+            (void)snprintf( this_line, sizeof( this_line ), "%s_bucket{le=\"%.9g\"} %llu\n",
+                this_name, (double)metrics_bucket_value( this_bucket - 1 ) / units, (unsigned long long)below );
+
+            this_text += this_line;
+        }
+
+        (void)snprintf( this_line, sizeof( this_line ),
+            "%s_bucket{le=\"+Inf\"} %llu\n%s_sum %.9g\n%s_count %llu\n",
+            this_name, (unsigned long long)this_snapshot.histogram_count[ this_item ],
+            this_name, (double)this_snapshot.histogram_sum[ this_item ] / units,
+            this_name, (unsigned long long)this_snapshot.histogram_count[ this_item ] );
+
+        this_text += this_line;
+
+        (void)snprintf( this_line, sizeof( this_line ),
+            "# TYPE %s_quantile gauge\n"
+            "%s_quantile{quantile=\"0.5\"} %.9g\n"
+            "%s_quantile{quantile=\"0.99\"} %.9g\n"
+            "%s_quantile{quantile=\"0.999\"} %.9g\n",
+            this_name,
+            this_name, (double)metrics_percentile( this_snapshot, (metric_histogram)this_item, 50.0 ) / units,
+            this_name, (double)metrics_percentile( this_snapshot, (metric_histogram)this_item, 99.0 ) / units,
+            this_name, (double)metrics_percentile( this_snapshot, (metric_histogram)this_item, 99.9 ) / units );
+
+        this_text += this_line;
+
+        (void)snprintf( this_line, sizeof( this_line ), "# TYPE %s_max gauge\n%s_max %.9g\n",
+            this_name, this_name, (double)this_snapshot.histogram_max[ this_item ] / units );
+
+        this_text += this_line;
+    }
+}
@@ -0,0 +1,140 @@
+
+// ----------------------------------------------------------------------
+// MetricsClass -- Small class which counts what the chat program does
+// and keeps histograms of how long it takes to do it.
+//
+// See main.c for disclaimers and other information.
+//
+// Fredric L. Rice, June 2018
+// http://www.crystallake.name
+// fred @ crystal lake . name
+//
+// ----------------------------------------------------------------------
+
+#ifndef _METRICSCLASS_H_
+#define _METRICSCLASS_H_   1
+
+#include <stdint.h>
+#include <string>
+
+// ----------------------------------------------------------------------
+// Every thread which counts something gets a shard of the counters of
+// its own, so that threads never write to the same memory. A snapshot
+// adds up every shard. Threads beyond the maximum share the last shard.
+//
+// ----------------------------------------------------------------------
+
+#define METRICS_MAX_THREADS         16
+
+// ----------------------------------------------------------------------
+// The histograms are log-linear in the way of an HDR histogram: every
+// power of two is split in to 16 buckets, so any value is known to
+// within about 6%. Values up to 2 to the 40th are kept, which is some
+// 18 minutes in nanoseconds; larger values land in the last bucket.
+//
+// ----------------------------------------------------------------------
+
+#define METRICS_SUB_BUCKET_BITS     4
+#define METRICS_SUB_BUCKETS         ( 1 << METRICS_SUB_BUCKET_BITS )
+#define METRICS_MAX_EXPONENT        40
+#define METRICS_HISTOGRAM_BUCKETS   ( ( METRICS_MAX_EXPONENT - METRICS_SUB_BUCKET_BITS + 1 ) * METRICS_SUB_BUCKETS )
+
+// ----------------------------------------------------------------------
+// The kinds of frames which are counted going in and out
+//
+// ----------------------------------------------------------------------
+
+    typedef enum METRIC_FRAME_T
+    {
+        metric_frame_text,                            // Chat text
+        metric_frame_transfer,                        // :xfer: file announcements and requests, :busy: refusals
+        metric_frame_block,                           // :blok: file data
+        metric_frame_digest,                          // :dgst: file digests
+        metric_frame_repair,                          // :rpar: repair requests
+        METRIC_FRAME_TYPES
+    } metric_frame;
+
+// ----------------------------------------------------------------------
+// The things which are counted
+//
+// ----------------------------------------------------------------------
+
+    typedef enum METRIC_COUNTER_T
+    {
+        metric_transfers_started,                     // Inbound files we began to receive
+        metric_transfers_completed,                   // Inbound files which were verified
+        metric_transfers_failed,                      // Inbound files which could not be verified
+        metric_transfers_timed_out,                   // Inbound files which stopped arriving
+        metric_transfers_queued,                      // Inbound files which waited for room
+        metric_transfers_refused,                     // Inbound files there was no room for
+        metric_blocks_dropped,                        // Blocks which failed their CRC check
+        metric_write_retries,                         // File writes which had to be tried again
+        metric_send_retries,                          // Sends put off because the socket was full
+        metric_send_errors,                           // Sends which failed
+        metric_socket_drops,                          // Frames Linux dropped, the receive socket was full
+        METRIC_COUNTERS
+    } metric_counter;
+
+// ----------------------------------------------------------------------
+// The things which are timed
+//
+// ----------------------------------------------------------------------
+
+    typedef enum METRIC_HISTOGRAM_T
+    {
+        metric_send_ns,                               // A frame handed to Linux
+        metric_frame_ns,                              // A received frame handled
+        metric_block_write_ns,                        // A file block written to the disk
+        metric_text_delivery_ns,                      // Text received until it was shown
+        metric_transfer_ms,                           // An inbound file from start to verified
+        metric_kernel_to_user_ns,                     // A frame from Linux stamping it to our reading it
+        METRIC_HISTOGRAMS
+    } metric_histogram;
+
+// ----------------------------------------------------------------------
+// A snapshot of every shard added together
+//
+// ----------------------------------------------------------------------
+
+    typedef struct METRICS_SNAPSHOT_T
+    {
+        uint64_t frames_in[ METRIC_FRAME_TYPES ];
+        uint64_t bytes_in[ METRIC_FRAME_TYPES ];
+        uint64_t frames_out[ METRIC_FRAME_TYPES ];
+        uint64_t bytes_out[ METRIC_FRAME_TYPES ];
+        uint64_t counters[ METRIC_COUNTERS ];
+        uint64_t histogram_count[ METRIC_HISTOGRAMS ];
+        uint64_t histogram_sum[ METRIC_HISTOGRAMS ];
+        uint64_t histogram_max[ METRIC_HISTOGRAMS ];
+        uint64_t histograms[ METRIC_HISTOGRAMS ][ METRICS_HISTOGRAM_BUCKETS ];
+    } metrics_snapshot;
+
+// ----------------------------------------------------------------------
+// Our class is defined here. There is only one set of metrics so
+// everything in it is static and it is never instantiated.
+//
+// ----------------------------------------------------------------------
+
+class MetricsClass
+{
+    public:
+        static void metrics_frame_in( const metric_frame this_type, const uint64_t this_bytes );
+        static void metrics_frame_out( const metric_frame this_type, const uint64_t this_bytes );
+        static void metrics_count( const metric_counter this_counter, const uint64_t this_amount = 1 );
+        static void metrics_record( const metric_histogram this_histogram, const uint64_t this_value );
+
+        static void metrics_get_snapshot( metrics_snapshot & this_snapshot );
+        static uint64_t metrics_percentile( const metrics_snapshot & this_snapshot,
+                        const metric_histogram this_histogram, const double this_percent );
+        static uint64_t metrics_bucket_value( const int this_bucket );
+        static void metrics_format_prometheus( const metrics_snapshot & this_snapshot, std::string & this_text );
+
+        static const char * metrics_frame_name( const metric_frame this_type );
+        static const char * metrics_counter_name( const metric_counter this_counter );
+        static const char * metrics_histogram_name( const metric_histogram this_histogram );
+
+    private:
+        MetricsClass( void );
+} ;
+
+#endif
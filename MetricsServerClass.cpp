@@ -0,0 +1,423 @@
+
+// ----------------------------------------------------------------------
+// MetricsServerClass -- Small class which serves the metrics to anyone
+// on this machine who asks for them, for collectors to scrape.
+//
+// The metrics are served in the Prometheus text exposition format on a
+// Unix domain socket, on a TCP port which only listens on the loopback
+// address, or both. A collector on the machine connects to the Unix
+// domain socket and reads until it is closed; there is nothing to send.
+// The TCP port speaks just enough HTTP for Prometheus itself: whatever
+// the request, the metrics are the reply.
+//
+// Nothing here ever waits. The main loop calls metrics_server_service()
+// every time around and it accepts, reads and writes only what may be
+// done right away, so a slow or stuck collector never holds up chat
+// frames. The metrics are a snapshot taken when the scrape is accepted.
+//
+// See main.c for disclaimers and other information.
+//
+// Fredric L. Rice, June 2018
+// http://www.crystallake.name
+// fred @ crystal lake . name
+//
+// ----------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "MetricsServerClass.h" // Our own class and defined constants
+#include "MetricsClass.h"       // The metrics being served
+#include "ClockClass.h"         // The cached clocks
+
+// ----------------------------------------------------------------------
+// MetricsServerClass Constructor
+//
+// Nothing is served until a socket is opened.
+//
+// ----------------------------------------------------------------------
+
+MetricsServerClass::MetricsServerClass( void )
+{
+    unix_socket = METRICS_SOCKET_NOT_VALID;
+    tcp_socket  = METRICS_SOCKET_NOT_VALID;
+}
+
+// ----------------------------------------------------------------------
+// MetricsServerClass Destructor
+//
+// ----------------------------------------------------------------------
+
+MetricsServerClass::~MetricsServerClass( void )
+{
+    metrics_server_close( );
+}
+
+// ----------------------------------------------------------------------
+// MetricsServerClass Open Unix
+//
+// Listens on a Unix domain socket at the path passed by argument. A
+// socket left there by a copy of the program which is gone is removed,
+// but one which another copy is still serving is left alone.
+//
+// Returns: true if the socket is listening
+//
+// ----------------------------------------------------------------------
+
+bool MetricsServerClass::metrics_server_open_unix( const char * path_and_name_p )
+{
+    struct sockaddr_un this_address;
+    struct stat        this_stat;
+    int                probe_socket = METRICS_SOCKET_NOT_VALID;
+
+    if ( strlen( path_and_name_p ) >= sizeof( this_address.sun_path ) )
+    {
+        (void)printf( "NOTE: The metrics socket name %s is too long\n", path_and_name_p );
+
+        return false;
+    }
+
+    (void)memset( (char *)&this_address, 0, sizeof( this_address ) );
+
+    this_address.sun_family = AF_UNIX;
+
+    (void)strcpy( this_address.sun_path, path_and_name_p );
+
+    // Is something already there?
+    if ( 0 == lstat( path_and_name_p, &this_stat ) )
+    {
+        if ( false == S_ISSOCK( this_stat.st_mode ) )
+        {
+            (void)printf( "NOTE: %s is not a socket, metrics are not served on it\n", path_and_name_p );
+
+            return false;
+        }
+
+        if ( ( probe_socket = socket( AF_UNIX, SOCK_STREAM, 0 ) ) >= 0 )
+        {
+            const bool in_use = 0 == connect( probe_socket, (struct sockaddr *)&this_address, sizeof( this_address ) );
+
+            (void)close( probe_socket );
+
+            if ( true == in_use )
+            {
+                (void)printf( "NOTE: Metrics are already being served on %s\n", path_and_name_p );
+
+                return false;
+            }
+        }
+
+        (void)unlink( path_and_name_p );
+    }
+
+    if ( ( unix_socket = socket( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 ) ) < 0 )
+    {
+        unix_socket = METRICS_SOCKET_NOT_VALID;
+
+        return false;
+    }
+
+    if ( bind( unix_socket, (struct sockaddr *)&this_address, sizeof( this_address ) ) < 0 ||
+        listen( unix_socket, METRICS_LISTEN_BACKLOG ) < 0 )
+    {
+        (void)printf( "NOTE: Unable to serve metrics on %s: %s\n", path_and_name_p, strerror( errno ) );
+
+        (void)close( unix_socket );
+
+        unix_socket = METRICS_SOCKET_NOT_VALID;
+
+        return false;
+    }
+
+    unix_path = path_and_name_p;
+
+    return true;
+}
+
+// ----------------------------------------------------------------------
+// MetricsServerClass Open TCP
+//
+// Listens on the TCP port passed by argument on the loopback address
+// only, so that nothing off of this machine may scrape us.
+//
+// Returns: true if the socket is listening
+//
+// ----------------------------------------------------------------------
+
+bool MetricsServerClass::metrics_server_open_tcp( const int this_port_number )
+{
+    struct sockaddr_in this_address;
+    const int          enable_reuse = 1;
+
+    if ( ( tcp_socket = socket( AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 ) ) < 0 )
+    {
+        tcp_socket = METRICS_SOCKET_NOT_VALID;
+
+        return false;
+    }
+
+    (void)setsockopt( tcp_socket, SOL_SOCKET, SO_REUSEADDR, &enable_reuse, sizeof( enable_reuse ) );
+
+    (void)memset( (char *)&this_address, 0, sizeof( this_address ) );
+
+    this_address.sin_family      = AF_INET;
+    this_address.sin_port        = htons( this_port_number );
+    this_address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+
+    if ( bind( tcp_socket, (struct sockaddr *)&this_address, sizeof( this_address ) ) < 0 ||
+        listen( tcp_socket, METRICS_LISTEN_BACKLOG ) < 0 )
+    {
+        (void)printf( "NOTE: Unable to serve metrics on port %d: %s\n", this_port_number, strerror( errno ) );
+
+        (void)close( tcp_socket );
+
+        tcp_socket = METRICS_SOCKET_NOT_VALID;
+
+        return false;
+    }
+
+    return true;
+}
+
+// ----------------------------------------------------------------------
+// MetricsServerClass Service
+//
+// Accepts the scrapes which are waiting, reads what there is of their
+// requests and writes what may be written of the replies. Scrapes which
+// are done, which failed or which took too long are closed.
+//
+// ----------------------------------------------------------------------
+
+void MetricsServerClass::metrics_server_service( void )
+{
+    const time_t current_time = ClockClass::clock_seconds( );
+    size_t       this_client  = 0;
+
+    accept_clients( unix_socket, false );
+    accept_clients( tcp_socket, true );
+
+    while ( this_client < clients.size( ) )
+    {
+        metrics_client & client    = clients[ this_client ];
+        bool             keep_open = true;
+
+        if ( true == client.want_request )
+        {
+            keep_open = read_request( client );
+
+            if ( true == keep_open && false == client.want_request )
+            {
+                build_response( client, true );
+            }
+        }
+
+        if ( true == keep_open && false == client.want_request )
+        {
+            keep_open = write_response( client );
+        }
+
+        if ( true == keep_open && current_time >= client.accepted_time + METRICS_CLIENT_TIMEOUT )
+        {
+            keep_open = false;
+        }
+
+        if ( false == keep_open )
+        {
+            (void)close( client.client_socket );
+
+            clients.erase( clients.begin( ) + this_client );
+        }
+        else
+        {
+            this_client++;
+        }
+    }
+}
+
+// ----------------------------------------------------------------------
+// MetricsServerClass Close
+//
+// Stops serving, dropping any scrapes in progress.
+//
+// ----------------------------------------------------------------------
+
+void MetricsServerClass::metrics_server_close( void )
+{
+    size_t this_client = 0;
+
+    for ( this_client = 0; this_client < clients.size( ); this_client++ )
+    {
+        (void)close( clients[ this_client ].client_socket );
+    }
+
+    clients.clear( );
+
+    if ( METRICS_SOCKET_NOT_VALID != unix_socket )
+    {
+        (void)close( unix_socket );
+        (void)unlink( unix_path.c_str( ) );
+
+        unix_socket = METRICS_SOCKET_NOT_VALID;
+    }
+
+    if ( METRICS_SOCKET_NOT_VALID != tcp_socket )
+    {
+        (void)close( tcp_socket );
+
+        tcp_socket = METRICS_SOCKET_NOT_VALID;
+    }
+}
+
+// ----------------------------------------------------------------------
+// MetricsServerClass Accept Clients
+//
+// Accepts the connections waiting on a listening socket, as many as
+// there is room for. A scrape of the Unix domain socket has its reply
+// made ready at once since it sends no request.
+//
+// ----------------------------------------------------------------------
+
+void MetricsServerClass::accept_clients( const int this_socket, const bool is_http )
+{
+    int client_socket = METRICS_SOCKET_NOT_VALID;
+
+    if ( METRICS_SOCKET_NOT_VALID == this_socket )
+    {
+        return;
+    }
+
+    while ( clients.size( ) < METRICS_MAX_CLIENTS &&
+        ( client_socket = accept4( this_socket, (struct sockaddr *)NULL, (socklen_t *)NULL,
+            SOCK_NONBLOCK | SOCK_CLOEXEC ) ) >= 0 )
+    {
+        metrics_client this_client;
+
+        this_client.client_socket = client_socket;
+        this_client.want_request  = is_http;
+        this_client.response_sent = 0;
+        this_client.accepted_time = ClockClass::clock_seconds( );
+
+        clients.push_back( this_client );
+
+        if ( false == is_http )
+        {
+            build_response( clients.back( ), false );
+        }
+    }
+}
+
+// ----------------------------------------------------------------------
+// MetricsServerClass Read Request
+//
+// Reads what has arrived of an HTTP request. The request is whole once
+// the empty line which ends its headers is in; what it asks for does
+// not matter.
+//
+// Returns: false if the connection should be closed
+//
+// ----------------------------------------------------------------------
+
+bool MetricsServerClass::read_request( metrics_client & this_client )
+{
+    char this_data[ 1024 ];
+    int  read_count = 0;
+
+    while ( ( read_count = recv( this_client.client_socket, this_data, sizeof( this_data ), 0 ) ) > 0 )
+    {
+        this_client.request.append( this_data, read_count );
+
+        if ( std::string::npos != this_client.request.find( "\r\n\r\n" ) ||
+            std::string::npos != this_client.request.find( "\n\n" ) )
+        {
+            this_client.want_request = false;
+
+            return true;
+        }
+
+        if ( this_client.request.size( ) > METRICS_MAX_REQUEST_SIZE )
+        {
+            return false;
+        }
+    }
+
+    // Closed before the request was whole, or it failed
+    if ( 0 == read_count || ( EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno ) )
+    {
+        return false;
+    }
+
+    return true;
+}
+
+// ----------------------------------------------------------------------
+// MetricsServerClass Write Response
+//
+// Writes what the socket has room for of the reply.
+//
+// Returns: false once the reply is all written, or the connection
+// failed, either way it should be closed
+//
+// ----------------------------------------------------------------------
+
+bool MetricsServerClass::write_response( metrics_client & this_client )
+{
+    ssize_t sent_count = 0;
+
+    while ( this_client.response_sent < this_client.response.size( ) )
+    {
+        sent_count = send( this_client.client_socket, this_client.response.data( ) + this_client.response_sent,
+            this_client.response.size( ) - this_client.response_sent, MSG_NOSIGNAL );
+
+        if ( sent_count < 0 )
+        {
+            return EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno;
+        }
+
+        this_client.response_sent += sent_count;
+    }
+
+    (void)shutdown( this_client.client_socket, SHUT_WR );
+
+    return false;
+}
+
+// ----------------------------------------------------------------------
+// MetricsServerClass Build Response
+//
+// Takes a snapshot of the metrics and makes the reply from it, with an
+// HTTP header in front if the scrape came over HTTP.
+//
+// ----------------------------------------------------------------------
+
+void MetricsServerClass::build_response( metrics_client & this_client, const bool is_http )
+{
+    static metrics_snapshot this_snapshot;
+    std::string             this_text;
+    char                    this_header[ 256 ];
+
+    MetricsClass::metrics_get_snapshot( this_snapshot );
+    MetricsClass::metrics_format_prometheus( this_snapshot, this_text );
+
+    this_client.response.clear( );
+
+    if ( true == is_http )
+    {
+        (void)snprintf( this_header, sizeof( this_header ),
+            "HTTP/1.0 200 OK\r\n"
+            "Content-Type: text/plain; version=0.0.4\r\n"
+            "Content-Length: %u\r\n"
+            "Connection: close\r\n\r\n", (unsigned int)this_text.size( ) );
+
+        this_client.response = this_header;
+    }
+
+    this_client.response += this_text;
+}
@@ -0,0 +1,84 @@
+
+// ----------------------------------------------------------------------
+// MetricsServerClass -- Small class which serves the metrics to anyone
+// on this machine who asks for them, for collectors to scrape.
+//
+// See main.c for disclaimers and other information.
+//
+// Fredric L. Rice, June 2018
+// http://www.crystallake.name
+// fred @ crystal lake . name
+//
+// ----------------------------------------------------------------------
+
+#ifndef _METRICSSERVERCLASS_H_
+#define _METRICSSERVERCLASS_H_   1
+
+#include <stdint.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+// ----------------------------------------------------------------------
+// No more than so many scrapes are served at once; others wait for the
+// listening socket to accept them. A scrape which has not finished in
+// so many seconds is dropped. An HTTP request longer than the maximum
+// is not a scrape.
+//
+// ----------------------------------------------------------------------
+
+#define METRICS_MAX_CLIENTS         16
+#define METRICS_CLIENT_TIMEOUT      5
+#define METRICS_MAX_REQUEST_SIZE    4096
+#define METRICS_LISTEN_BACKLOG      64
+#define METRICS_SOCKET_NOT_VALID    (int)-1
+
+// ----------------------------------------------------------------------
+// A scrape in progress. Over TCP the request is read first; over the
+// Unix domain socket there is no request, the metrics are written as
+// soon as the connection is accepted.
+//
+// ----------------------------------------------------------------------
+
+    typedef struct METRICS_CLIENT_T
+    {
+        int         client_socket;                    // The accepted connection
+        bool        want_request;                     // true until the HTTP request is in
+        std::string request;                          // What was read of the request
+        std::string response;                         // What is being written
+        size_t      response_sent;                    // How much of it was written
+        time_t      accepted_time;                    // Monotonic second it was accepted
+    } metrics_client;
+
+// ----------------------------------------------------------------------
+// Our class is defined here.
+//
+// ----------------------------------------------------------------------
+
+class MetricsServerClass
+{
+    public:
+        MetricsServerClass( void );
+        ~MetricsServerClass( void );
+
+        bool metrics_server_open_unix( const char * path_and_name_p );
+        bool metrics_server_open_tcp( const int this_port_number );
+        void metrics_server_service( void );
+        void metrics_server_close( void );
+
+    private:
+        MetricsServerClass( const MetricsServerClass & );
+        MetricsServerClass & operator=( const MetricsServerClass & );
+
+        void accept_clients( const int this_socket, const bool is_http );
+        bool read_request( metrics_client & this_client );
+        bool write_response( metrics_client & this_client );
+        void build_response( metrics_client & this_client, const bool is_http );
+
+        int                         unix_socket;
+        int                         tcp_socket;
+        std::string                 unix_path;
+        std::vector<metrics_client> clients;
+} ;
+
+#endif
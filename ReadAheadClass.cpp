@@ -0,0 +1,375 @@
+
+// ----------------------------------------------------------------------
+// ReadAheadClass -- Small class which reads a file ahead of the code
+// which consumes it.
+//
+// Once the file has been opened with read_ahead_open() a reader thread
+// reads the file in large sequential pieces in to a ring of buffers.
+// The consumer calls read_ahead_next() to get the oldest filled buffer,
+// transmits it, and then hands the buffer back with read_ahead_release()
+// so that the reader may fill it again.
+//
+// The kernel is told that the file is going to be read sequentially so
+// that its own read-ahead is made as aggressive as it can be.
+//
+// See main.c for disclaimers and other information.
+//
+// Fredric L. Rice, June 2018
+// http://www.crystallake.name
+// fred @ crystal lake . name
+//
+// ----------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "ReadAheadClass.h"     // Our own class and defined constants
+#include "TraceClass.h"         // Tracing the reads
+
+// ----------------------------------------------------------------------
+// ReadAheadClass Constructor
+//
+// The ring buffers are allocated aligned to a page boundary and the
+// file handle is set to indicate that no file is open.
+//
+// ----------------------------------------------------------------------
+
+ReadAheadClass::ReadAheadClass( void ) : in_file_handle( READ_AHEAD_NO_HANDLE ),
+    fill_index( 0 ), drain_index( 0 ), end_of_file( false ), read_error( 0 ), stop_reader( false )
+{
+    int this_index = 0;
+
+    for ( this_index = 0; this_index < READ_AHEAD_BUFFER_COUNT; this_index++ )
+    {
+        void * aligned_p = NULL;
+
+        // Aligned buffers are needed should direct I/O be used
+        if ( 0 != posix_memalign( &aligned_p, READ_AHEAD_ALIGNMENT, READ_AHEAD_BUFFER_SIZE ) )
+        {
+            aligned_p = NULL;
+        }
+
+        buffer_p[ this_index ]     = (char *)aligned_p;
+        buffer_count[ this_index ] = 0;
+    }
+}
+
+// ----------------------------------------------------------------------
+// ReadAheadClass Destructor
+//
+// The reader thread is stopped, the file is closed, and the ring
+// buffers are released.
+//
+// ----------------------------------------------------------------------
+
+ReadAheadClass::~ReadAheadClass( void )
+{
+    int this_index = 0;
+
+    read_ahead_close( );
+
+    for ( this_index = 0; this_index < READ_AHEAD_BUFFER_COUNT; this_index++ )
+    {
+        free( buffer_p[ this_index ] );
+
+        buffer_p[ this_index ] = (char *)NULL;
+    }
+}
+
+// ----------------------------------------------------------------------
+// ReadAheadClass Read Ahead Open
+//
+// The file passed to the method by argument is opened for reading from
+// the offset offered, the kernel is advised that the file will be read
+// sequentially, and the reader thread is started so that the first buffers are being filled
+// by the time the caller asks for them.
+//
+// Returns: true if the file was opened and the reader is running
+//
+// ----------------------------------------------------------------------
+
+bool ReadAheadClass::read_ahead_open( const char * path_and_name_p, const off_t start_offset )
+{
+    int this_index = 0;
+
+    // Make sure that we are not already reading a file
+    read_ahead_close( );
+
+    // Make sure that all of the ring buffers were allocated
+    for ( this_index = 0; this_index < READ_AHEAD_BUFFER_COUNT; this_index++ )
+    {
+        if ( (char *)NULL == buffer_p[ this_index ] )
+        {
+            return false;
+        }
+    }
+
+#if READ_AHEAD_USE_O_DIRECT
+    // Direct I/O is not supported by every file system so if the
+    // open fails we fall back to a normal open
+    in_file_handle = open( path_and_name_p, O_RDONLY | O_DIRECT );
+
+    if ( READ_AHEAD_NO_HANDLE == in_file_handle )
+#endif
+    {
+        in_file_handle = open( path_and_name_p, O_RDONLY );
+    }
+
+    if ( READ_AHEAD_NO_HANDLE == in_file_handle )
+    {
+        return false;
+    }
+
+    // Start reading where we were asked to
+    if ( start_offset > 0 && lseek( in_file_handle, start_offset, SEEK_SET ) != start_offset )
+    {
+        (void)close( in_file_handle );
+
+        in_file_handle = READ_AHEAD_NO_HANDLE;
+
+        return false;
+    }
+
+    // Let Linux know that we are going to read the file from there to the end
+    (void)posix_fadvise( in_file_handle, start_offset, 0, POSIX_FADV_SEQUENTIAL );
+
+    // Start out with an empty ring
+    fill_index  = 0;
+    drain_index = 0;
+    end_of_file = false;
+    read_error  = 0;
+    stop_reader = false;
+
+    // Start reading ahead
+    reader = std::thread( &ReadAheadClass::reader_thread, this );
+
+    return true;
+}
+
+// ----------------------------------------------------------------------
+// ReadAheadClass Read Ahead Ready
+//
+// Lets a caller which must not wait on the disk find out whether
+// read_ahead_next() would return right away.
+//
+// Returns: true if a filled buffer is waiting, or if the reader has
+// reached the end of the file or no file is open
+//
+// ----------------------------------------------------------------------
+
+bool ReadAheadClass::read_ahead_ready( void )
+{
+    std::lock_guard<std::mutex> ring_guard( ring_lock );
+
+    return READ_AHEAD_NO_HANDLE == in_file_handle || fill_index != drain_index || true == end_of_file;
+}
+
+// ----------------------------------------------------------------------
+// ReadAheadClass Read Ahead Next
+//
+// Waits for the oldest buffer in the ring to be filled by the reader
+// thread and offers a pointer to it through the argument. The buffer
+// remains owned by the caller until read_ahead_release() is called.
+//
+// Returns: The number of bytes in the buffer, else 0 at the end of the
+// file, or -1 if the file could not be read any further, the reason
+// for which read_ahead_error() offers.
+//
+// ----------------------------------------------------------------------
+
+int ReadAheadClass::read_ahead_next( const char ** data_pp )
+{
+    std::unique_lock<std::mutex> ring_guard( ring_lock );
+
+    // Make sure that there is a file being read
+    if ( READ_AHEAD_NO_HANDLE == in_file_handle )
+    {
+        return 0;
+    }
+
+    // Wait for the reader to get ahead of us
+    while ( fill_index == drain_index && false == end_of_file )
+    {
+        ring_filled.wait( ring_guard );
+    }
+
+    // Did the reader reach the end of the file, or fail to read it,
+    // before filling another?
+    if ( fill_index == drain_index )
+    {
+        return 0 == read_error ? 0 : -1;
+    }
+
+    *data_pp = buffer_p[ drain_index % READ_AHEAD_BUFFER_COUNT ];
+
+    return buffer_count[ drain_index % READ_AHEAD_BUFFER_COUNT ];
+}
+
+// ----------------------------------------------------------------------
+// ReadAheadClass Read Ahead Error
+//
+// Returns: The errno of the read which failed, else 0 if every read of
+// the file has worked
+//
+// ----------------------------------------------------------------------
+
+int ReadAheadClass::read_ahead_error( void )
+{
+    std::lock_guard<std::mutex> ring_guard( ring_lock );
+
+    return read_error;
+}
+
+// ----------------------------------------------------------------------
+// ReadAheadClass Read Ahead Release
+//
+// The buffer last offered by read_ahead_next() is given back to the
+// reader thread so that it may be filled again.
+//
+// ----------------------------------------------------------------------
+
+void ReadAheadClass::read_ahead_release( void )
+{
+    std::lock_guard<std::mutex> ring_guard( ring_lock );
+
+    if ( drain_index != fill_index )
+    {
+        drain_index++;
+
+        ring_drained.notify_one( );
+    }
+}
+
+// ----------------------------------------------------------------------
+// ReadAheadClass Read Ahead Close
+//
+// The reader thread is asked to stop and is waited upon, after which
+// the file gets closed.
+//
+// ----------------------------------------------------------------------
+
+void ReadAheadClass::read_ahead_close( void )
+{
+    // Ask the reader to stop
+    {
+        std::lock_guard<std::mutex> ring_guard( ring_lock );
+
+        stop_reader = true;
+
+        ring_drained.notify_one( );
+    }
+
+    if ( reader.joinable( ) )
+    {
+        reader.join( );
+    }
+
+    if ( READ_AHEAD_NO_HANDLE != in_file_handle )
+    {
+        (void)close( in_file_handle );
+
+        in_file_handle = READ_AHEAD_NO_HANDLE;
+    }
+}
+
+// ----------------------------------------------------------------------
+// ReadAheadClass Reader Thread
+//
+// Fills empty buffers in the ring one after another until the end of
+// the file is reached, an error occurs, or we are asked to stop. The
+// lock is not held while the disk is being read so that the consumer
+// may drain filled buffers at the same time.
+//
+// ----------------------------------------------------------------------
+
+void ReadAheadClass::reader_thread( void )
+{
+    while ( true )
+    {
+        char *   this_buffer_p = (char *)NULL;
+        int      read_count    = 0;
+        int      read_errno    = 0;
+        uint64_t read_start    = 0;
+
+        // Wait for an empty buffer in the ring
+        {
+            std::unique_lock<std::mutex> ring_guard( ring_lock );
+
+            while ( fill_index - drain_index >= READ_AHEAD_BUFFER_COUNT && false == stop_reader )
+            {
+                ring_drained.wait( ring_guard );
+            }
+
+            if ( true == stop_reader )
+            {
+                return;
+            }
+
+            this_buffer_p = buffer_p[ fill_index % READ_AHEAD_BUFFER_COUNT ];
+        }
+
+        // Fill the whole buffer unless the end of the file comes first,
+        // retrying if a signal interrupted the read. Full buffers mean
+        // that every buffer but the last starts at a multiple of the
+        // buffer size in the file.
+        read_start = TraceClass::trace_begin( );
+
+        while ( read_count < READ_AHEAD_BUFFER_SIZE )
+        {
+            const int this_count = read( in_file_handle, this_buffer_p + read_count,
+                READ_AHEAD_BUFFER_SIZE - read_count );
+
+            if ( this_count < 0 && EINTR == errno )
+            {
+                continue;
+            }
+
+            // Remember why a read failed so that it is not taken for
+            // the end of the file
+            if ( this_count < 0 )
+            {
+                read_errno = errno;
+
+                break;
+            }
+
+            if ( 0 == this_count )
+            {
+                break;
+            }
+
+            read_count += this_count;
+        }
+
+        TraceClass::trace_end( trace_disk_read, read_start, read_count );
+
+        // Hand the buffer to the consumer, or flag the end of the file.
+        // What was read before a read failed is handed over first.
+        {
+            std::lock_guard<std::mutex> ring_guard( ring_lock );
+
+            if ( read_count > 0 )
+            {
+                buffer_count[ fill_index % READ_AHEAD_BUFFER_COUNT ] = read_count;
+
+                fill_index++;
+            }
+
+            if ( read_count <= 0 || 0 != read_errno )
+            {
+                end_of_file = true;
+                read_error  = read_errno;
+            }
+
+            ring_filled.notify_one( );
+        }
+
+        if ( read_count <= 0 || 0 != read_errno )
+        {
+            return;
+        }
+    }
+}
@@ -0,0 +1,91 @@
+
+// ----------------------------------------------------------------------
+// ReadAheadClass -- Small class which reads a file ahead of the code
+// which consumes it. A reader thread fills a ring of large, aligned
+// buffers while the caller drains them, so reading from the disk and
+// transmitting on the network take place at the same time.
+//
+// See main.c for disclaimers and other information.
+//
+// Fredric L. Rice, June 2018
+// http://www.crystallake.name
+// fred @ crystal lake . name
+//
+// ----------------------------------------------------------------------
+
+#ifndef _READAHEADCLASS_H_
+#define _READAHEADCLASS_H_   1
+
+#include <sys/types.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// ----------------------------------------------------------------------
+// The ring of read-ahead buffers is described here. Each buffer is
+// large so that the reader thread asks the disk for big sequential
+// pieces of the file, and each buffer is aligned to a page so that
+// the file may be opened for direct I/O if that is wanted.
+//
+// ----------------------------------------------------------------------
+
+#define READ_AHEAD_BUFFER_COUNT     4
+#define READ_AHEAD_BUFFER_SIZE      (256 * 1024)
+#define READ_AHEAD_ALIGNMENT        4096
+
+// ----------------------------------------------------------------------
+// Set this value to 1 to have the file opened with O_DIRECT which
+// bypasses the page cache. File systems which do not support direct
+// I/O cause the file to be opened normally instead.
+//
+// ----------------------------------------------------------------------
+
+#define READ_AHEAD_USE_O_DIRECT     0
+
+// ----------------------------------------------------------------------
+// When a handle is not open, the variable used to hold the handle is
+// assigned this value to indicate that it is not opened.
+//
+// ----------------------------------------------------------------------
+
+#define READ_AHEAD_NO_HANDLE        (int)-1
+
+// ----------------------------------------------------------------------
+// Our class is defined here.
+//
+// ----------------------------------------------------------------------
+
+class ReadAheadClass
+{
+    public:
+        ReadAheadClass( void );
+        ~ReadAheadClass( void );
+
+        bool read_ahead_open( const char * path_and_name_p, const off_t start_offset );
+        bool read_ahead_ready( void );
+        int  read_ahead_next( const char ** data_pp );
+        int  read_ahead_error( void );
+        void read_ahead_release( void );
+        void read_ahead_close( void );
+
+    private:
+        ReadAheadClass( const ReadAheadClass & );
+        ReadAheadClass & operator=( const ReadAheadClass & );
+
+        void reader_thread( void );
+
+        int                     in_file_handle;
+        char                  * buffer_p[ READ_AHEAD_BUFFER_COUNT ];
+        int                     buffer_count[ READ_AHEAD_BUFFER_COUNT ];
+        unsigned int            fill_index;
+        unsigned int            drain_index;
+        bool                    end_of_file;
+        int                     read_error;
+        bool                    stop_reader;
+        std::thread             reader;
+        std::mutex              ring_lock;
+        std::condition_variable ring_filled;
+        std::condition_variable ring_drained;
+} ;
+
+#endif
@@ -0,0 +1,164 @@
+
+// ----------------------------------------------------------------------
+// SpscQueueClass -- Small class which passes items from one thread to
+// one other thread through a bounded ring, without locks.
+//
+// See main.c for disclaimers and other information.
+//
+// Fredric L. Rice, June 2018
+// http://www.crystallake.name
+// fred @ crystal lake . name
+//
+// ----------------------------------------------------------------------
+
+#ifndef _SPSCQUEUECLASS_H_
+#define _SPSCQUEUECLASS_H_   1
+
+#include <stdint.h>
+#include <atomic>
+
+// ----------------------------------------------------------------------
+// The head and the tail are each kept on a cache line of their own so
+// that the thread filling the ring and the thread draining it do not
+// take the line away from each other every time one of them moves.
+//
+// ----------------------------------------------------------------------
+
+#define SPSC_CACHE_LINE_SIZE        64
+
+// ----------------------------------------------------------------------
+// Our class is defined here. Exactly one thread may fill the ring and
+// exactly one other may drain it. The slot count must be a power of
+// two. The slots are allocated once, when the queue is, and are never
+// moved, so an item may be built and used where it sits: the filling
+// thread claims a slot, fills it in and publishes it, and the draining
+// thread looks at the front slot and releases it when it is done with
+// it. Slots may be claimed a few at a time and published together.
+//
+// ----------------------------------------------------------------------
+
+template < typename T, unsigned int SLOT_COUNT >
+class SpscQueueClass
+{
+    static_assert( 0 == ( SLOT_COUNT & ( SLOT_COUNT - 1 ) ), "SLOT_COUNT must be a power of two" );
+
+    public:
+        SpscQueueClass( void ) : queue_head( 0 ), tail_seen( 0 ), queue_tail( 0 ), head_seen( 0 )
+        {
+            slots_p = new T[ SLOT_COUNT ];
+        }
+
+        ~SpscQueueClass( void )
+        {
+            delete [] slots_p;
+        }
+
+        // ------------------------------------------------------------------
+        // Filling thread. Returns the slot the number passed by argument
+        // past the next one to be published, else NULL if the ring does
+        // not have that many free slots.
+        // ------------------------------------------------------------------
+
+        T * spsc_claim( const unsigned int slots_ahead )
+        {
+            const uint32_t this_tail = queue_tail.load( std::memory_order_relaxed );
+
+            if ( this_tail + slots_ahead - head_seen >= SLOT_COUNT )
+            {
+                head_seen = queue_head.load( std::memory_order_acquire );
+
+                if ( this_tail + slots_ahead - head_seen >= SLOT_COUNT )
+                {
+                    return (T *)NULL;
+                }
+            }
+
+            return &slots_p[ ( this_tail + slots_ahead ) & ( SLOT_COUNT - 1 ) ];
+        }
+
+        void spsc_publish( const unsigned int slot_count )
+        {
+            queue_tail.store( queue_tail.load( std::memory_order_relaxed ) + slot_count, std::memory_order_release );
+        }
+
+        bool spsc_push( const T & this_item )
+        {
+            T * slot_p = spsc_claim( 0 );
+
+            if ( (T *)NULL == slot_p )
+            {
+                return false;
+            }
+
+            *slot_p = this_item;
+
+            spsc_publish( 1 );
+
+            return true;
+        }
+
+        // ------------------------------------------------------------------
+        // Draining thread. Returns the oldest slot published, else NULL if
+        // the ring is empty.
+        // ------------------------------------------------------------------
+
+        T * spsc_front( void )
+        {
+            const uint32_t this_head = queue_head.load( std::memory_order_relaxed );
+
+            if ( this_head == tail_seen )
+            {
+                tail_seen = queue_tail.load( std::memory_order_acquire );
+
+                if ( this_head == tail_seen )
+                {
+                    return (T *)NULL;
+                }
+            }
+
+            return &slots_p[ this_head & ( SLOT_COUNT - 1 ) ];
+        }
+
+        void spsc_release( void )
+        {
+            queue_head.store( queue_head.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+        }
+
+        bool spsc_pop( T & this_item )
+        {
+            T * slot_p = spsc_front( );
+
+            if ( (T *)NULL == slot_p )
+            {
+                return false;
+            }
+
+            this_item = *slot_p;
+
+            spsc_release( );
+
+            return true;
+        }
+
+        // ------------------------------------------------------------------
+        // Either thread. Returns true if nothing is waiting, which may
+        // have changed by the time the caller looks at it.
+        // ------------------------------------------------------------------
+
+        bool spsc_empty( void )
+        {
+            return queue_head.load( std::memory_order_acquire ) == queue_tail.load( std::memory_order_acquire );
+        }
+
+    private:
+        SpscQueueClass( const SpscQueueClass & );
+        SpscQueueClass & operator=( const SpscQueueClass & );
+
+        alignas( SPSC_CACHE_LINE_SIZE ) std::atomic<uint32_t> queue_head;   // Next slot to drain
+        uint32_t                                               tail_seen;    // The drainer's copy of the tail
+        alignas( SPSC_CACHE_LINE_SIZE ) std::atomic<uint32_t> queue_tail;   // Next slot to fill
+        uint32_t                                               head_seen;    // The filler's copy of the head
+        alignas( SPSC_CACHE_LINE_SIZE ) T *                    slots_p;
+} ;
+
+#endif
@@ -0,0 +1,501 @@
+
+// ----------------------------------------------------------------------
+// TermIndexClass -- Small class which builds and reads the inverted
+// index of the words in a segment of the binary chat log.
+//
+// While a segment is being written the words of its records are added
+// to a table in memory, each word with the offsets of the records that
+// hold it. When the segment is closed the table is sorted and written
+// next to the segment, first in to a temporary file which is then
+// renamed so that a search never finds half of an index.
+//
+// A search loads a segment's index, finds the term with a binary search
+// of the sorted table, and decodes its postings.
+//
+// See main.c for disclaimers and other information.
+//
+// Fredric L. Rice, June 2018
+// http://www.crystallake.name
+// fred @ crystal lake . name
+//
+// ----------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <algorithm>
+#include "TermIndexClass.h"     // Our own class and defined constants
+
+// ----------------------------------------------------------------------
+// Fills the table which says what every character folds to in a word,
+// or 0 if the character ends a word.
+//
+// ----------------------------------------------------------------------
+
+static bool build_term_fold( char * fold_p )
+{
+    int this_char = 0;
+
+    for ( this_char = 0; this_char < 256; this_char++ )
+    {
+        fold_p[ this_char ] = 0;
+
+        if ( ( this_char < 0x80 && isalnum( this_char ) ) || '.' == this_char || '-' == this_char || '_' == this_char )
+        {
+            fold_p[ this_char ] = (char)tolower( this_char );
+        }
+    }
+
+    return true;
+}
+
+// ----------------------------------------------------------------------
+// Returns the table, which is filled the first time it is asked for
+// by whichever thread gets there first.
+//
+// ----------------------------------------------------------------------
+
+static const char * term_fold_table( void )
+{
+    static char       term_fold[ 256 ];
+    static const bool term_fold_built = build_term_fold( term_fold );
+
+    (void)term_fold_built;
+
+    return term_fold;
+}
+
+// ----------------------------------------------------------------------
+// Appends a value to the buffer seven bits at a time, lowest first, with
+// the top bit of each byte set if more follow.
+//
+// ----------------------------------------------------------------------
+
+static void put_varint( std::vector<unsigned char> & this_buffer, uint64_t this_value )
+{
+    while ( this_value >= 0x80 )
+    {
+        this_buffer.push_back( (unsigned char)( this_value | 0x80 ) );
+
+        this_value >>= 7;
+    }
+
+    this_buffer.push_back( (unsigned char)this_value );
+}
+
+// ----------------------------------------------------------------------
+// TermIndexClass Constructor
+//
+// ----------------------------------------------------------------------
+
+TermIndexClass::TermIndexClass( void ) : record_count( 0 ), complete( true )
+{
+}
+
+// ----------------------------------------------------------------------
+// TermIndexClass Destructor
+//
+// ----------------------------------------------------------------------
+
+TermIndexClass::~TermIndexClass( void )
+{
+}
+
+// ----------------------------------------------------------------------
+// TermIndexClass Next Word
+//
+// Finds the next word in the data at or after the position passed by
+// argument, folds it in to the string offered, and moves the position
+// past it.
+//
+// Returns: false if there are no more words
+//
+// ----------------------------------------------------------------------
+
+bool TermIndexClass::next_word( const char * this_data_p, size_t this_size, size_t & this_byte,
+    std::string & this_word )
+{
+    const char * term_fold = term_fold_table( );
+
+    while ( this_byte < this_size )
+    {
+        size_t word_start = 0;
+        size_t word_end   = 0;
+
+        while ( this_byte < this_size && 0 == term_fold[ (unsigned char)this_data_p[ this_byte ] ] )
+        {
+            this_byte++;
+        }
+
+        word_start = this_byte;
+
+        while ( this_byte < this_size && 0 != term_fold[ (unsigned char)this_data_p[ this_byte ] ] )
+        {
+            this_byte++;
+        }
+
+        word_end = this_byte;
+
+        // Trim the punctuation which ends sentences and starts options
+        while ( word_start < word_end && ( '.' == this_data_p[ word_start ] || '-' == this_data_p[ word_start ] ) )
+        {
+            word_start++;
+        }
+
+        while ( word_end > word_start && ( '.' == this_data_p[ word_end - 1 ] || '-' == this_data_p[ word_end - 1 ] ) )
+        {
+            word_end--;
+        }
+
+        if ( word_end > word_start )
+        {
+            if ( word_end - word_start > TERM_MAX_LENGTH )
+            {
+                word_end = word_start + TERM_MAX_LENGTH;
+            }
+
+            this_word.resize( word_end - word_start );
+
+            for ( size_t this_char = 0; this_char < this_word.size( ); this_char++ )
+            {
+                this_word[ this_char ] = term_fold[ (unsigned char)this_data_p[ word_start + this_char ] ];
+            }
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// ----------------------------------------------------------------------
+// TermIndexClass Term Index Tokens
+//
+// Cuts the data passed by argument in to the words that get indexed,
+// in the order they appear, offering them through the argument.
+//
+// ----------------------------------------------------------------------
+
+void TermIndexClass::term_index_tokens( const char * this_data_p, size_t this_size,
+    std::vector<std::string> & these_tokens )
+{
+    std::string this_word;
+    size_t      this_byte = 0;
+
+    these_tokens.clear( );
+
+    while ( true == next_word( this_data_p, this_size, this_byte, this_word ) )
+    {
+        these_tokens.push_back( this_word );
+    }
+}
+
+// ----------------------------------------------------------------------
+// TermIndexClass Term Index Add
+//
+// Adds the words of one record, which starts at the offset in the
+// segment passed by argument, to the index being built. Records must be
+// added in the order they are in the segment.
+//
+// ----------------------------------------------------------------------
+
+void TermIndexClass::term_index_add( const char * this_data_p, size_t this_size, const uint64_t record_offset )
+{
+    size_t this_byte = 0;
+
+    while ( true == next_word( this_data_p, this_size, this_byte, scratch_word ) )
+    {
+        std::unordered_map<std::string, std::vector<uint64_t> >::iterator this_term = postings.find( scratch_word );
+
+        if ( postings.end( ) == this_term )
+        {
+            postings[ scratch_word ].push_back( record_offset );
+        }
+        else if ( this_term->second.back( ) != record_offset )
+        {
+            // A word said twice in a record is posted once
+            this_term->second.push_back( record_offset );
+        }
+    }
+
+    record_count++;
+}
+
+// ----------------------------------------------------------------------
+// TermIndexClass Term Index Incomplete
+//
+// Notes that some records of the segment were not added to the index.
+//
+// ----------------------------------------------------------------------
+
+void TermIndexClass::term_index_incomplete( void )
+{
+    complete = false;
+}
+
+// ----------------------------------------------------------------------
+// TermIndexClass Term Index Write
+//
+// Sorts the index that was built and writes it to the file named by
+// argument.
+//
+// Returns: true if the index was written
+//
+// ----------------------------------------------------------------------
+
+bool TermIndexClass::term_index_write( const char * path_and_name_p )
+{
+    std::vector<const std::string *> these_terms;
+    std::vector<term_index_entry>    these_entries;
+    std::string                      term_text;
+    std::vector<unsigned char>       these_postings;
+    term_index_header                this_header;
+    std::string                      temporary_name( path_and_name_p );
+    FILE *                           index_p = (FILE *)NULL;
+    bool                             written = false;
+
+    for ( std::unordered_map<std::string, std::vector<uint64_t> >::const_iterator this_term = postings.begin( );
+        this_term != postings.end( ); ++this_term )
+    {
+        these_terms.push_back( &this_term->first );
+    }
+
+    std::sort( these_terms.begin( ), these_terms.end( ),
+        []( const std::string * first_p, const std::string * second_p ) { return *first_p < *second_p; } );
+
+    for ( size_t this_term = 0; this_term < these_terms.size( ); this_term++ )
+    {
+        const std::vector<uint64_t> & these_offsets = postings[ *these_terms[ this_term ] ];
+        term_index_entry              this_entry;
+        uint64_t                      previous      = 0;
+
+        this_entry.text_offset     = (uint32_t)term_text.size( );
+        this_entry.text_length     = (uint32_t)these_terms[ this_term ]->size( );
+        this_entry.postings_offset = these_postings.size( );
+        this_entry.posting_count   = (uint32_t)these_offsets.size( );
+
+        for ( size_t this_offset = 0; this_offset < these_offsets.size( ); this_offset++ )
+        {
+            put_varint( these_postings, these_offsets[ this_offset ] - previous );
+
+            previous = these_offsets[ this_offset ];
+        }
+
+        this_entry.postings_bytes = (uint32_t)( these_postings.size( ) - this_entry.postings_offset );
+
+        term_text += *these_terms[ this_term ];
+
+        these_entries.push_back( this_entry );
+    }
+
+    (void)memset( (char *)&this_header, 0, sizeof( this_header ) );
+    (void)memcpy( this_header.index_magic, TERM_INDEX_MAGIC, sizeof( TERM_INDEX_MAGIC ) );
+
+    this_header.format_version  = TERM_INDEX_VERSION;
+    this_header.term_count      = (uint32_t)these_entries.size( );
+    this_header.index_complete  = true == complete ? 1 : 0;
+    this_header.record_count    = record_count;
+    this_header.text_offset     = sizeof( this_header ) + these_entries.size( ) * sizeof( term_index_entry );
+    this_header.postings_offset = this_header.text_offset + term_text.size( );
+
+    temporary_name += ".tmp";
+
+    if ( (FILE *)NULL == ( index_p = fopen( temporary_name.c_str( ), "wb" ) ) )
+    {
+        return false;
+    }
+
+    written = 1 == fwrite( (char *)&this_header, sizeof( this_header ), 1, index_p ) &&
+        these_entries.size( ) == fwrite( (char *)these_entries.data( ), sizeof( term_index_entry ),
+            these_entries.size( ), index_p ) &&
+        term_text.size( ) == fwrite( term_text.data( ), 1, term_text.size( ), index_p ) &&
+        these_postings.size( ) == fwrite( (char *)these_postings.data( ), 1, these_postings.size( ), index_p );
+
+    written = 0 == fclose( index_p ) && true == written;
+
+    if ( false == written || 0 != rename( temporary_name.c_str( ), path_and_name_p ) )
+    {
+        (void)remove( temporary_name.c_str( ) );
+
+        return false;
+    }
+
+    return true;
+}
+
+// ----------------------------------------------------------------------
+// TermIndexClass Term Index Clear
+//
+// Throws away the index that was built so that the next segment may be
+// indexed.
+//
+// ----------------------------------------------------------------------
+
+void TermIndexClass::term_index_clear( void )
+{
+    std::unordered_map<std::string, std::vector<uint64_t> >( ).swap( postings );
+
+    record_count = 0;
+    complete     = true;
+}
+
+// ----------------------------------------------------------------------
+// TermIndexClass Term Index Load
+//
+// Reads the term index file named by argument in to memory and checks
+// that it holds together.
+//
+// Returns: true if the index may be searched
+//
+// ----------------------------------------------------------------------
+
+bool TermIndexClass::term_index_load( const char * path_and_name_p )
+{
+    FILE *                    index_p  = (FILE *)NULL;
+    long                      size     = 0;
+    const term_index_header * header_p = (const term_index_header *)NULL;
+
+    term_index_close( );
+
+    if ( (FILE *)NULL == ( index_p = fopen( path_and_name_p, "rb" ) ) )
+    {
+        return false;
+    }
+
+    if ( 0 == fseek( index_p, 0, SEEK_END ) && ( size = ftell( index_p ) ) > 0 && 0 == fseek( index_p, 0, SEEK_SET ) )
+    {
+        loaded.resize( (size_t)size );
+
+        if ( 1 != fread( loaded.data( ), (size_t)size, 1, index_p ) )
+        {
+            loaded.clear( );
+        }
+    }
+
+    (void)fclose( index_p );
+
+    header_p = (const term_index_header *)loaded.data( );
+
+    if ( loaded.size( ) < sizeof( term_index_header ) ||
+        0 != memcmp( header_p->index_magic, TERM_INDEX_MAGIC, sizeof( TERM_INDEX_MAGIC ) ) ||
+        TERM_INDEX_VERSION != header_p->format_version ||
+        header_p->text_offset != sizeof( term_index_header ) + (uint64_t)header_p->term_count * sizeof( term_index_entry ) ||
+        header_p->postings_offset < header_p->text_offset || header_p->postings_offset > loaded.size( ) )
+    {
+        term_index_close( );
+
+        return false;
+    }
+
+    return true;
+}
+
+// ----------------------------------------------------------------------
+// TermIndexClass Term Index Lookup
+//
+// Finds a term, which must already be folded the way the tokenizer
+// folds words, in the loaded index and offers the offsets of the
+// records which hold it, in segment order, through the argument.
+//
+// Returns: true if the term is in the index
+//
+// ----------------------------------------------------------------------
+
+bool TermIndexClass::term_index_lookup( const std::string & this_term, std::vector<uint64_t> & these_offsets )
+{
+    const term_index_header * header_p  = (const term_index_header *)loaded.data( );
+    const term_index_entry *  entries_p = (const term_index_entry *)NULL;
+    size_t                    low       = 0;
+    size_t                    high      = 0;
+
+    these_offsets.clear( );
+
+    if ( true == loaded.empty( ) )
+    {
+        return false;
+    }
+
+    entries_p = (const term_index_entry *)&loaded[ sizeof( term_index_header ) ];
+    high      = header_p->term_count;
+
+    while ( low < high )
+    {
+        const size_t             middle  = low + ( high - low ) / 2;
+        const term_index_entry & entry   = entries_p[ middle ];
+        int                      compare = 0;
+
+        if ( header_p->text_offset + entry.text_offset + entry.text_length > header_p->postings_offset )
+        {
+            return false;
+        }
+
+        compare = this_term.compare( 0, std::string::npos,
+            &loaded[ header_p->text_offset + entry.text_offset ], entry.text_length );
+
+        if ( compare > 0 )
+        {
+            low = middle + 1;
+        }
+        else if ( compare < 0 )
+        {
+            high = middle;
+        }
+        else
+        {
+            const unsigned char * byte_p = (const unsigned char *)&loaded[ header_p->postings_offset ];
+            uint64_t              at     = entry.postings_offset;
+            uint64_t              offset = 0;
+
+            if ( header_p->postings_offset + entry.postings_offset + entry.postings_bytes > loaded.size( ) )
+            {
+                return false;
+            }
+
+            while ( at < entry.postings_offset + entry.postings_bytes )
+            {
+                uint64_t delta = 0;
+                int      shift = 0;
+
+                do
+                {
+                    delta |= (uint64_t)( byte_p[ at ] & 0x7f ) << shift;
+
+                    shift += 7;
+                } while ( 0 != ( byte_p[ at++ ] & 0x80 ) && at < entry.postings_offset + entry.postings_bytes );
+
+                offset += delta;
+
+                these_offsets.push_back( offset );
+            }
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// ----------------------------------------------------------------------
+// TermIndexClass Term Index Is Complete
+//
+// Returns: true if every record of the segment is in the loaded index
+//
+// ----------------------------------------------------------------------
+
+bool TermIndexClass::term_index_is_complete( void )
+{
+    return false == loaded.empty( ) && 1 == ( (const term_index_header *)loaded.data( ) )->index_complete;
+}
+
+// ----------------------------------------------------------------------
+// TermIndexClass Term Index Close
+//
+// Throws away the index that was loaded.
+//
+// ----------------------------------------------------------------------
+
+void TermIndexClass::term_index_close( void )
+{
+    std::vector<char>( ).swap( loaded );
+}
@@ -0,0 +1,111 @@
+
+// ----------------------------------------------------------------------
+// TermIndexClass -- Small class which builds and reads the inverted
+// index of the words in a segment of the binary chat log.
+//
+// See main.c for disclaimers and other information.
+//
+// Fredric L. Rice, June 2018
+// http://www.crystallake.name
+// fred @ crystal lake . name
+//
+// ----------------------------------------------------------------------
+
+#ifndef _TERMINDEXCLASS_H_
+#define _TERMINDEXCLASS_H_   1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// ----------------------------------------------------------------------
+// The words of a record are runs of letters, digits, and the dots,
+// dashes and underscores found in host names and addresses, folded to
+// lower case, with dots and dashes trimmed from either end so that a
+// word ending a sentence is found. Words longer than the maximum are
+// cut short the same way when indexing and when searching.
+//
+// ----------------------------------------------------------------------
+
+#define TERM_MAX_LENGTH             64
+
+// ----------------------------------------------------------------------
+// A term index file sits next to its segment. It starts with a header,
+// followed by a table of the terms sorted so that a term may be found
+// with a binary search, then the text of the terms, then the postings.
+// A term's postings are the offsets in the segment of the records which
+// hold it, in order, each stored as the distance from the one before
+// in seven bit pieces. An index which is not complete is missing some
+// records, so a reader must scan the segment instead.
+//
+// ----------------------------------------------------------------------
+
+#define TERM_INDEX_SUFFIX           ".terms"
+#define TERM_INDEX_MAGIC            "CHATTRM"
+#define TERM_INDEX_VERSION          1
+
+    typedef struct TERM_INDEX_HEADER_T
+    {
+        char     index_magic[ 8 ];                    // Always CHATTRM
+        uint32_t format_version;                      // TERM_INDEX_VERSION
+        uint32_t term_count;                          // Entries in the table
+        uint32_t index_complete;                      // 1 if every record is in it
+        uint32_t reserved;                            // Always zero
+        uint64_t record_count;                        // Records indexed
+        uint64_t text_offset;                         // Where the term text starts
+        uint64_t postings_offset;                     // Where the postings start
+    } term_index_header;
+
+    typedef struct TERM_INDEX_ENTRY_T
+    {
+        uint32_t text_offset;                         // In the term text
+        uint32_t text_length;                         // Bytes of term text
+        uint64_t postings_offset;                     // In the postings
+        uint32_t postings_bytes;                      // Bytes of postings
+        uint32_t posting_count;                       // Records holding the term
+    } term_index_entry;
+
+// ----------------------------------------------------------------------
+// Our class is defined here.
+//
+// ----------------------------------------------------------------------
+
+class TermIndexClass
+{
+    public:
+        TermIndexClass( void );
+        ~TermIndexClass( void );
+
+        static void term_index_tokens( const char * this_data_p, size_t this_size,
+                        std::vector<std::string> & these_tokens );
+
+        void term_index_add( const char * this_data_p, size_t this_size, const uint64_t record_offset );
+        void term_index_incomplete( void );
+        bool term_index_write( const char * path_and_name_p );
+        void term_index_clear( void );
+
+        bool term_index_load( const char * path_and_name_p );
+        bool term_index_lookup( const std::string & this_term, std::vector<uint64_t> & these_offsets );
+        bool term_index_is_complete( void );
+        void term_index_close( void );
+
+    private:
+        TermIndexClass( const TermIndexClass & );
+        TermIndexClass & operator=( const TermIndexClass & );
+
+        static bool next_word( const char * this_data_p, size_t this_size, size_t & this_byte,
+                        std::string & this_word );
+
+        // What is being built for the segment being written
+        std::unordered_map<std::string, std::vector<uint64_t> > postings;
+        uint64_t                     record_count;
+        bool                         complete;
+        std::string                  scratch_word;
+
+        // What was loaded for a segment being searched
+        std::vector<char>            loaded;
+} ;
+
+#endif
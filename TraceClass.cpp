@@ -0,0 +1,426 @@
+
+// ----------------------------------------------------------------------
+// TraceClass -- Small class which records how long the stages of the
+// main loop and of file transfers take, for viewing on a timeline.
+//
+// When a transfer stalls the metrics say that it did but not where the
+// time went: reading the file, sending the blocks, the main loop's
+// sleep, or the receiver writing the file. The stages are recorded as
+// spans, a start time and a duration, in to a ring per thread, and the
+// rings may be written out at any time in the Chrome trace event
+// format, which chrome://tracing and the Perfetto UI both open.
+//
+// Tracing is off until it is turned on. While it is off a span costs
+// one relaxed load of a flag; the clock is not even read. While it is
+// on a span costs two clock reads and five stores to memory no other
+// thread writes to. The rings are not allocated until a thread records
+// its first span.
+//
+// Every slot of a ring carries a sequence number which is odd while
+// the slot is being written, so that the rings may be written out from
+// the main thread while other threads are recording. A span which was
+// being written over just then is left out.
+//
+// See main.c for disclaimers and other information.
+//
+// Fredric L. Rice, June 2018
+// http://www.crystallake.name
+// fred @ crystal lake . name
+//
+// ----------------------------------------------------------------------
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include "TraceClass.h"         // Our own class and defined constants
+#include "ClockClass.h"         // The precise clock
+
+// ----------------------------------------------------------------------
+// A slot of a ring, and a thread's ring
+//
+// ----------------------------------------------------------------------
+
+    typedef struct TRACE_SLOT_T
+    {
+        std::atomic<uint64_t> sequence;               // Twice the span number plus 2, odd while written
+        std::atomic<uint64_t> start_ns;               // When the span started
+        std::atomic<uint64_t> duration_ns;            // How long it took
+        std::atomic<uint64_t> this_arg;               // Bytes, transfer ID, whatever suits the event
+        std::atomic<uint64_t> event_and_thread;       // The event above the thread ID
+    } trace_slot;
+
+    typedef struct alignas( 64 ) TRACE_RING_T
+    {
+        std::atomic<bool>     in_use;                 // true while a thread is recording in to it
+        std::atomic<uint64_t> head;                   // How many spans were ever recorded
+        trace_slot            slots[ TRACE_RING_SPANS ];
+    } trace_ring;
+
+// ----------------------------------------------------------------------
+// A thread's hold on its ring, which lets the ring go when the thread
+// ends.
+//
+// ----------------------------------------------------------------------
+
+    typedef struct TRACE_RING_HOLD_T
+    {
+        trace_ring * ring_p;                          // The ring, NULL until the first span
+        bool         no_ring;                         // true if every ring was taken
+        uint32_t     thread_id;                       // Linux's ID for the thread
+
+        ~TRACE_RING_HOLD_T( void )
+        {
+            if ( (trace_ring *)NULL != ring_p )
+            {
+                ring_p->in_use.store( false, std::memory_order_release );
+            }
+        }
+    } trace_ring_hold;
+
+// ----------------------------------------------------------------------
+// Local data storage
+//
+// ----------------------------------------------------------------------
+
+    static std::atomic<bool>            tracing_on( false );
+    static std::atomic<trace_ring *>    all_rings[ TRACE_MAX_THREADS ];
+    static thread_local trace_ring_hold this_thread_hold = { (trace_ring *)NULL, false, 0 };
+
+    static const char * event_names[ TRACE_EVENTS ] =
+    {
+        "loop pass", "loop wait", "frame", "service transfers", "check timeouts", "sendto",
+        "sendto bulk", "disk read", "block write", "write retry", "verify", "inbound transfer",
+        "outbound transfer", "recvmmsg"
+    } ;
+
+    static const char * event_categories[ TRACE_EVENTS ] =
+    {
+        "loop", "loop", "receive", "send", "loop", "send",
+        "send", "disk", "disk", "disk", "receive", "transfer",
+        "transfer", "receive"
+    } ;
+
+    static const char * event_arg_names[ TRACE_EVENTS ] =
+    {
+        "frames", "us", "bytes", "transfers", "transfers", "bytes",
+        "bytes", "bytes", "bytes", "bytes", "leaves", "transfer",
+        "transfer", "frames"
+    } ;
+
+    // Whole transfers overlap everything else so they go on tracks of
+    // their own
+    static const bool event_is_async[ TRACE_EVENTS ] =
+    {
+        false, false, false, false, false, false,
+        false, false, false, false, false, true,
+        true, false
+    } ;
+
+// ----------------------------------------------------------------------
+// Returns: The calling thread's ring, finding it one if it has none, or
+// NULL if every ring is in use
+//
+// ----------------------------------------------------------------------
+
+static trace_ring * my_ring( void )
+{
+    int this_ring = 0;
+
+    if ( (trace_ring *)NULL != this_thread_hold.ring_p || true == this_thread_hold.no_ring )
+    {
+        return this_thread_hold.ring_p;
+    }
+
+    for ( this_ring = 0; this_ring < TRACE_MAX_THREADS; this_ring++ )
+    {
+        trace_ring * ring_p        = all_rings[ this_ring ].load( std::memory_order_acquire );
+        bool         not_in_use    = false;
+
+        // Nobody has used this one yet so make it
+        if ( (trace_ring *)NULL == ring_p )
+        {
+            trace_ring * new_ring_p = new trace_ring( );
+
+            new_ring_p->in_use.store( true, std::memory_order_relaxed );
+
+            if ( true == all_rings[ this_ring ].compare_exchange_strong( ring_p, new_ring_p,
+                std::memory_order_acq_rel ) )
+            {
+                this_thread_hold.ring_p = new_ring_p;
+
+                break;
+            }
+
+            // Another thread made it first, so see if it is still free
+            delete new_ring_p;
+        }
+
+        if ( true == ring_p->in_use.compare_exchange_strong( not_in_use, true, std::memory_order_acquire ) )
+        {
+            this_thread_hold.ring_p = ring_p;
+
+            break;
+        }
+    }
+
+    if ( (trace_ring *)NULL == this_thread_hold.ring_p )
+    {
+        this_thread_hold.no_ring = true;
+    }
+    else
+    {
+        this_thread_hold.thread_id = (uint32_t)syscall( SYS_gettid );
+    }
+
+    return this_thread_hold.ring_p;
+}
+
+// ----------------------------------------------------------------------
+// TraceClass Enable
+//
+// Turns tracing on or off. What was recorded is kept either way.
+//
+// ----------------------------------------------------------------------
+
+void TraceClass::trace_enable( const bool enable_tracing )
+{
+    tracing_on.store( enable_tracing, std::memory_order_relaxed );
+}
+
+// ----------------------------------------------------------------------
+// TraceClass Enabled
+//
+// Returns: true if tracing is on
+//
+// ----------------------------------------------------------------------
+
+bool TraceClass::trace_enabled( void )
+{
+    return tracing_on.load( std::memory_order_relaxed );
+}
+
+// ----------------------------------------------------------------------
+// TraceClass Begin
+//
+// Returns: The time a span starts at, to pass to trace_end(), or 0 if
+// tracing is off in which case trace_end() records nothing
+//
+// ----------------------------------------------------------------------
+
+uint64_t TraceClass::trace_begin( void )
+{
+    if ( false == tracing_on.load( std::memory_order_relaxed ) )
+    {
+        return 0;
+    }
+
+    return ClockClass::clock_precise_ns( );
+}
+
+// ----------------------------------------------------------------------
+// TraceClass End
+//
+// Records a span from the start time passed by argument until now.
+//
+// ----------------------------------------------------------------------
+
+void TraceClass::trace_end( const trace_event this_event, const uint64_t start_ns, const uint64_t this_arg )
+{
+    if ( 0 == start_ns )
+    {
+        return;
+    }
+
+    trace_span( this_event, start_ns, ClockClass::clock_precise_ns( ), this_arg );
+}
+
+// ----------------------------------------------------------------------
+// TraceClass Span
+//
+// Records a span whose start and end times are both known already, in
+// nanoseconds of the monotonic clock, if tracing is on.
+//
+// ----------------------------------------------------------------------
+
+void TraceClass::trace_span( const trace_event this_event, const uint64_t start_ns, const uint64_t end_ns,
+    const uint64_t this_arg )
+{
+    trace_ring * ring_p     = (trace_ring *)NULL;
+    trace_slot * slot_p     = (trace_slot *)NULL;
+    uint64_t     this_index = 0;
+
+    if ( false == tracing_on.load( std::memory_order_relaxed ) || 0 == start_ns )
+    {
+        return;
+    }
+
+    if ( (trace_ring *)NULL == ( ring_p = my_ring( ) ) )
+    {
+        return;
+    }
+
+    this_index = ring_p->head.load( std::memory_order_relaxed );
+    slot_p     = &ring_p->slots[ this_index % TRACE_RING_SPANS ];
+
+    // Mark the slot as being written before writing it
+    slot_p->sequence.store( this_index * 2 + 1, std::memory_order_relaxed );
+
+    std::atomic_thread_fence( std::memory_order_release );
+
+    slot_p->start_ns.store( start_ns, std::memory_order_relaxed );
+    slot_p->duration_ns.store( end_ns > start_ns ? end_ns - start_ns : 0, std::memory_order_relaxed );
+    slot_p->this_arg.store( this_arg, std::memory_order_relaxed );
+    slot_p->event_and_thread.store( ( (uint64_t)this_event << 32 ) | this_thread_hold.thread_id,
+        std::memory_order_relaxed );
+
+    slot_p->sequence.store( this_index * 2 + 2, std::memory_order_release );
+
+    ring_p->head.store( this_index + 1, std::memory_order_release );
+}
+
+// ----------------------------------------------------------------------
+// TraceClass Dump Chrome
+//
+// Writes every span in the rings to the file passed by argument in the
+// Chrome trace event format. Times are in microseconds of the monotonic
+// clock. Whole transfers are written as async events so that they get
+// tracks of their own.
+//
+// Returns: The number of spans written, or -1 if the file could not be
+// written
+//
+// ----------------------------------------------------------------------
+
+int TraceClass::trace_dump_chrome( const char * path_and_name_p )
+{
+    FILE *                out_file_p   = fopen( path_and_name_p, "w" );
+    const int             process_id   = (int)getpid( );
+    std::vector<uint32_t> thread_ids;
+    int                   span_count   = 0;
+    int                   this_ring    = 0;
+    size_t                this_thread  = 0;
+
+    if ( (FILE *)NULL == out_file_p )
+    {
+        return -1;
+    }
+
+    (void)fprintf( out_file_p, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+        "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"chat\"}}", process_id );
+
+    for ( this_ring = 0; this_ring < TRACE_MAX_THREADS; this_ring++ )
+    {
+        trace_ring *   ring_p     = all_rings[ this_ring ].load( std::memory_order_acquire );
+        uint64_t       this_head  = 0;
+        uint64_t       this_index = 0;
+
+        if ( (trace_ring *)NULL == ring_p )
+        {
+            continue;
+        }
+
+        this_head  = ring_p->head.load( std::memory_order_acquire );
+        this_index = this_head > TRACE_RING_SPANS ? this_head - TRACE_RING_SPANS : 0;
+
+        for ( ; this_index < this_head; this_index++ )
+        {
+            trace_slot &   this_slot     = ring_p->slots[ this_index % TRACE_RING_SPANS ];
+            const uint64_t sequence      = this_slot.sequence.load( std::memory_order_acquire );
+            uint64_t       start_ns      = 0;
+            uint64_t       duration_ns   = 0;
+            uint64_t       this_arg      = 0;
+            uint64_t       event_thread  = 0;
+            uint32_t       thread_id     = 0;
+            int            this_event    = 0;
+
+            if ( sequence != this_index * 2 + 2 )
+            {
+                continue;
+            }
+
+            start_ns     = this_slot.start_ns.load( std::memory_order_relaxed );
+            duration_ns  = this_slot.duration_ns.load( std::memory_order_relaxed );
+            this_arg     = this_slot.this_arg.load( std::memory_order_relaxed );
+            event_thread = this_slot.event_and_thread.load( std::memory_order_relaxed );
+
+            // Was it written over while we read it?
+            std::atomic_thread_fence( std::memory_order_acquire );
+
+            if ( this_slot.sequence.load( std::memory_order_relaxed ) != sequence )
+            {
+                continue;
+            }
+
+            this_event = (int)( event_thread >> 32 );
+            thread_id  = (uint32_t)event_thread;
+
+            if ( this_event >= TRACE_EVENTS )
+            {
+                continue;
+            }
+
+            if ( thread_ids.end( ) == std::find( thread_ids.begin( ), thread_ids.end( ), thread_id ) )
+            {
+                thread_ids.push_back( thread_id );
+            }
+
+            if ( true == event_is_async[ this_event ] )
+            {
+                (void)fprintf( out_file_p, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"b\",\"id\":\"0x%llx\","
+                    "\"ts\":%.3f,\"pid\":%d,\"tid\":%u,\"args\":{\"%s\":%llu}}",
+                    event_names[ this_event ], event_categories[ this_event ], (unsigned long long)this_arg,
+                    start_ns / 1e3, process_id, thread_id, event_arg_names[ this_event ],
+                    (unsigned long long)this_arg );
+
+                (void)fprintf( out_file_p, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"e\",\"id\":\"0x%llx\","
+                    "\"ts\":%.3f,\"pid\":%d,\"tid\":%u}",
+                    event_names[ this_event ], event_categories[ this_event ], (unsigned long long)this_arg,
+                    ( start_ns + duration_ns ) / 1e3, process_id, thread_id );
+            }
+            else
+            {
+                (void)fprintf( out_file_p, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,"
+                    "\"dur\":%.3f,\"pid\":%d,\"tid\":%u,\"args\":{\"%s\":%llu}}",
+                    event_names[ this_event ], event_categories[ this_event ], start_ns / 1e3,
+                    duration_ns / 1e3, process_id, thread_id, event_arg_names[ this_event ],
+                    (unsigned long long)this_arg );
+            }
+
+            span_count++;
+        }
+    }
+
+    // Name the threads so that the main loop is easy to find
+    for ( this_thread = 0; this_thread < thread_ids.size( ); this_thread++ )
+    {
+        (void)fprintf( out_file_p, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,"
+            "\"args\":{\"name\":\"%s %u\"}}", process_id, thread_ids[ this_thread ],
+            (uint32_t)process_id == thread_ids[ this_thread ] ? "main" : "thread", thread_ids[ this_thread ] );
+    }
+
+    (void)fprintf( out_file_p, "\n]}\n" );
+
+    if ( 0 != ferror( out_file_p ) )
+    {
+        (void)fclose( out_file_p );
+
+        return -1;
+    }
+
+    return 0 == fclose( out_file_p ) ? span_count : -1;
+}
+
+// ----------------------------------------------------------------------
+// TraceClass Event Name
+//
+// Returns: The name a span of the event passed by argument is shown as
+//
+// ----------------------------------------------------------------------
+
+const char * TraceClass::trace_event_name( const trace_event this_event )
+{
+    return event_names[ this_event ];
+}
@@ -0,0 +1,81 @@
+
+// ----------------------------------------------------------------------
+// TraceClass -- Small class which records how long the stages of the
+// main loop and of file transfers take, for viewing on a timeline.
+//
+// See main.c for disclaimers and other information.
+//
+// Fredric L. Rice, June 2018
+// http://www.crystallake.name
+// fred @ crystal lake . name
+//
+// ----------------------------------------------------------------------
+
+#ifndef _TRACECLASS_H_
+#define _TRACECLASS_H_   1
+
+#include <stdint.h>
+
+// ----------------------------------------------------------------------
+// Every thread which records a span gets a ring of its own, so that
+// threads never write to the same memory. A ring holds the latest so
+// many spans; older ones are written over. A ring is handed back when
+// its thread ends so that the file reader threads, one per file sent,
+// do not use them all up. Spans from threads beyond the maximum are
+// not recorded.
+//
+// ----------------------------------------------------------------------
+
+#define TRACE_MAX_THREADS           16
+#define TRACE_RING_SPANS            65536
+
+// ----------------------------------------------------------------------
+// The stages which are traced. A whole transfer is traced as well, and
+// is shown on a track of its own so that its stages may be seen inside
+// of it.
+//
+// ----------------------------------------------------------------------
+
+    typedef enum TRACE_EVENT_T
+    {
+        trace_loop_pass,                              // Once around the main loop
+        trace_loop_wait,                              // The main loop's sleep or wait for input
+        trace_frame,                                  // A received frame handled
+        trace_service,                                // service_transfers() sending blocks
+        trace_timeouts,                               // transfer_timed_out() checking transfers
+        trace_send,                                   // sendto() of text or control frames
+        trace_bulk_send,                              // sendto() of file blocks and digests
+        trace_disk_read,                              // The read-ahead thread reading a file
+        trace_block_write,                            // A received block written to the file
+        trace_write_retry,                            // The wait before a failed write is retried
+        trace_verify,                                 // A received file checked against its digest
+        trace_transfer_in,                            // A whole inbound file
+        trace_transfer_out,                           // A whole outbound file, or its repair
+        trace_receive,                                // The receive thread taking in a batch of frames
+        TRACE_EVENTS
+    } trace_event;
+
+// ----------------------------------------------------------------------
+// Our class is defined here. There is only one trace so everything in
+// it is static and it is never instantiated.
+//
+// ----------------------------------------------------------------------
+
+class TraceClass
+{
+    public:
+        static void     trace_enable( const bool enable_tracing );
+        static bool     trace_enabled( void );
+        static uint64_t trace_begin( void );
+        static void     trace_end( const trace_event this_event, const uint64_t start_ns, const uint64_t this_arg );
+        static void     trace_span( const trace_event this_event, const uint64_t start_ns, const uint64_t end_ns,
+                            const uint64_t this_arg );
+        static int      trace_dump_chrome( const char * path_and_name_p );
+
+        static const char * trace_event_name( const trace_event this_event );
+
+    private:
+        TraceClass( void );
+} ;
+
+#endif
@@ -0,0 +1,374 @@
+// ----------------------------------------------------------------------
+// crc_bench -- Microbenchmark for the per-block CRC32C check.
+//
+// Measures how long the CRC32C of one file block frame takes using the
+// SSE4.2 instruction or the table-driven fallback, whichever the
+// IntegrityClass picked, then how long a ChatClass takes to receive a
+// block frame through the path the chat program uses: read_data()
+// takes the frame off a loopback socket and hands it to
+// process_frame(), which passes it through receive_frame() and
+// receive_block_frame(), where the check is made, to receive_file_block()
+// and write_file_block(). The frames are sent ahead in bursts so that
+// only the receiving is timed. It reports what share of the per-block
+// receive time the check costs, and whether that is under the 1% that
+// was asked of it.
+//
+// What the chat class prints goes to the standard error.
+//
+// Usage: crc_bench [block count] [port]
+//
+// See main.c for disclaimers and other information.
+//
+// Fredric L. Rice, June 2018
+// http://www.crystallake.name
+// fred @ crystal lake . name
+//
+// ----------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <dirent.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <vector>
+#include "ChatClass.h"          // The receive path being measured
+#include "ClockClass.h"         // The cached clocks
+#include "IntegrityClass.h"     // The check being measured
+
+// ----------------------------------------------------------------------
+// Defined constants for the benchmark. The file received is a whole
+// number of leaves, sent in blocks which never straddle two of them as
+// a sender's never do, and its blocks are sent again and again until
+// as many as were asked for have been received.
+//
+// ----------------------------------------------------------------------
+
+#define BENCH_DEFAULT_BLOCKS        200000
+#define BENCH_DEFAULT_PORT          6787
+#define BENCH_CRC_ONLY_PASSES       2000000
+#define BENCH_RUN_COUNT             3
+#define BENCH_BURST_BLOCKS          32
+#define BENCH_FILE_LEAVES           16
+#define BENCH_FILE_SIZE             ( (uint64_t)BENCH_FILE_LEAVES * DIGEST_LEAF_SIZE )
+#define BENCH_FILE_BLOCKS           ( BENCH_FILE_SIZE / MAX_OUT_DATA_SIZE )
+#define BENCH_FRAME_SIZE            ( sizeof( file_block_header ) + MAX_OUT_DATA_SIZE )
+#define BENCH_TARGET_PCT            1.0
+#define BENCH_TRANSFER_ID           1
+
+#if DIGEST_LEAF_SIZE % MAX_OUT_DATA_SIZE
+#error "The benchmark's blocks must fit a leaf exactly"
+#endif
+
+// ----------------------------------------------------------------------
+// Local data storage
+//
+// ----------------------------------------------------------------------
+
+    static std::vector<unsigned char> block_frames;
+
+// ----------------------------------------------------------------------
+// Returns the monotonic time in nanoseconds
+//
+// ----------------------------------------------------------------------
+
+static double now_ns( void )
+{
+    struct timespec this_time;
+
+    (void)clock_gettime( CLOCK_MONOTONIC, &this_time );
+
+    return (double)this_time.tv_sec * 1e9 + (double)this_time.tv_nsec;
+}
+
+// ----------------------------------------------------------------------
+// Removes the files in the current directory, which are the files the
+// chat class took in under whatever names it gave them.
+//
+// ----------------------------------------------------------------------
+
+static void remove_files( void )
+{
+    DIR *           this_dir_p   = opendir( "." );
+    struct dirent * this_entry_p = (struct dirent *)NULL;
+
+    if ( (DIR *)NULL == this_dir_p )
+    {
+        return;
+    }
+
+    while ( (struct dirent *)NULL != ( this_entry_p = readdir( this_dir_p ) ) )
+    {
+        if ( DT_REG == this_entry_p->d_type )
+        {
+            (void)unlink( this_entry_p->d_name );
+        }
+    }
+
+    (void)closedir( this_dir_p );
+}
+
+// ----------------------------------------------------------------------
+// Measures the CRC of one frame, averaged across many passes, with the
+// implementation the IntegrityClass selected.
+//
+// Returns: nanoseconds per frame
+//
+// ----------------------------------------------------------------------
+
+static double time_crc_only( IntegrityClass & integrity )
+{
+    unsigned char     * frame_p    = &block_frames[ 0 ];
+    const unsigned char first_byte = frame_p[ 0 ];
+    volatile uint32_t   sink       = 0;
+    double              start_time = now_ns( );
+    int                 this_pass  = 0;
+
+    for ( this_pass = 0; this_pass < BENCH_CRC_ONLY_PASSES; this_pass++ )
+    {
+        frame_p[ 0 ] = (unsigned char)this_pass;
+
+        sink = sink + integrity.integrity_crc32c( frame_p, BENCH_FRAME_SIZE );
+    }
+
+    frame_p[ 0 ] = first_byte;
+
+    return ( now_ns( ) - start_time ) / BENCH_CRC_ONLY_PASSES;
+}
+
+// ----------------------------------------------------------------------
+// Builds a block frame for every block of the file, with its CRC, just
+// as send_file_block() does.
+//
+// ----------------------------------------------------------------------
+
+static void make_block_frames( IntegrityClass & integrity )
+{
+    uint64_t this_block = 0;
+    size_t   this_byte  = 0;
+
+    block_frames.resize( BENCH_FILE_BLOCKS * BENCH_FRAME_SIZE );
+
+    for ( this_byte = 0; this_byte < block_frames.size( ); this_byte++ )
+    {
+        block_frames[ this_byte ] = (unsigned char)( rand( ) & 0xff );
+    }
+
+    for ( this_block = 0; this_block < BENCH_FILE_BLOCKS; this_block++ )
+    {
+        unsigned char   * frame_p = &block_frames[ this_block * BENCH_FRAME_SIZE ];
+        file_block_header block_header;
+
+        (void)memset( (char *)&block_header, ASCII_NULL_ZERO, sizeof( block_header ) );
+        (void)strcpy( block_header.block_command, ":blok:" );
+
+        block_header.block_size   = MAX_OUT_DATA_SIZE;
+        block_header.block_offset = this_block * MAX_OUT_DATA_SIZE;
+        block_header.transfer_id  = BENCH_TRANSFER_ID;
+
+        (void)memcpy( frame_p, (char *)&block_header, sizeof( block_header ) );
+
+        block_header.block_crc = integrity.integrity_crc32c( frame_p, BENCH_FRAME_SIZE );
+
+        (void)memcpy( frame_p, (char *)&block_header, sizeof( block_header ) );
+    }
+}
+
+// ----------------------------------------------------------------------
+// Offers the file to a new ChatClass through the receive socket so that
+// it starts receiving it, then sends it the block frames in bursts and
+// times only the read_data() calls which take them in.
+//
+// Returns: nanoseconds per block, else 0.0 if blocks went missing
+//
+// ----------------------------------------------------------------------
+
+static double time_receive_path( const int block_count, const int port_number )
+{
+    ChatClass            this_chat( port_number + 1, port_number, INADDR_LOOPBACK, false );
+    struct sockaddr_in   to_address;
+    file_transfer_header file_header;
+    const int            send_socket  = socket( AF_INET, SOCK_DGRAM, 0 );
+    int                  this_block   = 0;
+    int                  burst_block  = 0;
+    int                  missing      = 0;
+    double               start_time   = 0.0;
+    double               elapsed_time = 0.0;
+
+    (void)memset( (char *)&to_address, ASCII_NULL_ZERO, sizeof( to_address ) );
+
+    to_address.sin_family      = AF_INET;
+    to_address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+    to_address.sin_port        = htons( port_number );
+
+    if ( send_socket < 0 )
+    {
+        (void)fprintf( stderr, "crc_bench: unable to acquire a socket\n" );
+
+        exit( 1 );
+    }
+
+    // Offer the file, as send_file() does
+    (void)memset( (char *)&file_header, ASCII_NULL_ZERO, sizeof( file_header ) );
+    (void)strcpy( file_header.header_command, ":xfer:" );
+    (void)strcpy( file_header.file_name, "bench.bin" );
+
+    file_header.file_size   = BENCH_FILE_SIZE;
+    file_header.trans_type  = trans_type_send;
+    file_header.transfer_id = BENCH_TRANSFER_ID;
+
+    (void)sendto( send_socket, (char *)&file_header, sizeof( file_header ), 0,
+        (struct sockaddr *)&to_address, sizeof( to_address ) );
+
+    ClockClass::clock_tick( );
+
+    if ( 0 != this_chat.read_data( ) || 1 != this_chat.inbound_transfer_count( ) )
+    {
+        (void)fprintf( stderr, "crc_bench: the chat class did not start receiving the file\n" );
+
+        exit( 1 );
+    }
+
+    for ( this_block = 0; this_block < block_count; this_block += BENCH_BURST_BLOCKS )
+    {
+        const int burst_count = block_count - this_block < BENCH_BURST_BLOCKS ?
+            block_count - this_block : BENCH_BURST_BLOCKS;
+
+        for ( burst_block = 0; burst_block < burst_count; burst_block++ )
+        {
+            const size_t file_block = (size_t)( this_block + burst_block ) % BENCH_FILE_BLOCKS;
+
+            (void)sendto( send_socket, &block_frames[ file_block * BENCH_FRAME_SIZE ], BENCH_FRAME_SIZE, 0,
+                (struct sockaddr *)&to_address, sizeof( to_address ) );
+        }
+
+        // The main loop keeps the clock going as frames come in
+        ClockClass::clock_tick( );
+
+        start_time = now_ns( );
+
+        for ( burst_block = 0; burst_block < burst_count; burst_block++ )
+        {
+            // Every block is taken in to the file, leaving no text
+            if ( 0 != this_chat.read_data( ) )
+            {
+                missing++;
+            }
+        }
+
+        elapsed_time += now_ns( ) - start_time;
+    }
+
+    (void)close( send_socket );
+
+    if ( missing > 0 )
+    {
+        (void)fprintf( stderr, "crc_bench: %d of %d blocks were not taken in\n", missing, block_count );
+
+        return 0.0;
+    }
+
+    return elapsed_time / block_count;
+}
+
+// ----------------------------------------------------------------------
+// main() The main entry point
+//
+// ----------------------------------------------------------------------
+
+int main( const int argc, const char * argv[] )
+{
+    IntegrityClass integrity;
+    char           temp_dir[]   = "/tmp/crc_bench.XXXXXX";
+    FILE         * results_p    = (FILE *)NULL;
+    int            block_count  = BENCH_DEFAULT_BLOCKS;
+    int            port_number  = BENCH_DEFAULT_PORT;
+    int            this_run     = 0;
+    double         crc_ns       = 0.0;
+    double         block_ns     = 0.0;
+    double         check_pct    = 0.0;
+
+    if ( argc > 1 )
+    {
+        block_count = atoi( argv[ 1 ] );
+    }
+
+    if ( argc > 2 )
+    {
+        port_number = atoi( argv[ 2 ] );
+    }
+
+    if ( block_count <= 0 )
+    {
+        block_count = BENCH_DEFAULT_BLOCKS;
+    }
+
+    // The file is received in a directory of our own
+    if ( (char *)NULL == mkdtemp( temp_dir ) || 0 != chdir( temp_dir ) )
+    {
+        (void)fprintf( stderr, "crc_bench: unable to make a work directory\n" );
+
+        return 1;
+    }
+
+    // The results keep the standard output to themselves
+    results_p = fdopen( dup( 1 ), "w" );
+
+    (void)dup2( 2, 1 );
+
+    make_block_frames( integrity );
+
+    crc_ns = time_crc_only( integrity );
+
+    (void)fprintf( results_p, "CRC32C of a %d byte frame (%s): %.1f ns, %.2f GB/s\n",
+        (int)BENCH_FRAME_SIZE,
+        integrity.integrity_has_hardware_crc( ) ? "SSE4.2" : "table",
+        crc_ns, BENCH_FRAME_SIZE / crc_ns );
+
+    // Warm up the socket and the file path, then measure a few times
+    // over, keeping the best to filter out noise
+    (void)time_receive_path( block_count / 10 + 1, port_number );
+
+    remove_files( );
+
+    for ( this_run = 0; this_run < BENCH_RUN_COUNT; this_run++ )
+    {
+        const double run_ns = time_receive_path( block_count, port_number );
+
+        remove_files( );
+
+        if ( run_ns > 0.0 && ( 0.0 == block_ns || run_ns < block_ns ) )
+        {
+            block_ns = run_ns;
+        }
+    }
+
+    (void)chdir( "/" );
+    (void)rmdir( temp_dir );
+
+    if ( 0.0 == block_ns )
+    {
+        (void)fprintf( stderr, "crc_bench: no run took in every block\n" );
+
+        return 1;
+    }
+
+    // The receiver computes the CRC once per block, so that is what the
+    // check costs it. The best run is used, which makes the share the
+    // check takes as large as it gets.
+    check_pct = 100.0 * crc_ns / block_ns;
+
+    (void)fprintf( results_p, "Per-block receive, read_data() through write_file_block(): %.1f ns\n", block_ns );
+    (void)fprintf( results_p, "Receiver check cost: %.3f%% of per-block processing\n", check_pct );
+    (void)fprintf( results_p, "Target of under %.0f%%: %s\n", BENCH_TARGET_PCT,
+        check_pct < BENCH_TARGET_PCT ? "met" : "NOT met" );
+
+    (void)fprintf( results_p, "crc_bench,frame_bytes=%d,crc_ns=%.1f,block_ns=%.1f,check_pct=%.3f,target_met=%s\n",
+        (int)BENCH_FRAME_SIZE, crc_ns, block_ns, check_pct, check_pct < BENCH_TARGET_PCT ? "yes" : "no" );
+
+    (void)fclose( results_p );
+
+    return 0;
+}
@@ -0,0 +1,528 @@
+
+// ----------------------------------------------------------------------
+// latency_bench -- Measures how long chat text takes to be shown by a
+// copy of the chat program, and to come back.
+//
+// The chat program is told to answer latency probes with :echo. This
+// driver sends it probes at a steady rate, each carrying the time it
+// was sent, and the chat program answers every one with the time at
+// which it had shown it. Both times are read from the monotonic clock,
+// which every process on a machine shares, so the one-way time is the
+// time from send_text() to the chat program's printf(), and the round
+// trip is that plus the reply coming back. That makes the one-way time
+// meaningful on the loopback or between network namespaces of one
+// machine, not between machines.
+//
+// Probes are sent on a schedule whether or not the answers to those
+// before them are in, so that a slow answer does not hide the ones
+// which would have queued up behind it.
+//
+// With -e the chat program given is started in a directory of its own
+// and told to answer; otherwise a copy must already be running with
+// echo on. Either way it may have chosen either pair of ports, and the
+// driver takes the other side of whichever pair it chose.
+//
+// The p50, p99, p99.9 and longest times are written as one line of
+// JSON to the standard output, and as text to the standard error, so
+// that the effect of the chat program's main loop, how many frames it
+// takes in at once and how it logs may be compared build to build.
+//
+// Usage: latency_bench [-r probes/s] [-c count] [-s size] [-w warmup]
+//                      [-p port] [-d address] [-e chat program]
+//
+// See main.c for disclaimers and other information.
+//
+// Fredric L. Rice, June 2018
+// http://www.crystallake.name
+// fred @ crystal lake . name
+//
+// ----------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/wait.h>
+#include <vector>
+#include <algorithm>
+#include "ChatClass.h"          // Our end of the conversation
+#include "ChatDefines.h"        // The probe and reply prefixes
+#include "ClockClass.h"         // The cached clocks
+
+// ----------------------------------------------------------------------
+// Defined constants for the benchmark
+//
+// ----------------------------------------------------------------------
+
+#define BENCH_DEFAULT_RATE          1000
+#define BENCH_DEFAULT_COUNT         10000
+#define BENCH_DEFAULT_SIZE          64
+#define BENCH_DEFAULT_WARMUP        100
+#define BENCH_DEFAULT_ADDRESS       "255.255.255.255"
+#define BENCH_FIND_TRIES            50
+#define BENCH_FIND_WAIT_US          100000
+#define BENCH_DRAIN_NS              1000000000ULL
+#define BENCH_MAX_WAIT_US           1000
+#define BENCH_MAX_READS             1024
+
+// ----------------------------------------------------------------------
+// What is known about every probe
+//
+// ----------------------------------------------------------------------
+
+    typedef struct PROBE_TIMES_T
+    {
+        uint64_t sent_ns;                             // When it was sent
+        uint64_t shown_ns;                            // When the chat program showed it
+        uint64_t answered_ns;                         // When its answer came back
+    } probe_times;
+
+// ----------------------------------------------------------------------
+// Local data storage
+//
+// ----------------------------------------------------------------------
+
+    static int                      probe_rate   = BENCH_DEFAULT_RATE;
+    static int                      probe_count  = BENCH_DEFAULT_COUNT;
+    static int                      probe_size   = BENCH_DEFAULT_SIZE;
+    static int                      warmup_count = BENCH_DEFAULT_WARMUP;
+    static std::vector<probe_times> probes;
+    static char                     probe_text[ MAX_CONSOLE_IN_SIZE + 2 ];
+
+// ----------------------------------------------------------------------
+// Sends probe number this_probe.
+//
+// ----------------------------------------------------------------------
+
+static void send_probe( ChatClass & this_chat, const int this_probe )
+{
+    int this_length = 0;
+
+    probes[ this_probe ].sent_ns = ClockClass::clock_precise_ns( );
+
+    this_length = snprintf( probe_text, MAX_CONSOLE_IN_SIZE - 1, "%s%d %llu ", ECHO_PROBE_PREFIX, this_probe,
+        (unsigned long long)probes[ this_probe ].sent_ns );
+
+    // Pad the probe out to the size asked for
+    while ( this_length < probe_size - 1 && this_length < MAX_CONSOLE_IN_SIZE - 2 )
+    {
+        probe_text[ this_length++ ] = 'x';
+    }
+
+    probe_text[ this_length++ ] = ASCII_LINE_FEED;
+    probe_text[ this_length ]   = ASCII_NULL_ZERO;
+
+    this_chat.send_text( probe_text );
+}
+
+// ----------------------------------------------------------------------
+// Takes in the answers which are waiting.
+//
+// Returns: how many answers were taken in
+//
+// ----------------------------------------------------------------------
+
+static int take_answers( ChatClass & this_chat )
+{
+    unsigned long long shown_ns    = 0;
+    unsigned long long sent_ns     = 0;
+    int                this_probe  = 0;
+    int                read_count  = 0;
+    int                this_count  = 0;
+    int                this_read   = 0;
+    char               prefix_text[ 16 ];
+
+    // A socket which did not open reads nothing forever, so only so
+    // many reads are tried at a time
+    for ( this_read = 0; this_read < BENCH_MAX_READS && ( read_count = this_chat.read_data( ) ) >= 0; this_read++ )
+    {
+        if ( read_count > 0 )
+        {
+            char * received_p = this_chat.received_text( );
+
+            received_p[ read_count ] = ASCII_NULL_ZERO;
+
+            if ( 0 == strncmp( received_p, ECHO_REPLY_PREFIX, strlen( ECHO_REPLY_PREFIX ) ) &&
+                4 == sscanf( received_p, "%15s %llu %d %llu", prefix_text, &shown_ns, &this_probe, &sent_ns ) &&
+                this_probe >= 0 && this_probe < (int)probes.size( ) &&
+                sent_ns == probes[ this_probe ].sent_ns && 0 == probes[ this_probe ].answered_ns )
+            {
+                probes[ this_probe ].shown_ns    = shown_ns;
+                probes[ this_probe ].answered_ns = this_chat.last_receive_time( );
+
+                this_count++;
+            }
+        }
+    }
+
+    return this_count;
+}
+
+// ----------------------------------------------------------------------
+// Returns: true if something on this machine already receives on the
+// UDP port passed by argument without sharing it
+//
+// ----------------------------------------------------------------------
+
+static bool port_is_taken( const int this_port_number )
+{
+    const int          probe_socket = socket( AF_INET, SOCK_DGRAM, 0 );
+    const int          enable_reuse = 1;
+    bool               is_taken     = false;
+    struct sockaddr_in this_address;
+
+    (void)memset( (char *)&this_address, 0, sizeof( this_address ) );
+
+    this_address.sin_family      = AF_INET;
+    this_address.sin_port        = htons( this_port_number );
+    this_address.sin_addr.s_addr = htonl( INADDR_ANY );
+
+    (void)setsockopt( probe_socket, SOL_SOCKET, SO_REUSEADDR, &enable_reuse, sizeof( enable_reuse ) );
+
+    is_taken = bind( probe_socket, (struct sockaddr *)&this_address, sizeof( this_address ) ) < 0;
+
+    (void)close( probe_socket );
+
+    return is_taken;
+}
+
+// ----------------------------------------------------------------------
+// Finds which pair of ports the chat program is using: it receives on
+// the base port and sends on the one above it if it was the first copy
+// on its machine, the other way around if not. It does not share the
+// port it receives on, so that is the port we are unable to bind to,
+// once it has started. A probe is then sent until it is answered.
+//
+// Returns: our end of the conversation, or NULL if nobody answered
+//
+// ----------------------------------------------------------------------
+
+static ChatClass * find_responder( const int base_port, const uint32_t destination )
+{
+    ChatClass * this_chat_p = (ChatClass *)NULL;
+    int         their_port  = 0;
+    int         this_try    = 0;
+
+    for ( this_try = 0; this_try < BENCH_FIND_TRIES && 0 == their_port; this_try++ )
+    {
+        if ( true == port_is_taken( base_port ) )
+        {
+            their_port = base_port;
+        }
+        else if ( true == port_is_taken( base_port + 1 ) )
+        {
+            their_port = base_port + 1;
+        }
+        else
+        {
+            usleep( BENCH_FIND_WAIT_US );
+        }
+    }
+
+    if ( 0 == their_port )
+    {
+        return (ChatClass *)NULL;
+    }
+
+    this_chat_p = new ChatClass( their_port, their_port == base_port ? base_port + 1 : base_port,
+        destination, true );
+
+    probes.assign( 1, probe_times( ) );
+
+    for ( this_try = 0; this_try < BENCH_FIND_TRIES; this_try++ )
+    {
+        send_probe( *this_chat_p, 0 );
+
+        usleep( BENCH_FIND_WAIT_US );
+
+        if ( take_answers( *this_chat_p ) > 0 )
+        {
+            return this_chat_p;
+        }
+    }
+
+    delete this_chat_p;
+
+    return (ChatClass *)NULL;
+}
+
+// ----------------------------------------------------------------------
+// Starts the chat program passed by argument in a new directory, with
+// echo on.
+//
+// Returns: the pipe which is its console, or -1 if it could not start
+//
+// ----------------------------------------------------------------------
+
+static int start_responder( const char * program_p, char * directory_p, pid_t & this_pid )
+{
+    int         console_pipe[ 2 ];
+    const char  echo_command[ ] = ":echo\n";
+    char        full_path[ PATH_MAX ];
+
+    if ( (char *)NULL == realpath( program_p, full_path ) || (char *)NULL == mkdtemp( directory_p ) ||
+        0 != pipe( console_pipe ) || ( this_pid = fork( ) ) < 0 )
+    {
+        return -1;
+    }
+
+    if ( 0 == this_pid )
+    {
+        const int null_handle = open( "/dev/null", O_WRONLY );
+
+        (void)dup2( console_pipe[ 0 ], 0 );
+        (void)dup2( null_handle, 1 );
+        (void)close( console_pipe[ 1 ] );
+
+        if ( 0 == chdir( directory_p ) )
+        {
+            (void)execl( full_path, full_path, (char *)NULL );
+        }
+
+        _exit( 1 );
+    }
+
+    (void)close( console_pipe[ 0 ] );
+
+    if ( (ssize_t)strlen( echo_command ) != write( console_pipe[ 1 ], echo_command, strlen( echo_command ) ) )
+    {
+        return -1;
+    }
+
+    return console_pipe[ 1 ];
+}
+
+// ----------------------------------------------------------------------
+// Stops the chat program we started and removes what it left behind.
+//
+// ----------------------------------------------------------------------
+
+static void stop_responder( const int console_handle, const pid_t this_pid, const char * directory_p )
+{
+    const char      exit_command[ ] = "exit\n";
+    DIR *           this_dir_p      = (DIR *)NULL;
+    struct dirent * this_entry_p    = (struct dirent *)NULL;
+    char            this_name[ PATH_MAX ];
+
+    if ( (ssize_t)strlen( exit_command ) != write( console_handle, exit_command, strlen( exit_command ) ) )
+    {
+        (void)kill( this_pid, SIGTERM );
+    }
+
+    (void)close( console_handle );
+    (void)waitpid( this_pid, (int *)NULL, 0 );
+
+    if ( (DIR *)NULL != ( this_dir_p = opendir( directory_p ) ) )
+    {
+        while ( (struct dirent *)NULL != ( this_entry_p = readdir( this_dir_p ) ) )
+        {
+            if ( '.' != this_entry_p->d_name[ 0 ] )
+            {
+                (void)snprintf( this_name, sizeof( this_name ), "%s/%s", directory_p, this_entry_p->d_name );
+                (void)unlink( this_name );
+            }
+        }
+
+        (void)closedir( this_dir_p );
+    }
+
+    (void)rmdir( directory_p );
+}
+
+// ----------------------------------------------------------------------
+// Returns: the time which the percent passed by argument of the sorted
+// times are at or below, in microseconds
+//
+// ----------------------------------------------------------------------
+
+static double percentile_us( const std::vector<uint64_t> & these_times, const double this_percent )
+{
+    size_t this_index = 0;
+
+    if ( true == these_times.empty( ) )
+    {
+        return 0.0;
+    }
+
+    this_index = (size_t)( these_times.size( ) * this_percent / 100.0 + 0.999999 );
+
+    if ( this_index > 0 )
+    {
+        this_index--;
+    }
+
+    if ( this_index >= these_times.size( ) )
+    {
+        this_index = these_times.size( ) - 1;
+    }
+
+    return these_times[ this_index ] / 1e3;
+}
+
+// ----------------------------------------------------------------------
+// main() The main entry point
+//
+// ----------------------------------------------------------------------
+
+int main( int argc, char *argv[ ] )
+{
+    std::vector<uint64_t> one_way_times;
+    std::vector<uint64_t> round_trip_times;
+    ChatClass *           this_chat_p      = (ChatClass *)NULL;
+    const char *          address_p        = BENCH_DEFAULT_ADDRESS;
+    const char *          program_p        = (const char *)NULL;
+    char                  directory[ ]     = "/tmp/latency_bench.XXXXXX";
+    int                   base_port        = DEFAULT_UDP_PORT_BASE;
+    int                   console_handle   = -1;
+    pid_t                 responder_pid    = 0;
+    int                   this_option      = 0;
+    int                   next_probe       = 0;
+    int                   answered_count   = 0;
+    uint64_t              start_ns         = 0;
+    uint64_t              interval_ns      = 0;
+    uint64_t              now_ns           = 0;
+    uint64_t              give_up_ns       = 0;
+    struct in_addr        this_address;
+
+    while ( -1 != ( this_option = getopt( argc, argv, "r:c:s:w:p:d:e:" ) ) )
+    {
+        switch ( this_option )
+        {
+            case 'r': probe_rate   = atoi( optarg ); break;
+            case 'c': probe_count  = atoi( optarg ); break;
+            case 's': probe_size   = atoi( optarg ); break;
+            case 'w': warmup_count = atoi( optarg ); break;
+            case 'p': base_port    = atoi( optarg ); break;
+            case 'd': address_p    = optarg;         break;
+            case 'e': program_p    = optarg;         break;
+
+            default:
+                (void)fprintf( stderr, "Usage: latency_bench [-r probes/s] [-c count] [-s size] [-w warmup]\n"
+                    "                     [-p port] [-d address] [-e chat program]\n" );
+
+                return 1;
+        }
+    }
+
+    if ( probe_rate < 1 || probe_count < 1 || warmup_count < 0 || 0 == inet_aton( address_p, &this_address ) )
+    {
+        (void)fprintf( stderr, "latency_bench: a rate, a count and an IPv4 address, please\n" );
+
+        return 1;
+    }
+
+    if ( (const char *)NULL != program_p &&
+        ( console_handle = start_responder( program_p, directory, responder_pid ) ) < 0 )
+    {
+        (void)fprintf( stderr, "latency_bench: unable to start %s\n", program_p );
+
+        return 1;
+    }
+
+    if ( (ChatClass *)NULL == ( this_chat_p = find_responder( base_port, ntohl( this_address.s_addr ) ) ) )
+    {
+        (void)fprintf( stderr, "latency_bench: no chat program with echo on answered on ports %d and %d\n",
+            base_port, base_port + 1 );
+
+        if ( console_handle >= 0 )
+        {
+            stop_responder( console_handle, responder_pid, directory );
+        }
+
+        return 1;
+    }
+
+    // Send the probes on schedule, taking in the answers in between
+    probes.assign( warmup_count + probe_count, probe_times( ) );
+
+    interval_ns = 1000000000ULL / probe_rate;
+    start_ns    = ClockClass::clock_precise_ns( );
+    give_up_ns  = ~0ULL;
+
+    while ( answered_count < (int)probes.size( ) )
+    {
+        now_ns = ClockClass::clock_precise_ns( );
+
+        if ( next_probe < (int)probes.size( ) && now_ns >= start_ns + next_probe * interval_ns )
+        {
+            send_probe( *this_chat_p, next_probe++ );
+
+            // Answers which have not come in a second after the last
+            // probe are not coming
+            if ( next_probe == (int)probes.size( ) )
+            {
+                give_up_ns = now_ns + BENCH_DRAIN_NS;
+            }
+
+            continue;
+        }
+
+        if ( now_ns >= give_up_ns )
+        {
+            break;
+        }
+
+        answered_count += take_answers( *this_chat_p );
+
+        // Wait for an answer, but no longer than until the next probe
+        if ( next_probe < (int)probes.size( ) )
+        {
+            const uint64_t due_ns = start_ns + next_probe * interval_ns;
+
+            (void)this_chat_p->wait_for_input( HANDLE_NOT_VALID,
+                due_ns > now_ns ? (int)std::min( ( due_ns - now_ns ) / 1000, (uint64_t)BENCH_MAX_WAIT_US ) : 0 );
+        }
+        else
+        {
+            (void)this_chat_p->wait_for_input( HANDLE_NOT_VALID, BENCH_MAX_WAIT_US );
+        }
+    }
+
+    delete this_chat_p;
+
+    if ( console_handle >= 0 )
+    {
+        stop_responder( console_handle, responder_pid, directory );
+    }
+
+    // Only the probes after the warmup count
+    for ( next_probe = warmup_count; next_probe < (int)probes.size( ); next_probe++ )
+    {
+        if ( 0 != probes[ next_probe ].answered_ns )
+        {
+            one_way_times.push_back( probes[ next_probe ].shown_ns - probes[ next_probe ].sent_ns );
+            round_trip_times.push_back( probes[ next_probe ].answered_ns - probes[ next_probe ].sent_ns );
+        }
+    }
+
+    std::sort( one_way_times.begin( ), one_way_times.end( ) );
+    std::sort( round_trip_times.begin( ), round_trip_times.end( ) );
+
+    (void)printf( "{\"bench\":\"latency\",\"count\":%d,\"rate\":%d,\"size\":%d,\"answered\":%u,\"lost\":%u,"
+        "\"one_way_p50_us\":%.1f,\"one_way_p99_us\":%.1f,\"one_way_p999_us\":%.1f,\"one_way_max_us\":%.1f,"
+        "\"rtt_p50_us\":%.1f,\"rtt_p99_us\":%.1f,\"rtt_p999_us\":%.1f,\"rtt_max_us\":%.1f}\n",
+        probe_count, probe_rate, probe_size, (unsigned int)one_way_times.size( ),
+        (unsigned int)( probe_count - one_way_times.size( ) ),
+        percentile_us( one_way_times, 50.0 ), percentile_us( one_way_times, 99.0 ),
+        percentile_us( one_way_times, 99.9 ), percentile_us( one_way_times, 100.0 ),
+        percentile_us( round_trip_times, 50.0 ), percentile_us( round_trip_times, 99.0 ),
+        percentile_us( round_trip_times, 99.9 ), percentile_us( round_trip_times, 100.0 ) );
+
+    (void)fprintf( stderr, "%u of %d probes answered at %d/s\n"
+        "  one-way    p50 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n"
+        "  round trip p50 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n",
+        (unsigned int)one_way_times.size( ), probe_count, probe_rate,
+        percentile_us( one_way_times, 50.0 ), percentile_us( one_way_times, 99.0 ),
+        percentile_us( one_way_times, 99.9 ), percentile_us( one_way_times, 100.0 ),
+        percentile_us( round_trip_times, 50.0 ), percentile_us( round_trip_times, 99.0 ),
+        percentile_us( round_trip_times, 99.9 ), percentile_us( round_trip_times, 100.0 ) );
+
+    return 0;
+}
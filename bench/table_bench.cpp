@@ -0,0 +1,483 @@
+
+// ----------------------------------------------------------------------
+// table_bench -- Benchmark of the table of files being received, with
+// as many sending devices as asked for.
+//
+// Every file being received has an entry in ChatClass's table, found
+// by the IP address of the device sending it and its transfer ID. This
+// feeds a ChatClass made-up frames through receive_frame(), the way
+// read_data() would, from devices numbered 10.0.0.0 upwards, so that
+// the table may be filled with tens of thousands of entries without
+// that many machines. For every number of devices it reports:
+//
+//  - how long it took each file transfer header to start a transfer
+//  - lookups per second: damaged block frames for devices picked at
+//    random, so that what is timed is finding the entry rather than
+//    writing to the disk
+//  - misses per second: the same for a device which is sending nothing
+//  - how long transfer_timed_out() takes when nothing has timed out,
+//    which the main loop calls every time around
+//  - how long it takes when every transfer has timed out, which means
+//    waiting out the transfer timeout once for every number of devices,
+//    cut short to a second for the benchmark
+//  - how long the ChatClass destructor takes to let go of them all
+//
+// One line of JSON is written to the standard output per number of
+// devices. What the chat class prints goes nowhere.
+//
+// Every entry keeps its file open, so the number of devices is limited
+// by how many files a process may open. The chat class is told it may
+// receive that many files at once. The limit is raised as far as
+// it may be; numbers of devices beyond it are reported as skipped.
+//
+// Usage: table_bench [-n devices[,devices...]] [-t ms] [-p port] [-w dir]
+//
+// See main.c for disclaimers and other information.
+//
+// Fredric L. Rice, June 2018
+// http://www.crystallake.name
+// fred @ crystal lake . name
+//
+// ----------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <arpa/inet.h>
+#include <sys/resource.h>
+#include <string>
+#include <vector>
+#include "ChatClass.h"          // The code being measured
+#include "ClockClass.h"         // The cached clocks
+#include "IntegrityClass.h"     // To damage block frames on purpose
+
+// ----------------------------------------------------------------------
+// Defined constants for the benchmark
+//
+// ----------------------------------------------------------------------
+
+#define BENCH_DEFAULT_DEVICES       "10,100,1000,10000,100000"
+#define BENCH_DEFAULT_MS            200
+#define BENCH_DEFAULT_PORT          6877
+#define BENCH_SPARE_FILES           64
+#define BENCH_FILE_SIZE             MAX_OUT_DATA_SIZE
+#define BENCH_BLOCK_SIZE            16
+#define BENCH_RANDOM_PEERS          4096
+#define BENCH_CHECK_EVERY           64
+#define BENCH_TICK_EVERY            1024
+#define BENCH_TRANSFER_TIMEOUT_MS   1000
+#define BENCH_MISSING_DEVICE        "192.0.2.1"
+
+// ----------------------------------------------------------------------
+// Local data storage
+//
+// ----------------------------------------------------------------------
+
+    static int                      measure_ms   = BENCH_DEFAULT_MS;
+    static int                      base_port    = BENCH_DEFAULT_PORT;
+    static FILE *                   results_p    = (FILE *)NULL;
+    static std::vector<std::string> device_addresses;
+    static std::vector<uint32_t>    random_devices;
+    static char                     block_frame[ sizeof( file_block_header ) + BENCH_BLOCK_SIZE ];
+    static uint32_t                 damaged_crc  = 0;
+
+// ----------------------------------------------------------------------
+// Removes the files in the current directory, which are the files the
+// chat class started receiving.
+//
+// ----------------------------------------------------------------------
+
+static void remove_files( void )
+{
+    DIR *           this_dir_p   = opendir( "." );
+    struct dirent * this_entry_p = (struct dirent *)NULL;
+
+    if ( (DIR *)NULL == this_dir_p )
+    {
+        return;
+    }
+
+    while ( (struct dirent *)NULL != ( this_entry_p = readdir( this_dir_p ) ) )
+    {
+        if ( DT_REG == this_entry_p->d_type )
+        {
+            (void)unlink( this_entry_p->d_name );
+        }
+    }
+
+    (void)closedir( this_dir_p );
+}
+
+// ----------------------------------------------------------------------
+// Makes the addresses of the devices, a random order in which to visit
+// them, and a block frame which will never pass its CRC check.
+//
+// ----------------------------------------------------------------------
+
+static void make_devices( const uint32_t device_count )
+{
+    file_block_header block_header;
+    IntegrityClass    integrity;
+    uint32_t          this_seed   = 0x9e3779b9U;
+    uint32_t          this_device = 0;
+    char              this_address[ SENT_CTRL_IP_SIZE ];
+
+    for ( this_device = device_addresses.size( ); this_device < device_count; this_device++ )
+    {
+        (void)snprintf( this_address, sizeof( this_address ), "10.%u.%u.%u",
+            ( this_device >> 16 ) & 255, ( this_device >> 8 ) & 255, this_device & 255 );
+
+        device_addresses.push_back( this_address );
+    }
+
+    random_devices.resize( BENCH_RANDOM_PEERS );
+
+    for ( this_device = 0; this_device < BENCH_RANDOM_PEERS; this_device++ )
+    {
+        this_seed ^= this_seed << 13;
+        this_seed ^= this_seed >> 17;
+        this_seed ^= this_seed << 5;
+
+        random_devices[ this_device ] = this_seed % device_count;
+    }
+
+    (void)memset( (char *)&block_header, 0, sizeof( block_header ) );
+    (void)memset( block_frame, 'x', sizeof( block_frame ) );
+
+    (void)strcpy( block_header.block_command, ":blok:" );
+
+    block_header.block_size  = BENCH_BLOCK_SIZE;
+    block_header.transfer_id = 1;
+
+    (void)memcpy( block_frame, (char *)&block_header, sizeof( block_header ) );
+
+    damaged_crc = ~integrity.integrity_crc32c( block_frame, sizeof( block_frame ) );
+}
+
+// ----------------------------------------------------------------------
+// Has every device start sending a file.
+//
+// Returns: the nanoseconds it took
+//
+// ----------------------------------------------------------------------
+
+static uint64_t start_transfers( ChatClass & this_chat, const uint32_t device_count )
+{
+    file_transfer_header file_header;
+    uint64_t             start_ns    = 0;
+    uint32_t             this_device = 0;
+
+    (void)memset( (char *)&file_header, 0, sizeof( file_header ) );
+
+    (void)strcpy( file_header.header_command, ":xfer:" );
+
+    file_header.file_size   = BENCH_FILE_SIZE;
+    file_header.trans_type  = trans_type_send;
+    file_header.transfer_id = 1;
+
+    ClockClass::clock_tick( );
+
+    start_ns = ClockClass::clock_precise_ns( );
+
+    for ( this_device = 0; this_device < device_count; this_device++ )
+    {
+        char this_frame[ sizeof( file_header ) ];
+
+        (void)snprintf( file_header.file_name, sizeof( file_header.file_name ), "d%u.", this_device );
+        (void)memcpy( this_frame, (char *)&file_header, sizeof( file_header ) );
+
+        (void)this_chat.receive_frame( this_frame, sizeof( this_frame ), device_addresses[ this_device ].c_str( ) );
+
+        // The main loop keeps the clock going as frames come in
+        if ( 0 == this_device % BENCH_TICK_EVERY )
+        {
+            ClockClass::clock_tick( );
+        }
+    }
+
+    return ClockClass::clock_precise_ns( ) - start_ns;
+}
+
+// ----------------------------------------------------------------------
+// Feeds damaged block frames from the devices in random order, or from
+// a device which is sending nothing, for the time asked for.
+//
+// Returns: the nanoseconds per frame
+//
+// ----------------------------------------------------------------------
+
+static double time_lookups( ChatClass & this_chat, const bool want_miss )
+{
+    const uint64_t end_ns      = ClockClass::clock_precise_ns( ) + (uint64_t)measure_ms * 1000000ULL;
+    uint64_t       start_ns    = ClockClass::clock_precise_ns( );
+    uint64_t       now_ns      = start_ns;
+    uint64_t       frame_count = 0;
+
+    while ( now_ns < end_ns )
+    {
+        const char * address_p = want_miss ? BENCH_MISSING_DEVICE :
+            device_addresses[ random_devices[ frame_count % BENCH_RANDOM_PEERS ] ].c_str( );
+
+        // Checking the frame zeroes the CRC in it, so put it back
+        (void)memcpy( block_frame + offsetof( file_block_header, block_crc ), &damaged_crc, sizeof( damaged_crc ) );
+
+        (void)this_chat.receive_frame( block_frame, sizeof( block_frame ), address_p );
+
+        if ( 0 == ++frame_count % BENCH_CHECK_EVERY )
+        {
+            now_ns = ClockClass::clock_precise_ns( );
+        }
+    }
+
+    return (double)( now_ns - start_ns ) / frame_count;
+}
+
+// ----------------------------------------------------------------------
+// Checks for timed out transfers, when none have, for the time asked
+// for.
+//
+// Returns: the nanoseconds per check
+//
+// ----------------------------------------------------------------------
+
+static double time_idle_sweeps( ChatClass & this_chat )
+{
+    const uint64_t end_ns      = ClockClass::clock_precise_ns( ) + (uint64_t)measure_ms * 1000000ULL;
+    uint64_t       start_ns    = ClockClass::clock_precise_ns( );
+    uint64_t       now_ns      = start_ns;
+    uint64_t       sweep_count = 0;
+
+    while ( now_ns < end_ns )
+    {
+        (void)this_chat.transfer_timed_out( );
+
+        sweep_count++;
+
+        now_ns = ClockClass::clock_precise_ns( );
+    }
+
+    return (double)( now_ns - start_ns ) / sweep_count;
+}
+
+// ----------------------------------------------------------------------
+// Runs the benchmark for one number of devices and writes its results.
+//
+// Returns: true if it ran
+//
+// ----------------------------------------------------------------------
+
+static bool run_devices( const uint32_t device_count, const rlim_t file_limit )
+{
+    ChatClass * this_chat_p    = (ChatClass *)NULL;
+    uint64_t    start_ns       = 0;
+    uint64_t    destroy_ns     = 0;
+    uint64_t    expiry_ns      = 0;
+    double      lookup_ns      = 0.0;
+    double      miss_ns        = 0.0;
+    double      idle_sweep_ns  = 0.0;
+    size_t      started_count  = 0;
+    size_t      refill_count   = 0;
+    size_t      expired_count  = 0;
+    uint64_t    expire_ns      = 0;
+
+    if ( (rlim_t)device_count + BENCH_SPARE_FILES > file_limit )
+    {
+        (void)fprintf( results_p, "{\"bench\":\"table\",\"devices\":%u,\"skipped\":\"needs %u open files, "
+            "the limit is %llu\"}\n", device_count, device_count + BENCH_SPARE_FILES, (unsigned long long)file_limit );
+        (void)fflush( results_p );
+
+        return true;
+    }
+
+    make_devices( device_count );
+
+    // Fill the table and take the measurements which leave it full
+    this_chat_p = new ChatClass( base_port, base_port + 1, INADDR_LOOPBACK, true );
+
+    this_chat_p->set_admission_limits( device_count, UINT64_MAX, device_count );
+
+    start_ns      = start_transfers( *this_chat_p, device_count );
+    started_count = this_chat_p->inbound_transfer_count( );
+    lookup_ns     = time_lookups( *this_chat_p, false );
+    miss_ns       = time_lookups( *this_chat_p, true );
+
+    ClockClass::clock_tick( );
+
+    idle_sweep_ns = time_idle_sweeps( *this_chat_p );
+
+    destroy_ns = ClockClass::clock_precise_ns( );
+
+    delete this_chat_p;
+
+    destroy_ns = ClockClass::clock_precise_ns( ) - destroy_ns;
+
+    remove_files( );
+
+    // Fill it again and wait until every transfer has timed out
+    this_chat_p = new ChatClass( base_port, base_port + 1, INADDR_LOOPBACK, true );
+
+    this_chat_p->set_transfer_timeout( transfer_class_data, BENCH_TRANSFER_TIMEOUT_MS );
+    this_chat_p->set_admission_limits( device_count, UINT64_MAX, device_count );
+
+    (void)start_transfers( *this_chat_p, device_count );
+
+    refill_count = this_chat_p->inbound_transfer_count( );
+
+    // Wait out the timeout and the tick a timer may have been rounded up by
+    ClockClass::clock_tick( );
+
+    expire_ns = ClockClass::clock_monotonic_ns( ) +
+        (uint64_t)( BENCH_TRANSFER_TIMEOUT_MS + 2 * TRANSFER_WHEEL_TICK_MS ) * 1000000ULL;
+
+    while ( ClockClass::clock_monotonic_ns( ) < expire_ns )
+    {
+        (void)usleep( TRANSFER_WHEEL_TICK_MS * 1000 );
+
+        ClockClass::clock_tick( );
+    }
+
+    expiry_ns = ClockClass::clock_precise_ns( );
+
+    (void)this_chat_p->transfer_timed_out( );
+
+    expiry_ns     = ClockClass::clock_precise_ns( ) - expiry_ns;
+    expired_count = refill_count - this_chat_p->inbound_transfer_count( );
+
+    delete this_chat_p;
+
+    remove_files( );
+
+    (void)fprintf( results_p, "{\"bench\":\"table\",\"devices\":%u,\"started\":%u,\"start_us\":%.2f,"
+        "\"lookups_per_s\":%.0f,\"lookup_ns\":%.0f,\"misses_per_s\":%.0f,\"miss_ns\":%.0f,"
+        "\"idle_sweep_us\":%.2f,\"expired\":%u,\"expiry_sweep_ms\":%.3f,\"destroy_ms\":%.3f}\n",
+        device_count, (unsigned int)started_count, start_ns / 1e3 / device_count,
+        1e9 / lookup_ns, lookup_ns, 1e9 / miss_ns, miss_ns,
+        idle_sweep_ns / 1e3, (unsigned int)expired_count, expiry_ns / 1e6, destroy_ns / 1e6 );
+    (void)fflush( results_p );
+
+    return started_count == device_count && expired_count == device_count;
+}
+
+// ----------------------------------------------------------------------
+// main() The main entry point
+//
+// ----------------------------------------------------------------------
+
+int main( int argc, char *argv[ ] )
+{
+    std::vector<uint32_t> device_counts;
+    std::string           device_list   = BENCH_DEFAULT_DEVICES;
+    const char *          given_dir_p   = (const char *)NULL;
+    char                  temp_dir[ ]   = "/tmp/table_bench.XXXXXX";
+    std::string           work_dir;
+    int                   this_option   = 0;
+    size_t                this_count    = 0;
+    size_t                list_start    = 0;
+    int                   exit_code     = 0;
+    int                   null_handle   = -1;
+    struct rlimit         file_limit;
+
+    while ( -1 != ( this_option = getopt( argc, argv, "n:t:p:w:" ) ) )
+    {
+        switch ( this_option )
+        {
+            case 'n': device_list = optarg;         break;
+            case 't': measure_ms  = atoi( optarg ); break;
+            case 'p': base_port   = atoi( optarg ); break;
+            case 'w': given_dir_p = optarg;         break;
+
+            default:
+                (void)fprintf( stderr, "Usage: table_bench [-n devices[,devices...]] [-t ms] [-p port] [-w dir]\n" );
+
+                return 1;
+        }
+    }
+
+    // The numbers of devices, each of which must fit in 10.0.0.0/8
+    while ( list_start <= device_list.size( ) )
+    {
+        size_t list_end = device_list.find( ',', list_start );
+
+        if ( std::string::npos == list_end )
+        {
+            list_end = device_list.size( );
+        }
+
+        this_count = strtoul( device_list.substr( list_start, list_end - list_start ).c_str( ), (char **)NULL, 10 );
+
+        if ( 0 == this_count || this_count >= ( 1U << 24 ) )
+        {
+            (void)fprintf( stderr, "table_bench: numbers of devices run from 1 to %u\n", ( 1U << 24 ) - 1 );
+
+            return 1;
+        }
+
+        device_counts.push_back( (uint32_t)this_count );
+
+        list_start = list_end + 1;
+    }
+
+    if ( measure_ms < 1 )
+    {
+        (void)fprintf( stderr, "table_bench: measure for at least a millisecond, please\n" );
+
+        return 1;
+    }
+
+    // Every entry holds a file open, so allow as many as we may
+    (void)getrlimit( RLIMIT_NOFILE, &file_limit );
+
+    file_limit.rlim_cur = file_limit.rlim_max;
+
+    (void)setrlimit( RLIMIT_NOFILE, &file_limit );
+    (void)getrlimit( RLIMIT_NOFILE, &file_limit );
+
+    // The files are received in a directory of our own
+    if ( (const char *)NULL != given_dir_p )
+    {
+        work_dir = given_dir_p;
+    }
+    else if ( (char *)NULL != mkdtemp( temp_dir ) )
+    {
+        work_dir = temp_dir;
+    }
+    else
+    {
+        (void)fprintf( stderr, "table_bench: unable to make a work directory\n" );
+
+        return 1;
+    }
+
+    if ( 0 != chdir( work_dir.c_str( ) ) )
+    {
+        (void)fprintf( stderr, "table_bench: unable to work in %s\n", work_dir.c_str( ) );
+
+        return 1;
+    }
+
+    // The results keep the standard output to themselves
+    results_p   = fdopen( dup( 1 ), "w" );
+    null_handle = open( "/dev/null", O_WRONLY );
+
+    (void)dup2( null_handle, 1 );
+    (void)close( null_handle );
+
+    for ( this_count = 0; this_count < device_counts.size( ); this_count++ )
+    {
+        if ( false == run_devices( device_counts[ this_count ], file_limit.rlim_cur ) )
+        {
+            exit_code = 1;
+        }
+    }
+
+    if ( (const char *)NULL == given_dir_p && 0 == chdir( "/" ) )
+    {
+        (void)rmdir( work_dir.c_str( ) );
+    }
+
+    return exit_code;
+}
@@ -0,0 +1,608 @@
+
+// ----------------------------------------------------------------------
+// transfer_bench -- Benchmark of whole file transfers on one machine.
+//
+// A sender and a number of receivers, each a process of its own with
+// a ChatClass of its own, send files of the sizes asked for to each
+// other through the loopback broadcast address, running the same loop
+// that main() runs: take in the frames waiting, service the transfers,
+// check for timeouts, then sleep. The receivers write the files to the
+// disk and check them against their digests, asking for repairs just
+// as the chat program does.
+//
+// For every size one line of JSON is written to the standard output
+// so that runs of different builds may be compared by a script:
+//
+//  - seconds and MB/s from the file being offered until the last
+//    receiver verified it
+//  - block frames sent per second
+//  - CPU seconds per GB of file, for the sender and for a receiver
+//  - the share of block frames sent which no receiver took in, and
+//    how many repairs that cost
+//
+// What the chat classes print goes to the standard error.
+//
+// Usage: transfer_bench [-n receivers] [-s size[,size...]] [-l loop us]
+//                       [-p port] [-d address] [-t timeout s] [-w dir]
+//
+// The files are made and received under a new directory in /tmp unless
+// another directory is given, which is left in place.
+//
+// Sizes may end in K, M or G. The loopback broadcast address is used
+// unless another is given; to run in a network namespace of its own,
+// run it under "unshare -rn" having brought up lo, and give -d
+// 255.255.255.255 if the namespace has no loopback broadcast route.
+//
+// See main.c for disclaimers and other information.
+//
+// Fredric L. Rice, June 2018
+// http://www.crystallake.name
+// fred @ crystal lake . name
+//
+// ----------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <string>
+#include <vector>
+#include "ChatClass.h"          // The code being measured
+#include "ChatDefines.h"        // The shape of the main loop
+#include "ClockClass.h"         // The cached clocks
+#include "MetricsClass.h"       // What was sent and received
+
+// ----------------------------------------------------------------------
+// Defined constants for the benchmark
+//
+// ----------------------------------------------------------------------
+
+#define BENCH_DEFAULT_RECEIVERS     2
+#define BENCH_DEFAULT_SIZES         "1K,1M,16M"
+#define BENCH_DEFAULT_PORT          6777
+#define BENCH_DEFAULT_ADDRESS       "127.255.255.255"
+#define BENCH_DEFAULT_TIMEOUT       300
+#define BENCH_MAX_RECEIVERS         64
+#define BENCH_FILE_NAME             "bench.bin"
+#define BENCH_WRITE_CHUNK           ( 1024 * 1024 )
+
+// ----------------------------------------------------------------------
+// What a receiver reports when it is done
+//
+// ----------------------------------------------------------------------
+
+    typedef struct RECEIVER_RESULT_T
+    {
+        uint64_t verified;                            // Files verified
+        uint64_t failed;                              // Files which failed or timed out
+        uint64_t blocks_in;                           // Block frames taken in
+        uint64_t bytes_in;                            // Bytes of block frames taken in
+        uint64_t repairs_sent;                        // Repair requests sent
+        uint64_t cpu_ns;                              // CPU time used
+    } receiver_result;
+
+// ----------------------------------------------------------------------
+// Local data storage
+//
+// ----------------------------------------------------------------------
+
+    static int                receiver_count = BENCH_DEFAULT_RECEIVERS;
+    static int                loop_delay_us  = MAIN_LOOP_SLEEP_DELAY;
+    static int                base_port      = BENCH_DEFAULT_PORT;
+    static int                timeout_sec    = BENCH_DEFAULT_TIMEOUT;
+    static uint32_t           destination    = 0;
+    static const char *       given_dir_p    = (const char *)NULL;
+    static FILE *             results_p      = (FILE *)NULL;
+    static metrics_snapshot   before_snapshot;
+    static metrics_snapshot   after_snapshot;
+
+// ----------------------------------------------------------------------
+// Returns the CPU time this process has used in nanoseconds
+//
+// ----------------------------------------------------------------------
+
+static uint64_t cpu_ns( void )
+{
+    struct rusage this_usage;
+
+    (void)getrusage( RUSAGE_SELF, &this_usage );
+
+    return ( (uint64_t)this_usage.ru_utime.tv_sec + (uint64_t)this_usage.ru_stime.tv_sec ) * 1000000000ULL +
+        ( (uint64_t)this_usage.ru_utime.tv_usec + (uint64_t)this_usage.ru_stime.tv_usec ) * 1000ULL;
+}
+
+// ----------------------------------------------------------------------
+// Turns a size such as 64K or 1G in to bytes
+//
+// Returns: 0 if it is not a size
+//
+// ----------------------------------------------------------------------
+
+static uint64_t parse_size( const char * size_p )
+{
+    char *   end_p      = (char *)NULL;
+    uint64_t this_size  = strtoull( size_p, &end_p, 10 );
+
+    switch ( *end_p )
+    {
+        case 'k': case 'K': this_size <<= 10; end_p++; break;
+        case 'm': case 'M': this_size <<= 20; end_p++; break;
+        case 'g': case 'G': this_size <<= 30; end_p++; break;
+        default: break;
+    }
+
+    return ( 0 == *end_p ) ? this_size : 0;
+}
+
+// ----------------------------------------------------------------------
+// Writes a file of pseudo-random bytes of the size passed by argument
+//
+// Returns: true if it was written
+//
+// ----------------------------------------------------------------------
+
+static bool make_file( const char * path_and_name_p, uint64_t this_size )
+{
+    std::vector<uint32_t> this_chunk( BENCH_WRITE_CHUNK / sizeof( uint32_t ) );
+    uint32_t              this_seed = 0x9e3779b9U;
+    FILE *                out_p     = fopen( path_and_name_p, "wb" );
+    size_t                this_word = 0;
+
+    if ( (FILE *)NULL == out_p )
+    {
+        return false;
+    }
+
+    while ( this_size > 0 )
+    {
+        const size_t these_bytes = this_size < BENCH_WRITE_CHUNK ? (size_t)this_size : BENCH_WRITE_CHUNK;
+
+        for ( this_word = 0; this_word < this_chunk.size( ); this_word++ )
+        {
+            this_seed ^= this_seed << 13;
+            this_seed ^= this_seed >> 17;
+            this_seed ^= this_seed << 5;
+
+            this_chunk[ this_word ] = this_seed;
+        }
+
+        if ( these_bytes != fwrite( &this_chunk[ 0 ], 1, these_bytes, out_p ) )
+        {
+            (void)fclose( out_p );
+
+            return false;
+        }
+
+        this_size -= these_bytes;
+    }
+
+    return 0 == fclose( out_p );
+}
+
+// ----------------------------------------------------------------------
+// One pass of the main loop, the way main() does it, without the
+// sleep.
+//
+// Returns: true if every frame waiting was taken in
+//
+// ----------------------------------------------------------------------
+
+static bool loop_pass( ChatClass & this_chat )
+{
+    int frame_count = 0;
+
+    ClockClass::clock_tick( );
+
+    for ( frame_count = 0; frame_count < MAX_FRAMES_PER_LOOP; frame_count++ )
+    {
+        if ( this_chat.read_data( ) < 0 )
+        {
+            break;
+        }
+    }
+
+    (void)this_chat.service_transfers( );
+    (void)this_chat.transfer_timed_out( );
+
+    return frame_count < MAX_FRAMES_PER_LOOP;
+}
+
+// ----------------------------------------------------------------------
+// Removes the files in the current directory, which are the files a
+// receiver took in under whatever names it gave them.
+//
+// ----------------------------------------------------------------------
+
+static void remove_files( void )
+{
+    DIR *           this_dir_p   = opendir( "." );
+    struct dirent * this_entry_p = (struct dirent *)NULL;
+
+    if ( (DIR *)NULL == this_dir_p )
+    {
+        return;
+    }
+
+    while ( (struct dirent *)NULL != ( this_entry_p = readdir( this_dir_p ) ) )
+    {
+        if ( DT_REG == this_entry_p->d_type )
+        {
+            (void)unlink( this_entry_p->d_name );
+        }
+    }
+
+    (void)closedir( this_dir_p );
+}
+
+// ----------------------------------------------------------------------
+// A receiver: takes in the file in a directory of its own and reports
+// what it took once the file is verified, or has failed, or the time
+// is up. It never returns.
+//
+// ----------------------------------------------------------------------
+
+static void run_receiver( const char * directory_p, const int ready_pipe, const int result_pipe )
+{
+    receiver_result this_result;
+    uint64_t        start_cpu = 0;
+    time_t          end_time  = 0;
+    const char      ready     = 1;
+
+    if ( 0 != chdir( directory_p ) )
+    {
+        _exit( 1 );
+    }
+
+    MetricsClass::metrics_get_snapshot( before_snapshot );
+
+    ChatClass this_chat( base_port + 1, base_port, destination, true );
+
+    start_cpu = cpu_ns( );
+    end_time  = time( NULL ) + timeout_sec;
+
+    (void)memset( (char *)&this_result, 0, sizeof( this_result ) );
+
+    if ( 1 != write( ready_pipe, &ready, 1 ) )
+    {
+        _exit( 1 );
+    }
+
+    while ( time( NULL ) < end_time )
+    {
+        if ( true == loop_pass( this_chat ) )
+        {
+            MetricsClass::metrics_get_snapshot( after_snapshot );
+
+            this_result.verified = after_snapshot.counters[ metric_transfers_completed ] -
+                before_snapshot.counters[ metric_transfers_completed ];
+
+            this_result.failed =
+                after_snapshot.counters[ metric_transfers_failed ] - before_snapshot.counters[ metric_transfers_failed ] +
+                after_snapshot.counters[ metric_transfers_timed_out ] - before_snapshot.counters[ metric_transfers_timed_out ];
+
+            if ( this_result.verified + this_result.failed > 0 )
+            {
+                break;
+            }
+        }
+
+        if ( loop_delay_us > 0 )
+        {
+            usleep( loop_delay_us );
+        }
+    }
+
+    MetricsClass::metrics_get_snapshot( after_snapshot );
+
+    this_result.blocks_in    = after_snapshot.frames_in[ metric_frame_block ] - before_snapshot.frames_in[ metric_frame_block ];
+    this_result.bytes_in     = after_snapshot.bytes_in[ metric_frame_block ] - before_snapshot.bytes_in[ metric_frame_block ];
+    this_result.repairs_sent = after_snapshot.frames_out[ metric_frame_repair ] - before_snapshot.frames_out[ metric_frame_repair ];
+    this_result.cpu_ns       = cpu_ns( ) - start_cpu;
+
+    remove_files( );
+
+    _exit( sizeof( this_result ) == write( result_pipe, &this_result, sizeof( this_result ) ) ? 0 : 1 );
+}
+
+// ----------------------------------------------------------------------
+// Sends a file of the size passed by argument to the receivers and
+// writes what it cost to the results.
+//
+// Returns: true if every receiver verified the file
+//
+// ----------------------------------------------------------------------
+
+static bool run_size( const std::string & work_dir, const uint64_t this_size )
+{
+    std::vector<pid_t> receivers;
+    std::vector<int>   result_pipes;
+    std::vector<bool>  reported;
+    receiver_result    total_result;
+    receiver_result    this_result;
+    std::string        source_name = work_dir + "/" + BENCH_FILE_NAME;
+    char               send_name[ MAX_OUT_FILE_NAME_SIZE ];
+    int                ready_pipe[ 2 ];
+    int                this_receiver  = 0;
+    int                reports_in     = 0;
+    char               ready          = 0;
+    uint64_t           start_ns       = 0;
+    uint64_t           elapsed_ns     = 0;
+    uint64_t           start_cpu      = 0;
+    uint64_t           sender_cpu     = 0;
+    uint64_t           blocks_sent    = 0;
+    time_t             end_time       = 0;
+    double             gigabytes      = 0.0;
+
+    (void)memset( (char *)&total_result, 0, sizeof( total_result ) );
+
+    if ( false == make_file( source_name.c_str( ), this_size ) || 0 != pipe( ready_pipe ) )
+    {
+        (void)fprintf( stderr, "transfer_bench: unable to make %s\n", source_name.c_str( ) );
+
+        return false;
+    }
+
+    // Start the receivers, each in a directory of its own
+    for ( this_receiver = 0; this_receiver < receiver_count; this_receiver++ )
+    {
+        char  directory[ PATH_MAX ];
+        int   result_pipe[ 2 ];
+        pid_t this_pid = 0;
+
+        (void)snprintf( directory, sizeof( directory ), "%s/rx%d", work_dir.c_str( ), this_receiver );
+        (void)mkdir( directory, 0700 );
+
+        if ( 0 != pipe( result_pipe ) || ( this_pid = fork( ) ) < 0 )
+        {
+            (void)fprintf( stderr, "transfer_bench: unable to start a receiver\n" );
+
+            exit( 1 );
+        }
+
+        if ( 0 == this_pid )
+        {
+            (void)close( ready_pipe[ 0 ] );
+            (void)close( result_pipe[ 0 ] );
+
+            run_receiver( directory, ready_pipe[ 1 ], result_pipe[ 1 ] );
+        }
+
+        (void)close( result_pipe[ 1 ] );
+        (void)fcntl( result_pipe[ 0 ], F_SETFL, O_NONBLOCK );
+
+        receivers.push_back( this_pid );
+        result_pipes.push_back( result_pipe[ 0 ] );
+        reported.push_back( false );
+    }
+
+    (void)close( ready_pipe[ 1 ] );
+
+    // Wait for every receiver to be listening
+    for ( this_receiver = 0; this_receiver < receiver_count; this_receiver++ )
+    {
+        if ( 1 != read( ready_pipe[ 0 ], &ready, 1 ) )
+        {
+            (void)fprintf( stderr, "transfer_bench: a receiver did not start\n" );
+
+            exit( 1 );
+        }
+    }
+
+    (void)close( ready_pipe[ 0 ] );
+
+    {
+        ChatClass this_chat( base_port, base_port + 1, destination, false );
+
+        MetricsClass::metrics_get_snapshot( before_snapshot );
+
+        (void)snprintf( send_name, sizeof( send_name ), "%s", source_name.c_str( ) );
+
+        start_cpu = cpu_ns( );
+        start_ns  = ClockClass::clock_precise_ns( );
+        end_time  = time( NULL ) + timeout_sec;
+
+        this_chat.send_file( send_name, false );
+
+        // Serve the transfer and any repairs until every receiver is done
+        while ( reports_in < receiver_count && time( NULL ) < end_time )
+        {
+            (void)loop_pass( this_chat );
+
+            for ( this_receiver = 0; this_receiver < receiver_count; this_receiver++ )
+            {
+                if ( false == reported[ this_receiver ] &&
+                    sizeof( this_result ) == read( result_pipes[ this_receiver ], &this_result, sizeof( this_result ) ) )
+                {
+                    reported[ this_receiver ] = true;
+                    reports_in++;
+
+                    total_result.verified     += this_result.verified;
+                    total_result.failed       += this_result.failed;
+                    total_result.blocks_in    += this_result.blocks_in;
+                    total_result.bytes_in     += this_result.bytes_in;
+                    total_result.repairs_sent += this_result.repairs_sent;
+                    total_result.cpu_ns       += this_result.cpu_ns;
+
+                    elapsed_ns = ClockClass::clock_precise_ns( ) - start_ns;
+                }
+            }
+
+            if ( loop_delay_us > 0 )
+            {
+                usleep( loop_delay_us );
+            }
+        }
+
+        sender_cpu = cpu_ns( ) - start_cpu;
+
+        MetricsClass::metrics_get_snapshot( after_snapshot );
+
+        blocks_sent = after_snapshot.frames_out[ metric_frame_block ] - before_snapshot.frames_out[ metric_frame_block ];
+    }
+
+    // Receivers which are still going ran out of time
+    for ( this_receiver = 0; this_receiver < receiver_count; this_receiver++ )
+    {
+        if ( false == reported[ this_receiver ] )
+        {
+            (void)kill( receivers[ this_receiver ], SIGKILL );
+        }
+
+        (void)waitpid( receivers[ this_receiver ], (int *)NULL, 0 );
+        (void)close( result_pipes[ this_receiver ] );
+    }
+
+    (void)unlink( source_name.c_str( ) );
+
+    if ( 0 == elapsed_ns )
+    {
+        elapsed_ns = ClockClass::clock_precise_ns( ) - start_ns;
+    }
+
+    gigabytes = (double)this_size / 1e9;
+
+    (void)fprintf( results_p,
+        "{\"bench\":\"transfer\",\"size\":%llu,\"receivers\":%d,\"loop_us\":%d,"
+        "\"verified\":%llu,\"failed\":%d,\"seconds\":%.6f,\"mb_per_s\":%.3f,"
+        "\"blocks_sent\":%llu,\"packets_per_s\":%.1f,"
+        "\"sender_cpu_s_per_gb\":%.3f,\"receiver_cpu_s_per_gb\":%.3f,"
+        "\"blocks_received\":%llu,\"loss_pct\":%.3f,\"repairs\":%llu}\n",
+        (unsigned long long)this_size, receiver_count, loop_delay_us,
+        (unsigned long long)total_result.verified, receiver_count - (int)total_result.verified,
+        elapsed_ns / 1e9, this_size / 1e6 / ( elapsed_ns / 1e9 ),
+        (unsigned long long)blocks_sent, blocks_sent / ( elapsed_ns / 1e9 ),
+        sender_cpu / 1e9 / gigabytes, total_result.cpu_ns / 1e9 / receiver_count / gigabytes,
+        (unsigned long long)total_result.blocks_in,
+        0 == blocks_sent ? 0.0 :
+            100.0 * ( 1.0 - (double)total_result.blocks_in / ( (double)blocks_sent * receiver_count ) ),
+        (unsigned long long)total_result.repairs_sent );
+
+    (void)fflush( results_p );
+
+    return total_result.verified == (uint64_t)receiver_count;
+}
+
+// ----------------------------------------------------------------------
+// main() The main entry point
+//
+// ----------------------------------------------------------------------
+
+int main( int argc, char *argv[ ] )
+{
+    std::vector<uint64_t> sizes;
+    std::string           size_list   = BENCH_DEFAULT_SIZES;
+    const char *          address_p   = BENCH_DEFAULT_ADDRESS;
+    char                  temp_dir[ ] = "/tmp/transfer_bench.XXXXXX";
+    std::string           work_dir;
+    int                   this_option = 0;
+    size_t                this_size   = 0;
+    size_t                list_start  = 0;
+    int                   exit_code   = 0;
+    struct in_addr        this_address;
+
+    while ( -1 != ( this_option = getopt( argc, argv, "n:s:l:p:d:t:w:" ) ) )
+    {
+        switch ( this_option )
+        {
+            case 'n': receiver_count = atoi( optarg ); break;
+            case 's': size_list      = optarg;         break;
+            case 'l': loop_delay_us  = atoi( optarg ); break;
+            case 'p': base_port      = atoi( optarg ); break;
+            case 'd': address_p      = optarg;         break;
+            case 't': timeout_sec    = atoi( optarg ); break;
+            case 'w': given_dir_p    = optarg;         break;
+
+            default:
+                (void)fprintf( stderr, "Usage: transfer_bench [-n receivers] [-s size[,size...]] [-l loop us]\n"
+                    "                      [-p port] [-d address] [-t timeout s] [-w dir]\n" );
+
+                return 1;
+        }
+    }
+
+    if ( receiver_count < 1 || receiver_count > BENCH_MAX_RECEIVERS || 0 == inet_aton( address_p, &this_address ) )
+    {
+        (void)fprintf( stderr, "transfer_bench: 1 to %d receivers and an IPv4 address, please\n", BENCH_MAX_RECEIVERS );
+
+        return 1;
+    }
+
+    destination = ntohl( this_address.s_addr );
+
+    // The sizes, none of them empty
+    while ( list_start <= size_list.size( ) )
+    {
+        size_t list_end = size_list.find( ',', list_start );
+
+        if ( std::string::npos == list_end )
+        {
+            list_end = size_list.size( );
+        }
+
+        this_size = parse_size( size_list.substr( list_start, list_end - list_start ).c_str( ) );
+
+        if ( 0 == this_size )
+        {
+            (void)fprintf( stderr, "transfer_bench: sizes must be at least 1 byte\n" );
+
+            return 1;
+        }
+
+        sizes.push_back( this_size );
+
+        list_start = list_end + 1;
+    }
+
+    // The files are made and received in a directory of our own
+    if ( (const char *)NULL != given_dir_p )
+    {
+        work_dir = given_dir_p;
+    }
+    else if ( (char *)NULL != mkdtemp( temp_dir ) )
+    {
+        work_dir = temp_dir;
+    }
+    else
+    {
+        (void)fprintf( stderr, "transfer_bench: unable to make a work directory\n" );
+
+        return 1;
+    }
+
+    // The results keep the standard output to themselves
+    results_p = fdopen( dup( 1 ), "w" );
+
+    (void)dup2( 2, 1 );
+
+    for ( this_size = 0; this_size < sizes.size( ); this_size++ )
+    {
+        if ( false == run_size( work_dir, sizes[ this_size ] ) )
+        {
+            exit_code = 1;
+        }
+    }
+
+    if ( (const char *)NULL == given_dir_p )
+    {
+        for ( this_option = 0; this_option < receiver_count; this_option++ )
+        {
+            char directory[ PATH_MAX ];
+
+            (void)snprintf( directory, sizeof( directory ), "%s/rx%d", work_dir.c_str( ), this_option );
+            (void)rmdir( directory );
+        }
+
+        (void)rmdir( work_dir.c_str( ) );
+    }
+
+    return exit_code;
+}
@@ -29,7 +29,22 @@
 //
 // If logging is enabled using the WANT_LOGGING defined constant,
 // typing :log will toggle logging on or off. Logging is enabled by
-// default.
+// default. Typing :logstat shows what the log writer has done and what
+// it cost.
+//
+// Typing :stats shows how many frames of every kind were sent and
+// received, what became of the files received, and how long sending,
+// receiving, writing and showing frames took. The same numbers are
+// served to collectors on a Unix domain socket or a loopback TCP port
+// in the Prometheus text format.
+//
+// Typing :echo toggles answering latency probes from bench/latency_bench
+// so that the time from a probe being sent to it being shown here, and
+// back, may be measured.
+//
+// Typing :trace toggles tracing of the main loop and of file transfers.
+// Typing :tracedump, optionally followed by a file name, writes what was
+// traced for chrome://tracing or the Perfetto UI to open.
 //
 // Of course none of this is even remotely concerned with security.
 // Anyone running WireShark or some other packet sniffer will see
@@ -59,6 +74,10 @@
 #include <unistd.h>
 #include "ChatClass.h"        // For UDP functionality
 #include "ChatDefines.h"      // For defined constants
+#include "ClockClass.h"       // For the cached clocks
+#include "MetricsClass.h"     // For the counters and histograms
+#include "MetricsServerClass.h" // For serving them to collectors
+#include "TraceClass.h"       // For tracing the stages of transfers
 #if WANT_LOGGING
 #include "LoggingClass.h"     // For logging functionality
 #endif
@@ -72,6 +91,8 @@
 
 static char console_in_data[ MAX_CONSOLE_IN_SIZE ];
 static int  console_in_count;
+static bool console_closed = false;
+static char echo_reply[ UDP_IN_BUFFER_SIZE + 64 ];
 
 // ----------------------------------------------------------------------
 // Accumulates console input up to the maximum byte count which will 
@@ -84,12 +105,19 @@ static int  console_in_count;
 
 static int accumulate_console_input( void )
 {
-    int read_count = 0;
+    int       read_count = 0;
+    const int want_count = sizeof( console_in_data ) - ( console_in_count + 1 );
 
     // See if there is console input waiting. If the buffer
     // is full, we ask for zero bytes
-    read_count = read( 0, &console_in_data[ console_in_count ], 
-        ( sizeof( console_in_data ) - ( console_in_count + 1 ) ) );
+    read_count = read( 0, &console_in_data[ console_in_count ], want_count );
+
+    // Nothing more will ever come from a console which was closed, such
+    // as a script which was piped in to us, so stop waiting on it
+    if ( 0 == read_count && want_count > 0 )
+    {
+        console_closed = true;
+    }
 
     if ( read_count > 0 )
     {
@@ -113,6 +141,184 @@ static int accumulate_console_input( void )
     return 0;
 }
 
+// ----------------------------------------------------------------------
+// Shows a snapshot of the metrics: the frames and bytes of every kind
+// sent and received, the counters which are not zero, and for every
+// histogram with anything in it the median, the tail and the longest.
+//
+// ----------------------------------------------------------------------
+
+static void show_metrics( void )
+{
+    static metrics_snapshot this_snapshot;
+    int                     this_item = 0;
+
+    MetricsClass::metrics_get_snapshot( this_snapshot );
+
+    for ( this_item = 0; this_item < METRIC_FRAME_TYPES; this_item++ )
+    {
+        if ( this_snapshot.frames_in[ this_item ] > 0 || this_snapshot.frames_out[ this_item ] > 0 )
+        {
+            (void)printf( " Frames %-8s in %llu (%llu bytes), out %llu (%llu bytes)\n",
+                MetricsClass::metrics_frame_name( (metric_frame)this_item ),
+                (unsigned long long)this_snapshot.frames_in[ this_item ],
+                (unsigned long long)this_snapshot.bytes_in[ this_item ],
+                (unsigned long long)this_snapshot.frames_out[ this_item ],
+                (unsigned long long)this_snapshot.bytes_out[ this_item ] );
+        }
+    }
+
+    for ( this_item = 0; this_item < METRIC_COUNTERS; this_item++ )
+    {
+        if ( this_snapshot.counters[ this_item ] > 0 )
+        {
+            (void)printf( " %s %llu\n", MetricsClass::metrics_counter_name( (metric_counter)this_item ),
+                (unsigned long long)this_snapshot.counters[ this_item ] );
+        }
+    }
+
+    for ( this_item = 0; this_item < METRIC_HISTOGRAMS; this_item++ )
+    {
+        const metric_histogram this_histogram = (metric_histogram)this_item;
+
+        if ( this_snapshot.histogram_count[ this_item ] > 0 )
+        {
+            (void)printf( " %s: %llu, p50 %llu, p99 %llu, p99.9 %llu, max %llu\n",
+                MetricsClass::metrics_histogram_name( this_histogram ),
+                (unsigned long long)this_snapshot.histogram_count[ this_item ],
+                (unsigned long long)MetricsClass::metrics_percentile( this_snapshot, this_histogram, 50.0 ),
+                (unsigned long long)MetricsClass::metrics_percentile( this_snapshot, this_histogram, 99.0 ),
+                (unsigned long long)MetricsClass::metrics_percentile( this_snapshot, this_histogram, 99.9 ),
+                (unsigned long long)this_snapshot.histogram_max[ this_item ] );
+        }
+    }
+}
+
+// ----------------------------------------------------------------------
+// Shows how large Linux has made the socket buffers, which may be less
+// than was asked for, and which grow if frames are being dropped.
+//
+// ----------------------------------------------------------------------
+
+static void show_socket_buffers( ChatClass & udp_interface )
+{
+    int      receive_bytes  = 0;
+    int      send_bytes     = 0;
+    int      bulk_bytes     = 0;
+    uint32_t frame_count    = 0;
+    uint32_t frame_bytes    = 0;
+    bool     huge_pages     = false;
+    uint32_t admitted_count = 0;
+    uint64_t reserved_bytes = 0;
+    uint32_t open_files     = 0;
+    size_t   queued_offers  = 0;
+
+    udp_interface.socket_buffer_sizes( receive_bytes, send_bytes, bulk_bytes );
+    udp_interface.frame_pool_sizes( frame_count, frame_bytes, huge_pages );
+    udp_interface.admission_usage( admitted_count, reserved_bytes, open_files, queued_offers );
+
+    (void)printf( " Socket buffers: receive %d KB, send %d KB, bulk send %d KB\n",
+        receive_bytes / 1024, send_bytes / 1024, bulk_bytes / 1024 );
+
+    (void)printf( " Frame buffers: %u of %u bytes, on %s pages\n",
+        frame_count, frame_bytes, ( true == huge_pages ? "huge" : "ordinary" ) );
+
+    (void)printf( " Inbound files: %u being received, %u open, %llu MB set aside, %u waiting\n",
+        admitted_count, open_files, (unsigned long long)( reserved_bytes / ( 1024 * 1024 ) ),
+        (unsigned int)queued_offers );
+}
+
+// ----------------------------------------------------------------------
+// Writes the trace to the file named after the :tracedump command, or
+// to the default trace file if none was named.
+//
+// ----------------------------------------------------------------------
+
+static void dump_trace( char * file_name_p )
+{
+    int span_count = 0;
+
+    skipspace( file_name_p );
+
+    // Remove the trailing endline characters
+    file_name_p[ strcspn( file_name_p, "\r\n" ) ] = ASCII_NULL_ZERO;
+
+    if ( ASCII_NULL_ZERO == file_name_p[ 0 ] )
+    {
+        file_name_p = (char *)CHAT_TRACE_FILE;
+    }
+
+    span_count = TraceClass::trace_dump_chrome( file_name_p );
+
+    if ( span_count < 0 )
+    {
+        (void)printf( " Unable to write the trace to %s\n", file_name_p );
+    }
+    else
+    {
+        (void)printf( " Wrote %d spans to %s\n", span_count, file_name_p );
+    }
+}
+
+#if WANT_LOGGING
+// ----------------------------------------------------------------------
+// Shows the log writer's statistics: how many lines and bytes it wrote
+// and how fast, and how long committing them took under the durability
+// mode in use.
+//
+// ----------------------------------------------------------------------
+
+static void show_log_stats( LoggingClass & log_interface )
+{
+    log_stats   these_stats;
+    double      elapsed_sec = 0.0;
+    const char *mode_p      = "buffered";
+
+    log_interface.logging_get_stats( these_stats );
+
+    if ( log_durability_flush == these_stats.durability )
+    {
+        mode_p = "flush";
+    }
+    else if ( log_durability_group_commit == these_stats.durability )
+    {
+        mode_p = "group commit";
+    }
+
+    elapsed_sec = these_stats.elapsed_ns / 1e9;
+
+    if ( elapsed_sec <= 0.0 )
+    {
+        elapsed_sec = 1.0;
+    }
+
+    (void)printf( " Log mode %s: %llu lines, %llu bytes in %llu batches, %.1f lines/s, %.3f MB/s, %llu dropped\n",
+        mode_p, (unsigned long long)these_stats.lines_written,
+        (unsigned long long)these_stats.bytes_written, (unsigned long long)these_stats.write_batches,
+        these_stats.lines_written / elapsed_sec, these_stats.bytes_written / elapsed_sec / 1e6,
+        (unsigned long long)these_stats.dropped_lines );
+
+    (void)printf( " Log segment %u, %u older segments compressed, %u removed\n",
+        these_stats.segment_number, these_stats.segments_compressed, these_stats.segments_removed );
+
+    if ( these_stats.segments_term_indexed > 0 )
+    {
+        (void)printf( " Log term indexes written for %u segments, %u of them incomplete\n",
+            these_stats.segments_term_indexed, these_stats.segments_term_incomplete );
+    }
+
+    if ( these_stats.commit_count > 0 )
+    {
+        (void)printf( " Log commits: %llu, %.1f us average, %.1f us longest, line waited %.2f ms average, %.2f ms longest\n",
+            (unsigned long long)these_stats.commit_count,
+            these_stats.commit_ns_total / 1e3 / these_stats.commit_count,
+            these_stats.commit_ns_max / 1e3,
+            these_stats.commit_delay_ns_total / 1e6 / these_stats.commit_count,
+            these_stats.commit_delay_ns_max / 1e6 );
+    }
+}
+#endif
+
 // ----------------------------------------------------------------------
 // main() The main entry point
 //
@@ -121,26 +327,64 @@ static int accumulate_console_input( void )
 // request files, or to enable/disable logging.
 //
 // Also scans for inbound UDP frames containing file transfer frames
-// or text message frames. If a file transfer is in progress this
-// function also checks to see if any transfered have timed out.
+// or text message frames. Files being sent are advanced a few blocks
+// every time around. If a file transfer is in progress this function
+// also checks to see if any transfered have timed out.
+//
+// If CHAT_PIPELINE_THREADS is set the frames are taken in, the file
+// blocks written and the files sent by threads of the Chat Class's own,
+// leaving this loop with the console and the text.
 //
 // ----------------------------------------------------------------------
 
 int main( const int argc, const char * argv[] )
 {
-    int  read_count    = 0;
-    int  while_running = true;
-    bool logging_on    = true;
+    int      read_count    = 0;
+    int      frame_count   = 0;
+    int      while_running = true;
+    bool     logging_on    = true;
+    bool     echo_on       = false;
+    uint64_t shown_time    = 0;
+    uint64_t pass_start    = 0;
+    uint64_t wait_start    = 0;
 
     // Instantiate a UDP Interface
     ChatClass udp_interface( DEFAULT_UDP_PORT_BASE );
 
+    // Limit the files we take in at once, before any shards are started
+    udp_interface.set_admission_limits( CHAT_ADMIT_TRANSFERS,
+        (uint64_t)CHAT_ADMIT_RESERVED_MB * 1024 * 1024, CHAT_ADMIT_OPEN_FILES );
+
+#if CHAT_PIPELINE_THREADS
+    // Receive, write and send on threads of their own
+    (void)udp_interface.pipeline_start( CHAT_RECEIVE_SHARDS );
+#endif
+
+    // Serve the metrics to collectors on this machine
+    MetricsServerClass metrics_server;
+
+    if ( 0 != CHAT_METRICS_SOCKET[ 0 ] )
+    {
+        (void)metrics_server.metrics_server_open_unix( CHAT_METRICS_SOCKET );
+    }
+
+    if ( 0 != CHAT_METRICS_TCP_PORT )
+    {
+        (void)metrics_server.metrics_server_open_tcp( CHAT_METRICS_TCP_PORT );
+    }
+
 #if WANT_LOGGING
     // Instantiate a Logging Interface
     LoggingClass log_interface;
 
+    // Index the words logged if we were asked to
+    log_interface.logging_set_term_index( CHAT_LOG_TERM_INDEX );
+
     // Create a logging file
     log_interface.logging_create_log( );
+
+    // Select how hard the log writer works to get lines on to the disk
+    log_interface.logging_set_durability( CHAT_LOG_DURABILITY, CHAT_LOG_COMMIT_MS, CHAT_LOG_COMMIT_BYTES );
 #endif
 
     // Initialize our local data
@@ -149,29 +393,74 @@ int main( const int argc, const char * argv[] )
     // Set the console input to non-blocking
     (void)udp_interface.set_non_blocking( 0 );
 
+    TraceClass::trace_enable( CHAT_TRACE_AT_START );
+
+    // Say how much of a burst the sockets will hold
+    show_socket_buffers( udp_interface );
+
     // Check for inbound UDP frames and for ourbound console input
     while( while_running )
     {
-        // See if there is inbound data
-        read_count = udp_interface.read_data( );
+        // Everything this pass reads the time from the cached clocks
+        ClockClass::clock_tick( );
 
-        // A byte count of greater than 0 indicates that there is
-        // data that is likely a test message. File transfer frames
-        // get processed by the Chat Class and only indicates that
-        // there is data for us to process here if any inbound
-        // data was not already processed and handled.
-        if ( read_count > 0 )
+        pass_start = TraceClass::trace_begin( );
+
+        // Take in the inbound frames that are waiting, up to a limit so
+        // that a flood of them does not starve the console. A byte
+        // count of less than 0 means that there are no more waiting.
+        for ( frame_count = 0; frame_count < MAX_FRAMES_PER_LOOP; frame_count++ )
         {
-            // Make sure that the inbound datais NULL terminated
-            udp_interface.udp_inbound_buffer[ read_count ] = ASCII_NULL_ZERO;
+            // See if there is inbound data
+            read_count = udp_interface.read_data( );
 
-            // Treat the inbound UDP frame as a NULL-terminated string
-            (void)printf( "%s", udp_interface.udp_inbound_buffer );
+            if ( read_count < 0 )
+            {
+                break;
+            }
+
+            // A byte count of greater than 0 indicates that there is
+            // data that is likely a test message. File transfer frames
+            // get processed by the Chat Class and only indicates that
+            // there is data for us to process here if any inbound
+            // data was not already processed and handled.
+            if ( read_count > 0 )
+            {
+                char * received_p = udp_interface.received_text( );
+
+                // Make sure that the inbound datais NULL terminated
+                received_p[ read_count ] = ASCII_NULL_ZERO;
+
+                // Treat the inbound UDP frame as a NULL-terminated string
+                (void)printf( "%s", received_p );
+
+                // Time how long the text took from arriving to being shown
+                shown_time = ClockClass::clock_precise_ns( );
+
+                MetricsClass::metrics_record( metric_text_delivery_ns, shown_time - udp_interface.last_receive_time( ) );
 
 #if WANT_LOGGING
-            // Log that inbound text
-            log_interface.logging_write_log( udp_interface.udp_inbound_buffer );
+                // Log that inbound text and who sent it
+                log_interface.logging_write_record( log_direction_inbound, log_frame_text,
+                    udp_interface.last_sender_address( ), received_p, strlen( received_p ) );
 #endif
+
+                // Answer a latency probe with when it was shown, after
+                // it was logged as any other text would have been
+                if ( true == echo_on && 0 == strncmp( received_p,
+                    ECHO_PROBE_PREFIX, strlen( ECHO_PROBE_PREFIX ) ) )
+                {
+                    (void)snprintf( echo_reply, sizeof( echo_reply ) - 2, "%s%llu %s", ECHO_REPLY_PREFIX,
+                        (unsigned long long)shown_time, &received_p[ strlen( ECHO_PROBE_PREFIX ) ] );
+
+                    udp_interface.send_text( echo_reply );
+
+#if WANT_LOGGING
+                    log_interface.logging_write_record( log_direction_outbound, log_frame_text,
+                        0, echo_reply, strlen( echo_reply ) );
+#endif
+                }
+            }
         }
 
         // See if there is console input to send
@@ -185,6 +474,32 @@ int main( const int argc, const char * argv[] )
 	        {
                 while_running = false;
             }
+            else if (! strncmp( console_in_data, command_stats, strlen( command_stats ) ) )
+            {
+                // Show what has been counted and timed so far
+                show_metrics( );
+                show_socket_buffers( udp_interface );
+            }
+            else if (! strncmp( console_in_data, command_echo, strlen( command_echo ) ) )
+            {
+                // Toggle whether latency probes should be answered
+                echo_on = !echo_on;
+
+                (void)printf(" Echo has been turned %s\n", echo_on ? "ON" : "OFF" );
+            }
+            else if (! strncmp( console_in_data, command_tracedump, strlen( command_tracedump ) ) )
+            {
+                // Write out the trace. This must be checked before
+                // :trace since :trace is the start of :tracedump.
+                dump_trace( &console_in_data[ strlen( command_tracedump ) ] );
+            }
+            else if (! strncmp( console_in_data, command_trace, strlen( command_trace ) ) )
+            {
+                // Toggle whether the stages of transfers are traced
+                TraceClass::trace_enable( false == TraceClass::trace_enabled( ) );
+
+                (void)printf(" Tracing has been turned %s\n", TraceClass::trace_enabled( ) ? "ON" : "OFF" );
+            }
 #if ALLOW_COMMAND_SEND
             else if (! strncmp( console_in_data, command_send, strlen( command_send ) ) )
             {
@@ -192,6 +507,11 @@ int main( const int argc, const char * argv[] )
                 // Indicate that the send is not in response to a get
                 // reqest received from another system.
                 udp_interface.send_file( &console_in_data[ 5 ], false );
+
+    #if WANT_LOGGING
+                log_interface.logging_write_record( log_direction_outbound, log_frame_command,
+                    0, console_in_data, strlen( console_in_data ) );
+    #endif
             }
 #endif
 #if ALLOW_COMMAND_GET
@@ -200,10 +520,21 @@ int main( const int argc, const char * argv[] )
                 // Query all listening destinations for a file and if
                 // it is located, send it to the system that requested it
                 udp_interface.get_file( &console_in_data[ 4 ] );
+
+    #if WANT_LOGGING
+                log_interface.logging_write_record( log_direction_outbound, log_frame_command,
+                    0, console_in_data, strlen( console_in_data ) );
+    #endif
             }
 #endif
 #if WANT_LOGGING
     #if ALLOW_COMMAND_LOG
+            else if (! strncmp( console_in_data, command_logstat, strlen( command_logstat ) ) )
+            {
+                // Show what the log writer has done. This must be checked
+                // before :log since :log is the start of :logstat.
+                show_log_stats( log_interface );
+            }
             else if (! strncmp( console_in_data, command_log, strlen( command_log ) ) )
             {
                 // Toggle whether logging should be on or off
@@ -224,7 +555,8 @@ int main( const int argc, const char * argv[] )
 
 #if WANT_LOGGING
                 // Log that outbound text
-                log_interface.logging_write_log( console_in_data );
+                log_interface.logging_write_record( log_direction_outbound, log_frame_text,
+                    0, console_in_data, strlen( console_in_data ) );
 #endif
             }
 
@@ -232,11 +564,28 @@ int main( const int argc, const char * argv[] )
             console_in_count = 0;
         }
 
+        // Send the next few blocks of any files we are sending
+        (void)udp_interface.service_transfers( );
+
         // See if we were receiving a file that timed out
         (void)udp_interface.transfer_timed_out( );
 
-        // To avoid hard loops we delay a number of milliseconds
+        // Answer collectors scraping the metrics
+        metrics_server.metrics_server_service( );
+
+        TraceClass::trace_end( trace_loop_pass, pass_start, frame_count );
+
+        // To avoid hard loops we delay a number of milliseconds, or
+        // until there is something to do if we were asked to
+        wait_start = TraceClass::trace_begin( );
+
+#if CHAT_LOOP_WAITS_FOR_INPUT
+        (void)udp_interface.wait_for_input( true == console_closed ? HANDLE_NOT_VALID : 0, MAIN_LOOP_SLEEP_DELAY );
+#else
         usleep( MAIN_LOOP_SLEEP_DELAY );
+#endif
+
+        TraceClass::trace_end( trace_loop_wait, wait_start, MAIN_LOOP_SLEEP_DELAY );
     }
 
     // Set the console back to blocking 
@@ -0,0 +1,196 @@
+
+// ----------------------------------------------------------------------
+// logdump -- Turns the binary chat log back in to text.
+//
+// Every record of every segment named on the command line is printed
+// on a line of its own with its wall clock time, direction, peer and
+// frame type, followed by the data with anything that is not printable
+// shown as an escape. Compressed segments are read through gzip. A
+// segment named as - is read from the standard input, and segments
+// which follow each other in the input are all read.
+//
+// With -c nothing is printed; the records are decoded and counted and
+// the rate at which they were scanned is reported.
+//
+// Usage: logdump [-c] segment [segment ...]
+//
+// See main.c for disclaimers and other information.
+//
+// Fredric L. Rice, June 2018
+// http://www.crystallake.name
+// fred @ crystal lake . name
+//
+// ----------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <vector>
+#include "LogReaderClass.h"     // The decoder
+
+// ----------------------------------------------------------------------
+// Defined constants for the tool
+//
+// ----------------------------------------------------------------------
+
+#define DUMP_READ_SIZE              (1024 * 1024)
+
+// ----------------------------------------------------------------------
+// Local data storage
+//
+// ----------------------------------------------------------------------
+
+    static bool     count_only    = false;
+    static uint64_t record_count  = 0;
+    static uint64_t record_bytes  = 0;
+    static char     output_line[ LOG_READER_LINE_SIZE ];
+
+// ----------------------------------------------------------------------
+// Returns the monotonic time in nanoseconds
+//
+// ----------------------------------------------------------------------
+
+static double now_ns( void )
+{
+    struct timespec this_time;
+
+    (void)clock_gettime( CLOCK_MONOTONIC, &this_time );
+
+    return (double)this_time.tv_sec * 1e9 + (double)this_time.tv_nsec;
+}
+
+// ----------------------------------------------------------------------
+// Reads every record of a segment, and of any segments following it in
+// the same data.
+//
+// Returns: true if the data held at least one segment
+//
+// ----------------------------------------------------------------------
+
+static bool dump_segments( LogReaderClass & reader, const char * data_p, size_t data_size, bool from_file )
+{
+    const log_record_header * record_p      = (const log_record_header *)NULL;
+    const char *              record_data_p = (const char *)NULL;
+    uint32_t                  this_size     = 0;
+    size_t                    segment_at    = 0;
+
+    while ( true )
+    {
+        while ( true == reader.log_reader_next( &record_p, &record_data_p, &this_size ) )
+        {
+            record_count++;
+            record_bytes += sizeof( log_record_header ) + this_size;
+
+            if ( false == count_only )
+            {
+                (void)fwrite( output_line, 1, LogReaderClass::log_reader_format( record_p,
+                    record_data_p, this_size, output_line ), stdout );
+            }
+        }
+
+        // Another segment may follow in data read from a pipe
+        segment_at += reader.log_reader_offset( );
+
+        if ( true == from_file || segment_at >= data_size ||
+            false == reader.log_reader_open_memory( &data_p[ segment_at ], data_size - segment_at ) )
+        {
+            return true;
+        }
+    }
+}
+
+// ----------------------------------------------------------------------
+// Reads the whole of the standard input in to memory.
+//
+// ----------------------------------------------------------------------
+
+static void read_standard_input( std::vector<char> & input_data )
+{
+    ssize_t read_count = 0;
+    size_t  held       = 0;
+
+    do
+    {
+        input_data.resize( held + DUMP_READ_SIZE );
+
+        read_count = read( STDIN_FILENO, &input_data[ held ], DUMP_READ_SIZE );
+
+        if ( read_count > 0 )
+        {
+            held += (size_t)read_count;
+        }
+    } while ( read_count > 0 );
+
+    input_data.resize( held );
+}
+
+// ----------------------------------------------------------------------
+// Main entry point
+//
+// ----------------------------------------------------------------------
+
+int main( int argc, char *argv[ ] )
+{
+    LogReaderClass    reader;
+    std::vector<char> input_data;
+    double            start_time = 0.0;
+    double            elapsed    = 0.0;
+    int               this_arg   = 1;
+    int               exit_code  = 0;
+
+    if ( argc > 1 && 0 == strcmp( argv[ 1 ], "-c" ) )
+    {
+        count_only = true;
+        this_arg++;
+    }
+
+    if ( this_arg >= argc )
+    {
+        (void)fprintf( stderr, "Usage: logdump [-c] segment [segment ...]\n" );
+
+        return 1;
+    }
+
+    start_time = now_ns( );
+
+    for ( ; this_arg < argc; this_arg++ )
+    {
+        bool opened = false;
+
+        if ( 0 == strcmp( argv[ this_arg ], "-" ) )
+        {
+            read_standard_input( input_data );
+
+            opened = reader.log_reader_open_memory( input_data.data( ), input_data.size( ) ) &&
+                dump_segments( reader, input_data.data( ), input_data.size( ), false );
+        }
+        else
+        {
+            opened = reader.log_reader_open( argv[ this_arg ] ) &&
+                dump_segments( reader, (const char *)NULL, 0, true );
+        }
+
+        if ( false == opened )
+        {
+            (void)fprintf( stderr, "logdump: [%s] is not a chat log segment\n", argv[ this_arg ] );
+
+            exit_code = 1;
+        }
+
+        reader.log_reader_close( );
+    }
+
+    elapsed = now_ns( ) - start_time;
+
+    if ( true == count_only )
+    {
+        (void)printf( "%llu records, %llu bytes in %.3f ms, %.0f records/s, %.1f MB/s\n",
+            (unsigned long long)record_count, (unsigned long long)record_bytes, elapsed / 1e6,
+            elapsed > 0.0 ? (double)record_count * 1e9 / elapsed : 0.0,
+            elapsed > 0.0 ? (double)record_bytes * 1e3 / elapsed : 0.0 );
+    }
+
+    return exit_code;
+}
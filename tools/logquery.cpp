@@ -0,0 +1,296 @@
+
+// ----------------------------------------------------------------------
+// logquery -- Finds the records of the binary chat log logged between
+// two times, from one peer, or both.
+//
+// The side index of each segment is used to pass over segments that
+// hold nothing from the time range or from the peer without opening
+// them, and to start reading the rest close to the start of the time
+// range rather than at the start of the segment. Segments without an
+// index, such as the one being written, are read from the start.
+//
+// Times are local, given as "YYYY-MM-DD HH:MM:SS", "YYYY-MM-DD", or as
+// seconds since the Linux epoch. The peer is an IPv4 address, or - for
+// what this system logged itself. With -c the matching records are
+// counted rather than printed and what the index saved is reported.
+//
+// Usage: logquery [-f from] [-t to] [-p peer] [-c] segment [segment ...]
+//
+// See main.c for disclaimers and other information.
+//
+// Fredric L. Rice, June 2018
+// http://www.crystallake.name
+// fred @ crystal lake . name
+//
+// ----------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <ctype.h>
+#include <arpa/inet.h>
+#include <vector>
+#include "LogReaderClass.h"     // The decoder and the side index
+
+// ----------------------------------------------------------------------
+// Local data storage
+//
+// ----------------------------------------------------------------------
+
+    static bool     count_only       = false;
+    static bool     want_peer        = false;
+    static uint32_t peer_address     = 0;
+    static uint64_t from_ns          = 0;
+    static uint64_t to_ns            = UINT64_MAX;
+    static uint64_t matched_count    = 0;
+    static uint64_t scanned_count    = 0;
+    static int      segments_read    = 0;
+    static int      segments_skipped = 0;
+    static char     output_line[ LOG_READER_LINE_SIZE ];
+
+// ----------------------------------------------------------------------
+// Returns the monotonic time in nanoseconds
+//
+// ----------------------------------------------------------------------
+
+static double now_ns( void )
+{
+    struct timespec this_time;
+
+    (void)clock_gettime( CLOCK_MONOTONIC, &this_time );
+
+    return (double)this_time.tv_sec * 1e9 + (double)this_time.tv_nsec;
+}
+
+// ----------------------------------------------------------------------
+// Turns a time given on the command line in to nanoseconds since the
+// Linux epoch. The end of a range includes the whole of the second, or
+// the whole of the day, that it names.
+//
+// Returns: true if the time could be understood
+//
+// ----------------------------------------------------------------------
+
+static bool parse_time( const char * this_text_p, uint64_t & this_ns, const bool range_end )
+{
+    struct tm    our_time;
+    const char * end_p         = (const char *)NULL;
+    time_t       these_seconds = 0;
+    uint64_t     this_length   = 1;
+
+    // All digits is seconds since the epoch
+    for ( end_p = this_text_p; isdigit( (unsigned char)*end_p ); end_p++ )
+    {
+    }
+
+    if ( end_p != this_text_p && ASCII_NULL_ZERO == *end_p )
+    {
+        this_ns = (uint64_t)strtoull( this_text_p, (char **)NULL, 10 ) * 1000000000ULL;
+
+        this_ns += true == range_end ? 999999999ULL : 0;
+
+        return true;
+    }
+
+    (void)memset( (char *)&our_time, ASCII_NULL_ZERO, sizeof( our_time ) );
+
+    end_p = strptime( this_text_p, "%Y-%m-%d %H:%M:%S", &our_time );
+
+    if ( (const char *)NULL == end_p )
+    {
+        (void)memset( (char *)&our_time, ASCII_NULL_ZERO, sizeof( our_time ) );
+
+        end_p = strptime( this_text_p, "%Y-%m-%d", &our_time );
+
+        this_length = 24 * 60 * 60;
+    }
+
+    if ( (const char *)NULL == end_p || ASCII_NULL_ZERO != *end_p )
+    {
+        return false;
+    }
+
+    // Let the C library work out whether daylight saving time applies
+    our_time.tm_isdst = -1;
+
+    if ( -1 == ( these_seconds = mktime( &our_time ) ) )
+    {
+        return false;
+    }
+
+    this_ns = (uint64_t)these_seconds * 1000000000ULL;
+
+    this_ns += true == range_end ? this_length * 1000000000ULL - 1 : 0;
+
+    return true;
+}
+
+// ----------------------------------------------------------------------
+// Decides from a segment's side index whether the segment may hold any
+// records that we are looking for.
+//
+// ----------------------------------------------------------------------
+
+static bool segment_may_match( const log_index_header & this_index )
+{
+    const uint32_t peer_bit = LOG_PEER_BIT( peer_address );
+
+    if ( 0 == this_index.record_count ||
+        this_index.last_wall_ns < from_ns || this_index.first_wall_ns > to_ns )
+    {
+        return false;
+    }
+
+    return false == want_peer ||
+        0 != ( this_index.peer_bitmap[ peer_bit / 8 ] & ( 1 << ( peer_bit % 8 ) ) );
+}
+
+// ----------------------------------------------------------------------
+// Reads the records of one segment which we are looking for, starting
+// where the side index says that the time range starts if there is an
+// index. Records are in the order they were logged so the first record
+// past the end of the time range ends the search.
+//
+// Returns: true if the segment could be read
+//
+// ----------------------------------------------------------------------
+
+static bool query_segment( LogReaderClass & reader, const char * path_and_name_p )
+{
+    log_index_header             this_index;
+    std::vector<log_index_entry> these_entries;
+    const log_record_header *    record_p  = (const log_record_header *)NULL;
+    const char *                 data_p    = (const char *)NULL;
+    uint32_t                     this_size = 0;
+    bool                         indexed   = false;
+
+    indexed = LogReaderClass::log_reader_load_index( path_and_name_p, this_index, these_entries );
+
+    if ( true == indexed && false == segment_may_match( this_index ) )
+    {
+        segments_skipped++;
+
+        return true;
+    }
+
+    if ( false == reader.log_reader_open( path_and_name_p ) )
+    {
+        return false;
+    }
+
+    segments_read++;
+
+    if ( true == indexed )
+    {
+        reader.log_reader_seek( LogReaderClass::log_reader_find_time( these_entries, from_ns ) );
+    }
+
+    while ( true == reader.log_reader_next( &record_p, &data_p, &this_size ) )
+    {
+        log_record_header this_record;
+
+        // The record may not be aligned in the segment
+        (void)memcpy( (char *)&this_record, (const char *)record_p, sizeof( this_record ) );
+
+        scanned_count++;
+
+        if ( this_record.wall_ns > to_ns )
+        {
+            break;
+        }
+
+        if ( this_record.wall_ns < from_ns ||
+            ( true == want_peer && this_record.peer_address != peer_address ) )
+        {
+            continue;
+        }
+
+        matched_count++;
+
+        if ( false == count_only )
+        {
+            (void)fwrite( output_line, 1, LogReaderClass::log_reader_format( record_p,
+                data_p, this_size, output_line ), stdout );
+        }
+    }
+
+    reader.log_reader_close( );
+
+    return true;
+}
+
+// ----------------------------------------------------------------------
+// Main entry point
+//
+// ----------------------------------------------------------------------
+
+int main( int argc, char *argv[ ] )
+{
+    LogReaderClass reader;
+    double         start_time = 0.0;
+    int            this_arg   = 1;
+    int            exit_code  = 0;
+
+    for ( ; this_arg < argc && '-' == argv[ this_arg ][ 0 ]; this_arg++ )
+    {
+        const bool has_value = this_arg + 1 < argc;
+
+        if ( 0 == strcmp( argv[ this_arg ], "-c" ) )
+        {
+            count_only = true;
+        }
+        else if ( 0 == strcmp( argv[ this_arg ], "-f" ) && true == has_value &&
+            true == parse_time( argv[ this_arg + 1 ], from_ns, false ) )
+        {
+            this_arg++;
+        }
+        else if ( 0 == strcmp( argv[ this_arg ], "-t" ) && true == has_value &&
+            true == parse_time( argv[ this_arg + 1 ], to_ns, true ) )
+        {
+            this_arg++;
+        }
+        else if ( 0 == strcmp( argv[ this_arg ], "-p" ) && true == has_value &&
+            ( 0 == strcmp( argv[ this_arg + 1 ], "-" ) ||
+            1 == inet_pton( AF_INET, argv[ this_arg + 1 ], &peer_address ) ) )
+        {
+            want_peer = true;
+
+            this_arg++;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if ( this_arg >= argc )
+    {
+        (void)fprintf( stderr, "Usage: logquery [-f from] [-t to] [-p peer] [-c] segment [segment ...]\n" );
+
+        return 1;
+    }
+
+    start_time = now_ns( );
+
+    for ( ; this_arg < argc; this_arg++ )
+    {
+        if ( false == query_segment( reader, argv[ this_arg ] ) )
+        {
+            (void)fprintf( stderr, "logquery: [%s] is not a chat log segment\n", argv[ this_arg ] );
+
+            exit_code = 1;
+        }
+    }
+
+    if ( true == count_only )
+    {
+        (void)printf( "%llu records matched, %llu scanned, %d segments read, "
+            "%d passed over by the index, in %.3f ms\n",
+            (unsigned long long)matched_count, (unsigned long long)scanned_count,
+            segments_read, segments_skipped, ( now_ns( ) - start_time ) / 1e6 );
+    }
+
+    return exit_code;
+}
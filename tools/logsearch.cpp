@@ -0,0 +1,312 @@
+
+// ----------------------------------------------------------------------
+// logsearch -- Finds the records of the binary chat log which mention
+// a word or a phrase.
+//
+// The query is cut in to words the same way the log writer cuts the
+// records. The term index of each segment gives the records holding
+// every one of the words, and only those records are read to make sure
+// that the words are next to each other in the order asked for. With
+// -a the words may be anywhere in the record. Segments without a whole
+// term index, such as the one being written, are read from the start.
+//
+// With -c the matching records are counted rather than printed and
+// what the index saved is reported.
+//
+// Usage: logsearch [-a] [-c] "words" segment [segment ...]
+//
+// See main.c for disclaimers and other information.
+//
+// Fredric L. Rice, June 2018
+// http://www.crystallake.name
+// fred @ crystal lake . name
+//
+// ----------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include "LogReaderClass.h"     // The decoder
+#include "TermIndexClass.h"     // The words and their index
+
+// ----------------------------------------------------------------------
+// Local data storage
+//
+// ----------------------------------------------------------------------
+
+    static bool                     count_only       = false;
+    static bool                     any_order        = false;
+    static std::vector<std::string> query_words;
+    static uint64_t                 matched_count    = 0;
+    static uint64_t                 read_count       = 0;
+    static int                      segments_indexed = 0;
+    static int                      segments_scanned = 0;
+    static char                     output_line[ LOG_READER_LINE_SIZE ];
+
+// ----------------------------------------------------------------------
+// Returns the monotonic time in nanoseconds
+//
+// ----------------------------------------------------------------------
+
+static double now_ns( void )
+{
+    struct timespec this_time;
+
+    (void)clock_gettime( CLOCK_MONOTONIC, &this_time );
+
+    return (double)this_time.tv_sec * 1e9 + (double)this_time.tv_nsec;
+}
+
+// ----------------------------------------------------------------------
+// Decides whether a record holds the words of the query, next to each
+// other and in order unless any order was asked for.
+//
+// ----------------------------------------------------------------------
+
+static bool record_matches( const char * data_p, uint32_t data_size )
+{
+    std::vector<std::string> these_words;
+    size_t                   this_word = 0;
+
+    TermIndexClass::term_index_tokens( data_p, data_size, these_words );
+
+    if ( true == any_order )
+    {
+        for ( this_word = 0; this_word < query_words.size( ); this_word++ )
+        {
+            if ( these_words.end( ) == std::find( these_words.begin( ), these_words.end( ), query_words[ this_word ] ) )
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    return these_words.end( ) != std::search( these_words.begin( ), these_words.end( ),
+        query_words.begin( ), query_words.end( ) );
+}
+
+// ----------------------------------------------------------------------
+// Reads the record at the reader's position and reports it if it holds
+// the query.
+//
+// Returns: false if there was no record left to read
+//
+// ----------------------------------------------------------------------
+
+static bool check_next_record( LogReaderClass & reader )
+{
+    const log_record_header * record_p  = (const log_record_header *)NULL;
+    const char *              data_p    = (const char *)NULL;
+    uint32_t                  this_size = 0;
+
+    if ( false == reader.log_reader_next( &record_p, &data_p, &this_size ) )
+    {
+        return false;
+    }
+
+    read_count++;
+
+    if ( false == record_matches( data_p, this_size ) )
+    {
+        return true;
+    }
+
+    matched_count++;
+
+    if ( false == count_only )
+    {
+        (void)fwrite( output_line, 1, LogReaderClass::log_reader_format( record_p,
+            data_p, this_size, output_line ), stdout );
+    }
+
+    return true;
+}
+
+// ----------------------------------------------------------------------
+// Finds the records of a segment which may hold the query through the
+// segment's term index: those which hold every word.
+//
+// Returns: true if the segment has a whole term index, else the
+// segment must be read from the start
+//
+// ----------------------------------------------------------------------
+
+static bool find_candidates( TermIndexClass & term_index, const char * path_and_name_p,
+    std::vector<uint64_t> & these_candidates )
+{
+    std::string           index_name( path_and_name_p );
+    std::vector<uint64_t> these_offsets;
+    size_t                this_word = 0;
+
+    // The index is named after the uncompressed segment
+    if ( index_name.size( ) > 3 && 0 == index_name.compare( index_name.size( ) - 3, 3, ".gz" ) )
+    {
+        index_name.resize( index_name.size( ) - 3 );
+    }
+
+    index_name += TERM_INDEX_SUFFIX;
+
+    if ( false == term_index.term_index_load( index_name.c_str( ) ) || false == term_index.term_index_is_complete( ) )
+    {
+        return false;
+    }
+
+    these_candidates.clear( );
+
+    for ( this_word = 0; this_word < query_words.size( ); this_word++ )
+    {
+        if ( false == term_index.term_index_lookup( query_words[ this_word ], these_offsets ) )
+        {
+            these_candidates.clear( );
+
+            break;
+        }
+
+        if ( 0 == this_word )
+        {
+            these_candidates.swap( these_offsets );
+        }
+        else
+        {
+            std::vector<uint64_t> both;
+
+            std::set_intersection( these_candidates.begin( ), these_candidates.end( ),
+                these_offsets.begin( ), these_offsets.end( ), std::back_inserter( both ) );
+
+            these_candidates.swap( both );
+        }
+
+        if ( true == these_candidates.empty( ) )
+        {
+            break;
+        }
+    }
+
+    term_index.term_index_close( );
+
+    return true;
+}
+
+// ----------------------------------------------------------------------
+// Searches one segment, through its term index if it has one.
+//
+// Returns: true if the segment could be searched
+//
+// ----------------------------------------------------------------------
+
+static bool search_segment( LogReaderClass & reader, TermIndexClass & term_index, const char * path_and_name_p )
+{
+    std::vector<uint64_t> these_candidates;
+    size_t                this_candidate = 0;
+
+    if ( true == find_candidates( term_index, path_and_name_p, these_candidates ) )
+    {
+        segments_indexed++;
+
+        // Nothing in the segment has every word, so it need not be opened
+        if ( true == these_candidates.empty( ) )
+        {
+            return true;
+        }
+
+        if ( false == reader.log_reader_open( path_and_name_p ) )
+        {
+            return false;
+        }
+
+        for ( this_candidate = 0; this_candidate < these_candidates.size( ); this_candidate++ )
+        {
+            reader.log_reader_seek( these_candidates[ this_candidate ] );
+
+            (void)check_next_record( reader );
+        }
+    }
+    else
+    {
+        segments_scanned++;
+
+        if ( false == reader.log_reader_open( path_and_name_p ) )
+        {
+            return false;
+        }
+
+        while ( true == check_next_record( reader ) )
+        {
+        }
+    }
+
+    reader.log_reader_close( );
+
+    return true;
+}
+
+// ----------------------------------------------------------------------
+// Main entry point
+//
+// ----------------------------------------------------------------------
+
+int main( int argc, char *argv[ ] )
+{
+    LogReaderClass reader;
+    TermIndexClass term_index;
+    double         start_time = 0.0;
+    int            this_arg   = 1;
+    int            exit_code  = 0;
+
+    for ( ; this_arg < argc && '-' == argv[ this_arg ][ 0 ]; this_arg++ )
+    {
+        if ( 0 == strcmp( argv[ this_arg ], "-a" ) )
+        {
+            any_order = true;
+        }
+        else if ( 0 == strcmp( argv[ this_arg ], "-c" ) )
+        {
+            count_only = true;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if ( this_arg + 1 < argc )
+    {
+        TermIndexClass::term_index_tokens( argv[ this_arg ], strlen( argv[ this_arg ] ), query_words );
+    }
+
+    if ( true == query_words.empty( ) )
+    {
+        (void)fprintf( stderr, "Usage: logsearch [-a] [-c] \"words\" segment [segment ...]\n" );
+
+        return 1;
+    }
+
+    start_time = now_ns( );
+
+    for ( this_arg++; this_arg < argc; this_arg++ )
+    {
+        if ( false == search_segment( reader, term_index, argv[ this_arg ] ) )
+        {
+            (void)fprintf( stderr, "logsearch: [%s] is not a chat log segment\n", argv[ this_arg ] );
+
+            exit_code = 1;
+        }
+    }
+
+    if ( true == count_only )
+    {
+        (void)printf( "%llu records matched, %llu read, %d segments searched through the index, "
+            "%d read from the start, in %.3f ms\n",
+            (unsigned long long)matched_count, (unsigned long long)read_count,
+            segments_indexed, segments_scanned, ( now_ns( ) - start_time ) / 1e6 );
+    }
+
+    return exit_code;
+}